@@ -1,6 +1,7 @@
 #include "callproxymodel.h"
 #include "event.h"
 #include "eventmodel.h"
+#include "eventwriter.h"
 #include "debug.h"
 
 using namespace CommHistory;
@@ -16,7 +17,7 @@ CallProxyModel::CallProxyModel(QObject *parent) :
     setQueryMode(CommHistory::EventModel::AsyncQuery);
     setFilter(CommHistory::CallModel::Sorting(m_grouping));
     setLimit(m_limit);
-    setResolveContacts(m_resolveContacts ? EventModel::ResolveImmediately : EventModel::ResolveOnDemand);
+    setResolveContacts(m_resolveContacts ? EventModel::ResolveImmediately : EventModel::ResolveVisible);
 }
 
 void CallProxyModel::classBegin()
@@ -83,9 +84,10 @@ void CallProxyModel::setResolveContacts(bool enabled)
     if (m_resolveContacts != enabled) {
         m_resolveContacts = enabled;
 
-        CallModel::setResolveContacts(m_resolveContacts ? EventModel::ResolveImmediately : EventModel::ResolveOnDemand);
+        CallModel::setResolveContacts(m_resolveContacts ? EventModel::ResolveImmediately : EventModel::ResolveVisible);
         if (m_componentComplete && m_resolveContacts) {
-            // Model must be reloaded to resolve contacts if getEvents was already called
+            // Model must be reloaded to resolve contacts if getEvents was already called;
+            // the existing rows are refreshed in place rather than reset
             getEvents();
         }
 
@@ -122,7 +124,6 @@ void CallProxyModel::onReadyChanged(bool ready)
 int CallProxyModel::createOutgoingCallEvent(const QString &localUid, const QString &remoteUid)
 {
     Event event;
-    EventModel model;
 
     event.setStartTime(QDateTime::currentDateTime());
     event.setEndTime(event.startTime());
@@ -130,7 +131,7 @@ int CallProxyModel::createOutgoingCallEvent(const QString &localUid, const QStri
     event.setDirection(CommHistory::Event::Outbound);
     event.setLocalUid(localUid);
     event.setRecipients(Recipient(localUid, remoteUid));
-    if (model.addEvent(event))
+    if (EventWriter::instance()->addEvent(event))
         return event.id();
     return -1;
 }
@@ -119,7 +119,9 @@ public:
     int limit() const;
     void setLimit(int);
 
-    // Shadow CallModel functions:
+    // Shadow CallModel functions. When disabled, contacts are resolved for the
+    // rows passed to setVisibleRange(), or for the rows that are read if the
+    // view doesn't report them.
     bool resolveContacts() const;
     void setResolveContacts(bool enabled);
 
@@ -108,7 +108,7 @@ void ConversationProxyModel::setResolveContacts(bool enabled)
     if (resolveContacts() == enabled)
         return;
 
-    ConversationModel::setResolveContacts(enabled ? EventModel::ResolveImmediately : EventModel::ResolveOnDemand);
+    ConversationModel::setResolveContacts(enabled ? EventModel::ResolveImmediately : EventModel::ResolveVisible);
     if (enabled)
         QTimer::singleShot(0, this, SLOT(reload()));
     emit resolveContactsChanged();
@@ -58,7 +58,9 @@ public:
     int groupId() const { return m_groupId; }
     void setGroupId(int groupId);
 
-    // Shadow ConversationModel functions:
+    // Shadow ConversationModel functions. When disabled after being enabled,
+    // contacts are resolved for the rows passed to setVisibleRange(), or for
+    // the rows that are read if the view doesn't report them.
     bool resolveContacts() const;
     void setResolveContacts(bool enabled);
 
@@ -31,6 +31,7 @@
 
 #include "draftevent.h"
 #include "singleeventmodel.h"
+#include "eventwriter.h"
 #include "commonutils.h"
 #include "debug.h"
 
@@ -68,7 +69,7 @@ void DraftEvent::save()
     if (!isModified())
         return;
 
-    SingleEventModel model;
+    EventWriter *writer = EventWriter::instance();
     m_event.setIsDraft(true);
     m_event.setIsRead(true);
     m_event.setStartTimeT(Event::currentTime_t());
@@ -77,18 +78,17 @@ void DraftEvent::save()
     m_event.setDirection(Event::Outbound);
 
     if (m_event.id() < 0) {
-        if (!model.addEvent(m_event))
+        if (!writer->addEvent(m_event))
             qCWarning(lcCommHistory) << "DraftEvent add failed:" << m_event.toString();
     } else {
-        if (!model.modifyEvent(m_event))
+        if (!writer->modifyEvent(m_event))
             qCWarning(lcCommHistory) << "DraftEvent modify failed:" << m_event.toString();
     }
 }
 
 void DraftEvent::deleteEvent()
 {
-    SingleEventModel model;
-    if (m_event.id() >= 0 && !model.deleteEvent(m_event))
+    if (m_event.id() >= 0 && !EventWriter::instance()->deleteEvent(m_event))
         qCWarning(lcCommHistory) << "DraftEvent delete failed:" << m_event.toString();
 }
 
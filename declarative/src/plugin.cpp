@@ -40,6 +40,7 @@
 #include "callproxymodel.h"
 #include "conversationproxymodel.h"
 #include "recentcontactsmodel.h"
+#include "searchmodel.h"
 #include "declarativegroupmanager.h"
 #include "draftsmodel.h"
 #include "draftevent.h"
@@ -68,6 +69,7 @@ void CommHistoryPlugin::registerTypes(const char *uri)
     qmlRegisterType<ConversationProxyModel>(uri, 1, 0, "CommConversationModel");
     qmlRegisterType<CommHistory::ContactGroupModel>(uri, 1, 0, "CommContactGroupModel");
     qmlRegisterType<CommHistory::RecentContactsModel>(uri, 1, 0, "CommRecentContactsModel");
+    qmlRegisterType<CommHistory::SearchModel>(uri, 1, 0, "CommSearchModel");
     qmlRegisterType<DeclarativeGroupManager>(uri, 1, 0, "CommGroupManager");
     qmlRegisterType<CommHistory::DraftsModel>(uri, 1, 0, "DraftsModel");
     qmlRegisterType<DraftEvent>(uri, 1, 0, "DraftEvent");
@@ -42,6 +42,8 @@ Q_SIGNALS:
     void eventsAdded(const QList<CommHistory::Event> &events);
     void eventsUpdated(const QList<CommHistory::Event> &events);
     void eventDeleted(int id);
+    void eventsDeleted(const QList<int> &ids);
+    void eventsImported();
     void groupsAdded(const QList<CommHistory::Group> &groups);
     void groupsUpdated(const QList<int> &groupIds);
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
@@ -0,0 +1,605 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "attachmentcollector.h"
+
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+
+#include "commhistorydatabase.h"
+#include "commhistorydatabasepath.h"
+#include "databaseio.h"
+#include "dbus_p.h"
+#include "debug_p.h"
+
+using namespace CommHistory;
+
+namespace CommHistory {
+
+class AttachmentCollectorPrivate : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(AttachmentCollector)
+
+public:
+    enum Phase {
+        Idle,
+        Parts,
+        Directories
+    };
+
+    AttachmentCollector *q_ptr;
+    QSqlDatabase db;
+    QTimer batchTimer;
+    QTimer idleTimer;
+    int batchSize;
+    int minimumAge;
+    bool collectOnIdle;
+    bool listening;
+    Phase phase;
+    int lastPartId;
+    QStringList pendingDirectories;
+    qint64 bytesReclaimed;
+    int partsRemoved;
+    int filesRemoved;
+    int directoriesRemoved;
+
+    explicit AttachmentCollectorPrivate(AttachmentCollector *parent);
+    ~AttachmentCollectorPrivate();
+
+    QSqlDatabase &connection();
+
+    void begin();
+    bool step();
+    void finish(bool successful);
+
+    bool collectParts();
+    bool collectDirectories();
+    bool checkArchive(bool &hasArchive);
+
+    static bool isInDataDir(const QString &path);
+    void removeFile(const QString &path);
+    void removeDirectory(const QString &path);
+
+public slots:
+    void runBatch();
+    void scheduleIdleCollection();
+    void eventDeletedSlot(int id);
+    void eventsDeletedSlot(const QList<int> &ids);
+    void groupsDeletedSlot(const QList<int> &groupIds);
+};
+
+} // namespace CommHistory
+
+AttachmentCollectorPrivate::AttachmentCollectorPrivate(AttachmentCollector *parent)
+    : QObject(parent),
+      q_ptr(parent),
+      batchTimer(this),
+      idleTimer(this),
+      batchSize(50),
+      minimumAge(60 * 60),
+      collectOnIdle(false),
+      listening(false),
+      phase(Idle),
+      lastPartId(0),
+      bytesReclaimed(0),
+      partsRemoved(0),
+      filesRemoved(0),
+      directoriesRemoved(0)
+{
+    batchTimer.setSingleShot(true);
+    batchTimer.setInterval(100);
+    connect(&batchTimer, SIGNAL(timeout()), SLOT(runBatch()));
+
+    idleTimer.setSingleShot(true);
+    idleTimer.setInterval(30 * 1000);
+    connect(&idleTimer, SIGNAL(timeout()), parent, SLOT(start()));
+}
+
+AttachmentCollectorPrivate::~AttachmentCollectorPrivate()
+{
+    if (db.isValid()) {
+        const QString name = db.connectionName();
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+QSqlDatabase &AttachmentCollectorPrivate::connection()
+{
+    // Opened on first use, in the thread the collector runs in
+    if (!db.isValid()) {
+        db = CommHistoryDatabase::open(QStringLiteral("commhistory-collector-%1")
+                                       .arg(quintptr(this), 0, 16));
+    }
+
+    return db;
+}
+
+void AttachmentCollectorPrivate::begin()
+{
+    phase = Parts;
+    lastPartId = 0;
+    pendingDirectories.clear();
+    bytesReclaimed = 0;
+    partsRemoved = 0;
+    filesRemoved = 0;
+    directoriesRemoved = 0;
+}
+
+bool AttachmentCollectorPrivate::step()
+{
+    if (phase == Parts)
+        return collectParts();
+    if (phase == Directories)
+        return collectDirectories();
+    return true;
+}
+
+void AttachmentCollectorPrivate::finish(bool successful)
+{
+    Q_Q(AttachmentCollector);
+
+    phase = Idle;
+    batchTimer.stop();
+    pendingDirectories.clear();
+
+    qCDebug(lcCommHistory) << "Attachment collection" << (successful ? "finished:" : "failed:")
+                           << partsRemoved << "parts," << filesRemoved << "files,"
+                           << directoriesRemoved << "directories," << bytesReclaimed << "bytes reclaimed";
+
+    emit q->finished(successful);
+}
+
+void AttachmentCollectorPrivate::runBatch()
+{
+    if (phase == Idle)
+        return;
+
+    if (!step()) {
+        finish(false);
+        return;
+    }
+
+    if (phase == Idle)
+        finish(true);
+    else
+        batchTimer.start();
+}
+
+bool AttachmentCollectorPrivate::collectParts()
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(
+        "SELECT id, path FROM MessageParts WHERE eventId IS NULL AND id > :lastId ORDER BY id LIMIT :limit",
+        connection());
+    query.bindValue(":lastId", lastPartId);
+    query.bindValue(":limit", batchSize);
+
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    QStringList ids;
+    QStringList paths;
+    while (query.next()) {
+        lastPartId = query.value(0).toInt();
+        ids.append(QString::number(lastPartId));
+        const QString path = query.value(1).toString();
+        if (!path.isEmpty())
+            paths.append(path);
+    }
+    query.finish();
+
+    if (ids.isEmpty()) {
+        QDir dataDir(CommHistoryDatabasePath::dataDir());
+        if (dataDir.exists())
+            pendingDirectories = dataDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        phase = Directories;
+        return true;
+    }
+
+    // Files shared with a part that is still in use are kept
+    QSet<QString> referenced;
+    if (!paths.isEmpty()) {
+        QString placeholders = QStringLiteral("?,").repeated(paths.size());
+        placeholders.chop(1);
+
+        bool hasArchive;
+        if (!checkArchive(hasArchive))
+            return false;
+        QString q = QStringLiteral("SELECT path FROM MessageParts WHERE eventId IS NOT NULL AND path IN (%1)").arg(placeholders);
+        if (hasArchive)
+            q += QStringLiteral(" UNION ALL SELECT path FROM archive.MessageParts WHERE path IN (%1)").arg(placeholders);
+
+        QSqlQuery refQuery = CommHistoryDatabase::prepare(q.toUtf8().constData(), connection());
+        for (int i = 0; i < (hasArchive ? 2 : 1); i++) {
+            foreach (const QString &path, paths)
+                refQuery.addBindValue(path);
+        }
+
+        if (!refQuery.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << refQuery.lastError();
+            qCWarning(lcCommHistory) << refQuery.lastQuery();
+            return false;
+        }
+
+        while (refQuery.next())
+            referenced.insert(refQuery.value(0).toString());
+    }
+
+    // Files go first; a row left behind by an interruption is simply
+    // collected again
+    foreach (const QString &path, paths) {
+        if (!referenced.contains(path) && isInDataDir(path))
+            removeFile(path);
+    }
+
+    QByteArray q = "DELETE FROM MessageParts WHERE id IN (" + ids.join(QLatin1Char(',')).toLatin1() + ")";
+    QSqlQuery deleteQuery = CommHistoryDatabase::prepare(q, connection());
+    if (!deleteQuery.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << deleteQuery.lastError();
+        qCWarning(lcCommHistory) << deleteQuery.lastQuery();
+        return false;
+    }
+
+    partsRemoved += deleteQuery.numRowsAffected();
+    return true;
+}
+
+bool AttachmentCollectorPrivate::collectDirectories()
+{
+    if (pendingDirectories.isEmpty()) {
+        phase = Idle;
+        return true;
+    }
+
+    const QStringList batch = pendingDirectories.mid(0, batchSize);
+    pendingDirectories = pendingDirectories.mid(batch.size());
+
+    // Only directories named after an event id are ours to remove
+    QStringList ids;
+    foreach (const QString &name, batch) {
+        bool isNumber = false;
+        const int id = name.toInt(&isNumber);
+        if (isNumber && QString::number(id) == name)
+            ids.append(name);
+    }
+
+    if (ids.isEmpty())
+        return true;
+
+    // Archived events keep their attachments in place
+    bool hasArchive;
+    if (!checkArchive(hasArchive))
+        return false;
+    const QByteArray idList = ids.join(QLatin1Char(',')).toLatin1();
+    QByteArray q = "SELECT id FROM Events WHERE id IN (" + idList + ")";
+    if (hasArchive)
+        q += " UNION ALL SELECT id FROM archive.Events WHERE id IN (" + idList + ")";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    QSet<QString> existing;
+    while (query.next())
+        existing.insert(query.value(0).toString());
+    query.finish();
+
+    // The directory of a message being received may exist before its event
+    const QDateTime cutoff = QDateTime::currentDateTime().addSecs(-minimumAge);
+
+    foreach (const QString &id, ids) {
+        if (existing.contains(id))
+            continue;
+
+        const QString path = CommHistoryDatabasePath::dataDir(id.toInt());
+        if (QFileInfo(path).lastModified() > cutoff)
+            continue;
+
+        QByteArray partQ = "SELECT 1 FROM MessageParts WHERE eventId IS NOT NULL AND substr(path, 1, :length) = :prefix";
+        if (hasArchive)
+            partQ += " UNION ALL SELECT 1 FROM archive.MessageParts WHERE substr(path, 1, :length) = :prefix";
+        QSqlQuery partQuery = CommHistoryDatabase::prepare(partQ + " LIMIT 1", connection());
+        partQuery.bindValue(":length", path.length());
+        partQuery.bindValue(":prefix", path);
+
+        if (!partQuery.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << partQuery.lastError();
+            qCWarning(lcCommHistory) << partQuery.lastQuery();
+            return false;
+        }
+
+        if (!partQuery.next())
+            removeDirectory(path);
+    }
+
+    return true;
+}
+
+bool AttachmentCollectorPrivate::checkArchive(bool &hasArchive)
+{
+    // Without the archive its attachments would look unreferenced, so an
+    // archive that exists but cannot be attached stops the collection
+    hasArchive = CommHistoryDatabase::hasArchive(connection());
+    if (!hasArchive && QFile::exists(QDir(CommHistoryDatabasePath::databaseDir())
+                                     .absoluteFilePath(CommHistoryDatabasePath::archiveFile()))) {
+        qCWarning(lcCommHistory) << "Archive database is not attached, not collecting attachments";
+        return false;
+    }
+
+    return true;
+}
+
+bool AttachmentCollectorPrivate::isInDataDir(const QString &path)
+{
+    const QString dataDir = QDir(CommHistoryDatabasePath::dataDir()).absolutePath() + QLatin1Char('/');
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath()).startsWith(dataDir);
+}
+
+void AttachmentCollectorPrivate::removeFile(const QString &path)
+{
+    QFileInfo info(path);
+    if (!info.isFile())
+        return;
+
+    const qint64 size = info.size();
+    if (!QFile::remove(path)) {
+        qCWarning(lcCommHistory) << "Failed to remove attachment" << path;
+        return;
+    }
+
+    bytesReclaimed += size;
+    filesRemoved++;
+}
+
+void AttachmentCollectorPrivate::removeDirectory(const QString &path)
+{
+    qint64 size = 0;
+    int files = 0;
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        size += it.fileInfo().size();
+        files++;
+    }
+
+    if (!QDir(path).removeRecursively()) {
+        qCWarning(lcCommHistory) << "Failed to remove attachment directory" << path;
+        return;
+    }
+
+    bytesReclaimed += size;
+    filesRemoved += files;
+    directoriesRemoved++;
+}
+
+void AttachmentCollectorPrivate::scheduleIdleCollection()
+{
+    // Restarting the timer waits for a quiet period after a burst of
+    // deletions
+    if (collectOnIdle)
+        idleTimer.start();
+}
+
+void AttachmentCollectorPrivate::eventDeletedSlot(int id)
+{
+    Q_UNUSED(id);
+    scheduleIdleCollection();
+}
+
+void AttachmentCollectorPrivate::eventsDeletedSlot(const QList<int> &ids)
+{
+    Q_UNUSED(ids);
+    scheduleIdleCollection();
+}
+
+void AttachmentCollectorPrivate::groupsDeletedSlot(const QList<int> &groupIds)
+{
+    Q_UNUSED(groupIds);
+    scheduleIdleCollection();
+}
+
+AttachmentCollector::AttachmentCollector(QObject *parent)
+    : QObject(parent), d_ptr(new AttachmentCollectorPrivate(this))
+{
+}
+
+AttachmentCollector::~AttachmentCollector()
+{
+}
+
+int AttachmentCollector::batchSize() const
+{
+    Q_D(const AttachmentCollector);
+    return d->batchSize;
+}
+
+void AttachmentCollector::setBatchSize(int size)
+{
+    Q_D(AttachmentCollector);
+    d->batchSize = qMax(1, size);
+}
+
+int AttachmentCollector::batchInterval() const
+{
+    Q_D(const AttachmentCollector);
+    return d->batchTimer.interval();
+}
+
+void AttachmentCollector::setBatchInterval(int msec)
+{
+    Q_D(AttachmentCollector);
+    d->batchTimer.setInterval(msec);
+}
+
+int AttachmentCollector::minimumAge() const
+{
+    Q_D(const AttachmentCollector);
+    return d->minimumAge;
+}
+
+void AttachmentCollector::setMinimumAge(int seconds)
+{
+    Q_D(AttachmentCollector);
+    d->minimumAge = seconds;
+}
+
+bool AttachmentCollector::collectOnIdle() const
+{
+    Q_D(const AttachmentCollector);
+    return d->collectOnIdle;
+}
+
+void AttachmentCollector::setCollectOnIdle(bool enabled)
+{
+    Q_D(AttachmentCollector);
+
+    if (d->collectOnIdle == enabled)
+        return;
+
+    d->collectOnIdle = enabled;
+    if (!enabled) {
+        d->idleTimer.stop();
+        return;
+    }
+
+    if (!d->listening) {
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_INTERFACE, EVENT_DELETED_SIGNAL,
+            d, SLOT(eventDeletedSlot(int)));
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_DELETED_SIGNAL,
+            d, SLOT(eventsDeletedSlot(const QList<int> &)));
+        QDBusConnection::sessionBus().connect(
+            QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_DELETED_SIGNAL,
+            d, SLOT(groupsDeletedSlot(const QList<int> &)));
+        // Background deletions leave their attachments behind only when
+        // they finish
+        connect(DatabaseIO::instance(), SIGNAL(deletionFinished(QList<int>,bool)),
+                d, SLOT(scheduleIdleCollection()));
+        d->listening = true;
+    }
+
+    d->scheduleIdleCollection();
+}
+
+int AttachmentCollector::idleDelay() const
+{
+    Q_D(const AttachmentCollector);
+    return d->idleTimer.interval();
+}
+
+void AttachmentCollector::setIdleDelay(int msec)
+{
+    Q_D(AttachmentCollector);
+    d->idleTimer.setInterval(msec);
+}
+
+bool AttachmentCollector::isRunning() const
+{
+    Q_D(const AttachmentCollector);
+    return d->phase != AttachmentCollectorPrivate::Idle;
+}
+
+qint64 AttachmentCollector::bytesReclaimed() const
+{
+    Q_D(const AttachmentCollector);
+    return d->bytesReclaimed;
+}
+
+int AttachmentCollector::partsRemoved() const
+{
+    Q_D(const AttachmentCollector);
+    return d->partsRemoved;
+}
+
+int AttachmentCollector::filesRemoved() const
+{
+    Q_D(const AttachmentCollector);
+    return d->filesRemoved;
+}
+
+int AttachmentCollector::directoriesRemoved() const
+{
+    Q_D(const AttachmentCollector);
+    return d->directoriesRemoved;
+}
+
+void AttachmentCollector::start()
+{
+    Q_D(AttachmentCollector);
+
+    if (isRunning())
+        return;
+
+    d->idleTimer.stop();
+    d->begin();
+    d->batchTimer.start();
+}
+
+void AttachmentCollector::stop()
+{
+    Q_D(AttachmentCollector);
+
+    if (isRunning())
+        d->finish(false);
+}
+
+bool AttachmentCollector::collect()
+{
+    Q_D(AttachmentCollector);
+
+    // A pass already running incrementally is completed here
+    if (!isRunning())
+        d->begin();
+    d->idleTimer.stop();
+    d->batchTimer.stop();
+
+    while (isRunning()) {
+        if (!d->step()) {
+            d->finish(false);
+            return false;
+        }
+    }
+
+    d->finish(true);
+    return true;
+}
+
+#include "attachmentcollector.moc"
@@ -0,0 +1,123 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_ATTACHMENTCOLLECTOR_H
+#define COMMHISTORY_ATTACHMENTCOLLECTOR_H
+
+#include <QObject>
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class AttachmentCollectorPrivate;
+
+/*!
+ * \class AttachmentCollector
+ * \brief Removes message attachments that no event refers to.
+ *
+ * Message parts are detached from their event when the event is deleted
+ * or modified, but the rows and the files under
+ * CommHistoryDatabasePath::dataDir() are left behind. A collection pass
+ * deletes detached part rows and their files, and then the data
+ * directories of events that no longer exist.
+ *
+ * The work is done in batches of batchSize() items with batchInterval()
+ * milliseconds between them, so a pass never holds the database for
+ * long. The collector opens its own database connection and can be
+ * moved to another thread before it is started.
+ */
+class LIBCOMMHISTORY_EXPORT AttachmentCollector : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(AttachmentCollector)
+
+public:
+    explicit AttachmentCollector(QObject *parent = 0);
+    ~AttachmentCollector();
+
+    /*!
+     * Number of part rows or directories handled per batch, 50 by default.
+     */
+    int batchSize() const;
+    void setBatchSize(int size);
+
+    /*!
+     * Pause between batches in milliseconds, 100 by default.
+     */
+    int batchInterval() const;
+    void setBatchInterval(int msec);
+
+    /*!
+     * Data directories modified less than \a seconds ago are kept even if
+     * their event does not exist yet. One hour by default.
+     */
+    int minimumAge() const;
+    void setMinimumAge(int seconds);
+
+    /*!
+     * If enabled, a pass is started once no events or groups have been
+     * deleted for idleDelay() milliseconds. Disabled by default.
+     */
+    bool collectOnIdle() const;
+    void setCollectOnIdle(bool enabled);
+
+    int idleDelay() const;
+    void setIdleDelay(int msec);
+
+    bool isRunning() const;
+
+    /*!
+     * Statistics of the current or last pass.
+     */
+    qint64 bytesReclaimed() const;
+    int partsRemoved() const;
+    int filesRemoved() const;
+    int directoriesRemoved() const;
+
+public Q_SLOTS:
+    /*!
+     * Start an incremental pass unless one is running. finished() is
+     * emitted when it is done.
+     */
+    void start();
+
+    /*!
+     * Stop the running pass after the current batch.
+     */
+    void stop();
+
+    /*!
+     * Run a complete pass without returning to the event loop.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool collect();
+
+Q_SIGNALS:
+    void finished(bool successful);
+
+private:
+    AttachmentCollectorPrivate *d_ptr;
+};
+
+}
+
+#endif
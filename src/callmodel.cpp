@@ -30,6 +30,7 @@
 #include "eventmodel_p.h"
 #include "callmodel.h"
 #include "event.h"
+#include "dbus_p.h"
 #include "debug_p.h"
 
 namespace {
@@ -79,11 +80,14 @@ public:
     void eventsUpdatedSlot(const QList<Event> &events);
     QModelIndex findEvent(int id) const;
     void deleteFromModel(int id);
+    void deleteFromModel(const QList<int> &ids);
+    bool reloadEvents();
 
     virtual void recipientsUpdated(const QSet<Recipient> &recipients, bool resolved = false);
 
 public Q_SLOTS:
     void slotAllCallsDeleted(int unused);
+    void eventsImportedSlot();
 
 public:
     CallModel::Sorting sortBy;
@@ -103,6 +107,11 @@ CallModelPrivate::CallModelPrivate(EventModel *model)
         , hasBeenFetched(false)
 {
     propertyMask -= unusedProperties;
+    setUpdatesScope(QStringList() << eventTypeUpdatesPath(Event::CallEvent));
+
+    QDBusConnection::sessionBus().connect(
+        QString(), COMM_HISTORY_OBJECT_PATH, COMM_HISTORY_INTERFACE, EVENTS_IMPORTED_SIGNAL,
+        this, SLOT(eventsImportedSlot()));
 }
 
 bool CallModelPrivate::eventMatchesFilter(const Event &event) const
@@ -144,6 +153,10 @@ bool CallModelPrivate::acceptsEvent(const Event &event) const
         return false;
     }
 
+    // calls that are being deleted in the background
+    if (event.id() <= DatabaseIOPrivate::instance()->hiddenCallsLastId())
+        return false;
+
     return true;
 }
 
@@ -304,7 +317,13 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
         return EventModelPrivate::fillModel(start, end, events, resolved);
     }
 
-    if (events.count() > 0) {
+    // when refreshing, the groups are built from scratch and then replace
+    // the existing top level items
+    const bool refresh = refreshing;
+
+    if (refresh && events.isEmpty()) {
+        refreshItems(QList<EventTreeItem *>());
+    } else if (events.count() > 0) {
         /*
          * call events are grouped as follows:
          *
@@ -380,12 +399,18 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                     }
                 }
 
+                foreach (EventTreeItem *item, topLevelItems)
+                    item->event().setEventCount(calculateEventCount(item));
+
+                if (refresh) {
+                    refreshItems(topLevelItems);
+                    break;
+                }
+
                 // save top level items into the model
                 q->beginInsertRows(QModelIndex(), 0, topLevelItems.count() - 1);
-                foreach (EventTreeItem *item, topLevelItems) {
-                    item->event().setEventCount(calculateEventCount(item));
+                foreach (EventTreeItem *item, topLevelItems)
                     eventRootItem->appendChild(item);
-                }
                 q->endInsertRows();
 
                 break;
@@ -407,7 +432,9 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                 EventTreeItem *previousLastItem = 0;
 
                 EventTreeItem *last = 0;
-                if (eventRootItem->childCount()) {
+                if (refresh) {
+                    previousLastRow = -1;
+                } else if (eventRootItem->childCount()) {
                     last = eventRootItem->child(previousLastRow);
                     previousLastItem = last;
                 }
@@ -455,6 +482,11 @@ bool CallModelPrivate::fillModel(int start, int end, QList<CommHistory::Event> e
                     delete last;
                 }
 
+                if (refresh) {
+                    refreshItems(newItems);
+                    break;
+                }
+
                 // update count for last item in the previous batch
                 if (!newItems.isEmpty()) {
                     if (previousLastRow != -1)
@@ -683,6 +715,30 @@ QModelIndex CallModelPrivate::findEvent(int id) const
     return QModelIndex();
 }
 
+bool CallModelPrivate::reloadEvents()
+{
+    Q_Q(CallModel);
+    return q->getEvents();
+}
+
+void CallModelPrivate::eventsImportedSlot()
+{
+    // Imported calls are not announced one by one
+    if (hasBeenFetched)
+        reloadEvents();
+}
+
+void CallModelPrivate::deleteFromModel(const QList<int> &ids)
+{
+    if (!isInTreeMode) {
+        return EventModelPrivate::deleteFromModel(ids);
+    }
+
+    // grouped items may need regrouping, handle them one at a time
+    foreach (int id, ids)
+        deleteFromModel(id);
+}
+
 void CallModelPrivate::deleteFromModel(int id)
 {
     Q_Q(CallModel);
@@ -1009,9 +1065,14 @@ bool CallModel::getEvents()
 
     d->hasBeenFetched = true;
 
-    beginResetModel();
-    d->clearEvents();
-    endResetModel();
+    if (d->eventRootItem->childCount() > 0) {
+        // Refilter in place, only the rows that differ are signalled
+        d->beginRefresh();
+    } else {
+        beginResetModel();
+        d->clearEvents();
+        endResetModel();
+    }
     d->countedUids.clear();
     d->updatedGroups.clear();
 
@@ -1034,6 +1095,12 @@ bool CallModel::getEvents()
         q += QString::fromLatin1("AND startTime >= %1 ").arg(d->referenceTime);
     }
 
+    // Calls being deleted in the background stay hidden until they are gone
+    const int hiddenCallsLastId = DatabaseIOPrivate::instance()->hiddenCallsLastId();
+    if (hiddenCallsLastId > 0) {
+        q += QString::fromLatin1("AND id > %1 ").arg(hiddenCallsLastId);
+    }
+
     q += "ORDER BY endTime DESC, id DESC";
 
     QSqlQuery query = d->prepareQuery(q);
@@ -1059,8 +1126,10 @@ bool CallModel::deleteAll()
 {
     Q_D(CallModel);
 
+    // With a background thread the calls are deleted in chunks there and
+    // DatabaseIO::deletionFinished() is emitted once they are gone
     bool deleted;
-    deleted = d->database()->deleteAllEvents(Event::CallEvent);
+    deleted = d->database()->deleteAllEvents(Event::CallEvent, d->bgThread);
     if (!deleted) {
         qCWarning(lcCommHistory) << Q_FUNC_INFO << "Failed to delete events";
         return false;
@@ -1150,19 +1219,23 @@ bool CallModel::deleteEvent(int id)
         {
             EventTreeItem *item = d->eventRootItem->child(index.row());
 
-            if (!d->database()->transaction())
-                return false;
-
             QList<Event> deletedEvents;
+            QList<int> deletedIds;
 
-            // get all events stored in the item and delete them one by one
+            // get all events stored in the item and delete them at once
             for (int i = 0; i < item->childCount(); i++) {
                 // NOTE: when events are sorted by time, the tree hierarchy is only 2 levels deep
-                if (!d->database()->deleteEvent(item->child(i)->event())) {
-                    d->database()->rollback();
-                    return false;
-                }
                 deletedEvents << item->child(i)->event();
+                deletedIds << item->child(i)->event().id();
+            }
+
+            if (!d->database()->transaction())
+                return false;
+
+            QList<int> updatedGroups, deletedGroups;
+            if (!d->database()->deleteEvents(deletedIds, &updatedGroups, &deletedGroups)) {
+                d->database()->rollback();
+                return false;
             }
 
             if (!d->database()->commit())
@@ -1171,8 +1244,11 @@ bool CallModel::deleteEvent(int id)
             // delete event from model (not only from db)
             d->deleteFromModel(id);
             // signal delete in case someone else needs to know it
-            foreach (const Event &e, deletedEvents)
-                emit d->eventDeleted(e.id());
+            emit d->eventsDeleted(deletedIds);
+            if (!deletedGroups.isEmpty())
+                emit d->groupsDeleted(deletedGroups);
+            if (!updatedGroups.isEmpty())
+                emit d->groupsUpdated(updatedGroups);
             emit d->eventsCommitted(deletedEvents, true);
 
             return true;
@@ -167,6 +167,11 @@ public:
     /*!
      * \brief Deletes all call events from the database and clears model.
      *
+     * With a backgroundThread(), the calls are deleted there in chunks and
+     * DatabaseIO::deletionFinished() is emitted once they are gone. Until
+     * then, call models of this process leave them out when fetching. Calls
+     * added in the meantime are kept.
+     *
      * \return true if successful; false, otherwise.
      */
     bool deleteAll();
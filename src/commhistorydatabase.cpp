@@ -22,9 +22,20 @@
 
 #include "commhistorydatabase.h"
 #include "commhistorydatabasepath.h"
+#include "databasemigrator.h"
+#include "queryprofiler.h"
+#include "queryprofiler_p.h"
 #include "debug_p.h"
+#include <QAtomicInt>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutex>
+#include <QScopedPointer>
+#include <QSet>
+#include <QSettings>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QStandardPaths>
@@ -34,6 +45,10 @@
 #define COMMHISTORY_DATABASE_DIR "/commhistory/"
 #define COMMHISTORY_DATABASE_NAME "commhistory.db"
 #define COMMHISTORY_DATA_DIR COMMHISTORY_DATABASE_DIR "data/"
+#define COMMHISTORY_ARCHIVE_NAME "commhistory-archive.db"
+#define COMMHISTORY_TUNING_NAME "commhistory-tuning.conf"
+#define COMMHISTORY_LOCK_NAME "commhistory.db.lock"
+#define COMMHISTORY_USERS_DIR "commhistory.db.users/"
 
 static QString db_root_dir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
 
@@ -44,16 +59,42 @@ static const char *db_setup[] = {
 };
 static int db_setup_count = sizeof(db_setup) / sizeof(*db_setup);
 
-static const char *db_schema[] = {
-    "PRAGMA encoding = \"UTF-16\"",
+// Event::category() of an Events.type value
+#define RECENT_RECIPIENTS_CATEGORY(type) \
+    "CASE " type " WHEN 1 THEN 16 WHEN 2 THEN 4 WHEN 3 THEN 1 WHEN 4 THEN 2 WHEN 6 THEN 8 ELSE 32 END"
+
+// Records NEW as the latest event of its address and category unless a
+// later one is already there
+#define RECENT_RECIPIENTS_UPSERT \
+    "    INSERT OR REPLACE INTO RecentRecipients (localUid, remoteUid, category, lastEventId, lastEndTime) " \
+    "      SELECT NEW.localUid, NEW.remoteUid, " RECENT_RECIPIENTS_CATEGORY("NEW.type") ", NEW.id, IFNULL(NEW.endTime, 0) " \
+    "      WHERE NEW.remoteUid != '' AND NEW.localUid IS NOT NULL AND NOT EXISTS ( " \
+    "        SELECT 1 FROM RecentRecipients WHERE localUid=NEW.localUid AND remoteUid=NEW.remoteUid " \
+    "          AND category=" RECENT_RECIPIENTS_CATEGORY("NEW.type") " " \
+    "          AND (lastEndTime > IFNULL(NEW.endTime, 0) " \
+    "            OR (lastEndTime = IFNULL(NEW.endTime, 0) AND lastEventId > NEW.id))); "
+
+// Finds the latest remaining event of OLD's address and category once its
+// row has been removed
+#define RECENT_RECIPIENTS_RECOMPUTE \
+    "    INSERT INTO RecentRecipients (localUid, remoteUid, category, lastEventId, lastEndTime) " \
+    "      SELECT localUid, remoteUid, " RECENT_RECIPIENTS_CATEGORY("type") ", id, IFNULL(endTime, 0) FROM Events " \
+    "      WHERE OLD.remoteUid != '' AND remoteUid=OLD.remoteUid AND localUid=OLD.localUid " \
+    "        AND " RECENT_RECIPIENTS_CATEGORY("type") "=" RECENT_RECIPIENTS_CATEGORY("OLD.type") " " \
+    "        AND NOT EXISTS (SELECT 1 FROM RecentRecipients WHERE localUid=OLD.localUid " \
+    "          AND remoteUid=OLD.remoteUid AND category=" RECENT_RECIPIENTS_CATEGORY("OLD.type") ") " \
+    "      ORDER BY endTime DESC, id DESC LIMIT 1; "
 
+// The encoding is set from the tuning profile before these are executed
+static const char *db_schema[] = {
     "CREATE TABLE Groups ( "
     "  id INTEGER PRIMARY KEY AUTOINCREMENT, "
     "  localUid TEXT, "
     "  remoteUids TEXT, "
     "  type INTEGER, "
     "  chatName TEXT, "
-    "  lastModified INTEGER UNSIGNED "
+    "  lastModified INTEGER UNSIGNED, "
+    "  isDeleted BOOL DEFAULT 0 "
     ")",
 
     "CREATE TABLE Events ( "
@@ -137,7 +178,87 @@ static const char *db_schema[] = {
     "    UPDATE Events SET hasMessageParts=0 WHERE id=OLD.eventId; "
     "  END",
 
-    "PRAGMA user_version=4"
+    "CREATE TABLE ChangeLog ( "
+    "  seq INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "  itemType INTEGER NOT NULL, "
+    "  itemId INTEGER NOT NULL, "
+    "  groupId INTEGER, "
+    "  op INTEGER NOT NULL, "
+    "  UNIQUE (itemType, itemId) ON CONFLICT REPLACE "
+    ")",
+
+    "CREATE TRIGGER events_changelog_insert AFTER INSERT ON Events "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, NEW.id, NEW.groupId, 0); "
+    "  END",
+    // The flag triggers of EventProperties and MessageParts update these
+    // columns of a row that has already been journaled
+    "CREATE TRIGGER events_changelog_update AFTER UPDATE ON Events "
+    "  WHEN OLD.hasExtraProperties IS NEW.hasExtraProperties AND OLD.hasMessageParts IS NEW.hasMessageParts "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, NEW.id, NEW.groupId, 1); "
+    "  END",
+    "CREATE TRIGGER events_changelog_move AFTER UPDATE OF groupId ON Events "
+    "  WHEN OLD.groupId IS NOT NULL AND OLD.groupId IS NOT NEW.groupId "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, OLD.groupId, OLD.groupId, 1); "
+    "  END",
+    "CREATE TRIGGER events_changelog_delete AFTER DELETE ON Events "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, OLD.id, OLD.groupId, 2); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_insert AFTER INSERT ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, NEW.id, NEW.id, 0); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_update AFTER UPDATE ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, NEW.id, NEW.id, 1); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_delete AFTER DELETE ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, OLD.id, OLD.id, 2); "
+    "  END",
+
+    "CREATE TABLE ArchivedGroups ( "
+    "  groupId INTEGER PRIMARY KEY, "
+    "  archivedEvents INTEGER, "
+    "  FOREIGN KEY (groupId) REFERENCES Groups(id) ON DELETE CASCADE "
+    ")",
+
+    // Latest event per address and event category, for RecentContactsModel
+    "CREATE TABLE RecentRecipients ( "
+    "  localUid TEXT NOT NULL, "
+    "  remoteUid TEXT NOT NULL, "
+    "  category INTEGER NOT NULL, "
+    "  lastEventId INTEGER NOT NULL, "
+    "  lastEndTime INTEGER NOT NULL, "
+    "  PRIMARY KEY (localUid, remoteUid, category) "
+    ")",
+    "CREATE INDEX recentrecipients_sorting ON RecentRecipients (lastEndTime DESC, lastEventId DESC, category)",
+    "CREATE INDEX recentrecipients_lastEventId ON RecentRecipients (lastEventId)",
+
+    "CREATE TRIGGER recentrecipients_insert AFTER INSERT ON Events "
+    "  WHEN NEW.remoteUid != '' AND NEW.localUid IS NOT NULL "
+    "  BEGIN "
+    RECENT_RECIPIENTS_UPSERT
+    "  END",
+    "CREATE TRIGGER recentrecipients_update AFTER UPDATE OF type, endTime, localUid, remoteUid ON Events "
+    "  WHEN OLD.type IS NOT NEW.type OR OLD.endTime IS NOT NEW.endTime "
+    "    OR OLD.localUid IS NOT NEW.localUid OR OLD.remoteUid IS NOT NEW.remoteUid "
+    "  BEGIN "
+    "    DELETE FROM RecentRecipients WHERE lastEventId=OLD.id; "
+    RECENT_RECIPIENTS_RECOMPUTE
+    RECENT_RECIPIENTS_UPSERT
+    "  END",
+    "CREATE TRIGGER recentrecipients_delete AFTER DELETE ON Events "
+    "  WHEN OLD.id IN (SELECT lastEventId FROM RecentRecipients) "
+    "  BEGIN "
+    "    DELETE FROM RecentRecipients WHERE lastEventId=OLD.id; "
+    RECENT_RECIPIENTS_RECOMPUTE
+    "  END",
+
+    "PRAGMA user_version=9"
 };
 static int db_schema_count = sizeof(db_schema) / sizeof(*db_schema);
 
@@ -203,15 +324,260 @@ static const char *db_upgrade_3[] = {
     0
 };
 
+static const char *db_upgrade_4[] = {
+    "CREATE TABLE ChangeLog ( "
+    "  seq INTEGER PRIMARY KEY AUTOINCREMENT, "
+    "  itemType INTEGER NOT NULL, "
+    "  itemId INTEGER NOT NULL, "
+    "  groupId INTEGER, "
+    "  op INTEGER NOT NULL, "
+    "  UNIQUE (itemType, itemId) ON CONFLICT REPLACE "
+    ")",
+
+    "CREATE TRIGGER events_changelog_insert AFTER INSERT ON Events "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, NEW.id, NEW.groupId, 0); "
+    "  END",
+    // The flag triggers of EventProperties and MessageParts update these
+    // columns of a row that has already been journaled
+    "CREATE TRIGGER events_changelog_update AFTER UPDATE ON Events "
+    "  WHEN OLD.hasExtraProperties IS NEW.hasExtraProperties AND OLD.hasMessageParts IS NEW.hasMessageParts "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, NEW.id, NEW.groupId, 1); "
+    "  END",
+    "CREATE TRIGGER events_changelog_move AFTER UPDATE OF groupId ON Events "
+    "  WHEN OLD.groupId IS NOT NULL AND OLD.groupId IS NOT NEW.groupId "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, OLD.groupId, OLD.groupId, 1); "
+    "  END",
+    "CREATE TRIGGER events_changelog_delete AFTER DELETE ON Events "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (0, OLD.id, OLD.groupId, 2); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_insert AFTER INSERT ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, NEW.id, NEW.id, 0); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_update AFTER UPDATE ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, NEW.id, NEW.id, 1); "
+    "  END",
+    "CREATE TRIGGER groups_changelog_delete AFTER DELETE ON Groups "
+    "  BEGIN "
+    "    INSERT INTO ChangeLog (itemType, itemId, groupId, op) VALUES (1, OLD.id, OLD.id, 2); "
+    "  END",
+    "PRAGMA user_version=5",
+    0
+};
+
+static const char *db_upgrade_5[] = {
+    // The search index is set up by setupSearchIndex()
+    "PRAGMA user_version=6",
+    0
+};
+
+static const char *db_upgrade_6[] = {
+    // Groups waiting for background deletion
+    "ALTER TABLE Groups ADD COLUMN isDeleted BOOL DEFAULT 0",
+    "PRAGMA user_version=7",
+    0
+};
+
+static const char *db_upgrade_7[] = {
+    // Groups with events in the archive database
+    "CREATE TABLE ArchivedGroups ( "
+    "  groupId INTEGER PRIMARY KEY, "
+    "  archivedEvents INTEGER, "
+    "  FOREIGN KEY (groupId) REFERENCES Groups(id) ON DELETE CASCADE "
+    ")",
+    "PRAGMA user_version=8",
+    0
+};
+
+static const char *db_upgrade_8[] = {
+    "CREATE TABLE RecentRecipients ( "
+    "  localUid TEXT NOT NULL, "
+    "  remoteUid TEXT NOT NULL, "
+    "  category INTEGER NOT NULL, "
+    "  lastEventId INTEGER NOT NULL, "
+    "  lastEndTime INTEGER NOT NULL, "
+    "  PRIMARY KEY (localUid, remoteUid, category) "
+    ")",
+    "CREATE INDEX recentrecipients_sorting ON RecentRecipients (lastEndTime DESC, lastEventId DESC, category)",
+    "CREATE INDEX recentrecipients_lastEventId ON RecentRecipients (lastEventId)",
+
+    "CREATE TRIGGER recentrecipients_insert AFTER INSERT ON Events "
+    "  WHEN NEW.remoteUid != '' AND NEW.localUid IS NOT NULL "
+    "  BEGIN "
+    RECENT_RECIPIENTS_UPSERT
+    "  END",
+    "CREATE TRIGGER recentrecipients_update AFTER UPDATE OF type, endTime, localUid, remoteUid ON Events "
+    "  WHEN OLD.type IS NOT NEW.type OR OLD.endTime IS NOT NEW.endTime "
+    "    OR OLD.localUid IS NOT NEW.localUid OR OLD.remoteUid IS NOT NEW.remoteUid "
+    "  BEGIN "
+    "    DELETE FROM RecentRecipients WHERE lastEventId=OLD.id; "
+    RECENT_RECIPIENTS_RECOMPUTE
+    RECENT_RECIPIENTS_UPSERT
+    "  END",
+    "CREATE TRIGGER recentrecipients_delete AFTER DELETE ON Events "
+    "  WHEN OLD.id IN (SELECT lastEventId FROM RecentRecipients) "
+    "  BEGIN "
+    "    DELETE FROM RecentRecipients WHERE lastEventId=OLD.id; "
+    RECENT_RECIPIENTS_RECOMPUTE
+    "  END",
+    "INSERT OR REPLACE INTO RecentRecipients (localUid, remoteUid, category, lastEventId, lastEndTime) "
+    "  SELECT localUid, remoteUid, " RECENT_RECIPIENTS_CATEGORY("type") ", id, IFNULL(endTime, 0) FROM Events "
+    "  WHERE remoteUid != '' AND localUid IS NOT NULL "
+    "  ORDER BY IFNULL(endTime, 0), id",
+    "PRAGMA user_version=9",
+    0
+};
+
 // REMEMBER TO UPDATE THE SCHEMA AND USER_VERSION!
 static const char **db_upgrade[] = {
     db_upgrade_0,
     db_upgrade_1,
     db_upgrade_2,
-    db_upgrade_3
+    db_upgrade_3,
+    db_upgrade_4,
+    db_upgrade_5,
+    db_upgrade_6,
+    db_upgrade_7,
+    db_upgrade_8
 };
 static int db_upgrade_count = sizeof(db_upgrade) / sizeof(*db_upgrade);
 
+// Attached as "archive" once the file exists. The tables match the main
+// schema without the Groups reference, which cannot cross databases;
+// message parts go with their event.
+static const char *db_archive_schema[] = {
+    "CREATE TABLE IF NOT EXISTS archive.Events ( "
+    "  id INTEGER PRIMARY KEY, "
+    "  type INTEGER, "
+    "  startTime INTEGER, "
+    "  endTime INTEGER, "
+    "  direction INTEGER, "
+    "  isDraft INTEGER, "
+    "  isRead INTEGER, "
+    "  isMissedCall INTEGER, "
+    "  isEmergencyCall INTEGER, "
+    "  status INTEGER, "
+    "  bytesReceived INTEGER, "
+    "  localUid TEXT, "
+    "  remoteUid TEXT, "
+    "  parentId INTEGER, "
+    "  subject TEXT, "
+    "  freeText TEXT, "
+    "  groupId INTEGER, "
+    "  messageToken TEXT, "
+    "  lastModified INTEGER, "
+    "  vCardFileName TEXT, "
+    "  vCardLabel TEXT, "
+    "  isDeleted INTEGER, "
+    "  reportDelivery INTEGER, "
+    "  validityPeriod INTEGER, "
+    "  contentLocation TEXT, "
+    "  messageParts TEXT, "
+    "  headers TEXT, "
+    "  readStatus INTEGER, "
+    "  reportRead INTEGER, "
+    "  reportedReadRequested INTEGER, "
+    "  mmsId INTEGER, "
+    "  isAction INTEGER, "
+    "  hasExtraProperties BOOL DEFAULT 0, "
+    "  hasMessageParts BOOL DEFAULT 0 "
+    ")",
+    "CREATE INDEX IF NOT EXISTS archive.events_type ON Events (type)",
+    "CREATE INDEX IF NOT EXISTS archive.events_sorting ON Events (groupId, endTime DESC, id DESC)",
+
+    "CREATE TABLE IF NOT EXISTS archive.EventProperties ( "
+    "  eventId INTEGER, "
+    "  key TEXT, "
+    "  value BLOB, "
+    "  FOREIGN KEY (eventId) REFERENCES Events(id) ON DELETE CASCADE, "
+    "  PRIMARY KEY (eventId, key) ON CONFLICT REPLACE "
+    ")",
+
+    "CREATE TABLE IF NOT EXISTS archive.MessageParts ( "
+    "  id INTEGER PRIMARY KEY, "
+    "  eventId INTEGER, "
+    "  contentId TEXT, "
+    "  contentType TEXT, "
+    "  path TEXT, "
+    "  FOREIGN KEY (eventId) REFERENCES Events(id) ON DELETE CASCADE "
+    ")",
+    "CREATE INDEX IF NOT EXISTS archive.messageparts_eventId ON MessageParts (eventId)"
+};
+static int db_archive_schema_count = sizeof(db_archive_schema) / sizeof(*db_archive_schema);
+
+// Full text search index, only set up if SQLite has FTS5. The triggers
+// are dropped without it, so that a database indexed by a library with
+// FTS5 can still be written to; the index is rebuilt once FTS5 is back.
+// Disabling fullTextSearch in the tuning leaves them in place.
+static const char *db_search_table =
+    "CREATE VIRTUAL TABLE IF NOT EXISTS EventsSearch USING fts5 ( "
+    "  freeText, "
+    "  subject, "
+    "  content='Events', "
+    "  content_rowid='id', "
+    "  prefix='2 3' "
+    ")";
+
+static const char *db_search_triggers[] = {
+    "CREATE TRIGGER events_search_insert AFTER INSERT ON Events "
+    "  BEGIN "
+    "    INSERT INTO EventsSearch (rowid, freeText, subject) VALUES (NEW.id, NEW.freeText, NEW.subject); "
+    "  END",
+    "CREATE TRIGGER events_search_update AFTER UPDATE OF freeText, subject ON Events "
+    "  BEGIN "
+    "    INSERT INTO EventsSearch (EventsSearch, rowid, freeText, subject) VALUES ('delete', OLD.id, OLD.freeText, OLD.subject); "
+    "    INSERT INTO EventsSearch (rowid, freeText, subject) VALUES (NEW.id, NEW.freeText, NEW.subject); "
+    "  END",
+    "CREATE TRIGGER events_search_delete AFTER DELETE ON Events "
+    "  BEGIN "
+    "    INSERT INTO EventsSearch (EventsSearch, rowid, freeText, subject) VALUES ('delete', OLD.id, OLD.freeText, OLD.subject); "
+    "  END",
+    // Index the existing events
+    "INSERT INTO EventsSearch (EventsSearch) VALUES ('rebuild')"
+};
+static int db_search_triggers_count = sizeof(db_search_triggers) / sizeof(*db_search_triggers);
+
+static const char *db_search_drop[] = {
+    "DROP TRIGGER IF EXISTS events_search_insert",
+    "DROP TRIGGER IF EXISTS events_search_update",
+    "DROP TRIGGER IF EXISTS events_search_delete"
+};
+static int db_search_drop_count = sizeof(db_search_drop) / sizeof(*db_search_drop);
+
+// Connections that have the archive attached
+static QMutex db_archive_mutex;
+static QSet<QString> db_archive_connections;
+
+// Held from the first open() until the process exits, see isInUse()
+Q_GLOBAL_STATIC(QScopedPointer<QLockFile>, db_user_lock)
+
+static QString usersDir()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(QStringLiteral(COMMHISTORY_USERS_DIR));
+}
+
+// Called with the open lock held
+static void registerUser()
+{
+    QScopedPointer<QLockFile> &lock = *db_user_lock();
+    if (lock)
+        return;
+
+    QDir dir(usersDir());
+    dir.mkpath(QLatin1String("."));
+    lock.reset(new QLockFile(dir.absoluteFilePath(QString::number(QCoreApplication::applicationPid())
+                                                  + QLatin1String(".lock"))));
+    // Stale once the process is gone, however long it runs
+    lock->setStaleLockTime(0);
+    if (!lock->tryLock(0))
+        qCWarning(lcCommHistory) << "Failed to register database user:" << lock->error();
+}
+
 static bool execute(QSqlDatabase &database, const QString &statement)
 {
     QSqlQuery query(database);
@@ -227,7 +593,8 @@ static bool execute(QSqlDatabase &database, const QString &statement)
 
 static bool prepareDatabase(QSqlDatabase &database)
 {
-    if (!database.transaction())
+    const QString encoding = QStringLiteral("PRAGMA encoding = \"%1\"").arg(CommHistoryDatabase::tuning().encoding);
+    if (!execute(database, encoding) || !database.transaction())
         return false;
 
     bool error = false;
@@ -243,7 +610,7 @@ static bool prepareDatabase(QSqlDatabase &database)
         }
     }
 
-    if (error) {
+    if (error || !setupSearchIndex(database)) {
         database.rollback();
         return false;
     } else {
@@ -286,12 +653,190 @@ static bool upgradeDatabase(QSqlDatabase &database)
     return true;
 }
 
+// Whether SQLite was built with FTS5, which does not change while running
+static bool hasFts5(const QSqlDatabase &database)
+{
+    static QAtomicInt available(-1);
+    if (available.loadAcquire() < 0) {
+        QSqlQuery query(database);
+        const bool fts5 = query.exec(QStringLiteral("SELECT sqlite_compileoption_used('ENABLE_FTS5')"))
+                && query.next() && query.value(0).toBool();
+        if (!fts5)
+            qCWarning(lcCommHistory) << "SQLite has no FTS5, searching without an index";
+        available.storeRelease(fts5 ? 1 : 0);
+    }
+
+    return available.loadAcquire() == 1;
+}
+
+// Number of the triggers keeping EventsSearch up to date that exist
+static bool searchTriggerCount(const QSqlDatabase &database, int &count)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QStringLiteral("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name IN "
+                                   "('events_search_insert', 'events_search_update', 'events_search_delete')"))
+            || !query.next()) {
+        qCWarning(lcCommHistory) << "Search index query failed:" << query.lastError();
+        return false;
+    }
+
+    count = query.value(0).toInt();
+    return true;
+}
+
+static bool setupSearchIndex(QSqlDatabase &database)
+{
+    int triggers;
+    if (!searchTriggerCount(database, triggers))
+        return false;
+
+    // The triggers are shared by all processes, so they are only dropped
+    // when SQLite cannot run them. The fullTextSearch tuning of this
+    // process only decides whether the index is used and built.
+    if (!hasFts5(database)) {
+        if (triggers > 0) {
+            qCWarning(lcCommHistory) << "Full text search is not available, dropping the search index triggers";
+            for (int i = 0; i < db_search_drop_count; i++) {
+                if (!execute(database, QLatin1String(db_search_drop[i])))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    if (triggers == db_search_drop_count || !CommHistoryDatabase::tuning().fullTextSearch)
+        return true;
+
+    // Triggers left over from an interrupted setup are created again
+    qCDebug(lcCommHistory) << "Building the search index";
+    for (int i = 0; i < db_search_drop_count; i++) {
+        if (!execute(database, QLatin1String(db_search_drop[i])))
+            return false;
+    }
+    if (!execute(database, QLatin1String(db_search_table)))
+        return false;
+    for (int i = 0; i < db_search_triggers_count; i++) {
+        if (!execute(database, QLatin1String(db_search_triggers[i])))
+            return false;
+    }
+
+    return true;
+}
+
+static QString archivePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::archiveFile());
+}
+
+// Attaches the archive database if it exists, or creates it with \a create.
+// Attaching fails within a transaction, which is only warned about with
+// \a create.
+static bool attachArchive(QSqlDatabase &database, bool create)
+{
+    const QString archiveFile = archivePath();
+    if (!create && !QFile::exists(archiveFile))
+        return false;
+
+    QSqlQuery query(database);
+    query.prepare(QStringLiteral("ATTACH DATABASE :file AS archive"));
+    query.bindValue(":file", archiveFile);
+    if (!query.exec()) {
+        if (create) {
+            qCWarning(lcCommHistory) << "Failed to attach archive database";
+            qCWarning(lcCommHistory) << query.lastError();
+        }
+        return false;
+    }
+
+    // Only a new archive is written to
+    for (int i = 0; i < db_archive_schema_count; i++) {
+        if (!execute(database, QLatin1String(db_archive_schema[i]))) {
+            execute(database, QStringLiteral("DETACH DATABASE archive"));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static QVariant tuningValue(const QSettings &settings, const char *key, const QVariant &defaultValue)
+{
+    const QByteArray env = qgetenv("COMMHISTORY_DB_" + QByteArray(key).toUpper());
+    if (!env.isEmpty())
+        return QString::fromLatin1(env);
+    return settings.value(QLatin1String(key), defaultValue);
+}
+
+static CommHistoryDatabase::Tuning loadTuning()
+{
+    QString fileName = QString::fromLocal8Bit(qgetenv("COMMHISTORY_DB_TUNING"));
+    if (fileName.isEmpty())
+        fileName = CommHistoryDatabasePath::databaseDir() + QLatin1String(COMMHISTORY_TUNING_NAME);
+    QSettings settings(fileName, QSettings::IniFormat);
+
+    // Checkpoints normally happen when idle, so the automatic checkpoint
+    // is only a limit for busy periods
+    CommHistoryDatabase::Tuning tuning;
+    tuning.cacheSize = tuningValue(settings, "cacheSize", 4096).toInt();
+    tuning.mmapSize = tuningValue(settings, "mmapSize", 16 * 1024 * 1024).toLongLong();
+    tuning.synchronous = tuningValue(settings, "synchronous", QStringLiteral("FULL")).toString().toUpper();
+    tuning.walAutocheckpoint = tuningValue(settings, "walAutocheckpoint", 4000).toInt();
+    tuning.busyTimeout = tuningValue(settings, "busyTimeout", 5000).toInt();
+    tuning.checkpointOnIdle = tuningValue(settings, "checkpointOnIdle", true).toBool();
+    tuning.checkpointIdleDelay = tuningValue(settings, "checkpointIdleDelay", 2000).toInt();
+    tuning.truncateWalSize = tuningValue(settings, "truncateWalSize", 1024 * 1024).toLongLong();
+    tuning.changeLogSize = tuningValue(settings, "changeLogSize", 10000).toLongLong();
+    tuning.fullTextSearch = tuningValue(settings, "fullTextSearch", true).toBool();
+    tuning.encoding = tuningValue(settings, "encoding", QStringLiteral("UTF-8")).toString().toUpper();
+
+    if (tuning.synchronous != QLatin1String("OFF") && tuning.synchronous != QLatin1String("NORMAL")
+            && tuning.synchronous != QLatin1String("FULL")) {
+        qCWarning(lcCommHistory) << "Invalid synchronous setting" << tuning.synchronous << "- using FULL";
+        tuning.synchronous = QStringLiteral("FULL");
+    }
+    if (tuning.encoding != QLatin1String("UTF-8") && tuning.encoding != QLatin1String("UTF-16")) {
+        qCWarning(lcCommHistory) << "Invalid encoding setting" << tuning.encoding << "- using UTF-8";
+        tuning.encoding = QStringLiteral("UTF-8");
+    }
+
+    qCDebug(lcCommHistory) << "Database tuning: cache" << tuning.cacheSize << "KiB, mmap" << tuning.mmapSize
+                           << "bytes, synchronous" << tuning.synchronous << ", autocheckpoint"
+                           << tuning.walAutocheckpoint << "pages, busy timeout" << tuning.busyTimeout << "ms";
+    return tuning;
+}
+
+const CommHistoryDatabase::Tuning &CommHistoryDatabase::tuning()
+{
+    static const Tuning tuning = loadTuning();
+    return tuning;
+}
+
+static void applyTuning(QSqlDatabase &database)
+{
+    const CommHistoryDatabase::Tuning &tuning = CommHistoryDatabase::tuning();
+
+    // Failures only cost performance, so the connection is used regardless
+    execute(database, QStringLiteral("PRAGMA cache_size = -%1").arg(tuning.cacheSize));
+    execute(database, QStringLiteral("PRAGMA mmap_size = %1").arg(tuning.mmapSize));
+    execute(database, QStringLiteral("PRAGMA synchronous = %1").arg(tuning.synchronous));
+    execute(database, QStringLiteral("PRAGMA wal_autocheckpoint = %1").arg(tuning.walAutocheckpoint));
+    execute(database, QStringLiteral("PRAGMA busy_timeout = %1").arg(tuning.busyTimeout));
+}
+
 QSqlDatabase CommHistoryDatabase::open(const QString &databaseName)
 {
     QDir databaseDir(CommHistoryDatabasePath::databaseDir());
     if (!databaseDir.exists())
         databaseDir.mkpath(QLatin1String("."));
 
+    QLockFile lock(lockFile());
+    lock.lock();
+
+    // Only succeeds in the first process to open the database
+    if (CommHistory::DatabaseMigrator::isPending())
+        CommHistory::DatabaseMigrator::swapDatabase();
+    registerUser();
+
     const QString databaseFile = databaseDir.absoluteFilePath(CommHistoryDatabasePath::databaseFile());
     const bool exists = QFile::exists(databaseFile);
 
@@ -315,6 +860,8 @@ QSqlDatabase CommHistoryDatabase::open(const QString &databaseName)
         }
     }
 
+    applyTuning(database);
+
     if (!exists) {
         if (!prepareDatabase(database)) {
             database.close();
@@ -326,18 +873,129 @@ QSqlDatabase CommHistoryDatabase::open(const QString &databaseName)
             return database;
         }
 
-        if (!upgradeDatabase(database) || !execute(database, "END TRANSACTION")) {
+        if (!upgradeDatabase(database) || !setupSearchIndex(database)
+                || !execute(database, "END TRANSACTION")) {
             execute(database, "ROLLBACK");
             qCritical() << "Database upgrade failed! Everything may break catastrophically.";
         }
     }
 
+    // Without the archive, archived events are just not visible. It is
+    // only created once events are archived, see createArchive().
+    QMutexLocker locker(&db_archive_mutex);
+    if (database.isOpen() && attachArchive(database, false))
+        db_archive_connections.insert(databaseName);
+    else
+        db_archive_connections.remove(databaseName);
+
     return database;
 }
 
-QSqlQuery CommHistoryDatabase::prepare(const char *statement, const QSqlDatabase &database)
+QString CommHistoryDatabase::lockFile()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(QStringLiteral(COMMHISTORY_LOCK_NAME));
+}
+
+bool CommHistoryDatabase::isInUse()
+{
+    if (*db_user_lock())
+        return true;
+
+    QDir dir(usersDir());
+    foreach (const QString &name, dir.entryList(QStringList() << QStringLiteral("*.lock"), QDir::Files)) {
+        QLockFile user(dir.absoluteFilePath(name));
+        user.setStaleLockTime(0);
+        // Only succeeds if the process that held it has exited
+        if (!user.tryLock(0))
+            return true;
+        user.unlock();
+    }
+
+    return false;
+}
+
+bool CommHistoryDatabase::hasArchive(const QSqlDatabase &database)
+{
+    QMutexLocker locker(&db_archive_mutex);
+    if (db_archive_connections.contains(database.connectionName()))
+        return true;
+
+    // Another connection may have created the archive since this one was
+    // opened
+    QSqlDatabase connection(database);
+    if (!connection.isOpen() || !attachArchive(connection, false))
+        return false;
+
+    db_archive_connections.insert(database.connectionName());
+    return true;
+}
+
+bool CommHistoryDatabase::hasFullTextSearch(const QSqlDatabase &database)
+{
+    // The index is stale if the triggers were dropped, or never created
+    int triggers = 0;
+    return tuning().fullTextSearch && hasFts5(database)
+        && searchTriggerCount(database, triggers) && triggers == db_search_drop_count;
+}
+
+bool CommHistoryDatabase::createArchive(QSqlDatabase &database)
 {
+    QMutexLocker locker(&db_archive_mutex);
+    if (db_archive_connections.contains(database.connectionName()))
+        return true;
+
+    if (!database.isOpen() || !attachArchive(database, true))
+        return false;
+
+    db_archive_connections.insert(database.connectionName());
+    return true;
+}
+
+QString CommHistoryDatabase::walFile()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir())
+            .absoluteFilePath(CommHistoryDatabasePath::databaseFile()) + QLatin1String("-wal");
+}
+
+qint64 CommHistoryDatabase::walSize()
+{
+    return QFileInfo(walFile()).size();
+}
+
+bool CommHistoryDatabase::checkpoint(QSqlDatabase &database, bool truncate, bool *complete)
+{
+    const qint64 sizeBefore = walSize();
+    QElapsedTimer timer;
+    timer.start();
+
     QSqlQuery query(database);
+    if (!query.exec(truncate ? QStringLiteral("PRAGMA wal_checkpoint(TRUNCATE)")
+                             : QStringLiteral("PRAGMA wal_checkpoint(PASSIVE)")) || !query.next()) {
+        qCWarning(lcCommHistory) << "WAL checkpoint failed";
+        qCWarning(lcCommHistory) << query.lastError();
+        return false;
+    }
+
+    // Columns are: blocked by a writer or reader, frames in the WAL,
+    // frames copied back into the database
+    const bool busy = query.value(0).toInt() != 0;
+    const int frames = query.value(1).toInt();
+    const int checkpointed = query.value(2).toInt();
+    query.finish();
+
+    qCDebug(lcCommHistory) << (truncate ? "Truncating" : "Passive") << "WAL checkpoint took" << timer.elapsed()
+                           << "ms: copied" << checkpointed << "of" << frames << "frames, WAL size"
+                           << sizeBefore << "->" << walSize() << "bytes" << (busy ? "(busy)" : "");
+
+    if (complete)
+        *complete = !busy && checkpointed >= frames;
+    return true;
+}
+
+QSqlQuery CommHistoryDatabase::prepare(const char *statement, const QSqlDatabase &database)
+{
+    // While profiling, every prepared query is timed through its result
+    QSqlQuery query = QueryProfiler::isEnabled() ? QSqlQuery(new ProfilingResult(database)) : QSqlQuery(database);
     query.setForwardOnly(true);
     if (!query.prepare(statement)) {
         qCWarning(lcCommHistory) << "Failed to prepare query";
@@ -345,6 +1003,7 @@ QSqlQuery CommHistoryDatabase::prepare(const char *statement, const QSqlDatabase
         qCWarning(lcCommHistory) << statement;
         return QSqlQuery();
     }
+
     return query;
 }
 
@@ -363,6 +1022,11 @@ QString CommHistoryDatabasePath::databaseFile()
     return QString(QLatin1String(COMMHISTORY_DATABASE_NAME));
 }
 
+QString CommHistoryDatabasePath::archiveFile()
+{
+    return QStringLiteral(COMMHISTORY_ARCHIVE_NAME);
+}
+
 QString CommHistoryDatabasePath::dataDir()
 {
     return db_root_dir + QStringLiteral(COMMHISTORY_DATA_DIR);
@@ -24,12 +24,62 @@
 #define COMMHISTORYDATABASE_H
 
 #include <QSqlDatabase>
+#include <QString>
 
 class CommHistoryDatabase
 {
 public:
+    // Connection settings applied by open(). They are read once from the
+    // ini file named by COMMHISTORY_DB_TUNING, or commhistory-tuning.conf
+    // in the database directory; COMMHISTORY_DB_<KEY> environment
+    // variables override single keys (e.g. COMMHISTORY_DB_CACHESIZE).
+    struct Tuning {
+        int cacheSize;              // cacheSize, KiB per connection
+        qint64 mmapSize;            // mmapSize, bytes
+        QString synchronous;        // synchronous, OFF, NORMAL or FULL
+        int walAutocheckpoint;      // walAutocheckpoint, pages
+        int busyTimeout;            // busyTimeout, milliseconds
+        bool checkpointOnIdle;      // checkpointOnIdle
+        int checkpointIdleDelay;    // checkpointIdleDelay, milliseconds
+        qint64 truncateWalSize;     // truncateWalSize, bytes
+        qint64 changeLogSize;       // changeLogSize, change sequences kept when idle
+        bool fullTextSearch;        // fullTextSearch, use the FTS5 index if SQLite has it
+        QString encoding;           // encoding of new databases, UTF-8 or UTF-16
+    };
+    static const Tuning &tuning();
+
     static QSqlDatabase open(const QString &databaseName);
+
+    // Held while a connection is opened, so that a migrated database is
+    // never swapped in under a connection being set up
+    static QString lockFile();
+
+    // True if this or any other process may have the database open. Each
+    // process holds a lock file from its first open() until it exits;
+    // call this with lockFile() held so that none starts meanwhile.
+    static bool isInUse();
     static QSqlQuery prepare(const char *statement, const QSqlDatabase &database);
+
+    // True if the archive database is attached to the connection as
+    // "archive". An archive created after the connection was opened is
+    // attached on the next call outside of a transaction.
+    static bool hasArchive(const QSqlDatabase &database);
+
+    // True if SQLite has FTS5, it is not disabled by the tuning and the
+    // triggers keeping the EventsSearch index up to date exist
+    static bool hasFullTextSearch(const QSqlDatabase &database);
+
+    // Attaches the archive database, creating it if it does not exist yet
+    static bool createArchive(QSqlDatabase &database);
+
+    // Path and size in bytes of the write-ahead log
+    static QString walFile();
+    static qint64 walSize();
+
+    // Checkpoints the WAL, truncating it if \a truncate is set, and logs
+    // the WAL size and how long it took. \a complete is set if every frame
+    // was copied back into the database.
+    static bool checkpoint(QSqlDatabase &database, bool truncate, bool *complete = 0);
 };
 
 #endif
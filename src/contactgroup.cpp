@@ -392,15 +392,23 @@ bool ContactGroup::markAsRead()
     if (d->groups.isEmpty() || !unreadMessages())
         return true;
 
+    DatabaseIO::ReadFilter filter;
+    foreach (GroupObject *group, d->groups) {
+        if (group->unreadMessages())
+            filter.groupIds.append(group->id());
+    }
+
+    // An empty list would select the events of every group
+    if (filter.groupIds.isEmpty())
+        return true;
+
     DatabaseIO *database = DatabaseIO::instance();
     if (!database->transaction())
         return false;
 
-    foreach (GroupObject *group, d->groups) {
-        if (group->unreadMessages() && !database->markAsReadGroup(group->id())) {
-            database->rollback();
-            return false;
-        }
+    if (!database->markAsRead(filter)) {
+        database->rollback();
+        return false;
     }
 
     if (!database->commit())
@@ -23,6 +23,9 @@
 #include "contactresolver.h"
 
 #include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QSharedPointer>
 
 #include "recipient_p.h"
 #include "debug_p.h"
@@ -33,13 +36,16 @@ using namespace CommHistory;
 
 namespace CommHistory {
 
-class ContactResolverPrivate : public QObject, public SeasideCache::ResolveListener
+class ContactResolutionService;
+
+class ContactResolverPrivate : public QObject
 {
     Q_OBJECT
     Q_DECLARE_PUBLIC(ContactResolver)
 
 public:
     ContactResolver *q_ptr;
+    QSharedPointer<ContactResolutionService> service;
     QSet<Recipient> pending;
     bool resolving;
     bool forceResolving;
@@ -49,27 +55,239 @@ public:
 
     void resolve(Recipient recipient);
     void checkIfFinishedAsynchronously();
-    virtual void addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item);
+    void lookupFinished(const Recipient &recipient);
 
 public slots:
     bool checkIfFinished();
 };
 
+/* Looks up recipients for every ContactResolver in the process.
+ *
+ * A recipient that is already being looked up for one resolver is not
+ * looked up again for another; each resolver waiting for it is told when
+ * the result arrives. Addresses missing from the cache are queued and
+ * passed to SeasideCache together once control returns to the event loop,
+ * so that it can fetch them in one request. */
+class ContactResolutionService : public QObject, public SeasideCache::ResolveListener
+{
+    Q_OBJECT
+
+public:
+    static QSharedPointer<ContactResolutionService> instance();
+    ~ContactResolutionService();
+
+    // Returns true if the recipient was resolved from the cache, otherwise
+    // lookupFinished() is called on the waiter later
+    bool resolve(ContactResolverPrivate *waiter, const Recipient &recipient);
+    void cancel(ContactResolverPrivate *waiter, const Recipient &recipient);
+
+    virtual void addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item);
+
+private slots:
+    void issueLookups();
+
+private:
+    ContactResolutionService();
+
+    void finish(const Recipient &recipient, SeasideCache::CacheItem *item);
+
+    struct Lookup {
+        QList<ContactResolverPrivate *> waiters;
+        QElapsedTimer timer;
+        bool issued;
+    };
+
+    QHash<Recipient, Lookup> lookups;
+    QList<Recipient> queued;
+    bool issueScheduled;
+};
+
 } // namespace CommHistory
 
+// Kept apart from the service, which only lives while resolvers exist
+static ContactResolver::Statistics resolutionStatistics;
+
+Q_GLOBAL_STATIC(QWeakPointer<ContactResolutionService>, resolutionServiceInstance);
+
+ContactResolutionService::ContactResolutionService()
+    : issueScheduled(false)
+{
+}
+
+ContactResolutionService::~ContactResolutionService()
+{
+    SeasideCache::unregisterResolveListener(this);
+    resolutionStatistics.pending = 0;
+}
+
+QSharedPointer<ContactResolutionService> ContactResolutionService::instance()
+{
+    QSharedPointer<ContactResolutionService> result = resolutionServiceInstance->toStrongRef();
+    if (!result) {
+        result = QSharedPointer<ContactResolutionService>(new ContactResolutionService);
+        *resolutionServiceInstance = result.toWeakRef();
+    }
+
+    return result;
+}
+
+bool ContactResolutionService::resolve(ContactResolverPrivate *waiter, const Recipient &recipient)
+{
+    resolutionStatistics.requests++;
+
+    QHash<Recipient, Lookup>::iterator it = lookups.find(recipient);
+    if (it != lookups.end()) {
+        resolutionStatistics.sharedLookups++;
+        it->waiters.append(waiter);
+        return false;
+    }
+
+    SeasideCache::CacheItem *item = 0;
+    if (recipient.isPhoneNumber()) {
+        item = SeasideCache::itemByPhoneNumber(recipient.remoteUid(), false);
+    } else {
+        item = SeasideCache::itemByOnlineAccount(recipient.localUid(), recipient.remoteUid(), false);
+    }
+
+    if (item) {
+        resolutionStatistics.cacheHits++;
+        RecipientPrivate::setResolved(&recipient, item);
+        return true;
+    }
+
+    Lookup &lookup = lookups[recipient];
+    lookup.waiters.append(waiter);
+    lookup.timer.start();
+    lookup.issued = false;
+    queued.append(recipient);
+
+    resolutionStatistics.pending = lookups.size();
+    resolutionStatistics.peakPending = qMax(resolutionStatistics.peakPending, resolutionStatistics.pending);
+
+    if (!issueScheduled) {
+        issueScheduled = true;
+        bool ok = metaObject()->invokeMethod(this, "issueLookups", Qt::QueuedConnection);
+        Q_UNUSED(ok);
+        Q_ASSERT(ok);
+    }
+    return false;
+}
+
+void ContactResolutionService::cancel(ContactResolverPrivate *waiter, const Recipient &recipient)
+{
+    QHash<Recipient, Lookup>::iterator it = lookups.find(recipient);
+    if (it == lookups.end())
+        return;
+
+    it->waiters.removeAll(waiter);
+
+    // A lookup that was passed on goes on, since its result is cached for
+    // everyone, but one that is still queued is dropped
+    if (it->waiters.isEmpty() && !it->issued) {
+        lookups.erase(it);
+        resolutionStatistics.cancelled++;
+        resolutionStatistics.pending = lookups.size();
+    }
+}
+
+void ContactResolutionService::issueLookups()
+{
+    issueScheduled = false;
+
+    QList<Recipient> batch;
+    batch.swap(queued);
+    if (batch.isEmpty())
+        return;
+
+    resolutionStatistics.batches++;
+    qCDebug(lcCommHistory) << "Resolving" << batch.size() << "addresses," << lookups.size() << "pending";
+
+    foreach (const Recipient &recipient, batch) {
+        // Cancelled while queued
+        QHash<Recipient, Lookup>::iterator it = lookups.find(recipient);
+        if (it == lookups.end() || it->issued)
+            continue;
+
+        it->issued = true;
+        resolutionStatistics.lookups++;
+
+        SeasideCache::CacheItem *item = 0;
+        if (recipient.isPhoneNumber()) {
+            item = SeasideCache::resolvePhoneNumber(this, recipient.remoteUid(), false);
+        } else {
+            item = SeasideCache::resolveOnlineAccount(this, recipient.localUid(), recipient.remoteUid(), false);
+        }
+
+        if (item)
+            finish(recipient, item);
+    }
+}
+
+void ContactResolutionService::addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item)
+{
+    if (second.isEmpty()) {
+        qCWarning(lcCommHistory) << "Got addressResolved with empty UIDs" << first << second << item;
+        return;
+    } else if (first.isEmpty()) {
+        // This resolution is for a phone number - we need to call back to libcontacts
+        // to select the best match from multiple possible resolutions
+        const Recipient::PhoneNumberMatchDetails phoneNumber(Recipient::phoneNumberMatchDetails(second));
+        QList<Recipient> matches;
+        for (QHash<Recipient, Lookup>::const_iterator it = lookups.constBegin(); it != lookups.constEnd(); ++it) {
+            if (it.key().matchesPhoneNumber(phoneNumber))
+                matches.append(it.key());
+        }
+
+        foreach (const Recipient &recipient, matches) {
+            // Look up the best match for the full number
+            finish(recipient, SeasideCache::itemByPhoneNumber(recipient.remoteUid(), false));
+        }
+    } else {
+        finish(Recipient(first, second), item);
+    }
+}
+
+void ContactResolutionService::finish(const Recipient &recipient, SeasideCache::CacheItem *item)
+{
+    QHash<Recipient, Lookup>::iterator it = lookups.find(recipient);
+    if (it == lookups.end())
+        return;
+
+    const qint64 latency = it->timer.elapsed();
+    QList<QPointer<ContactResolverPrivate> > waiters;
+    foreach (ContactResolverPrivate *waiter, it->waiters)
+        waiters.append(waiter);
+    lookups.erase(it);
+
+    RecipientPrivate::setResolved(&recipient, item);
+
+    resolutionStatistics.completed++;
+    resolutionStatistics.totalLatency += latency;
+    resolutionStatistics.maxLatency = qMax(resolutionStatistics.maxLatency, latency);
+    resolutionStatistics.pending = lookups.size();
+
+    // A waiter may delete other resolvers when it finishes
+    foreach (const QPointer<ContactResolverPrivate> &waiter, waiters) {
+        if (waiter)
+            waiter->lookupFinished(recipient);
+    }
+}
+
 ContactResolver::ContactResolver(QObject *parent)
     : QObject(parent), d_ptr(new ContactResolverPrivate(this))
 {
 }
 
 ContactResolverPrivate::ContactResolverPrivate(ContactResolver *parent)
-    : QObject(parent), q_ptr(parent), resolving(false), forceResolving(false)
+    : QObject(parent), q_ptr(parent), service(ContactResolutionService::instance()),
+      resolving(false), forceResolving(false)
 {
 }
 
 ContactResolverPrivate::~ContactResolverPrivate()
 {
-    SeasideCache::unregisterResolveListener(this);
+    foreach (const Recipient &recipient, pending)
+        service->cancel(this, recipient);
 }
 
 bool ContactResolver::isResolving() const
@@ -90,6 +308,19 @@ void ContactResolver::setForceResolving(bool enabled)
     d->forceResolving = enabled;
 }
 
+ContactResolver::Statistics ContactResolver::statistics()
+{
+    return resolutionStatistics;
+}
+
+void ContactResolver::resetStatistics()
+{
+    const int pending = resolutionStatistics.pending;
+    resolutionStatistics = Statistics();
+    resolutionStatistics.pending = pending;
+    resolutionStatistics.peakPending = pending;
+}
+
 void ContactResolver::add(const Recipient &recipient)
 {
     Q_D(ContactResolver);
@@ -132,18 +363,8 @@ void ContactResolverPrivate::resolve(Recipient recipient)
     if (pending.contains(recipient))
         return;
 
-    SeasideCache::CacheItem *item = 0;
-    if (recipient.isPhoneNumber()) {
-        item = SeasideCache::resolvePhoneNumber(this, recipient.remoteUid(), false);
-    } else {
-        item = SeasideCache::resolveOnlineAccount(this, recipient.localUid(), recipient.remoteUid(), false);
-    }
-
-    if (item) {
-        RecipientPrivate::setResolved(&recipient, item);
-    } else {
+    if (!service->resolve(this, recipient))
         pending.insert(recipient);
-    }
 }
 
 void ContactResolverPrivate::checkIfFinishedAsynchronously()
@@ -170,32 +391,9 @@ bool ContactResolverPrivate::checkIfFinished()
     return false;
 }
 
-void ContactResolverPrivate::addressResolved(const QString &first, const QString &second, SeasideCache::CacheItem *item)
+void ContactResolverPrivate::lookupFinished(const Recipient &recipient)
 {
-    if (second.isEmpty()) {
-        qCWarning(lcCommHistory) << "Got addressResolved with empty UIDs" << first << second << item;
-        return;
-    } else if (first.isEmpty()) {
-        // This resolution is for a phone number - we need to call back to libcontacts
-        // to select the best match from multiple possible resolutions
-        const Recipient::PhoneNumberMatchDetails phoneNumber(Recipient::phoneNumberMatchDetails(second));
-        for (QSet<Recipient>::iterator it = pending.begin(); it != pending.end(); ) {
-            if (it->matchesPhoneNumber(phoneNumber)) {
-                // Look up the best match for the full number
-                RecipientPrivate::setResolved(&(*it), SeasideCache::itemByPhoneNumber(it->remoteUid(), false));
-                it = pending.erase(it);
-            } else {
-                ++it;
-            }
-        }
-    } else {
-        QSet<Recipient>::iterator it = pending.find(Recipient(first, second));
-        if (it != pending.end()) {
-            RecipientPrivate::setResolved(&(*it), item);
-            pending.erase(it);
-        }
-    }
-
+    pending.remove(recipient);
     checkIfFinished();
 }
 
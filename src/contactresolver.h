@@ -42,6 +42,10 @@ class ContactResolverPrivate;
  * To ensure that all contacts are resolved for a list of Event, you can add
  * the recipients for each event to ContactResolver and wait for the finished
  * signal.
+ *
+ * All resolvers in a process share their lookups. A recipient that is being
+ * looked up for one resolver is not looked up again for another, and the
+ * addresses missing from the contact cache are passed to it together.
  */
 class LIBCOMMHISTORY_EXPORT ContactResolver : public QObject
 {
@@ -49,8 +53,29 @@ class LIBCOMMHISTORY_EXPORT ContactResolver : public QObject
     Q_DECLARE_PRIVATE(ContactResolver)
 
 public:
+    /* Counters for all resolvers in the process, with latencies in
+     * milliseconds from queuing an address to its result */
+    struct Statistics {
+        int requests;       // recipients that were not resolved yet
+        int cacheHits;      // resolved from the contact cache right away
+        int sharedLookups;  // joined a lookup made for another resolver
+        int lookups;        // addresses passed to the contact cache
+        int batches;        // times queued addresses were passed on
+        int completed;      // lookups that have a result
+        int cancelled;      // dropped before being passed on
+        int pending;        // lookups waiting for a result
+        int peakPending;
+        qint64 totalLatency;
+        qint64 maxLatency;
+
+        qint64 averageLatency() const { return completed ? totalLatency / completed : 0; }
+    };
+
     explicit ContactResolver(QObject *parent);
 
+    static Statistics statistics();
+    static void resetStatistics();
+
     /* Force resolving contacts even if already resolved */
     bool forceResolving() const;
     void setForceResolving(bool enabled);
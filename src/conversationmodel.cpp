@@ -48,6 +48,9 @@ ConversationModelPrivate::ConversationModelPrivate(EventModel *model)
             , filterAccount(QString())
             , filterDirection(Event::UnknownDirection)
             , allGroups(false)
+            , refreshLimit(0)
+            , includeArchive(true)
+            , inArchive(false)
 {
     QDBusConnection::sessionBus().connect(
         QString(), QString(), COMM_HISTORY_INTERFACE, GROUPS_ADDED_SIGNAL,
@@ -57,43 +60,168 @@ ConversationModelPrivate::ConversationModelPrivate(EventModel *model)
         this, SLOT(groupsDeletedSlot(const QList<int> &)));
     // remove call properties
     propertyMask -= unusedProperties;
+    // only message updates are relevant until a group filter is set
+    setUpdatesScope(messageTypesScope());
 }
 
-void ConversationModelPrivate::groupsAddedSlot(const QList<Group> &/*groups*/)
+void ConversationModelPrivate::groupsAddedSlot(const QList<Group> &groups)
 {
-    Q_Q(ConversationModel);
-    bool changed = allGroups;
-
-    // XXX This could be more efficient by adding events from this group without
-    // refreshing others
-    if (changed) {
-        if (allGroups)
-            q->getEvents();
-        else
-            q->getEvents(filterGroupIds.values());
+    if (!allGroups || groups.isEmpty())
+        return;
+
+    // A query in flight covers the new groups. A ready model is merged into
+    // even when it is empty, and so is a streamed one between chunks.
+    if (!isModelReady() && (queryMode != EventModel::StreamedAsyncQuery || eventRootItem->childCount() == 0))
+        return;
+
+    QList<int> groupIds;
+    foreach (const Group &group, groups)
+        groupIds.append(group.id());
+
+    // Only the range that is already loaded is merged, older events of the
+    // new groups arrive with the following chunks like any others
+    QSqlQuery query = buildQuery(groupIds, false, (queryMode == EventModel::StreamedAsyncQuery && !isReady)
+                                                   ? LoadedEvents : AllEvents);
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return;
+    }
+
+    QList<Event> events;
+    QList<int> extraPropertyIndices;
+    QList<int> hasPartsIndices;
+    while (query.next()) {
+        Event e;
+        bool extra = false, parts = false;
+        DatabaseIOPrivate::readEventResult(query, e, extra, parts);
+        if (findEvent(e.id()).isValid())
+            continue;
+        if (extra)
+            extraPropertyIndices.append(events.size());
+        if (parts)
+            hasPartsIndices.append(events.size());
+        events.append(e);
     }
+    query.finish();
+
+    foreach (int i, extraPropertyIndices)
+        database()->getEventExtraProperties(events[i]);
+    foreach (int i, hasPartsIndices)
+        database()->getMessageParts(events[i]);
+
+    insertSorted(events);
+
+    // Resolved events replace the inserted ones in place
+    if (resolveContacts == EventModel::ResolveImmediately && !events.isEmpty())
+        resolveAddedEvents(events);
 }
 
 void ConversationModelPrivate::groupsDeletedSlot(const QList<int> &groupIds)
+{
+    QSet<int> removedGroups;
+    foreach (int group, groupIds) {
+        if (allGroups || filterGroupIds.remove(group))
+            removedGroups.insert(group);
+    }
+
+    if (removedGroups.isEmpty())
+        return;
+
+    if (!allGroups)
+        updateScope();
+
+    QList<int> removedEvents;
+    for (int row = 0; row < eventRootItem->childCount(); row++) {
+        const Event &event = eventRootItem->eventAt(row);
+        if (removedGroups.contains(event.groupId()))
+            removedEvents.append(event.id());
+    }
+
+    deleteFromModel(removedEvents);
+}
+
+void ConversationModelPrivate::insertSorted(const QList<Event> &events)
 {
     Q_Q(ConversationModel);
-    bool changed = false;
 
-    foreach (int group, groupIds) {
-        if (allGroups)
-            changed = true;
-        else if (filterGroupIds.remove(group))
-            changed = true;
+    // Rows are ordered by endTime DESC, id DESC; merge the (already sorted)
+    // new events in runs sharing the same insertion point.
+    int inserted = 0;
+    int i = 0;
+    while (i < events.size()) {
+        const Event &first = events.at(i);
+        int low = 0, high = eventRootItem->childCount();
+        while (low < high) {
+            const int mid = (low + high) / 2;
+            const Event &e = eventRootItem->eventAt(mid);
+            if (e.endTimeT() > first.endTimeT()
+                || (e.endTimeT() == first.endTimeT() && e.id() > first.id()))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        int end = i + 1;
+        if (low < eventRootItem->childCount()) {
+            const Event &next = eventRootItem->eventAt(low);
+            while (end < events.size()
+                   && (events.at(end).endTimeT() > next.endTimeT()
+                       || (events.at(end).endTimeT() == next.endTimeT()
+                           && events.at(end).id() > next.id())))
+                end++;
+        } else {
+            end = events.size();
+        }
+
+        q->beginInsertRows(QModelIndex(), low, low + end - i - 1);
+        for (int j = i; j < end; j++)
+            eventRootItem->insertChildAt(low + j - i, new EventTreeItem(events.at(j), eventRootItem));
+        q->endInsertRows();
+
+        inserted += end - i;
+        i = end;
     }
 
-    // XXX This could be more efficient by removing events from this group without
-    // refreshing others
-    if (changed) {
-        if (allGroups)
-            q->getEvents();
-        else
-            q->getEvents(filterGroupIds.values());
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << "merged" << inserted << "events";
+}
+
+void ConversationModelPrivate::updateScope()
+{
+    if (allGroups || filterGroupIds.isEmpty()) {
+        setUpdatesScope(messageTypesScope());
+        return;
     }
+
+    // The moved path carries updates of events leaving one of the groups
+    QStringList scope;
+    foreach (int groupId, filterGroupIds)
+        scope << groupUpdatesPath(groupId);
+    scope << COMM_HISTORY_MOVED_PATH;
+    setUpdatesScope(scope);
+}
+
+QStringList ConversationModelPrivate::messageTypesScope() const
+{
+    if (filterType != Event::UnknownType)
+        return QStringList() << eventTypeUpdatesPath(filterType);
+
+    return QStringList() << eventTypeUpdatesPath(Event::IMEvent)
+                         << eventTypeUpdatesPath(Event::SMSEvent)
+                         << eventTypeUpdatesPath(Event::MMSEvent)
+                         << eventTypeUpdatesPath(Event::StatusMessageEvent);
+}
+
+bool ConversationModelPrivate::reloadEvents()
+{
+    Q_Q(ConversationModel);
+
+    if (allGroups)
+        return q->getEvents();
+    if (!filterGroupIds.isEmpty())
+        return q->getEvents(filterGroupIds.values());
+    return true;
 }
 
 bool ConversationModelPrivate::acceptsEvent(const Event &event) const
@@ -125,13 +253,18 @@ bool ConversationModelPrivate::acceptsEvent(const Event &event) const
 
 QSqlQuery ConversationModelPrivate::buildQuery() const
 {
-    QList<int> groups = filterGroupIds.values();
+    return buildQuery(filterGroupIds.values(), allGroups, NextChunk);
+}
+
+QSqlQuery ConversationModelPrivate::buildQuery(const QList<int> &groups, bool anyGroup,
+                                               QueryRange range) const
+{
     QString q;
     int unionCount = 0;
 
     qint64 firstTimestamp = 0;
     int firstId = -1;
-    if (eventRootItem->childCount() > 0) {
+    if ((range == NextChunk || range == LoadedEvents) && eventRootItem->childCount() > 0) {
         Event firstEvent = eventRootItem->eventAt(eventRootItem->childCount() - 1);
         firstTimestamp = firstEvent.endTimeT();
         firstId = firstEvent.id();
@@ -144,11 +277,19 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
         filters += "AND Events.type = :filterType ";
     if (filterDirection != Event::UnknownDirection)
         filters += "AND Events.direction = :filterDirection ";
-    if (firstId >= 0) {
+    if (firstId >= 0 && range == NextChunk) {
         filters += "AND (Events.endTime < :firstTimestamp OR (Events.endTime = :firstTimestamp "
                     "AND Events.id < :firstId)) ";
+    } else if (firstId >= 0 && range == LoadedEvents) {
+        filters += "AND (Events.endTime > :firstTimestamp OR (Events.endTime = :firstTimestamp "
+                    "AND Events.id >= :firstId)) ";
     }
 
+    // Past the live range, chunks continue from the archive
+    const QString eventQueryBase = (inArchive && range == NextChunk)
+            ? DatabaseIOPrivate::archiveEventQueryBase()
+            : DatabaseIOPrivate::eventQueryBase();
+
     if (!groups.isEmpty()) {
         /* Rather than the intuitive solution of groupId IN (1,2),
          * this query is built as:
@@ -164,7 +305,7 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
         do {
             if (unionCount)
                 q += "UNION ALL ";
-            q += DatabaseIOPrivate::eventQueryBase();
+            q += eventQueryBase;
             q += "WHERE Events.isDraft = 0 ";
 
             if (unionCount < groups.size())
@@ -174,16 +315,20 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
 
             unionCount++;
         } while (unionCount < groups.size());
-    } else if (allGroups) {
-        q += DatabaseIOPrivate::eventQueryBase();
-        q += "WHERE Events.isDraft = 0 ";
+    } else if (anyGroup) {
+        // Skip groups waiting for background deletion
+        q += eventQueryBase;
+        q += "WHERE Events.isDraft = 0 "
+             "AND IFNULL(Events.groupId, 0) NOT IN (SELECT id FROM Groups WHERE isDeleted = 1) ";
         q += filters;
     }
 
     q += "ORDER BY Events.endTime DESC, Events.id DESC ";
 
-    if (!queryLimit && queryMode == EventModel::StreamedAsyncQuery && chunkSize > 0)
+    if (range == NextChunk && !queryLimit && queryMode == EventModel::StreamedAsyncQuery && chunkSize > 0)
         q += "LIMIT " + QString::number((firstId < 0 && firstChunkSize > 0) ? firstChunkSize : chunkSize);
+    else if (range == RefreshedRows && refreshLimit > 0)
+        q += "LIMIT " + QString::number(refreshLimit);
 
     QSqlQuery query = prepareQuery(q);
 
@@ -201,15 +346,77 @@ QSqlQuery ConversationModelPrivate::buildQuery() const
     return query;
 }
 
+void ConversationModelPrivate::eventsUpdatedSlot(const QList<Event> &events)
+{
+    // Events moved out of the filtered groups leave the model
+    QList<Event> updated;
+    QList<int> moved;
+    foreach (const Event &event, events) {
+        if (!allGroups && event.validProperties().contains(Event::GroupId)
+            && !filterGroupIds.contains(event.groupId())) {
+            if (findEvent(event.id()).isValid())
+                moved.append(event.id());
+        } else {
+            updated.append(event);
+        }
+    }
+
+    if (!moved.isEmpty())
+        deleteFromModel(moved);
+    EventModelPrivate::eventsUpdatedSlot(updated);
+}
+
 void ConversationModelPrivate::eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events)
 {
-    // There is no more data when a query returns no rows
-    if (queryMode == EventModel::StreamedAsyncQuery && events.size() == 0)
-        isReady = true;
+    // There is no more data when a query returns no rows, or fewer rows
+    // than a refresh asked for
+    if (queryMode == EventModel::StreamedAsyncQuery) {
+        if (refreshing) {
+            isReady = refreshLimit == 0 || events.size() < refreshLimit;
+        } else if (events.size() == 0) {
+            if (!inArchive && hasArchivedEvents()) {
+                // The live range is exhausted; the next chunk is the first
+                // one from the archive
+                inArchive = true;
+                QSqlQuery query = buildQuery();
+                executeQuery(query, true);
+                return;
+            }
+            isReady = true;
+        }
+    }
 
     EventModelPrivate::eventsReceivedSlot(start, end, events);
 }
 
+bool ConversationModelPrivate::hasArchivedEvents() const
+{
+    if (!includeArchive || eventRootItem->childCount() == 0
+            || !CommHistoryDatabase::hasArchive(DatabaseIOPrivate::instance()->connection()))
+        return false;
+
+    // ArchivedGroups lives in the main database, so the archive file is
+    // only touched for conversations that have archived events
+    QString q = QStringLiteral("SELECT 1 FROM ArchivedGroups ");
+    if (!allGroups) {
+        QStringList groups;
+        foreach (int groupId, filterGroupIds)
+            groups.append(QString::number(groupId));
+        q += QStringLiteral("WHERE groupId IN (") + groups.join(QLatin1Char(',')) + QStringLiteral(") ");
+    }
+    q += QStringLiteral("LIMIT 1");
+
+    QSqlQuery query = prepareQuery(q);
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return query.next();
+}
+
 void ConversationModelPrivate::modelUpdatedSlot(bool successful)
 {
     if (queryMode == EventModel::StreamedAsyncQuery) {
@@ -245,12 +452,31 @@ bool ConversationModel::setFilter(Event::EventType type,
     d->filterAccount = account;
     d->filterDirection = direction;
 
+    // Rows paged in from the archive are not covered by a refresh
+    if ((d->allGroups || !d->filterGroupIds.isEmpty()) && d->eventRootItem->childCount() > 0
+            && !d->inArchive) {
+        // Query as many rows as are loaded and only signal the difference,
+        // views keep their position and the rows that still match
+        d->updateScope();
+
+        const bool chunked = d->queryMode == StreamedAsyncQuery && !d->queryLimit && d->chunkSize > 0;
+        d->refreshLimit = (chunked && !d->isReady)
+                ? qMax<int>(d->eventRootItem->childCount(), d->firstChunkSize > 0 ? d->firstChunkSize : d->chunkSize)
+                : 0;
+
+        QSqlQuery query = d->buildQuery(d->filterGroupIds.values(), d->allGroups,
+                                        ConversationModelPrivate::RefreshedRows);
+        d->beginRefresh();
+        return d->executeQuery(query);
+    }
+
     if (!d->filterGroupIds.isEmpty()) {
         return getEvents(d->filterGroupIds.values());
     } else if (d->allGroups) {
         return getEvents();
     }
 
+    d->updateScope();
     return true;
 }
 
@@ -265,6 +491,9 @@ bool ConversationModel::getEvents(QList<int> groupIds)
 
     d->filterGroupIds = QSet<int>::fromList(groupIds);
     d->allGroups = false;
+    d->inArchive = false;
+
+    d->updateScope();
 
     beginResetModel();
     d->clearEvents();
@@ -283,6 +512,8 @@ bool ConversationModel::getEvents()
 
     d->filterGroupIds.clear();
     d->allGroups = true;
+    d->inArchive = false;
+    d->updateScope();
 
     beginResetModel();
     d->clearEvents();
@@ -292,6 +523,18 @@ bool ConversationModel::getEvents()
     return d->executeQuery(query);
 }
 
+bool ConversationModel::includeArchive() const
+{
+    Q_D(const ConversationModel);
+    return d->includeArchive;
+}
+
+void ConversationModel::setIncludeArchive(bool enabled)
+{
+    Q_D(ConversationModel);
+    d->includeArchive = enabled;
+}
+
 bool ConversationModel::canFetchMore(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -310,7 +553,7 @@ void ConversationModel::fetchMore(const QModelIndex &parent)
         return;
 
     QSqlQuery query = d->buildQuery();
-    d->executeQuery(query);
+    d->executeQuery(query, d->inArchive);
 }
 
 }
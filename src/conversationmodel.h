@@ -63,7 +63,8 @@ public:
 
     /*!
      * Set optional filter for conversation. Will result in a new
-     * tracker query if called after getEvents().
+     * tracker query if called after getEvents(). Loaded rows are updated
+     * in place with row insertions and removals rather than a model reset.
      * Account filtering is useless at the moment with service-specific
      * conversations; left in for future compatibility.
      *
@@ -98,6 +99,16 @@ public:
      */
     bool getEvents();
 
+    /*!
+     * Whether events moved to the archive database by RetentionEngine are
+     * paged in after the live ones. This only applies to
+     * StreamedAsyncQuery mode, where the archive is read once the live
+     * events are exhausted. Archived events are not updated
+     * incrementally. Enabled by default.
+     */
+    bool includeArchive() const;
+    void setIncludeArchive(bool enabled);
+
     virtual bool canFetchMore(const QModelIndex &parent) const;
     virtual void fetchMore(const QModelIndex &parent);
 
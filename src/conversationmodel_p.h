@@ -38,15 +38,29 @@ public:
     Q_OBJECT
     Q_DECLARE_PUBLIC(ConversationModel)
 
+    enum QueryRange {
+        NextChunk,      // events following the loaded ones, chunk limited
+        LoadedEvents,   // events within the already loaded range
+        RefreshedRows,  // the first refreshLimit events, see ConversationModel::setFilter()
+        AllEvents
+    };
+
     ConversationModelPrivate(EventModel *model);
 
     bool acceptsEvent(const Event &event) const;
+    QStringList messageTypesScope() const;
+    bool reloadEvents();
     QSqlQuery buildQuery() const;
+    QSqlQuery buildQuery(const QList<int> &groups, bool anyGroup, QueryRange range) const;
     bool isModelReady() const;
+    bool hasArchivedEvents() const;
+    void insertSorted(const QList<Event> &events);
+    void updateScope();
 
 public Q_SLOTS:
     virtual void eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events);
     virtual void modelUpdatedSlot(bool successful);
+    virtual void eventsUpdatedSlot(const QList<CommHistory::Event> &events);
     void groupsAddedSlot(const QList<Group> &groups);
     void groupsDeletedSlot(const QList<int> &groupIds);
 
@@ -56,6 +70,9 @@ public:
     QString filterAccount;
     Event::EventDirection filterDirection;
     bool allGroups;
+    int refreshLimit;
+    bool includeArchive;
+    bool inArchive;
 };
 
 }
@@ -25,8 +25,12 @@
 #include "commhistorydatabase.h"
 #include "contactlistener.h"
 #include "group.h"
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QFileInfo>
 #include <QSqlQuery>
 #include <QSqlError>
+#include "dbus_p.h"
 #include "debug_p.h"
 
 using namespace CommHistory;
@@ -330,7 +334,7 @@ DatabaseIOPrivate *DatabaseIOPrivate::instance()
 }
 
 DatabaseIOPrivate::DatabaseIOPrivate(DatabaseIO *p)
-    : q(p)
+    : q(p), m_checkpointScheduler(0)
 {
 }
 
@@ -351,10 +355,41 @@ QSqlQuery DatabaseIOPrivate::prepareQuery(const QString &s, int limit, int offse
 
 QSqlDatabase &DatabaseIOPrivate::connection()
 {
-    if (!m_pConnection.isValid())
-        m_pConnection = CommHistoryDatabase::open("commhistory");
+    ThreadConnection *threadConnection = m_connections.localData();
+    if (!threadConnection) {
+        static QAtomicInt connectionCounter;
+
+        // The owning thread keeps the name used before connections were per thread
+        const bool owningThread = QThread::currentThread() == thread();
+        const QString name = owningThread
+                ? QStringLiteral("commhistory")
+                : QStringLiteral("commhistory-thread-%1").arg(connectionCounter.fetchAndAddRelaxed(1) + 1);
+
+        threadConnection = new ThreadConnection(name);
+        m_connections.setLocalData(threadConnection);
+
+        // The scheduler needs the event loop of the thread owning DatabaseIO
+        if (owningThread && !m_checkpointScheduler.loadAcquire()
+                && CommHistoryDatabase::tuning().checkpointOnIdle)
+            m_checkpointScheduler.storeRelease(new CheckpointScheduler(this));
+    }
+
+    return threadConnection->database;
+}
+
+ThreadConnection::ThreadConnection(const QString &name)
+    : database(CommHistoryDatabase::open(name))
+{
+}
 
-    return m_pConnection;
+ThreadConnection::~ThreadConnection()
+{
+    if (database.isValid()) {
+        const QString name = database.connectionName();
+        database.close();
+        database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
 }
 
 QSqlQuery DatabaseIOPrivate::createQuery()
@@ -467,6 +502,153 @@ bool DatabaseIOPrivate::insertMessageParts(Event &event)
     return true;
 }
 
+bool DatabaseIOPrivate::updateEventProperties(int eventId, const QVariantMap &properties)
+{
+    // Only the changed keys are written. Writing a key that is already
+    // set would fire the flag trigger and update the event row again.
+    QSqlQuery query = CommHistoryDatabase::prepare("SELECT key, value FROM EventProperties WHERE eventId=:eventId",
+                                                   connection());
+    query.bindValue(":eventId", eventId);
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    QHash<QString, QString> stored;
+    while (query.next())
+        stored.insert(query.value(0).toString(), query.value(1).toString());
+    query.finish();
+
+    QVariantMap added;
+    QSqlQuery updateQuery = CommHistoryDatabase::prepare(
+        "UPDATE EventProperties SET value=:value WHERE eventId=:eventId AND key=:key",
+        connection());
+    updateQuery.bindValue(":eventId", eventId);
+
+    for (QVariantMap::const_iterator it = properties.begin(); it != properties.end(); it++) {
+        QHash<QString, QString>::iterator existing = stored.find(it.key());
+        if (existing == stored.end()) {
+            added.insert(it.key(), it.value());
+            continue;
+        }
+
+        const QString value = it.value().toString();
+        if (*existing != value) {
+            updateQuery.bindValue(":key", it.key());
+            updateQuery.bindValue(":value", value);
+            if (!updateQuery.exec()) {
+                qCWarning(lcCommHistory) << "Failed to execute query";
+                qCWarning(lcCommHistory) << updateQuery.lastError();
+                qCWarning(lcCommHistory) << updateQuery.lastQuery();
+                return false;
+            }
+        }
+        stored.erase(existing);
+    }
+
+    // Whatever is left in stored has been removed from the event
+    if (!stored.isEmpty()) {
+        QSqlQuery deleteQuery = CommHistoryDatabase::prepare(
+            "DELETE FROM EventProperties WHERE eventId=:eventId AND key=:key",
+            connection());
+        deleteQuery.bindValue(":eventId", eventId);
+        for (QHash<QString, QString>::const_iterator it = stored.constBegin(); it != stored.constEnd(); ++it) {
+            deleteQuery.bindValue(":key", it.key());
+            if (!deleteQuery.exec()) {
+                qCWarning(lcCommHistory) << "Failed to execute query";
+                qCWarning(lcCommHistory) << deleteQuery.lastError();
+                qCWarning(lcCommHistory) << deleteQuery.lastQuery();
+                return false;
+            }
+        }
+    }
+
+    return added.isEmpty() || insertEventProperties(eventId, added);
+}
+
+bool DatabaseIOPrivate::updateMessageParts(Event &event)
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(
+        "SELECT id, contentId, contentType, path FROM MessageParts WHERE eventId=:eventId",
+        connection());
+    query.bindValue(":eventId", event.id());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    QHash<int, MessagePart> stored;
+    while (query.next()) {
+        MessagePart part;
+        part.setId(query.value(0).toInt());
+        part.setContentId(query.value(1).toString());
+        part.setContentType(query.value(2).toString());
+        part.setPath(query.value(3).toString());
+        stored.insert(part.id(), part);
+    }
+    query.finish();
+
+    // Parts that are stored unchanged are left alone
+    QList<MessagePart> parts = event.messageParts();
+    QList<MessagePart> changed;
+    QList<int> changedRows;
+    for (int i = 0; i < parts.size(); i++) {
+        const MessagePart &part = parts.at(i);
+        QHash<int, MessagePart>::iterator existing = part.id() >= 0 ? stored.find(part.id()) : stored.end();
+        if (existing != stored.end()) {
+            const MessagePart &old = *existing;
+            if (old.contentId() != part.contentId() || old.contentType() != part.contentType()
+                || old.path() != part.path()) {
+                changed.append(part);
+                changedRows.append(i);
+            }
+            stored.erase(existing);
+        } else {
+            changed.append(part);
+            changedRows.append(i);
+        }
+    }
+
+    // Parts with no associated event are cleaned up asynchronously
+    if (!stored.isEmpty()) {
+        QSqlQuery detachQuery = CommHistoryDatabase::prepare(
+            "UPDATE MessageParts SET eventId=NULL WHERE id=:id",
+            connection());
+        for (QHash<int, MessagePart>::const_iterator it = stored.constBegin(); it != stored.constEnd(); ++it) {
+            detachQuery.bindValue(":id", it.key());
+            if (!detachQuery.exec()) {
+                qCWarning(lcCommHistory) << "Failed to execute query";
+                qCWarning(lcCommHistory) << detachQuery.lastError();
+                qCWarning(lcCommHistory) << detachQuery.lastQuery();
+                return false;
+            }
+        }
+    }
+
+    if (!changed.isEmpty()) {
+        // insertMessageParts() writes the parts it is given and sets
+        // the ids of new ones
+        Event changedEvent;
+        changedEvent.setId(event.id());
+        changedEvent.setMessageParts(changed);
+        if (!insertMessageParts(changedEvent))
+            return false;
+
+        const QList<MessagePart> written = changedEvent.messageParts();
+        for (int i = 0; i < changedRows.size(); i++)
+            parts[changedRows.at(i)] = written.at(i);
+    }
+
+    event.setMessageParts(parts);
+    event.resetModifiedProperty(Event::MessageParts);
+
+    return true;
+}
+
 // See http://www.sqlite.org/fileformat2.html#seqtab
 bool DatabaseIO::reserveEventIds(int count, int *firstReservedId)
 {
@@ -554,6 +736,14 @@ QString DatabaseIOPrivate::eventQueryBase()
     return QLatin1String(baseEventQuery);
 }
 
+QString DatabaseIOPrivate::archiveEventQueryBase()
+{
+    // Same columns, aliased so that conditions on Events.* apply unchanged
+    QString q = QLatin1String(baseEventQuery);
+    q.replace(QLatin1String("FROM Events "), QLatin1String("FROM archive.Events AS Events "));
+    return q;
+}
+
 QString DatabaseIOPrivate::limitClause(int limit, int offset)
 {
     QString rv;
@@ -690,8 +880,23 @@ bool DatabaseIO::getEvent(int id, Event &event)
 
 bool DatabaseIO::getEventExtraProperties(Event &event)
 {
-    const char *q = "SELECT key, value FROM EventProperties WHERE eventId=:eventId";
-    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+    return d->getEventExtraProperties(event, false);
+}
+
+bool DatabaseIO::getMessageParts(Event &event)
+{
+    return d->getMessageParts(event, false);
+}
+
+bool DatabaseIOPrivate::getEventExtraProperties(Event &event, bool archived)
+{
+    const char *q = archived
+            ? "SELECT key, value FROM archive.EventProperties WHERE eventId=:eventId"
+            : "SELECT key, value FROM EventProperties WHERE eventId=:eventId";
+    if (archived && !CommHistoryDatabase::hasArchive(connection()))
+        return false;
+
+    QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
     query.bindValue(":eventId", event.id());
 
     if (!query.exec()) {
@@ -704,15 +909,21 @@ bool DatabaseIO::getEventExtraProperties(Event &event)
     QVariantMap data;
     while (query.next())
         data.insert(query.value(0).toString(), query.value(1).toString());
+
     event.setExtraProperties(data);
     event.resetModifiedProperty(Event::ExtraProperties);
     return true;
 }
 
-bool DatabaseIO::getMessageParts(Event &event)
+bool DatabaseIOPrivate::getMessageParts(Event &event, bool archived)
 {
-    const char *q = "SELECT id, contentId, contentType, path FROM MessageParts WHERE eventId=:eventId";
-    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+    const char *q = archived
+            ? "SELECT id, contentId, contentType, path FROM archive.MessageParts WHERE eventId=:eventId"
+            : "SELECT id, contentId, contentType, path FROM MessageParts WHERE eventId=:eventId";
+    if (archived && !CommHistoryDatabase::hasArchive(connection()))
+        return false;
+
+    QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
     query.bindValue(":eventId", event.id());
 
     if (!query.exec()) {
@@ -722,19 +933,63 @@ bool DatabaseIO::getMessageParts(Event &event)
         return false;
     }
 
-    event.setMessageParts(QList<MessagePart>());
+    QList<MessagePart> parts;
     while (query.next()) {
         MessagePart part;
         part.setId(query.value(0).toInt());
         part.setContentId(query.value(1).toString());
         part.setContentType(query.value(2).toString());
         part.setPath(query.value(3).toString());
-        event.addMessagePart(part);
+        parts.append(part);
     }
+
+    event.setMessageParts(parts);
     event.resetModifiedProperty(Event::MessageParts);
     return true;
 }
 
+bool DatabaseIOPrivate::getEvents(const QString &querySuffix, QList<Event> &events)
+{
+    // Ids are never reused, so each event is in one database or the other
+    const bool archive = CommHistoryDatabase::hasArchive(connection());
+    for (int i = 0; i < (archive ? 2 : 1); i++) {
+        const bool archived = i > 0;
+        QSqlQuery query = prepareQuery((archived ? archiveEventQueryBase() : eventQueryBase())
+                                       + QLatin1Char(' ') + querySuffix);
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            return false;
+        }
+
+        QList<int> extraPropertyIndices;
+        QList<int> hasPartsIndices;
+        while (query.next()) {
+            Event e;
+            bool extra = false, parts = false;
+            readEventResult(query, e, extra, parts);
+            if (extra)
+                extraPropertyIndices.append(events.size());
+            if (parts)
+                hasPartsIndices.append(events.size());
+            events.append(e);
+        }
+        query.finish();
+
+        foreach (int index, extraPropertyIndices) {
+            if (!getEventExtraProperties(events[index], archived))
+                return false;
+        }
+        foreach (int index, hasPartsIndices) {
+            if (!getMessageParts(events[index], archived))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 bool DatabaseIO::getEventByMessageToken(const QString &token, Event &event)
 {
     QByteArray q = baseEventQuery;
@@ -840,49 +1095,13 @@ bool DatabaseIO::modifyEvent(Event &event)
     }
     query.finish();
 
-    if (event.modifiedProperties().contains(Event::ExtraProperties)) {
-        const char *q = "DELETE FROM EventProperties WHERE eventId=:eventId";
-        query = CommHistoryDatabase::prepare(q, d->connection());
-        query.bindValue(":eventId", event.id());
-        if (!query.exec()) {
-            qCWarning(lcCommHistory) << "Failed to execute query";
-            qCWarning(lcCommHistory) << query.lastError();
-            qCWarning(lcCommHistory) << query.lastQuery();
-            return false;
-        }
-        query.finish();
-
-        QVariantMap properties = event.extraProperties();
-        if (!properties.isEmpty() && !d->insertEventProperties(event.id(), properties))
-            return false;
+    if (event.modifiedProperties().contains(Event::ExtraProperties)
+        && !d->updateEventProperties(event.id(), event.extraProperties())) {
+        return false;
     }
 
-    if (event.modifiedProperties().contains(Event::MessageParts)) {
-        QList<MessagePart> parts = event.messageParts();
-        QByteArray idList;
-        foreach (const MessagePart &part, parts) {
-            if (part.id() >= 0) {
-                if (!idList.isEmpty())
-                    idList.append(',');
-                idList.append(QString::number(part.id()));
-            }
-        }
-
-        // Parts with no associated event are cleaned up asynchronously
-        QByteArray q = "UPDATE MessageParts SET eventId=NULL WHERE eventId=:eventId AND id NOT IN (" + idList + ")";
-        query = CommHistoryDatabase::prepare(q, d->connection());
-        query.bindValue(":eventId", event.id());
-        if (!query.exec()) {
-            qCWarning(lcCommHistory) << "Failed to execute query";
-            qCWarning(lcCommHistory) << query.lastError();
-            qCWarning(lcCommHistory) << query.lastQuery();
-            return false;
-        }
-        query.finish();
-
-        if (!event.messageParts().isEmpty() && !d->insertMessageParts(event))
-            return false;
-    }
+    if (event.modifiedProperties().contains(Event::MessageParts) && !d->updateMessageParts(event))
+        return false;
 
     return savepoint.release();
 }
@@ -905,6 +1124,42 @@ bool DatabaseIO::moveEvent(Event &event, int groupId)
     return true;
 }
 
+// Groups that only have archived events are not empty
+static const char *emptyGroupsDeletion =
+    "DELETE FROM Groups WHERE (SELECT COUNT(id) FROM Events WHERE groupId=Groups.id) = 0 "
+    "AND id NOT IN (SELECT groupId FROM ArchivedGroups)";
+
+// Drops the archive pointers of groups whose archived events are gone
+static const char *archivedGroupsCleanup =
+    "DELETE FROM ArchivedGroups WHERE NOT EXISTS "
+    "(SELECT 1 FROM archive.Events WHERE archive.Events.groupId = ArchivedGroups.groupId)";
+
+// Ids bound to one statement at most; older SQLite builds allow 999 variables
+static const int maxBoundIds = 500;
+
+static inline QByteArray placeholderList(int count)
+{
+    QByteArray re;
+    re.reserve(count * 2);
+    for (int i = 0; i < count; i++) {
+        if (i)
+            re += ',';
+        re += '?';
+    }
+    return re;
+}
+
+static inline QByteArray joinNumberList(const QList<int> &list)
+{
+    QByteArray re;
+    foreach (int i, list) {
+        if (!re.isEmpty())
+            re += ',';
+        re += QByteArray::number(i);
+    }
+    return re;
+}
+
 bool DatabaseIO::deleteEvent(Event &event, QThread *)
 {
     static const char *q = "DELETE FROM Events WHERE id=:id";
@@ -918,6 +1173,78 @@ bool DatabaseIO::deleteEvent(Event &event, QThread *)
         return false;
     }
 
+    // Ids are never reused, so the event is in one database or the other
+    if (query.numRowsAffected() == 0)
+        return d->deleteArchivedEvents("id = " + QByteArray::number(event.id()));
+
+    return true;
+}
+
+bool DatabaseIO::deleteEvents(const QList<int> &eventIds, QList<int> *updatedGroupIds,
+                              QList<int> *deletedGroupIds)
+{
+    if (eventIds.isEmpty())
+        return true;
+
+    const QByteArray idList = joinNumberList(eventIds);
+
+    // Collect affected groups before the events disappear
+    QList<int> groupIds;
+    QByteArray q = "SELECT DISTINCT groupId FROM Events WHERE id IN (" + idList + ") AND groupId IS NOT NULL";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+    while (query.next())
+        groupIds.append(query.value(0).toInt());
+    query.finish();
+
+    q = "DELETE FROM Events WHERE id IN (" + idList + ")";
+    query = CommHistoryDatabase::prepare(q, d->connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    if (query.numRowsAffected() < eventIds.size() && !d->deleteArchivedEvents("id IN (" + idList + ")"))
+        return false;
+
+    if (groupIds.isEmpty())
+        return true;
+
+    // Recompute the affected groups once, removing the ones left empty
+    QList<int> emptyGroupIds;
+    q = "SELECT id FROM Groups WHERE id IN (" + joinNumberList(groupIds) + ") "
+        "AND NOT EXISTS (SELECT 1 FROM Events WHERE groupId=Groups.id) "
+        "AND NOT EXISTS (SELECT 1 FROM ArchivedGroups WHERE groupId=Groups.id)";
+    query = CommHistoryDatabase::prepare(q, d->connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+    while (query.next())
+        emptyGroupIds.append(query.value(0).toInt());
+    query.finish();
+
+    if (!emptyGroupIds.isEmpty() && !deleteGroups(emptyGroupIds))
+        return false;
+
+    if (updatedGroupIds) {
+        foreach (int groupId, groupIds) {
+            if (!emptyGroupIds.contains(groupId))
+                updatedGroupIds->append(groupId);
+        }
+    }
+    if (deletedGroupIds)
+        deletedGroupIds->append(emptyGroupIds);
+
     return true;
 }
 
@@ -1022,7 +1349,7 @@ static const char *baseGroupQuery =
 bool DatabaseIO::getGroup(int id, Group &group)
 {
     QByteArray q = baseGroupQuery;
-    q += "\n WHERE Groups.id = :groupId GROUP BY Groups.id LIMIT 1";
+    q += "\n WHERE Groups.id = :groupId AND Groups.isDeleted = 0 GROUP BY Groups.id LIMIT 1";
 
     QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
     query.bindValue(":groupId", id);
@@ -1047,18 +1374,13 @@ bool DatabaseIO::getGroup(int id, Group &group)
 
 bool DatabaseIO::getGroups(const QString &localUid, const QString &remoteUid, QList<Group> &result, const QString &queryOrder)
 {
+    // Groups waiting for background deletion are hidden
     QByteArray q = baseGroupQuery;
-    if (!localUid.isEmpty() || !remoteUid.isEmpty()) {
-        q += " WHERE ";
-        if (!localUid.isEmpty()) {
-            q += "Groups.localUid = :localUid ";
-            if (!remoteUid.isEmpty())
-                q += "AND ";
-        }
-
-        if (!remoteUid.isEmpty())
-            q += "Groups.remoteUids = :remoteUid ";
-    }
+    q += " WHERE Groups.isDeleted = 0 ";
+    if (!localUid.isEmpty())
+        q += "AND Groups.localUid = :localUid ";
+    if (!remoteUid.isEmpty())
+        q += "AND Groups.remoteUids = :remoteUid ";
     q += "GROUP BY Groups.id " + queryOrder;
 
     QSqlQuery query = CommHistoryDatabase::prepare(q.data(), d->connection());
@@ -1105,23 +1427,26 @@ bool DatabaseIO::deleteGroup(int groupId, QThread *backgroundThread)
     return deleteGroups(QList<int>() << groupId, backgroundThread);
 }
 
-static inline QByteArray joinNumberList(const QList<int> &list)
-{
-    QByteArray re;
-    foreach (int i, list) {
-        if (!re.isEmpty())
-            re += ',';
-        re += QByteArray::number(i);
-    }
-    return re;
-}
-
 bool DatabaseIO::deleteGroups(QList<int> groupIds, QThread *backgroundThread)
 {
-    Q_UNUSED(backgroundThread);
+    if (groupIds.isEmpty())
+        return true;
+
+    if (backgroundThread) {
+        // Hide the groups now and leave the events to the worker; deleting
+        // a large group in one statement would block every other writer
+        if (!d->hideGroups(groupIds))
+            return false;
 
-    // Events are deleted via SQL foreign keys
-    QByteArray q = "DELETE FROM Groups WHERE id IN (" + joinNumberList(groupIds) + ")";
+        DeletionWorker *worker = d->deletionWorker(backgroundThread);
+        QMetaObject::invokeMethod(worker, "deleteGroups", Qt::QueuedConnection,
+                                  Q_ARG(QList<int>, groupIds));
+        return true;
+    }
+
+    // Events are deleted via SQL foreign keys, archived events explicitly
+    const QByteArray idList = joinNumberList(groupIds);
+    QByteArray q = "DELETE FROM Groups WHERE id IN (" + idList + ")";
     QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
 
     if (!query.exec()) {
@@ -1131,7 +1456,7 @@ bool DatabaseIO::deleteGroups(QList<int> groupIds, QThread *backgroundThread)
         return false;
     }
 
-    return true;
+    return d->deleteArchivedEvents("groupId IN (" + idList + ")");
 }
 
 bool DatabaseIO::totalEventsInGroup(int groupId, int &totalEvents)
@@ -1173,20 +1498,89 @@ bool DatabaseIO::markAsReadGroup(int groupId)
 
 bool DatabaseIO::markAsRead(const QList<int> &eventIds)
 {
-    QByteArray q = "UPDATE Events SET isRead=1 WHERE id IN (";
-    q += joinNumberList(eventIds) + ") AND isRead=0";
+    for (int offset = 0; offset < eventIds.size(); offset += maxBoundIds) {
+        const QList<int> ids = eventIds.mid(offset, maxBoundIds);
+        const QByteArray q = "UPDATE Events SET isRead=1 WHERE id IN (" + placeholderList(ids.size()) + ") AND isRead=0";
 
-    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
-    if (!query.exec()) {
-        qCWarning(lcCommHistory) << "Failed to execute query";
-        qCWarning(lcCommHistory) << query.lastError();
-        qCWarning(lcCommHistory) << query.lastQuery();
-        return false;
+        QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+        foreach (int id, ids)
+            query.addBindValue(id);
+
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            return false;
+        }
     }
 
     return true;
 }
 
+DatabaseIO::ReadFilter::ReadFilter()
+    : eventType(Event::UnknownType)
+{
+}
+
+// Binds the values for the condition built in markAsRead(), in order
+static void bindReadFilter(QSqlQuery &query, const DatabaseIO::ReadFilter &filter, const QList<int> &groupIds)
+{
+    foreach (int groupId, groupIds)
+        query.addBindValue(groupId);
+    if (filter.eventType != Event::UnknownType)
+        query.addBindValue(filter.eventType);
+    if (!filter.localUid.isEmpty())
+        query.addBindValue(filter.localUid);
+    if (filter.before.isValid())
+        query.addBindValue(filter.before.toTime_t());
+}
+
+bool DatabaseIO::markAsRead(const ReadFilter &filter, QHash<int, int> *unreadDeltas)
+{
+    int offset = 0;
+    do {
+        const QList<int> groupIds = filter.groupIds.mid(offset, maxBoundIds);
+        offset += maxBoundIds;
+
+        QByteArray condition = "isRead=0";
+        if (!groupIds.isEmpty())
+            condition += " AND groupId IN (" + placeholderList(groupIds.size()) + ")";
+        if (filter.eventType != Event::UnknownType)
+            condition += " AND type=?";
+        if (!filter.localUid.isEmpty())
+            condition += " AND localUid=?";
+        if (filter.before.isValid())
+            condition += " AND endTime<?";
+
+        if (unreadDeltas) {
+            const QByteArray q = "SELECT groupId, COUNT(*) FROM Events WHERE " + condition
+                                 + " AND groupId IS NOT NULL GROUP BY groupId";
+            QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+            bindReadFilter(query, filter, groupIds);
+            if (!query.exec()) {
+                qCWarning(lcCommHistory) << "Failed to execute query";
+                qCWarning(lcCommHistory) << query.lastError();
+                qCWarning(lcCommHistory) << query.lastQuery();
+                return false;
+            }
+            while (query.next())
+                (*unreadDeltas)[query.value(0).toInt()] += query.value(1).toInt();
+        }
+
+        QSqlQuery query = CommHistoryDatabase::prepare("UPDATE Events SET isRead=1 WHERE " + condition,
+                                                       d->connection());
+        bindReadFilter(query, filter, groupIds);
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            return false;
+        }
+    } while (offset < filter.groupIds.size());
+
+    return true;
+}
+
 bool DatabaseIO::markAsReadAll(Event::EventType eventType)
 {
     static const char *q = "UPDATE Events SET isRead=1 WHERE type=:eventType AND isRead=0";
@@ -1203,8 +1597,32 @@ bool DatabaseIO::markAsReadAll(Event::EventType eventType)
     return true;
 }
 
-bool DatabaseIO::deleteAllEvents(Event::EventType eventType)
+bool DatabaseIO::deleteAllEvents(Event::EventType eventType, QThread *backgroundThread)
 {
+    if (backgroundThread) {
+        // Events added after this call are left alone
+        QSqlQuery query = CommHistoryDatabase::prepare("SELECT MAX(id) FROM Events", d->connection());
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            return false;
+        }
+        const int lastEventId = query.next() ? query.value(0).toInt() : 0;
+        query.finish();
+
+        if (eventType == Event::UnknownType && !d->hideGroups(QList<int>()))
+            return false;
+        // Calls have no group to hide, CallModel skips them by id instead
+        if (eventType == Event::UnknownType || eventType == Event::CallEvent)
+            d->m_hiddenCallsLastId.storeRelease(lastEventId);
+
+        DeletionWorker *worker = d->deletionWorker(backgroundThread);
+        QMetaObject::invokeMethod(worker, "deleteAllEvents", Qt::QueuedConnection,
+                                  Q_ARG(int, eventType), Q_ARG(int, lastEventId));
+        return true;
+    }
+
     QByteArray q = "DELETE FROM Events ";
     if (eventType != Event::UnknownType)
         q += "WHERE type=:eventType ";
@@ -1220,13 +1638,16 @@ bool DatabaseIO::deleteAllEvents(Event::EventType eventType)
         return false;
     }
 
+    if (!d->deleteArchivedEvents(eventType != Event::UnknownType
+                                 ? "type = " + QByteArray::number(eventType) : QByteArray("1")))
+        return false;
+
     return d->deleteEmptyGroups();
 }
 
 bool DatabaseIOPrivate::deleteEmptyGroups()
 {
-    static const char *q = "DELETE FROM Groups WHERE (SELECT COUNT(id) FROM Events WHERE groupId=Groups.id) = 0";
-    QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
+    QSqlQuery query = CommHistoryDatabase::prepare(emptyGroupsDeletion, connection());
     if (!query.exec()) {
         qCWarning(lcCommHistory) << "Failed to execute query";
         qCWarning(lcCommHistory) << query.lastError();
@@ -1240,6 +1661,433 @@ bool DatabaseIOPrivate::deleteEmptyGroups()
     return true;
 }
 
+bool DatabaseIOPrivate::deleteArchivedEvents(const QByteArray &condition)
+{
+    if (!CommHistoryDatabase::hasArchive(connection()))
+        return true;
+
+    QSqlQuery query = CommHistoryDatabase::prepare("DELETE FROM archive.Events WHERE " + condition, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    if (query.numRowsAffected() == 0)
+        return true;
+    query.finish();
+
+    query = CommHistoryDatabase::prepare(archivedGroupsCleanup, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return true;
+}
+
+bool DatabaseIOPrivate::hideGroups(const QList<int> &groupIds)
+{
+    // An empty list hides all groups
+    QByteArray q = "UPDATE Groups SET isDeleted=1 WHERE isDeleted=0";
+    if (!groupIds.isEmpty())
+        q += " AND id IN (" + joinNumberList(groupIds) + ")";
+
+    QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return true;
+}
+
+int DatabaseIOPrivate::hiddenCallsLastId() const
+{
+    return m_hiddenCallsLastId.loadAcquire();
+}
+
+void DatabaseIOPrivate::allEventsDeleted(int lastEventId)
+{
+    // A later deleteAllEvents() may have hidden more calls already
+    m_hiddenCallsLastId.testAndSetOrdered(lastEventId, 0);
+}
+
+DeletionWorker *DatabaseIOPrivate::deletionWorker(QThread *thread)
+{
+    if (m_deletionWorker && m_deletionWorker->thread() == thread)
+        return m_deletionWorker;
+
+    qRegisterMetaType<QList<int> >();
+
+    DeletionWorker *worker = new DeletionWorker;
+    worker->moveToThread(thread);
+    connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(worker, SIGNAL(progress(QList<int>,int,int)),
+            q, SIGNAL(deletionProgress(QList<int>,int,int)), Qt::QueuedConnection);
+    // Before deletionFinished(), so that calls are shown again by then
+    connect(worker, SIGNAL(allEventsDeleted(int)),
+            this, SLOT(allEventsDeleted(int)), Qt::QueuedConnection);
+    connect(worker, SIGNAL(finished(QList<int>,bool)),
+            q, SIGNAL(deletionFinished(QList<int>,bool)), Qt::QueuedConnection);
+
+    if (!m_deletionWorker) {
+        // Pick up groups left hidden by an interrupted deletion
+        QSqlQuery query = CommHistoryDatabase::prepare("SELECT id FROM Groups WHERE isDeleted=1", connection());
+        if (query.exec()) {
+            QList<int> pending;
+            while (query.next())
+                pending.append(query.value(0).toInt());
+            if (!pending.isEmpty()) {
+                QMetaObject::invokeMethod(worker, "deleteGroups", Qt::QueuedConnection,
+                                          Q_ARG(QList<int>, pending));
+            }
+        } else {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+        }
+    }
+
+    m_deletionWorker = worker;
+    return worker;
+}
+
+// Events deleted per transaction by DeletionWorker, and the pause between
+// transactions that lets other writers in
+static const int deletionChunkSize = 500;
+static const int deletionChunkDelay = 20;
+
+DeletionWorker::DeletionWorker()
+{
+}
+
+DeletionWorker::~DeletionWorker()
+{
+    if (m_connection.isValid()) {
+        const QString name = m_connection.connectionName();
+        m_connection.close();
+        m_connection = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+QSqlDatabase &DeletionWorker::connection()
+{
+    // Each worker has a connection of its own, one per thread
+    if (!m_connection.isValid()) {
+        m_connection = CommHistoryDatabase::open(QStringLiteral("commhistory-deletion-%1")
+                                                 .arg(quintptr(this), 0, 16));
+    }
+
+    return m_connection;
+}
+
+bool DeletionWorker::execute(const QByteArray &statement)
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(statement, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return true;
+}
+
+bool DeletionWorker::deleteInChunks(const QByteArray &condition, const QList<int> &groupIds)
+{
+    // Archived events go the same way, after the live ones
+    QList<QByteArray> tables;
+    tables << "Events";
+    if (CommHistoryDatabase::hasArchive(connection()))
+        tables << "archive.Events";
+
+    int total = 0;
+    foreach (const QByteArray &table, tables) {
+        QSqlQuery query = CommHistoryDatabase::prepare("SELECT COUNT(id) FROM " + table + " WHERE " + condition, connection());
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            return false;
+        }
+        total += query.next() ? query.value(0).toInt() : 0;
+    }
+
+    int deleted = 0;
+    foreach (const QByteArray &table, tables) {
+        const QByteArray q = "DELETE FROM " + table + " WHERE id IN (SELECT id FROM " + table + " WHERE "
+                             + condition + " LIMIT " + QByteArray::number(deletionChunkSize) + ")";
+
+        forever {
+            if (!connection().transaction()) {
+                qCWarning(lcCommHistory) << "Failed to begin transaction" << connection().lastError();
+                return false;
+            }
+
+            QSqlQuery deleteQuery = CommHistoryDatabase::prepare(q, connection());
+            if (!deleteQuery.exec()) {
+                qCWarning(lcCommHistory) << "Failed to execute query";
+                qCWarning(lcCommHistory) << deleteQuery.lastError();
+                qCWarning(lcCommHistory) << deleteQuery.lastQuery();
+                connection().rollback();
+                return false;
+            }
+            const int affected = deleteQuery.numRowsAffected();
+            deleteQuery.finish();
+
+            if (!connection().commit()) {
+                qCWarning(lcCommHistory) << "Failed to commit transaction" << connection().lastError();
+                connection().rollback();
+                return false;
+            }
+
+            if (affected <= 0)
+                break;
+
+            deleted += affected;
+            emit progress(groupIds, deleted, qMax(deleted, total));
+
+            if (affected < deletionChunkSize)
+                break;
+
+            QThread::msleep(deletionChunkDelay);
+        }
+    }
+
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << "Deleted" << deleted << "events";
+    return true;
+}
+
+void DeletionWorker::deleteGroups(const QList<int> &groupIds)
+{
+    const QByteArray idList = joinNumberList(groupIds);
+
+    // The groups are removed last, so an interrupted deletion resumes
+    // from the hidden groups next time
+    bool ok = deleteInChunks("groupId IN (" + idList + ")", groupIds)
+              && execute("DELETE FROM Groups WHERE id IN (" + idList + ")");
+
+    emit finished(groupIds, ok);
+}
+
+void DeletionWorker::deleteAllEvents(int eventType, int lastEventId)
+{
+    const QByteArray lastId = QByteArray::number(lastEventId);
+    QByteArray condition = "id <= " + lastId;
+    if (eventType != Event::UnknownType)
+        condition += " AND type = " + QByteArray::number(eventType);
+
+    bool ok = deleteInChunks(condition, QList<int>());
+    if (ok && CommHistoryDatabase::hasArchive(connection()))
+        ok = execute(archivedGroupsCleanup);
+    if (ok) {
+        // Removing a group cascades to its events, so groups that received
+        // events after the deletion started are shown again instead
+        if (eventType == Event::UnknownType) {
+            ok = execute("UPDATE Groups SET isDeleted=0 WHERE isDeleted=1 "
+                         "AND id IN (SELECT groupId FROM Events WHERE id > " + lastId + ")")
+                 && execute("DELETE FROM Groups WHERE isDeleted=1");
+        } else {
+            ok = execute(emptyGroupsDeletion);
+        }
+    }
+
+    emit allEventsDeleted(lastEventId);
+    emit finished(QList<int>(), ok);
+}
+
+// Journal rows with this item type mark the point up to which it was pruned
+static const int changeLogPruneMarker = -1;
+
+// Idle periods in a row in which a checkpoint is retried while readers
+// keep it from completing
+static const int maxCheckpointRetries = 3;
+
+CheckpointScheduler::CheckpointScheduler(QObject *parent)
+    : QObject(parent), m_timer(this), m_retries(0)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(CommHistoryDatabase::tuning().checkpointIdleDelay);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(checkpoint()));
+
+    // Any change signal means the WAL grew; the slot takes no arguments
+    // so that it matches all of them
+    const char *signalNames[] = { "eventsAdded", "eventsUpdated", "eventDeleted", "eventsDeleted",
+                                  "eventsImported", "groupsAdded", "groupsUpdated", "groupsUpdatedFull", "groupsDeleted" };
+    for (unsigned i = 0; i < sizeof(signalNames) / sizeof(*signalNames); i++) {
+        QDBusConnection::sessionBus().connect(QString(), COMM_HISTORY_OBJECT_PATH, COMM_HISTORY_INTERFACE,
+                                              QLatin1String(signalNames[i]), this, SLOT(noteActivity()));
+    }
+
+    // Changes from before this process started
+    if (CommHistoryDatabase::walSize() > 0)
+        m_timer.start();
+}
+
+void CheckpointScheduler::noteActivity()
+{
+    m_timer.start();
+}
+
+void CheckpointScheduler::pruneChangeLog()
+{
+    const qint64 size = CommHistoryDatabase::tuning().changeLogSize;
+    if (size <= 0)
+        return;
+
+    static const char *q = "SELECT IFNULL(MIN(seq), 0), IFNULL(MAX(seq), 0) FROM ChangeLog WHERE itemType != :marker";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, DatabaseIOPrivate::instance()->connection());
+    query.bindValue(":marker", changeLogPruneMarker);
+
+    if (!query.exec() || !query.next()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return;
+    }
+
+    // Pruned down to changeLogSize sequences once it has grown to twice
+    // that, so that an idle period does not add a marker every time.
+    // Models further behind than that reload when they catch up.
+    const qint64 oldest = query.value(0).toLongLong();
+    const qint64 latest = query.value(1).toLongLong();
+    query.finish();
+    if (latest - oldest < 2 * size)
+        return;
+
+    qCDebug(lcCommHistory) << "Pruning change log before sequence" << latest - size + 1;
+    DatabaseIO::instance()->pruneChanges(latest - size + 1);
+}
+
+void CheckpointScheduler::checkpoint()
+{
+    // Another connection wrote since the last signal was seen
+    const QDateTime modified = QFileInfo(CommHistoryDatabase::walFile()).lastModified();
+    if (modified.isValid() && modified.msecsTo(QDateTime::currentDateTime()) < m_timer.interval()) {
+        m_timer.start();
+        return;
+    }
+
+    pruneChangeLog();
+
+    const qint64 size = CommHistoryDatabase::walSize();
+    if (size <= 0)
+        return;
+
+    // A passive checkpoint never waits. Truncating waits for readers, so
+    // it is only done once the passive one has copied every frame.
+    QSqlDatabase &database = DatabaseIOPrivate::instance()->connection();
+    bool complete = false;
+    if (!CommHistoryDatabase::checkpoint(database, false, &complete))
+        return;
+
+    if (complete) {
+        m_retries = 0;
+        if (size >= CommHistoryDatabase::tuning().truncateWalSize)
+            CommHistoryDatabase::checkpoint(database, true);
+    } else if (++m_retries < maxCheckpointRetries) {
+        // Readers kept some frames in the WAL
+        m_timer.start();
+    } else {
+        m_retries = 0;
+    }
+}
+
+
+bool DatabaseIO::currentChangeSequence(qint64 &sequence)
+{
+    static const char *q = "SELECT IFNULL(MAX(seq), 0) FROM ChangeLog";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+
+    if (!query.exec() || !query.next()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    sequence = query.value(0).toLongLong();
+    return true;
+}
+
+bool DatabaseIO::getChangesSince(qint64 sequence, QList<Change> &changes, bool &resetRequired)
+{
+    static const char *q = "SELECT seq, itemType, itemId, groupId, op FROM ChangeLog WHERE seq > :seq ORDER BY seq";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+    query.bindValue(":seq", sequence);
+
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    resetRequired = false;
+    while (query.next()) {
+        const int itemType = query.value(1).toInt();
+        if (itemType == changeLogPruneMarker) {
+            // itemId holds the first sequence that survived the pruning
+            if (query.value(2).toLongLong() > sequence + 1)
+                resetRequired = true;
+            continue;
+        }
+
+        Change change;
+        change.sequence = query.value(0).toLongLong();
+        change.itemType = static_cast<ChangeItemType>(itemType);
+        change.itemId = query.value(2).toInt();
+        change.groupId = query.value(3).isNull() ? -1 : query.value(3).toInt();
+        change.operation = static_cast<ChangeOperation>(query.value(4).toInt());
+        changes.append(change);
+    }
+
+    return true;
+}
+
+bool DatabaseIO::pruneChanges(qint64 sequence)
+{
+    AutoSavepoint savepoint(d->connection());
+    if (!savepoint.begin())
+        return false;
+
+    static const char *q = "DELETE FROM ChangeLog WHERE seq < :seq";
+    QSqlQuery query = CommHistoryDatabase::prepare(q, d->connection());
+    query.bindValue(":seq", sequence);
+
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    if (query.numRowsAffected() > 0) {
+        static const char *markerQuery = "INSERT INTO ChangeLog (itemType, itemId, op) VALUES (:itemType, :seq, :op)";
+        QSqlQuery marker = CommHistoryDatabase::prepare(markerQuery, d->connection());
+        marker.bindValue(":itemType", changeLogPruneMarker);
+        marker.bindValue(":seq", sequence);
+        marker.bindValue(":op", ItemDeleted);
+
+        if (!marker.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << marker.lastError();
+            qCWarning(lcCommHistory) << marker.lastQuery();
+            return false;
+        }
+    }
+
+    return savepoint.release();
+}
+
 bool DatabaseIO::transaction()
 {
     bool re = d->connection().transaction();
@@ -1257,6 +2105,9 @@ bool DatabaseIO::commit()
         qCWarning(lcCommHistory) << "Failed to commit transaction";
         qCWarning(lcCommHistory) << d->connection().lastError();
         rollback();
+    } else if (CheckpointScheduler *scheduler = d->m_checkpointScheduler.loadAcquire()) {
+        // Queued when committing on another thread
+        QMetaObject::invokeMethod(scheduler, "noteActivity");
     }
     return re;
 }
@@ -25,6 +25,8 @@
 
 #include <QObject>
 #include <QUrl>
+#include <QDateTime>
+#include <QHash>
 
 #include "event.h"
 #include "libcommhistoryexport.h"
@@ -39,12 +41,52 @@ class Group;
  *
  * Class for handling events with the database. You can use this if you are
  * implementing your own model.
+ *
+ * The instance can be used from any thread. Each thread gets its own
+ * database connection, which is closed when the thread exits; transactions
+ * started with transaction() apply to the calling thread only.
  */
 class LIBCOMMHISTORY_EXPORT DatabaseIO : public QObject
 {
     Q_OBJECT
 
 public:
+    enum ChangeItemType {
+        EventChange = 0,
+        GroupChange = 1
+    };
+
+    enum ChangeOperation {
+        ItemAdded = 0,
+        ItemModified = 1,
+        ItemDeleted = 2
+    };
+
+    /*!
+     * Entry of the change journal. Only the latest change of each item is
+     * kept, so an item appears at most once in a list of changes.
+     */
+    struct Change {
+        ChangeItemType itemType;
+        int itemId;
+        int groupId;
+        ChangeOperation operation;
+        qint64 sequence;
+    };
+
+    /*!
+     * Selects the events for markAsRead(). An event has to match every
+     * condition that is set.
+     */
+    struct LIBCOMMHISTORY_EXPORT ReadFilter {
+        ReadFilter();
+
+        QList<int> groupIds;        // events of these groups, or of any
+        Event::EventType eventType; // Event::UnknownType for any type
+        QString localUid;           // account, or empty for any
+        QDateTime before;           // events that ended before, or invalid for any
+    };
+
     DatabaseIO();
     ~DatabaseIO();
     static DatabaseIO* instance();
@@ -156,6 +198,19 @@ public:
      */
     bool deleteEvent(Event &event, QThread *backgroundThread = 0);
 
+    /*!
+     * Delete several events at once. Groups left without events are
+     * deleted as well.
+     *
+     * \param eventIds Existing event ids
+     * \param updatedGroupIds optional result for groups that still contain events
+     * \param deletedGroupIds optional result for groups that became empty and were deleted
+     *
+     * \return true if successful, otherwise false
+     */
+    bool deleteEvents(const QList<int> &eventIds, QList<int> *updatedGroupIds = 0,
+                      QList<int> *deletedGroupIds = 0);
+
     /*!
      * Query a single group by id.
      *
@@ -188,7 +243,7 @@ public:
      * Delete a group
      *
      * \param groupId Existing group id
-     * \param backgroundThread optional thread (to delete mms attachments)
+     * \param backgroundThread optional thread, see deleteGroups()
      *
      * \return true if successful, otherwise false
      */
@@ -197,8 +252,15 @@ public:
     /*!
      * Delete groups
      *
+     * Without \a backgroundThread the groups and their events are deleted
+     * right away. Otherwise the groups are only hidden from queries and
+     * their events are deleted in chunks of bounded size on that thread,
+     * each chunk in its own transaction. deletionProgress() and
+     * deletionFinished() report on the background work. Do not use a
+     * background thread inside a transaction.
+     *
      * \param groupIds Existing group ids
-     * \param backgroundThread optional thread (to delete mms attachments)
+     * \param backgroundThread optional thread to delete the events on
      *
      * \return true if successful, otherwise false
      */
@@ -232,6 +294,18 @@ public:
      */
     bool markAsRead(const QList<int> &eventIds);
 
+    /*!
+     * Mark the unread events selected by \a filter as read with one
+     * statement. Group lists too long to bind at once are split.
+     *
+     * \param filter events to mark
+     * \param unreadDeltas if set, receives the number of events marked as
+     *        read in each affected group
+     *
+     * \return true if successful, otherwise false
+     */
+    bool markAsRead(const ReadFilter &filter, QHash<int, int> *unreadDeltas = 0);
+
     /*!
      * Mark all messages of a certain type as read
      *
@@ -244,12 +318,49 @@ public:
     /*!
      * Delete events of a certain type
      *
-     * If Event::UnknownType is passed, all events are deleted.
+     * If Event::UnknownType is passed, all events are deleted. With
+     * \a backgroundThread the events are deleted in chunks on that thread
+     * as in deleteGroups(); when deleting everything, all groups are
+     * hidden right away. Events added after the call are kept, and so are
+     * the groups they were added to.
      *
      * \param eventType
+     * \param backgroundThread optional thread to delete the events on
+     * \return true if successful, otherwise false
+     */
+    bool deleteAllEvents(Event::EventType eventType, QThread *backgroundThread = 0);
+
+    /*!
+     * Query the latest change sequence number. Store it before reading
+     * data and pass it to getChangesSince() later to catch up.
+     *
+     * \param sequence result
+     * \return true if successful, otherwise false
+     */
+    bool currentChangeSequence(qint64 &sequence);
+
+    /*!
+     * Query changes to events and groups made after \a sequence, ordered
+     * by sequence number.
+     *
+     * If the journal has been pruned past \a sequence, \a resetRequired
+     * is set and the caller must reload everything instead.
+     *
+     * \param sequence last sequence number seen by the caller
+     * \param changes result
+     * \param resetRequired set if changes since \a sequence are no longer available
      * \return true if successful, otherwise false
      */
-    bool deleteAllEvents(Event::EventType eventType);
+    bool getChangesSince(qint64 sequence, QList<Change> &changes, bool &resetRequired);
+
+    /*!
+     * Remove journal entries older than \a sequence. Readers that have not
+     * caught up to \a sequence will be asked to reload.
+     *
+     * \param sequence oldest sequence number to keep
+     * \return true if successful, otherwise false
+     */
+    bool pruneChanges(qint64 sequence);
 
     /*!
      * Initate a new database transaction.
@@ -270,6 +381,18 @@ public:
      */
     bool rollback();
 
+Q_SIGNALS:
+    /*!
+     * Progress of a background deletion started by deleteGroups() or
+     * deleteAllEvents(). \a groupIds is empty for deleteAllEvents().
+     */
+    void deletionProgress(const QList<int> &groupIds, int deletedEvents, int totalEvents);
+
+    /*!
+     * Emitted when a background deletion has completed.
+     */
+    void deletionFinished(const QList<int> &groupIds, bool successful);
+
 private:
     friend class DatabaseIOPrivate;
     DatabaseIOPrivate * const d;
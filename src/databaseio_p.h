@@ -32,6 +32,9 @@
 #include <QThreadStorage>
 #include <QStringList>
 #include <QSqlDatabase>
+#include <QPointer>
+#include <QTimer>
+#include <QAtomicPointer>
 
 #include "event.h"
 
@@ -39,6 +42,9 @@ namespace CommHistory {
 
 class Group;
 class DatabaseIO;
+class DeletionWorker;
+class CheckpointScheduler;
+class ThreadConnection;
 
 /**
  * \class DatabaseIOPrivate
@@ -66,21 +72,123 @@ public:
     static void readGroupResult(QSqlQuery &query, Group &group);
 
     static QString eventQueryBase();
+    static QString archiveEventQueryBase();
     static QString limitClause(int limit, int offset);
     static QString categoryClause(int categoryMask);
 
+    // Appends the events matching \a querySuffix, a WHERE clause on Events,
+    // from the live database and the archive
     bool getEvents(const QString &querySuffix, QList<Event> &events);
+    // With \a archived, read from the archive database instead
+    bool getEventExtraProperties(Event &event, bool archived);
+    bool getMessageParts(Event &event, bool archived);
 
     bool deleteEmptyGroups();
+    bool deleteArchivedEvents(const QByteArray &condition);
+    bool hideGroups(const QList<int> &groupIds);
+    DeletionWorker *deletionWorker(QThread *thread);
+
+    // Calls up to this id are being deleted in the background and must not
+    // be read again, 0 if there are none
+    int hiddenCallsLastId() const;
 
     bool insertEventProperties(int eventId, const QVariantMap &properties);
     bool insertMessageParts(Event &event);
+    // Write only the differences to the stored properties and parts
+    bool updateEventProperties(int eventId, const QVariantMap &properties);
+    bool updateMessageParts(Event &event);
 
     QSqlQuery createQuery();
     QSqlDatabase& connection();
 
+public Q_SLOTS:
+    void allEventsDeleted(int lastEventId);
+
+public:
+    QThreadStorage<ThreadConnection *> m_connections;
+    QPointer<DeletionWorker> m_deletionWorker;
+    QAtomicInt m_hiddenCallsLastId;
+    // Created by the first connection opened on the owning thread
+    QAtomicPointer<CheckpointScheduler> m_checkpointScheduler;
+};
+
+/**
+ * \class ThreadConnection
+ *
+ * Database connection of one thread. QSqlDatabase connections must only
+ * be used by the thread that opened them, so DatabaseIOPrivate opens one
+ * per thread and QThreadStorage deletes it when the thread exits.
+ */
+class ThreadConnection
+{
+public:
+    ThreadConnection(const QString &name);
+    ~ThreadConnection();
+
+    QSqlDatabase database;
+};
+
+/**
+ * \class DeletionWorker
+ *
+ * Deletes events in chunks on a background thread, using its own
+ * database connection. Each chunk is a separate transaction, so other
+ * writers only wait for one chunk at a time.
+ */
+class DeletionWorker : public QObject
+{
+    Q_OBJECT
+
 public:
-    QSqlDatabase m_pConnection;
+    DeletionWorker();
+    ~DeletionWorker();
+
+public Q_SLOTS:
+    void deleteGroups(const QList<int> &groupIds);
+    void deleteAllEvents(int eventType, int lastEventId);
+
+Q_SIGNALS:
+    void progress(const QList<int> &groupIds, int deletedEvents, int totalEvents);
+    void allEventsDeleted(int lastEventId);
+    void finished(const QList<int> &groupIds, bool successful);
+
+private:
+    bool deleteInChunks(const QByteArray &condition, const QList<int> &groupIds);
+    bool execute(const QByteArray &statement);
+    QSqlDatabase &connection();
+
+    QSqlDatabase m_connection;
+};
+
+/**
+ * \class CheckpointScheduler
+ *
+ * Checkpoints the write-ahead log once the database has been idle for
+ * CommHistoryDatabase::Tuning::checkpointIdleDelay, so that the automatic
+ * checkpoint rarely lands inside a write. Writes are noticed through
+ * DatabaseIO::commit() and the change signals of all processes.
+ *
+ * The change journal is pruned at the same time, keeping the last
+ * CommHistoryDatabase::Tuning::changeLogSize sequences.
+ */
+class CheckpointScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    CheckpointScheduler(QObject *parent = 0);
+
+public Q_SLOTS:
+    void noteActivity();
+
+private Q_SLOTS:
+    void checkpoint();
+
+private:
+    void pruneChangeLog();
+
+    QTimer m_timer;
+    int m_retries;
 };
 
 } // namespace
@@ -0,0 +1,980 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "databasemigrator.h"
+#include "databasemigrator_p.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEvent>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#include <cstdio>
+
+#include "commhistorydatabase.h"
+#include "commhistorydatabasepath.h"
+#include "debug_p.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const char *migratedSuffix = ".utf8";
+
+QString databasePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::databaseFile());
+}
+
+QString archivePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::archiveFile());
+}
+
+QString migratedPath(const QString &path)
+{
+    return path + QLatin1String(migratedSuffix);
+}
+
+bool execute(QSqlDatabase &database, const QString &statement)
+{
+    QSqlQuery query(database);
+    if (!query.exec(statement)) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << statement;
+        return false;
+    }
+
+    return true;
+}
+
+// Plain connection, without the setup and schema of CommHistoryDatabase::open()
+QSqlDatabase openFile(const QString &name, const QString &fileName)
+{
+    QSqlDatabase database = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), name);
+    database.setDatabaseName(fileName);
+    if (!database.open()) {
+        qCWarning(lcCommHistory) << "Failed to open" << fileName;
+        qCWarning(lcCommHistory) << database.lastError();
+    }
+    return database;
+}
+
+void closeFile(QSqlDatabase &database)
+{
+    if (!database.isValid())
+        return;
+
+    const QString name = database.connectionName();
+    database.close();
+    database = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
+}
+
+QString connectionName(const char *role, const void *owner)
+{
+    return QStringLiteral("commhistory-migration-%1-%2").arg(QLatin1String(role)).arg(quintptr(owner), 0, 16);
+}
+
+bool isUtf16(QSqlDatabase &database)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QStringLiteral("PRAGMA encoding")) || !query.next())
+        return false;
+    return query.value(0).toString().startsWith(QLatin1String("UTF-16"));
+}
+
+QString joinIds(const QList<qint64> &ids)
+{
+    QStringList re;
+    foreach (qint64 id, ids)
+        re.append(QString::number(id));
+    return re.join(QLatin1Char(','));
+}
+
+QList<qint64> selectIds(QSqlDatabase &database, const QString &statement, bool *ok)
+{
+    QList<qint64> ids;
+    QSqlQuery query(database);
+    query.setForwardOnly(true);
+    *ok = query.exec(statement);
+    if (!*ok) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << statement;
+        return ids;
+    }
+
+    while (query.next())
+        ids.append(query.value(0).toLongLong());
+    return ids;
+}
+
+QStringList tableColumns(QSqlDatabase &database, const QString &table)
+{
+    QStringList columns;
+    QSqlQuery query(database);
+    if (query.exec(QStringLiteral("PRAGMA table_info(%1)").arg(table))) {
+        while (query.next())
+            columns.append(QLatin1Char('"') + query.value(1).toString() + QLatin1Char('"'));
+    }
+    return columns;
+}
+
+/* Copies rows of \a table matching \a condition with a rowid above
+ * \a lastRowId, at most \a limit of them if limit is positive. Values go
+ * through QVariant, which converts the text to the encoding of the target.
+ *
+ * Returns the number of rows copied, or -1 on failure. */
+int copyRows(QSqlDatabase &source, QSqlDatabase &target, const QString &table,
+             const QString &condition, qint64 &lastRowId, int limit = 0)
+{
+    const QStringList columns = tableColumns(source, table);
+    if (columns.isEmpty())
+        return -1;
+
+    QString q = QStringLiteral("SELECT rowid, ") + columns.join(QLatin1String(", "))
+            + QStringLiteral(" FROM ") + table + QStringLiteral(" WHERE rowid > :rowid");
+    if (!condition.isEmpty())
+        q += QStringLiteral(" AND (") + condition + QLatin1Char(')');
+    q += QStringLiteral(" ORDER BY rowid");
+    if (limit > 0)
+        q += QStringLiteral(" LIMIT ") + QString::number(limit);
+
+    QSqlQuery select(source);
+    select.setForwardOnly(true);
+    select.prepare(q);
+    select.bindValue(QStringLiteral(":rowid"), lastRowId);
+    if (!select.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << select.lastError();
+        qCWarning(lcCommHistory) << select.lastQuery();
+        return -1;
+    }
+
+    QStringList placeholders;
+    for (int i = 0; i < columns.size(); i++)
+        placeholders.append(QStringLiteral("?"));
+
+    QSqlQuery insert(target);
+    if (!insert.prepare(QStringLiteral("INSERT OR REPLACE INTO ") + table + QStringLiteral(" (")
+                        + columns.join(QLatin1String(", ")) + QStringLiteral(") VALUES (")
+                        + placeholders.join(QLatin1String(", ")) + QLatin1Char(')'))) {
+        qCWarning(lcCommHistory) << "Failed to prepare query";
+        qCWarning(lcCommHistory) << insert.lastError();
+        return -1;
+    }
+
+    int count = 0;
+    while (select.next()) {
+        lastRowId = select.value(0).toLongLong();
+        for (int i = 0; i < columns.size(); i++)
+            insert.bindValue(i, select.value(i + 1));
+
+        if (!insert.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << insert.lastError();
+            qCWarning(lcCommHistory) << insert.lastQuery();
+            return -1;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+bool copyAll(QSqlDatabase &source, QSqlDatabase &target, const QString &table, const QString &condition)
+{
+    qint64 lastRowId = -1;
+    return copyRows(source, target, table, condition, lastRowId) >= 0;
+}
+
+bool copySequences(QSqlDatabase &source, QSqlDatabase &target)
+{
+    QSqlQuery select(source);
+    if (!select.exec(QStringLiteral("SELECT name, seq FROM sqlite_sequence")))
+        return true; // no AUTOINCREMENT tables
+
+    if (!execute(target, QStringLiteral("DELETE FROM sqlite_sequence")))
+        return false;
+
+    QSqlQuery insert(target);
+    insert.prepare(QStringLiteral("INSERT INTO sqlite_sequence (name, seq) VALUES (?, ?)"));
+    while (select.next()) {
+        insert.bindValue(0, select.value(0));
+        insert.bindValue(1, select.value(1));
+        if (!insert.exec()) {
+            qCWarning(lcCommHistory) << "Failed to copy sequence" << insert.lastError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int userVersion(QSqlDatabase &database)
+{
+    QSqlQuery query(database);
+    if (!query.exec(QStringLiteral("PRAGMA user_version")) || !query.next())
+        return -1;
+    return query.value(0).toInt();
+}
+
+bool readMigrationState(QSqlDatabase &copy, qint64 &sequence)
+{
+    QSqlQuery query(copy);
+    if (!query.exec(QStringLiteral("SELECT sourceSequence FROM MigrationState")) || !query.next())
+        return false;
+    sequence = query.value(0).toLongLong();
+    return true;
+}
+
+bool replaceFile(const QString &from, const QString &to)
+{
+    // rename() replaces the target atomically
+    if (::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) != 0) {
+        qCWarning(lcCommHistory) << "Failed to rename" << from << "to" << to;
+        return false;
+    }
+    return true;
+}
+
+}
+
+namespace CommHistory {
+
+/* Builds the UTF-8 copy of one database file.
+ *
+ * Tables are created first and filled without indexes or triggers, which
+ * are created afterwards from the original statements. FTS indexes are
+ * rebuilt from their content tables. Every batch is read in its own
+ * transaction, so the copy is not a snapshot: the MigrationState table
+ * remembers the last ChangeLog sequence from before the first batch, and
+ * the changes after it are applied again when the copy is swapped in. It
+ * also marks the copy as complete. */
+class Rebuild
+{
+public:
+    QString sourcePath;
+    QSqlDatabase source;
+    QSqlDatabase target;
+    QStringList tables;
+    QStringList postStatements;
+    QStringList ftsTables;
+    int tableIndex;
+    qint64 lastRowId;
+    qint64 sequence;
+    int totalRows;
+
+    Rebuild() : tableIndex(0), lastRowId(-1), sequence(0), totalRows(0) {}
+    ~Rebuild() { close(); }
+
+    bool begin(const QString &path);
+    // Returns the number of rows copied, 0 when done, -1 on failure
+    int step(int batchSize);
+    bool finish();
+    void close();
+};
+
+}
+
+bool Rebuild::begin(const QString &path)
+{
+    sourcePath = path;
+    QFile::remove(migratedPath(path));
+
+    source = openFile(connectionName("source", this), path);
+    target = openFile(connectionName("target", this), migratedPath(path));
+    if (!source.isOpen() || !target.isOpen())
+        return false;
+
+    // The copy is discarded if anything fails, so it is not synced until
+    // it is complete
+    if (!execute(target, QStringLiteral("PRAGMA encoding = \"UTF-8\""))
+            || !execute(target, QStringLiteral("PRAGMA synchronous = OFF")))
+        return false;
+
+    // The schema, row counts and sequence are read together; the rows are
+    // copied in later transactions
+    if (!source.transaction())
+        return false;
+
+    QSqlQuery query(source);
+    query.setForwardOnly(true);
+    if (!query.exec(QStringLiteral("SELECT type, name, sql FROM sqlite_master "
+                                   "WHERE sql IS NOT NULL AND name NOT LIKE 'sqlite_%' ORDER BY rowid"))) {
+        qCWarning(lcCommHistory) << "Failed to read schema" << query.lastError();
+        return false;
+    }
+
+    QStringList virtualTables;
+    while (query.next()) {
+        const QString type = query.value(0).toString();
+        const QString name = query.value(1).toString();
+        const QString sql = query.value(2).toString();
+
+        if (type != QLatin1String("table")) {
+            postStatements.append(sql);
+            continue;
+        }
+
+        // Shadow tables are created with their virtual table
+        bool shadow = false;
+        foreach (const QString &table, virtualTables) {
+            if (name.startsWith(table + QLatin1Char('_')))
+                shadow = true;
+        }
+        if (shadow)
+            continue;
+
+        if (!execute(target, sql))
+            return false;
+
+        if (sql.startsWith(QLatin1String("CREATE VIRTUAL TABLE"), Qt::CaseInsensitive)) {
+            virtualTables.append(name);
+            if (sql.contains(QLatin1String("fts5"), Qt::CaseInsensitive))
+                ftsTables.append(name);
+        } else {
+            tables.append(name);
+        }
+    }
+    query.finish();
+
+    const int version = userVersion(source);
+    if (version < 0 || !execute(target, QStringLiteral("PRAGMA user_version = %1").arg(version)))
+        return false;
+
+    foreach (const QString &table, tables) {
+        if (query.exec(QStringLiteral("SELECT COUNT(*) FROM ") + table) && query.next())
+            totalRows += query.value(0).toInt();
+        query.finish();
+    }
+
+    if (tables.contains(QLatin1String("ChangeLog"))) {
+        if (!query.exec(QStringLiteral("SELECT IFNULL(MAX(seq), 0) FROM ChangeLog")) || !query.next())
+            return false;
+        sequence = query.value(0).toLongLong();
+        query.finish();
+    }
+
+    return source.commit();
+}
+
+int Rebuild::step(int batchSize)
+{
+    while (tableIndex < tables.size()) {
+        // A short read transaction per batch, so that the copy never keeps
+        // a checkpoint from resetting the WAL for long. Batches continue
+        // from the last rowid, which is the id of the tables that have one.
+        if (!source.transaction())
+            return -1;
+        if (!target.transaction()) {
+            source.rollback();
+            return -1;
+        }
+
+        const int count = copyRows(source, target, tables.at(tableIndex), QString(), lastRowId, batchSize);
+        source.commit();
+        if (count < 0 || !target.commit()) {
+            target.rollback();
+            return -1;
+        }
+
+        if (count < batchSize) {
+            tableIndex++;
+            lastRowId = -1;
+        }
+        if (count > 0)
+            return count;
+    }
+
+    return 0;
+}
+
+bool Rebuild::finish()
+{
+    if (!target.transaction())
+        return false;
+
+    bool ok = copySequences(source, target);
+    foreach (const QString &statement, postStatements) {
+        if (ok)
+            ok = execute(target, statement);
+    }
+    foreach (const QString &table, ftsTables) {
+        if (ok)
+            ok = execute(target, QStringLiteral("INSERT INTO %1 (%1) VALUES ('rebuild')").arg(table));
+    }
+
+    if (ok) {
+        ok = execute(target, QStringLiteral("CREATE TABLE MigrationState (sourceSequence INTEGER)"))
+          && execute(target, QStringLiteral("INSERT INTO MigrationState (sourceSequence) VALUES (%1)").arg(sequence));
+    }
+
+    if (!ok || !execute(target, QStringLiteral("PRAGMA synchronous = FULL")) || !target.commit()) {
+        target.rollback();
+        return false;
+    }
+
+    return true;
+}
+
+void Rebuild::close()
+{
+    closeFile(source);
+    closeFile(target);
+}
+
+/* The triggers of the copy maintain the search index and derived tables
+ * as rows are deleted and inserted again; foreign keys are off, so nothing
+ * cascades. The ChangeLog entries written by the triggers are replaced
+ * with the original ones at the end. */
+bool DatabaseMigratorPrivate::catchUpDatabase(QSqlDatabase &live, QSqlDatabase &copy, qint64 sequence)
+{
+    QSqlQuery query(live);
+    query.setForwardOnly(true);
+
+    // DatabaseIO::pruneChanges() leaves a marker holding the first
+    // sequence it kept
+    if (!query.exec(QStringLiteral("SELECT IFNULL(MAX(itemId), 0) FROM ChangeLog WHERE itemType = -1"))
+            || !query.next()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        return false;
+    }
+    if (query.value(0).toLongLong() > sequence + 1) {
+        qCDebug(lcCommHistory) << "Changes since the UTF-8 copy were pruned from the change log";
+        return false;
+    }
+    query.finish();
+
+    query.prepare(QStringLiteral("SELECT itemType, itemId FROM ChangeLog WHERE seq > :seq AND itemType >= 0"));
+    query.bindValue(QStringLiteral(":seq"), sequence);
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        return false;
+    }
+
+    // DatabaseIO::EventChange and DatabaseIO::GroupChange
+    QList<qint64> eventIds, groupIds;
+    while (query.next()) {
+        if (query.value(0).toInt() == 0)
+            eventIds.append(query.value(1).toLongLong());
+        else
+            groupIds.append(query.value(1).toLongLong());
+    }
+    query.finish();
+
+    qCDebug(lcCommHistory) << "Applying" << eventIds.size() << "event and" << groupIds.size()
+                           << "group changes to the migrated database";
+
+    const QString events = joinIds(eventIds);
+    const QString groups = joinIds(groupIds);
+
+    bool ok = true;
+    if (!groups.isEmpty()) {
+        ok = execute(copy, QStringLiteral("DELETE FROM Groups WHERE id IN (%1)").arg(groups))
+          && copyAll(live, copy, QStringLiteral("Groups"), QStringLiteral("id IN (%1)").arg(groups));
+    }
+    if (ok && !events.isEmpty()) {
+        ok = execute(copy, QStringLiteral("DELETE FROM EventProperties WHERE eventId IN (%1)").arg(events))
+          && execute(copy, QStringLiteral("DELETE FROM MessageParts WHERE eventId IN (%1)").arg(events))
+          && execute(copy, QStringLiteral("DELETE FROM Events WHERE id IN (%1)").arg(events))
+          && copyAll(live, copy, QStringLiteral("Events"), QStringLiteral("id IN (%1)").arg(events))
+          && copyAll(live, copy, QStringLiteral("EventProperties"), QStringLiteral("eventId IN (%1)").arg(events))
+          && copyAll(live, copy, QStringLiteral("MessageParts"), QStringLiteral("eventId IN (%1)").arg(events));
+    }
+
+    // Tables that are not journaled are small enough to copy again
+    ok = ok
+      && execute(copy, QStringLiteral("DELETE FROM MessageParts WHERE eventId IS NULL"))
+      && copyAll(live, copy, QStringLiteral("MessageParts"), QStringLiteral("eventId IS NULL"))
+      && execute(copy, QStringLiteral("DELETE FROM ArchivedGroups"))
+      && copyAll(live, copy, QStringLiteral("ArchivedGroups"), QString());
+
+    if (ok) {
+        query.exec(QStringLiteral("SELECT IFNULL(MIN(seq), 0) FROM ChangeLog"));
+        const qint64 oldest = query.next() ? query.value(0).toLongLong() : 0;
+        query.finish();
+
+        ok = execute(copy, QStringLiteral("DELETE FROM ChangeLog WHERE seq > %1 OR seq < %2").arg(sequence).arg(oldest))
+          && copyAll(live, copy, QStringLiteral("ChangeLog"), QStringLiteral("seq > %1").arg(sequence))
+          && copySequences(live, copy);
+    }
+
+    return ok;
+}
+
+/* Archived events are only ever added or deleted, so comparing the ids is
+ * enough to bring the copy of the archive up to date. */
+bool DatabaseMigratorPrivate::catchUpArchive(QSqlDatabase &live, QSqlDatabase &copy)
+{
+    bool ok = false;
+    const QSet<qint64> liveIds = selectIds(live, QStringLiteral("SELECT id FROM Events"), &ok).toSet();
+    if (!ok)
+        return false;
+    const QSet<qint64> copyIds = selectIds(copy, QStringLiteral("SELECT id FROM Events"), &ok).toSet();
+    if (!ok)
+        return false;
+
+    const QString removed = joinIds((copyIds - liveIds).toList());
+    const QString added = joinIds((liveIds - copyIds).toList());
+
+    if (!removed.isEmpty()) {
+        ok = execute(copy, QStringLiteral("DELETE FROM EventProperties WHERE eventId IN (%1)").arg(removed))
+          && execute(copy, QStringLiteral("DELETE FROM MessageParts WHERE eventId IN (%1)").arg(removed))
+          && execute(copy, QStringLiteral("DELETE FROM Events WHERE id IN (%1)").arg(removed));
+    }
+    if (ok && !added.isEmpty()) {
+        ok = copyAll(live, copy, QStringLiteral("Events"), QStringLiteral("id IN (%1)").arg(added))
+          && copyAll(live, copy, QStringLiteral("EventProperties"), QStringLiteral("eventId IN (%1)").arg(added))
+          && copyAll(live, copy, QStringLiteral("MessageParts"), QStringLiteral("eventId IN (%1)").arg(added));
+    }
+
+    return ok;
+}
+
+
+MigrationWorker::MigrationWorker()
+    : batchSize(1000),
+      successful(false),
+      copiedRows(0),
+      totalRows(0),
+      originalSize(0),
+      migratedSize(0)
+{
+}
+
+MigrationWorker::~MigrationWorker()
+{
+    qDeleteAll(rebuilds);
+}
+
+void MigrationWorker::migrate()
+{
+    copiedRows = totalRows = 0;
+    originalSize = migratedSize = 0;
+
+    bool ok = begin();
+    if (ok)
+        emit progress(copiedRows, totalRows);
+
+    while (ok && !rebuilds.isEmpty()) {
+        if (stopping.loadAcquire()) {
+            ok = false;
+            break;
+        }
+
+        ok = step();
+
+        const int interval = batchInterval.loadAcquire();
+        if (ok && interval > 0 && !rebuilds.isEmpty())
+            QThread::msleep(interval);
+    }
+
+    finish(ok);
+    emit done();
+    thread()->quit();
+}
+
+bool MigrationWorker::begin()
+{
+    qDeleteAll(rebuilds);
+    rebuilds.clear();
+
+    QStringList files;
+    files << databasePath();
+    if (QFile::exists(archivePath()))
+        files << archivePath();
+
+    foreach (const QString &file, files) {
+        Rebuild *rebuild = new Rebuild;
+        rebuilds.append(rebuild);
+        if (!rebuild->begin(file))
+            return false;
+        totalRows += rebuild->totalRows;
+        originalSize += QFileInfo(file).size();
+    }
+
+    qCDebug(lcCommHistory) << "Migrating" << totalRows << "rows to UTF-8";
+    return true;
+}
+
+bool MigrationWorker::step()
+{
+    Rebuild *rebuild = rebuilds.first();
+    const int count = rebuild->step(batchSize);
+    if (count < 0)
+        return false;
+
+    if (count > 0) {
+        copiedRows += count;
+        emit progress(copiedRows, totalRows);
+        return true;
+    }
+
+    if (!rebuild->finish())
+        return false;
+
+    const QString copy = migratedPath(rebuild->sourcePath);
+    rebuild->close();
+    migratedSize += QFileInfo(copy).size();
+    delete rebuilds.takeFirst();
+    return true;
+}
+
+void MigrationWorker::finish(bool ok)
+{
+    // Partial copies are of no use
+    if (!ok) {
+        foreach (Rebuild *rebuild, rebuilds) {
+            rebuild->close();
+            QFile::remove(migratedPath(rebuild->sourcePath));
+        }
+    }
+    qDeleteAll(rebuilds);
+    rebuilds.clear();
+
+    successful = ok;
+    if (successful) {
+        qCDebug(lcCommHistory) << "Migrated" << copiedRows << "rows to UTF-8:" << originalSize
+                               << "bytes before," << migratedSize << "bytes after";
+    }
+}
+
+DatabaseMigratorPrivate::DatabaseMigratorPrivate(DatabaseMigrator *parent)
+    : QObject(parent),
+      q_ptr(parent),
+      batchSize(1000),
+      batchInterval(20),
+      running(false),
+      copiedRows(0),
+      totalRows(0),
+      originalSize(0),
+      migratedSize(0)
+{
+    worker.moveToThread(&thread);
+    connect(&worker, SIGNAL(progress(int,int)), SLOT(workerProgress(int,int)));
+    connect(&worker, SIGNAL(done()), SLOT(workerDone()));
+}
+
+DatabaseMigratorPrivate::~DatabaseMigratorPrivate()
+{
+    // The partial copy is removed by the worker
+    worker.stopping.storeRelease(1);
+    thread.quit();
+    thread.wait();
+}
+
+void DatabaseMigratorPrivate::begin()
+{
+    running = true;
+    copiedRows = totalRows = 0;
+    originalSize = migratedSize = 0;
+
+    worker.batchSize = batchSize;
+    worker.batchInterval.storeRelease(batchInterval);
+    worker.stopping.storeRelease(0);
+
+    thread.start();
+    QMetaObject::invokeMethod(&worker, "migrate", Qt::QueuedConnection);
+}
+
+bool DatabaseMigratorPrivate::finish()
+{
+    Q_Q(DatabaseMigrator);
+
+    thread.wait();
+    // Progress and done() of this run may still be queued
+    QCoreApplication::removePostedEvents(this, QEvent::MetaCall);
+
+    running = false;
+    copiedRows = worker.copiedRows;
+    totalRows = worker.totalRows;
+    originalSize = worker.originalSize;
+    migratedSize = worker.migratedSize;
+
+    emit q->finished(worker.successful);
+    return worker.successful;
+}
+
+void DatabaseMigratorPrivate::workerProgress(int copied, int total)
+{
+    Q_Q(DatabaseMigrator);
+
+    if (!running)
+        return;
+
+    copiedRows = copied;
+    totalRows = total;
+    emit q->progress(copiedRows, totalRows);
+}
+
+void DatabaseMigratorPrivate::workerDone()
+{
+    if (running)
+        finish();
+}
+
+DatabaseMigrator::DatabaseMigrator(QObject *parent)
+    : QObject(parent), d_ptr(new DatabaseMigratorPrivate(this))
+{
+}
+
+DatabaseMigrator::~DatabaseMigrator()
+{
+}
+
+bool DatabaseMigrator::isRequired()
+{
+    const QString path = databasePath();
+    if (!QFile::exists(path))
+        return false;
+
+    QSqlDatabase database = openFile(connectionName("check", &path), path);
+    const bool required = database.isOpen() && isUtf16(database);
+    closeFile(database);
+    return required;
+}
+
+bool DatabaseMigrator::isPending()
+{
+    return QFile::exists(migratedPath(databasePath()));
+}
+
+bool DatabaseMigrator::completeMigration()
+{
+    if (!isPending())
+        return false;
+
+    QLockFile lock(CommHistoryDatabase::lockFile());
+    if (!lock.tryLock(CommHistoryDatabase::tuning().busyTimeout))
+        return false;
+
+    return swapDatabase();
+}
+
+bool DatabaseMigrator::swapDatabase()
+{
+    // The caller holds the open lock, so no process starts using the
+    // database until the files have been replaced
+    if (CommHistoryDatabase::isInUse()) {
+        qCDebug(lcCommHistory) << "Database is in use, UTF-8 migration is completed later";
+        return false;
+    }
+
+    return DatabaseMigratorPrivate::replaceDatabase(databasePath(), archivePath());
+}
+
+bool DatabaseMigratorPrivate::replaceDatabase(const QString &mainFile, const QString &archiveFile)
+{
+    const char *owner = "swap";
+    if (!QFile::exists(migratedPath(mainFile)))
+        return false;
+
+    // A copy without MigrationState is still being written
+    QSqlDatabase copy = openFile(connectionName("copy", owner), migratedPath(mainFile));
+    qint64 sequence = 0;
+    if (!readMigrationState(copy, sequence)) {
+        closeFile(copy);
+        return false;
+    }
+
+    // Nothing else has the files open; the lock only keeps the live file
+    // from changing while the copy catches up
+    QSqlDatabase live = openFile(connectionName("live", owner), mainFile);
+    if (!execute(live, QStringLiteral("PRAGMA locking_mode = EXCLUSIVE"))
+            || !execute(live, QStringLiteral("BEGIN EXCLUSIVE"))) {
+        closeFile(live);
+        closeFile(copy);
+        return false;
+    }
+
+    if (!isUtf16(live) || userVersion(live) != userVersion(copy)) {
+        // Left over from a migration that already finished, or the
+        // schema was upgraded since the copy was taken
+        execute(live, QStringLiteral("ROLLBACK"));
+        closeFile(live);
+        closeFile(copy);
+        QFile::remove(migratedPath(mainFile));
+        QFile::remove(migratedPath(archiveFile));
+        return false;
+    }
+
+    const qint64 sizeBefore = QFileInfo(mainFile).size() + QFileInfo(archiveFile).size();
+
+    bool ok = copy.transaction() && catchUpDatabase(live, copy, sequence)
+           && execute(copy, QStringLiteral("DROP TABLE MigrationState")) && copy.commit();
+    closeFile(copy);
+
+    if (ok && QFile::exists(archiveFile)) {
+        QSqlDatabase liveArchive = openFile(connectionName("live-archive", owner), archiveFile);
+        QSqlDatabase copyArchive = openFile(connectionName("copy-archive", owner), migratedPath(archiveFile));
+        qint64 unused;
+        if (readMigrationState(copyArchive, unused)) {
+            ok = copyArchive.transaction() && catchUpArchive(liveArchive, copyArchive)
+              && execute(copyArchive, QStringLiteral("DROP TABLE MigrationState")) && copyArchive.commit();
+            closeFile(liveArchive);
+            closeFile(copyArchive);
+        } else {
+            // The archive was created after the copy was taken
+            closeFile(liveArchive);
+            closeFile(copyArchive);
+            Rebuild rebuild;
+            ok = rebuild.begin(archiveFile);
+            int count = 0;
+            while (ok && (count = rebuild.step(1000)) > 0)
+                ;
+            ok = ok && count == 0 && rebuild.finish();
+            rebuild.close();
+            if (ok) {
+                QSqlDatabase built = openFile(connectionName("copy-archive", owner), migratedPath(archiveFile));
+                ok = execute(built, QStringLiteral("DROP TABLE MigrationState"));
+                closeFile(built);
+            }
+        }
+    }
+
+    // Leaving WAL mode empties the log, so nothing refers to the old file
+    // once it has been replaced
+    ok = ok && execute(live, QStringLiteral("COMMIT"))
+            && execute(live, QStringLiteral("PRAGMA journal_mode = DELETE"));
+
+    if (ok && QFile::exists(migratedPath(archiveFile)))
+        ok = replaceFile(migratedPath(archiveFile), archiveFile);
+    if (ok)
+        ok = replaceFile(migratedPath(mainFile), mainFile);
+
+    if (!ok)
+        execute(live, QStringLiteral("ROLLBACK"));
+    closeFile(live);
+    QFile::remove(mainFile + QLatin1String("-shm"));
+
+    if (!ok) {
+        // Start over with a new copy
+        qCWarning(lcCommHistory) << "Failed to complete UTF-8 migration";
+        QFile::remove(migratedPath(mainFile));
+        QFile::remove(migratedPath(archiveFile));
+        return false;
+    }
+
+    qCWarning(lcCommHistory) << "Migrated commhistory database to UTF-8:" << sizeBefore << "bytes before,"
+                             << QFileInfo(mainFile).size() + QFileInfo(archiveFile).size() << "bytes after";
+    return true;
+}
+
+int DatabaseMigrator::batchSize() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->batchSize;
+}
+
+void DatabaseMigrator::setBatchSize(int size)
+{
+    Q_D(DatabaseMigrator);
+    d->batchSize = qMax(1, size);
+}
+
+int DatabaseMigrator::batchInterval() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->batchInterval;
+}
+
+void DatabaseMigrator::setBatchInterval(int msec)
+{
+    Q_D(DatabaseMigrator);
+    d->batchInterval = qMax(0, msec);
+}
+
+bool DatabaseMigrator::isRunning() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->running;
+}
+
+int DatabaseMigrator::copiedRows() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->copiedRows;
+}
+
+int DatabaseMigrator::totalRows() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->totalRows;
+}
+
+qint64 DatabaseMigrator::originalSize() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->originalSize;
+}
+
+qint64 DatabaseMigrator::migratedSize() const
+{
+    Q_D(const DatabaseMigrator);
+    return d->migratedSize;
+}
+
+void DatabaseMigrator::start()
+{
+    Q_D(DatabaseMigrator);
+
+    if (d->running || !isRequired())
+        return;
+
+    d->begin();
+}
+
+void DatabaseMigrator::stop()
+{
+    Q_D(DatabaseMigrator);
+
+    if (!d->running)
+        return;
+
+    d->worker.stopping.storeRelease(1);
+    d->finish();
+}
+
+bool DatabaseMigrator::run()
+{
+    Q_D(DatabaseMigrator);
+
+    if (!d->running) {
+        if (!isRequired())
+            return true;
+        d->begin();
+    }
+
+    // The rest is copied without pausing between batches
+    d->worker.batchInterval.storeRelease(0);
+    return d->finish();
+}
@@ -0,0 +1,142 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_DATABASEMIGRATOR_H
+#define COMMHISTORY_DATABASEMIGRATOR_H
+
+#include <QObject>
+#include "libcommhistoryexport.h"
+
+class CommHistoryDatabase;
+
+namespace CommHistory {
+
+class DatabaseMigratorPrivate;
+
+/*!
+ * \class DatabaseMigrator
+ * \brief Rebuilds a UTF-16 database in UTF-8.
+ *
+ * Databases created by older versions store text in UTF-16. SQLite cannot
+ * change the encoding of an existing database, so the migrator copies the
+ * database and the archive database into new UTF-8 files next to them.
+ * The copy runs on a thread of its own while other clients keep writing,
+ * in batches of batchSize() rows with batchInterval() milliseconds
+ * between them. Each batch is read in its own short transaction.
+ *
+ * The new files replace the old ones when the first process opens the
+ * database, while no other process has it open, usually when the device
+ * starts. Changes made since the copy started are applied to it first.
+ * Use completeMigration() to try the swap right away.
+ */
+class LIBCOMMHISTORY_EXPORT DatabaseMigrator : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(DatabaseMigrator)
+
+public:
+    explicit DatabaseMigrator(QObject *parent = 0);
+    ~DatabaseMigrator();
+
+    /*!
+     * True if the database is stored in UTF-16.
+     */
+    static bool isRequired();
+
+    /*!
+     * True if a finished copy is waiting to replace the database.
+     */
+    static bool isPending();
+
+    /*!
+     * Replace the database with the finished copy, applying the changes
+     * made since it was taken. This fails if any process, this one
+     * included, has opened the database; it is then replaced on a later
+     * open.
+     *
+     * \return true if the database was replaced, otherwise false
+     */
+    static bool completeMigration();
+
+    /*!
+     * Number of rows copied per batch, 1000 by default.
+     */
+    int batchSize() const;
+    void setBatchSize(int size);
+
+    /*!
+     * Pause between batches in milliseconds, 20 by default.
+     */
+    int batchInterval() const;
+    void setBatchInterval(int msec);
+
+    bool isRunning() const;
+
+    /*!
+     * Progress of the current or last copy.
+     */
+    int copiedRows() const;
+    int totalRows() const;
+
+    /*!
+     * Size in bytes of the UTF-16 files and of their copies, once the
+     * copy has finished.
+     */
+    qint64 originalSize() const;
+    qint64 migratedSize() const;
+
+public Q_SLOTS:
+    /*!
+     * Start copying in the background unless a copy is running or a
+     * migration is not needed. finished() is emitted when it is done.
+     */
+    void start();
+
+    /*!
+     * Stop copying after the current batch. The partial copy is removed.
+     */
+    void stop();
+
+    /*!
+     * Copy the whole database without returning to the event loop, or
+     * wait for the running copy without further pauses.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool run();
+
+Q_SIGNALS:
+    void progress(int copiedRows, int totalRows);
+    void finished(bool successful);
+
+private:
+    friend class ::CommHistoryDatabase;
+
+    // Called by CommHistoryDatabase::open() while it holds the open lock,
+    // before the process registers as a user
+    static bool swapDatabase();
+
+    DatabaseMigratorPrivate *d_ptr;
+};
+
+}
+
+#endif
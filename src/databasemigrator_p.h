@@ -0,0 +1,131 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_DATABASEMIGRATOR_P_H
+#define COMMHISTORY_DATABASEMIGRATOR_P_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QThread>
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class DatabaseMigrator;
+class Rebuild;
+
+/*!
+ * Copies the database files on the migrator's thread. Each batch reads
+ * from its own short transaction, so the WAL can still be checkpointed
+ * while the copy runs; rows changed between the batches are brought up
+ * to date from the ChangeLog when the copy is swapped in.
+ */
+class MigrationWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    MigrationWorker();
+    ~MigrationWorker();
+
+    // Set before the thread is started. batchInterval and stopping are
+    // also changed while it runs.
+    int batchSize;
+    QAtomicInt batchInterval;
+    QAtomicInt stopping;
+
+    // Read once the thread has finished
+    bool successful;
+    int copiedRows;
+    int totalRows;
+    qint64 originalSize;
+    qint64 migratedSize;
+
+public slots:
+    // Copies every file and quits the thread
+    void migrate();
+
+signals:
+    void progress(int copiedRows, int totalRows);
+    void done();
+
+private:
+    bool begin();
+    // Returns false on failure; rebuilds is empty when done
+    bool step();
+    void finish(bool ok);
+
+    QList<Rebuild*> rebuilds;
+};
+
+class LIBCOMMHISTORY_EXPORT DatabaseMigratorPrivate : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(DatabaseMigrator)
+
+public:
+    DatabaseMigrator *q_ptr;
+    QThread thread;
+    MigrationWorker worker;
+    int batchSize;
+    int batchInterval;
+    bool running;
+    int copiedRows;
+    int totalRows;
+    qint64 originalSize;
+    qint64 migratedSize;
+
+    explicit DatabaseMigratorPrivate(DatabaseMigrator *parent);
+    ~DatabaseMigratorPrivate();
+
+    void begin();
+    // Waits for the worker and reports its result
+    bool finish();
+
+    /*!
+     * Applies the changes in the ChangeLog of \a live after \a sequence
+     * to \a copy. Fails if the log was pruned past them.
+     */
+    static bool catchUpDatabase(QSqlDatabase &live, QSqlDatabase &copy, qint64 sequence);
+
+    /*!
+     * Adds and removes archived events in \a copy to match \a live.
+     */
+    static bool catchUpArchive(QSqlDatabase &live, QSqlDatabase &copy);
+
+    /*!
+     * Replaces \a mainFile and \a archiveFile with their finished UTF-8
+     * copies, after applying the changes made since the copy was taken.
+     * Nothing else may have the files open.
+     */
+    static bool replaceDatabase(const QString &mainFile, const QString &archiveFile);
+
+public slots:
+    void workerProgress(int copiedRows, int totalRows);
+    void workerDone();
+};
+
+}
+
+#endif
@@ -33,15 +33,40 @@
 #define COMM_HISTORY_INTERFACE     QLatin1String("com.nokia.commhistory")
 #define COMM_HISTORY_OBJECT_PATH   QLatin1String("/CommHistoryModel")
 
+// Scoped copies of eventsAdded/eventsUpdated, one object path per group
+// and per event type, so that listeners can narrow their match rules.
+// Updates that move an event to another group are also sent on the moved
+// path, as the old group is not known any more.
+#define COMM_HISTORY_SCOPED_INTERFACE QLatin1String("com.nokia.commhistory.scoped")
+#define COMM_HISTORY_GROUP_PATH       QLatin1String("/CommHistoryModel/group/")
+#define COMM_HISTORY_TYPE_PATH        QLatin1String("/CommHistoryModel/type/")
+#define COMM_HISTORY_MOVED_PATH       QLatin1String("/CommHistoryModel/moved")
+
 #define EVENTS_ADDED_SIGNAL        QLatin1String("eventsAdded")
 #define EVENTS_UPDATED_SIGNAL      QLatin1String("eventsUpdated")
 #define EVENT_DELETED_SIGNAL       QLatin1String("eventDeleted")
+#define EVENTS_DELETED_SIGNAL      QLatin1String("eventsDeleted")
+#define EVENTS_IMPORTED_SIGNAL     QLatin1String("eventsImported")
 
 #define GROUPS_ADDED_SIGNAL        QLatin1String("groupsAdded")
 #define GROUPS_UPDATED_SIGNAL      QLatin1String("groupsUpdated")
 #define GROUPS_UPDATED_FULL_SIGNAL QLatin1String("groupsUpdatedFull")
 #define GROUPS_DELETED_SIGNAL      QLatin1String("groupsDeleted")
 
+namespace CommHistory {
+
+inline QString groupUpdatesPath(int groupId)
+{
+    return COMM_HISTORY_GROUP_PATH + QString::number(groupId);
+}
+
+inline QString eventTypeUpdatesPath(int eventType)
+{
+    return COMM_HISTORY_TYPE_PATH + QString::number(eventType);
+}
+
+}
+
 QDBusArgument &operator<<(QDBusArgument &argument, const CommHistory::Recipient &recipient);
 const QDBusArgument &operator>>(const QDBusArgument &argument, CommHistory::Recipient &recipient);
 
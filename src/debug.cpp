@@ -1,3 +1,5 @@
 #include "debug_p.h"
 
 Q_LOGGING_CATEGORY(lcCommHistory, "com.nokia.commhistory", QtWarningMsg)
+// Only written to while QueryProfiler is enabled
+Q_LOGGING_CATEGORY(lcCommHistorySql, "com.nokia.commhistory.sql", QtInfoMsg)
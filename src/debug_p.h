@@ -4,5 +4,6 @@
 #include <QtCore/QLoggingCategory>
 
 Q_DECLARE_LOGGING_CATEGORY(lcCommHistory)
+Q_DECLARE_LOGGING_CATEGORY(lcCommHistorySql)
 
 #endif
@@ -24,8 +24,10 @@
 #include <QtDBus/QtDBus>
 
 #include "databaseio.h"
+#include "databaseio_p.h"
 #include "eventmodel.h"
 #include "eventmodel_p.h"
+#include "eventwriter_p.h"
 #include "adaptor.h"
 #include "commonutils_p.h"
 #include "event.h"
@@ -267,25 +269,14 @@ static QVariantList messagePartData(const Event &event)
     return re;
 }
 
-QVariant EventModel::data(const QModelIndex &index, int role) const
+static QVariant eventRoleData(const Event &event, int role)
 {
-    Q_D(const EventModel);
-
-    if (!index.isValid()) {
-        return QVariant();
-    }
-
-    EventTreeItem *item = static_cast<EventTreeItem *>(index.internalPointer());
-    Event &event = item->event();
-
     switch (role) {
     case EventRole:
         return QVariant::fromValue(event);
     case ContactIdsRole:
-        d->resolveIfRequired(event);
         return QVariant::fromValue(contactIds(event.contacts()));
     case ContactNamesRole:
-        d->resolveIfRequired(event);
         return QVariant::fromValue(contactNames(event.contacts()));
     case MessagePartsRole:
         return QVariant::fromValue(messagePartData(event));
@@ -327,7 +318,6 @@ QVariant EventModel::data(const QModelIndex &index, int role) const
     case RemoteUidRole:
         return QVariant::fromValue(event.recipients().value(0).remoteUid());
     case ContactsRole:
-        d->resolveIfRequired(event);
         return QVariant::fromValue(event.contacts());
     case FreeTextRole:
         return QVariant::fromValue(event.freeText());
@@ -355,6 +345,54 @@ QVariant EventModel::data(const QModelIndex &index, int role) const
     }
 }
 
+QVariant EventModel::data(const QModelIndex &index, int role) const
+{
+    Q_D(const EventModel);
+
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    EventTreeItem *item = static_cast<EventTreeItem *>(index.internalPointer());
+    Event &event = item->event();
+
+    // Views ask for the same roles of a row every time it is shown, so keep
+    // the values that are costly to build until the row changes. The event
+    // count and read state are changed in place by CallModel and are cheap.
+    bool cacheable = false;
+    switch (role) {
+    case ContactIdsRole:
+    case ContactNamesRole:
+    case ContactsRole:
+        d->resolveIfRequired(event);
+        // fall through
+    case ContactNameRole:
+        // Contacts can still arrive while any are unresolved
+        cacheable = d->resolveContacts != DoNotResolve && event.recipients().allContactsResolved();
+        break;
+    case MessagePartsRole:
+    case AccountRole:
+    case DateAndAccountGroupingRole:
+    case StartTimeRole:
+    case EndTimeRole:
+    case RemoteUidRole:
+        cacheable = true;
+        break;
+    default:
+        break;
+    }
+
+    if (!cacheable)
+        return eventRoleData(event, role);
+
+    if (const QVariant *value = item->cachedData(role))
+        return *value;
+
+    const QVariant value(eventRoleData(event, role));
+    item->setCachedData(role, value);
+    return value;
+}
+
 Event EventModel::event(const QModelIndex &index) const
 {
     if (!index.isValid()) {
@@ -452,6 +490,26 @@ void EventModel::setResolveContacts(ContactResolveType resolveType)
     d->setResolveContacts(resolveType);
 }
 
+void EventModel::setVisibleRange(int first, int last)
+{
+    Q_D(EventModel);
+    d->visibleFirst = first;
+    d->visibleLast = last;
+    d->resolveViewport();
+}
+
+int EventModel::resolveMargin() const
+{
+    Q_D(const EventModel);
+    return d->resolveMargin;
+}
+
+void EventModel::setResolveMargin(int rows)
+{
+    Q_D(EventModel);
+    d->resolveMargin = qMax(0, rows);
+}
+
 bool EventModel::addEvent(Event &event, bool toModelOnly)
 {
     QList<Event> list;
@@ -466,19 +524,8 @@ bool EventModel::addEvents(QList<Event> &events, bool toModelOnly)
     Q_D(EventModel);
 
     if (!toModelOnly) {
-        // Insert the events into the database
-        if (!d->database()->transaction())
-            return false;
-
-        // Cannot be foreach, because addEvent modifies the events with their new ID
-        for (int i = 0; i < events.size(); i++) {
-            if (!d->database()->addEvent(events[i])) {
-                d->database()->rollback();
-                return false;
-            }
-        }
-
-        if (!d->database()->commit())
+        // Insert the events into the database and announce them
+        if (!EventWriterPrivate::addEvents(d->database(), d->emitter.data(), events))
             return false;
     } else {
         // Set ids to have valid events
@@ -497,10 +544,10 @@ bool EventModel::addEvents(QList<Event> &events, bool toModelOnly)
         }
     }
 
-    emit d->eventsAdded(events);
-
     if (!toModelOnly)
         emit d->eventsCommitted(events, true);
+    else
+        emit d->eventsAdded(events);
 
     return true;
 }
@@ -518,39 +565,9 @@ bool EventModel::modifyEvents(QList<Event> &events)
 {
     Q_D(EventModel);
 
-    if (!d->database()->transaction())
+    if (!EventWriterPrivate::modifyEvents(d->database(), d->emitter.data(), events))
         return false;
 
-    QList<int> modifiedGroups;
-    for (QList<Event>::Iterator it = events.begin(); it != events.end(); it++) {
-        Event &event = *it;
-        if (event.id() == -1) {
-            qCWarning(lcCommHistory) << Q_FUNC_INFO << "Event id not set";
-            d->database()->rollback();
-            return false;
-        }
-
-        if (event.lastModifiedT() == 0)
-            event.setLastModifiedT(Event::currentTime_t());
-
-        if (!d->database()->modifyEvent(event)) {
-            d->database()->rollback();
-            return false;
-        }
-
-        if (event.isValid()
-            && event.groupId() != -1
-            && !modifiedGroups.contains(event.groupId())) {
-            modifiedGroups.append(event.groupId());
-        }
-    }
-
-    if (!d->database()->commit())
-        return false;
-
-    emit d->eventsUpdated(events);
-    if (!modifiedGroups.isEmpty())
-        emit d->groupsUpdated(modifiedGroups);
     emit d->eventsCommitted(events, true);
 
     return true;
@@ -582,45 +599,46 @@ bool EventModel::deleteEvent(Event &event)
         return false;
     }
 
-    if (!d->database()->transaction())
+    // Also deletes the group if this was its last event
+    if (!EventWriterPrivate::deleteEvents(d->database(), d->emitter.data(), QList<int>() << event.id()))
         return false;
 
-    if (!d->database()->deleteEvent(event, d->bgThread)) {
-        d->database()->rollback();
-        return false;
-    }
+    emit d->eventsCommitted(QList<Event>() << event, true);
 
-    bool groupUpdated = false, groupDeleted = false;
-    if (event.groupId() != -1) {
-        int total;
-        if (!d->database()->totalEventsInGroup(event.groupId(), total)) {
-            d->database()->rollback();
-            return false;
-        }
+    return true;
+}
 
-        if (total == 0) {
-            qCDebug(lcCommHistory) << Q_FUNC_INFO << ": deleting empty group";
-            if (!d->database()->deleteGroup(event.groupId())) {
-                d->database()->rollback();
-                return false;
-            } else
-                groupDeleted = true;
-        } else {
-            groupUpdated = true;
-        }
+bool EventModel::deleteEvents(const QList<int> &ids)
+{
+    Q_D(EventModel);
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << ":" << ids.size() << "events";
+
+    if (ids.isEmpty())
+        return true;
+
+    QList<Event> deletedEvents;
+    QStringList unloadedIds;
+    foreach (int id, ids) {
+        QModelIndex index = d->findEvent(id);
+        if (index.isValid())
+            deletedEvents << this->event(index);
+        else
+            unloadedIds << QString::number(id);
     }
 
-    if (!d->database()->commit())
+    // Events that are not in the model are read with one query, so that
+    // eventsCommitted carries them in full
+    if (!unloadedIds.isEmpty()
+            && !DatabaseIOPrivate::instance()->getEvents(QStringLiteral("WHERE Events.id IN (")
+                                                         + unloadedIds.join(QLatin1Char(','))
+                                                         + QLatin1Char(')'), deletedEvents)) {
         return false;
+    }
 
-    emit d->eventDeleted(event.id());
-
-    if (groupDeleted)
-        emit d->groupsDeleted(QList<int>() << event.groupId());
-    else if (groupUpdated)
-        emit d->groupsUpdated(QList<int>() << event.groupId());
+    if (!EventWriterPrivate::deleteEvents(d->database(), d->emitter.data(), ids))
+        return false;
 
-    emit d->eventsCommitted(QList<Event>() << event, true);
+    emit d->eventsCommitted(deletedEvents, true);
 
     return true;
 }
@@ -686,6 +704,12 @@ bool EventModel::moveEvent(Event &event, int groupId)
     return true;
 }
 
+bool EventModel::syncChanges()
+{
+    Q_D(EventModel);
+    return d->syncChanges();
+}
+
 bool EventModel::modifyEventsInGroup(QList<Event> &events, Group group)
 {
     Q_D(EventModel);
@@ -53,6 +53,9 @@ class DatabaseIO;
  * to sync models in the current and other processes. addEvent() will
  * send the signal right away, while other methods emit it only
  * on a sucessful commit to the database.
+ *
+ * These operations write on the calling thread. Use WriteQueue to
+ * write in the background instead.
  */
 class LIBCOMMHISTORY_EXPORT EventModel: public QAbstractItemModel
 {
@@ -70,6 +73,7 @@ class LIBCOMMHISTORY_EXPORT EventModel: public QAbstractItemModel
     Q_PROPERTY(bool defaultAccept READ defaultAccept WRITE setDefaultAccept)
     Q_PROPERTY(int eventCategoryMask READ eventCategoryMask WRITE setEventCategoryMask)
     Q_PROPERTY(bool bufferInsertions READ bufferInsertions WRITE setBufferInsertions NOTIFY bufferInsertionsChanged)
+    Q_PROPERTY(int resolveMargin READ resolveMargin WRITE setResolveMargin)
 
 public:
     enum QueryMode { AsyncQuery, StreamedAsyncQuery, SyncQuery };
@@ -77,7 +81,8 @@ public:
     enum ContactResolveType {
         ResolveImmediately,
         ResolveOnDemand,
-        DoNotResolve
+        DoNotResolve,
+        ResolveVisible
     };
 
     enum {
@@ -233,12 +238,31 @@ public:
      * explicitly requested, by accesing the contact-dependent properties
      * of an event.  Changes to contacts will be reported.
      *
+     * ResolveVisible works like ResolveOnDemand until setVisibleRange() is
+     * called. From then on, contacts are resolved for the visible rows and
+     * the rows around them instead of the rows whose properties are read.
+     *
      * The ResolveImmediately mode is not compatible with SyncQuery
      * query mode.
      */
     void setResolveContacts(ContactResolveType resolveType);
     ContactResolveType resolveContacts() const;
 
+    /*!
+     * Tell the model which top level rows the view shows, for the
+     * ResolveVisible mode. Contacts are resolved for these rows first and
+     * then for resolveMargin() rows after and before them. Lookups for rows
+     * that have been scrolled out of that range are cancelled.
+     */
+    Q_INVOKABLE void setVisibleRange(int first, int last);
+
+    /*!
+     * Number of rows on each side of the visible range that are resolved
+     * in the ResolveVisible mode, 20 by default.
+     */
+    int resolveMargin() const;
+    void setResolveMargin(int rows);
+
     /*!
      * Set whether the default action is to accept a new event.
      *
@@ -312,6 +336,14 @@ public:
      */
     virtual bool deleteEvent(Event &event);
 
+    /*!
+     * Delete several events from the model and the database in a single
+     * transaction. Groups left empty are deleted as well.
+     * \param ids ids of the events to be deleted.
+     * \return true if successful
+     */
+    bool deleteEvents(const QList<int> &ids);
+
     /*!
      * Modify events belonging to the group and updates group model properties.
      * queries
@@ -330,6 +362,18 @@ public:
      */
     bool moveEvent(Event &event, int groupId);
 
+    /*!
+     * Applies changes made to the database since the model was filled or
+     * last synchronized, for example when update signals were missed while
+     * the process was suspended. Only the changed events are queried.
+     *
+     * Models that can not be brought up to date incrementally (because the
+     * change journal has been pruned) are reloaded if they support it.
+     *
+     * \return true if successful, false if the caller has to reload the model.
+     */
+    Q_INVOKABLE bool syncChanges();
+
     /*!
      * In StreamedAsyncQuery mode, returns true if the tracker query has
      * more data available.
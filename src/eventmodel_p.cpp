@@ -25,6 +25,8 @@
 #include <QSqlQuery>
 #include <QSqlError>
 
+#include <algorithm>
+
 #include "databaseio.h"
 #include "databaseio_p.h"
 #include "eventmodel.h"
@@ -48,6 +50,46 @@ bool initializeTypes()
 
 const int defaultChunkSize = 50;
 
+// Event::operator== ignores the texts and states that are shown in the rows
+bool sameContents(const CommHistory::Event &a, const CommHistory::Event &b)
+{
+    return a == b
+        && a.freeText() == b.freeText()
+        && a.subject() == b.subject()
+        && a.status() == b.status()
+        && a.readStatus() == b.readStatus()
+        && a.eventCount() == b.eventCount()
+        && a.isResolved() == b.isResolved();
+}
+
+// Positions of the longest strictly increasing subsequence of values
+QSet<int> increasingSubsequence(const QVector<int> &values)
+{
+    QVector<int> tails;                             // position ending the run of each length
+    QVector<int> previous(values.size(), -1);
+    for (int i = 0; i < values.size(); i++) {
+        int low = 0, high = tails.size();
+        while (low < high) {
+            const int mid = (low + high) / 2;
+            if (values.at(tails.at(mid)) < values.at(i))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if (low > 0)
+            previous[i] = tails.at(low - 1);
+        if (low == tails.size())
+            tails.append(i);
+        else
+            tails[low] = i;
+    }
+
+    QSet<int> result;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i))
+        result.insert(i);
+    return result;
+}
+
 }
 
 bool eventmodel_p_initialized = initializeTypes();
@@ -56,6 +98,11 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
         : addResolver(0)
         , receiveResolver(0)
         , onDemandResolver(0)
+        , viewportResolver(0)
+        , visibleFirst(0)
+        , visibleLast(-1)
+        , resolveMargin(20)
+        , viewportScheduled(false)
         , queryMode(EventModel::AsyncQuery)
         , chunkSize(defaultChunkSize)
         , firstChunkSize(0)
@@ -70,6 +117,8 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
         , resolveContacts(EventModel::DoNotResolve)
         , propertyMask(Event::allProperties())
         , bgThread(0)
+        , changeSequence(0)
+        , refreshing(false)
 {
     q_ptr = model;
 
@@ -81,6 +130,8 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
             emitter.data(), SIGNAL(eventsUpdated(const QList<CommHistory::Event>&)));
     connect(this, SIGNAL(eventDeleted(int)),
             emitter.data(), SIGNAL(eventDeleted(int)));
+    connect(this, SIGNAL(eventsDeleted(const QList<int>&)),
+            emitter.data(), SIGNAL(eventsDeleted(const QList<int>&)));
     connect(this, SIGNAL(groupsUpdated(const QList<int>&)),
             emitter.data(), SIGNAL(groupsUpdated(const QList<int>&)));
     connect(this, SIGNAL(groupsUpdatedFull(const QList<CommHistory::Group>&)),
@@ -89,15 +140,13 @@ EventModelPrivate::EventModelPrivate(EventModel *model)
             emitter.data(), SIGNAL(groupsDeleted(const QList<int>&)));
 
     // listen to dbus signals
-    QDBusConnection::sessionBus().connect(
-        QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_ADDED_SIGNAL,
-        this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_UPDATED_SIGNAL,
-        this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
+    connectEventUpdates(true);
     QDBusConnection::sessionBus().connect(
         QString(), QString(), COMM_HISTORY_INTERFACE, EVENT_DELETED_SIGNAL,
         this, SLOT(eventDeletedSlot(int)));
+    QDBusConnection::sessionBus().connect(
+        QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_DELETED_SIGNAL,
+        this, SLOT(eventsDeletedSlot(const QList<int> &)));
 
     eventRootItem = new EventTreeItem(Event());
 }
@@ -152,7 +201,7 @@ QSqlQuery EventModelPrivate::prepareQuery(const QString &q, int limit, int offse
     return DatabaseIOPrivate::prepareQuery(q, limit, offset);
 }
 
-bool EventModelPrivate::executeQuery(QSqlQuery &query)
+bool EventModelPrivate::executeQuery(QSqlQuery &query, bool archived)
 {
     qCDebug(lcCommHistory) << Q_FUNC_INFO;
 
@@ -162,6 +211,7 @@ bool EventModelPrivate::executeQuery(QSqlQuery &query)
         qCWarning(lcCommHistory) << "Failed to execute query";
         qCWarning(lcCommHistory) << query.lastError();
         qCWarning(lcCommHistory) << query.lastQuery();
+        refreshing = false;
         return false;
     }
 
@@ -180,10 +230,11 @@ bool EventModelPrivate::executeQuery(QSqlQuery &query)
     }
     query.finish();
 
+    DatabaseIOPrivate *database = DatabaseIOPrivate::instance();
     foreach (int i, extraPropertyIndices)
-        DatabaseIO::instance()->getEventExtraProperties(events[i]);
+        database->getEventExtraProperties(events[i], archived);
     foreach (int i, hasPartsIndices)
-        DatabaseIO::instance()->getMessageParts(events[i]);
+        database->getMessageParts(events[i], archived);
 
     eventsReceivedSlot(0, events.size(), events);
     return true;
@@ -195,6 +246,12 @@ bool EventModelPrivate::fillModel(int start, int end, QList<CommHistory::Event>
     Q_UNUSED(end);
     Q_UNUSED(resolved);
 
+    if (refreshing) {
+        refreshEvents(events);
+        modelUpdatedSlot(true);
+        return true;
+    }
+
     if (events.isEmpty()) {
         // Empty results are still "ready"
         modelUpdatedSlot(true);
@@ -218,6 +275,10 @@ bool EventModelPrivate::fillModel(QList<CommHistory::Event> events, bool resolve
 {
     Q_Q(EventModel);
 
+    // Rows that already exist are the point of a refresh
+    if (refreshing)
+        return fillModel(0, events.count() - 1, events, resolved);
+
     QMutableListIterator<Event> i(events);
     while (i.hasNext()) {
         const Event &event = i.next();
@@ -244,6 +305,212 @@ void EventModelPrivate::clearEvents()
     qCDebug(lcCommHistory) << Q_FUNC_INFO;
     delete eventRootItem;
     eventRootItem = new EventTreeItem(Event());
+
+    // Contents are about to be queried again, anything journaled from
+    // here on must be applied by syncChanges()
+    if (!database()->currentChangeSequence(changeSequence))
+        changeSequence = 0;
+}
+
+void EventModelPrivate::beginRefresh()
+{
+    refreshing = true;
+
+    // As in clearEvents(), the next query covers everything journaled so far
+    if (!database()->currentChangeSequence(changeSequence))
+        changeSequence = 0;
+}
+
+void EventModelPrivate::refreshEvents(const QList<Event> &events)
+{
+    QList<EventTreeItem *> items;
+    foreach (const Event &event, events)
+        items.append(new EventTreeItem(event, eventRootItem));
+    refreshItems(items);
+}
+
+void EventModelPrivate::refreshItems(const QList<EventTreeItem *> &items)
+{
+    Q_Q(EventModel);
+
+    refreshing = false;
+
+    QHash<int, int> targetRows;
+    for (int i = 0; i < items.size(); i++)
+        targetRows.insert(items.at(i)->event().id(), i);
+
+    // Remove rows missing from the new results, in contiguous ranges
+    int removed = 0;
+    for (int last = eventRootItem->childCount() - 1; last >= 0; ) {
+        if (targetRows.contains(eventRootItem->eventAt(last).id())) {
+            last--;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && !targetRows.contains(eventRootItem->eventAt(first - 1).id()))
+            first--;
+
+        q->beginRemoveRows(QModelIndex(), first, last);
+        for (int row = last; row >= first; row--)
+            eventRootItem->removeAt(row);
+        q->endRemoveRows();
+
+        removed += last - first + 1;
+        last = first - 1;
+    }
+
+    // The longest run of remaining rows that is already in the new order
+    // stays put; each other row is moved right behind its new predecessor.
+    // Current row of each remaining event, kept up to date as rows move
+    QHash<int, int> present;
+    QVector<int> targets(eventRootItem->childCount());
+    for (int row = 0; row < eventRootItem->childCount(); row++) {
+        const int id = eventRootItem->eventAt(row).id();
+        present.insert(id, row);
+        targets[row] = targetRows.value(id);
+    }
+
+    QSet<int> stable;
+    foreach (int row, increasingSubsequence(targets))
+        stable.insert(targets.at(row));
+
+    int moved = 0;
+    int previousId = -1;
+    for (int i = 0; i < items.size(); i++) {
+        const int id = items.at(i)->event().id();
+        if (!present.contains(id))
+            continue;
+
+        if (!stable.contains(i)) {
+            const int from = present.value(id);
+            const int to = previousId < 0 ? 0 : present.value(previousId) + 1;
+            if (to != from && to != from + 1) {
+                const int dest = to > from ? to - 1 : to;
+                q->beginMoveRows(QModelIndex(), from, from, QModelIndex(), to);
+                eventRootItem->moveChild(from, dest);
+                q->endMoveRows();
+
+                // Only the rows between the old and the new position shift
+                for (int row = qMin(from, dest); row <= qMax(from, dest); row++)
+                    present[eventRootItem->eventAt(row).id()] = row;
+                moved++;
+            }
+        }
+        previousId = id;
+    }
+
+    // Existing rows are now in order; fill in the new ones and update the rest
+    int inserted = 0;
+    for (int i = 0; i < items.size(); ) {
+        EventTreeItem *item = items.at(i);
+        if (!present.contains(item->event().id())) {
+            int end = i + 1;
+            while (end < items.size() && !present.contains(items.at(end)->event().id()))
+                end++;
+
+            q->beginInsertRows(QModelIndex(), i, end - 1);
+            for (int row = i; row < end; row++)
+                eventRootItem->insertChildAt(row, items.at(row));
+            q->endInsertRows();
+
+            inserted += end - i;
+            i = end;
+            continue;
+        }
+
+        EventTreeItem *existing = eventRootItem->child(i);
+        const QModelIndex parent = q->index(i, 0);
+
+        bool sameChildren = existing->childCount() == item->childCount();
+        for (int row = 0; sameChildren && row < item->childCount(); row++)
+            sameChildren = existing->eventAt(row).id() == item->eventAt(row).id();
+
+        if (sameChildren) {
+            for (int row = 0; row < item->childCount(); row++) {
+                if (!sameContents(existing->eventAt(row), item->eventAt(row))) {
+                    existing->child(row)->setEvent(item->eventAt(row));
+                    emitDataChanged(row, existing->child(row));
+                }
+            }
+        } else {
+            if (existing->childCount()) {
+                q->beginRemoveRows(parent, 0, existing->childCount() - 1);
+                while (existing->childCount())
+                    existing->removeAt(existing->childCount() - 1);
+                q->endRemoveRows();
+            }
+            if (item->childCount()) {
+                q->beginInsertRows(parent, 0, item->childCount() - 1);
+                for (int row = 0; row < item->childCount(); row++)
+                    existing->appendChild(new EventTreeItem(item->eventAt(row), existing));
+                q->endInsertRows();
+            }
+        }
+
+        if (!sameContents(existing->event(), item->event())) {
+            existing->setEvent(item->event());
+            emitDataChanged(i, existing);
+        }
+
+        delete item;
+        i++;
+    }
+
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << "removed" << removed << "moved" << moved
+                           << "inserted" << inserted;
+}
+
+bool EventModelPrivate::syncChanges()
+{
+    QList<DatabaseIO::Change> changes;
+    bool resetRequired = false;
+    if (!database()->getChangesSince(changeSequence, changes, resetRequired))
+        return false;
+
+    if (resetRequired) {
+        qCDebug(lcCommHistory) << Q_FUNC_INFO << "change journal pruned, reloading";
+        return reloadEvents();
+    }
+
+    qint64 sequence = changeSequence;
+    QList<int> deleted;
+    QList<Event> updated;
+    foreach (const DatabaseIO::Change &change, changes) {
+        sequence = change.sequence;
+        if (change.itemType != DatabaseIO::EventChange)
+            continue;
+
+        if (change.operation == DatabaseIO::ItemDeleted) {
+            deleted.append(change.itemId);
+            continue;
+        }
+
+        Event event;
+        if (!database()->getEvent(change.itemId, event))
+            continue;
+
+        if (acceptsEvent(event))
+            updated.append(event);
+        else if (findEvent(event.id()).isValid())
+            deleted.append(event.id());
+    }
+
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << changes.size() << "changes:"
+                           << updated.size() << "updated" << deleted.size() << "deleted";
+
+    if (!deleted.isEmpty())
+        deleteFromModel(deleted);
+    if (!updated.isEmpty())
+        eventsUpdatedSlot(updated);
+
+    changeSequence = sequence;
+    return true;
+}
+
+bool EventModelPrivate::reloadEvents()
+{
+    return false;
 }
 
 void EventModelPrivate::setBufferInsertions(bool buffer)
@@ -336,9 +603,17 @@ void EventModelPrivate::prependEvents(QList<Event> events, bool resolved)
 
 void EventModelPrivate::resolveIfRequired(const Event &event) const
 {
-    if (resolveContacts != EventModel::ResolveOnDemand || event.isResolved())
+    if (event.isResolved())
         return;
 
+    if (resolveContacts == EventModel::ResolveVisible) {
+        // Once the view has reported its rows, resolveViewport() takes over
+        if (visibleLast >= 0)
+            return;
+    } else if (resolveContacts != EventModel::ResolveOnDemand) {
+        return;
+    }
+
     if (!onDemandResolver) {
         onDemandResolver = new ContactResolver(const_cast<EventModelPrivate *>(this));
         connect(onDemandResolver, SIGNAL(finished()), SLOT(onDemandResolverFinished()));
@@ -363,6 +638,102 @@ void EventModelPrivate::onDemandResolverFinished()
     slotContactChanged(resolvedRecipients.values());
 }
 
+void EventModelPrivate::resolveViewport()
+{
+    viewportScheduled = false;
+
+    if (resolveContacts != EventModel::ResolveVisible || visibleLast < visibleFirst)
+        return;
+
+    const int first = qMax(0, visibleFirst - resolveMargin);
+    const int last = qMin(eventRootItem->childCount() - 1, visibleLast + resolveMargin);
+
+    // Visible rows come first, then the ones after and before them, nearest first
+    QList<Event> visible, after, before;
+    QSet<int> inRange;
+    for (int row = first; row <= last; ++row) {
+        const Event &event(eventRootItem->eventAt(row));
+        inRange.insert(event.id());
+        if (event.isResolved() || event.recipients().allContactsResolved())
+            continue;
+
+        if (row < visibleFirst)
+            before.prepend(event);
+        else if (row > visibleLast)
+            after.append(event);
+        else
+            visible.append(event);
+    }
+
+    if (!pendingViewport.isEmpty()) {
+        QSet<int> pendingIds;
+        bool stale = false;
+        foreach (const Event &event, pendingViewport) {
+            pendingIds.insert(event.id());
+            if (!inRange.contains(event.id()))
+                stale = true;
+        }
+
+        if (!stale) {
+            // Rows that have just become visible join the current lookups
+            QList<Event> missing;
+            foreach (const Event &event, visible) {
+                if (!pendingIds.contains(event.id()))
+                    missing.append(event);
+            }
+            if (!missing.isEmpty()) {
+                pendingViewport.append(missing);
+                viewportResolver->add(missing);
+            }
+            return;
+        }
+
+        // Scrolled past these rows; drop their lookups unless another
+        // resolver is waiting for the same addresses
+        delete viewportResolver;
+        viewportResolver = 0;
+        pendingViewport.clear();
+    }
+
+    const QList<Event> batch = visible.isEmpty() ? after + before : visible;
+    if (batch.isEmpty())
+        return;
+
+    if (!viewportResolver) {
+        viewportResolver = new ContactResolver(this);
+        connect(viewportResolver, SIGNAL(finished()), SLOT(viewportResolverFinished()));
+    }
+
+    pendingViewport = batch;
+    viewportResolver->add(batch);
+}
+
+void EventModelPrivate::scheduleViewportResolution()
+{
+    if (!viewportScheduled && visibleLast >= 0) {
+        viewportScheduled = true;
+        QMetaObject::invokeMethod(this, "resolveViewport", Qt::QueuedConnection);
+    }
+}
+
+void EventModelPrivate::viewportResolverFinished()
+{
+    QList<Event> resolved(pendingViewport);
+    pendingViewport.clear();
+
+    QSet<Recipient> resolvedRecipients;
+    foreach (const Event &event, resolved) {
+        const RecipientList &recipients(event.recipients());
+        for (RecipientList::const_iterator it = recipients.constBegin(), end = recipients.constEnd(); it != end; ++it)
+            resolvedRecipients.insert(*it);
+    }
+
+    slotContactChanged(resolvedRecipients.values());
+
+    // Go on with the rows around the visible ones
+    resolveViewport();
+}
+
 void EventModelPrivate::modifyInModel(Event &event)
 {
     Q_Q(EventModel);
@@ -398,6 +769,40 @@ void EventModelPrivate::modifyInModel(Event &event)
     }
 }
 
+void EventModelPrivate::setUpdatesScope(const QStringList &paths)
+{
+    if (paths == updatesScope)
+        return;
+
+    connectEventUpdates(false);
+    updatesScope = paths;
+    connectEventUpdates(true);
+}
+
+void EventModelPrivate::connectEventUpdates(bool enable)
+{
+    QDBusConnection bus(QDBusConnection::sessionBus());
+    typedef bool (QDBusConnection::*ConnectFunction)(const QString &, const QString &,
+                                                     const QString &, const QString &,
+                                                     QObject *, const char *);
+    ConnectFunction method = enable ? &QDBusConnection::connect : &QDBusConnection::disconnect;
+
+    if (updatesScope.isEmpty()) {
+        (bus.*method)(QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_ADDED_SIGNAL,
+                      this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+        (bus.*method)(QString(), QString(), COMM_HISTORY_INTERFACE, EVENTS_UPDATED_SIGNAL,
+                      this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
+        return;
+    }
+
+    foreach (const QString &path, updatesScope) {
+        (bus.*method)(QString(), path, COMM_HISTORY_SCOPED_INTERFACE, EVENTS_ADDED_SIGNAL,
+                      this, SLOT(eventsAddedSlot(const QList<CommHistory::Event> &)));
+        (bus.*method)(QString(), path, COMM_HISTORY_SCOPED_INTERFACE, EVENTS_UPDATED_SIGNAL,
+                      this, SLOT(eventsUpdatedSlot(const QList<CommHistory::Event> &)));
+    }
+}
+
 void EventModelPrivate::deleteFromModel(int id)
 {
     Q_Q(EventModel);
@@ -412,18 +817,61 @@ void EventModelPrivate::deleteFromModel(int id)
     }
 }
 
+void EventModelPrivate::deleteFromModel(const QList<int> &ids)
+{
+    Q_Q(EventModel);
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << ids.size();
+
+    // Collect rows per parent so that adjacent rows go out as one range
+    QHash<EventTreeItem *, QList<int> > rowsByParent;
+    foreach (int id, ids) {
+        QModelIndex index = findEvent(id);
+        if (!index.isValid())
+            continue;
+        EventTreeItem *parent = static_cast<EventTreeItem *>(index.parent().internalPointer());
+        if (!parent) parent = eventRootItem;
+        rowsByParent[parent].append(index.row());
+    }
+
+    for (auto it = rowsByParent.begin(); it != rowsByParent.end(); ++it) {
+        EventTreeItem *parent = it.key();
+        QModelIndex parentIndex;
+        if (parent != eventRootItem)
+            parentIndex = q->createIndex(parent->row(), 0, parent);
+
+        QList<int> &rows = it.value();
+        std::sort(rows.begin(), rows.end());
+
+        // Remove from the end so earlier row numbers stay valid
+        int last = rows.size() - 1;
+        while (last >= 0) {
+            int first = last;
+            while (first > 0 && rows.at(first - 1) == rows.at(first) - 1)
+                first--;
+
+            q->beginRemoveRows(parentIndex, rows.at(first), rows.at(last));
+            for (int row = rows.at(last); row >= rows.at(first); row--)
+                parent->removeAt(row);
+            q->endRemoveRows();
+
+            last = first - 1;
+        }
+    }
+}
+
 void EventModelPrivate::eventsReceivedSlot(int start, int end, QList<Event> events)
 {
     qCDebug(lcCommHistory) << Q_FUNC_INFO << ":" << start << end << events.count();
 
-    if (events.isEmpty()) {
+    if (events.isEmpty() && !refreshing) {
         // Empty results are still "ready"
         modelUpdatedSlot(true);
         return;
     }
 
     // Contact resolution is not allowed in synchronous query mode
-    if (resolveContacts == EventModel::ResolveImmediately && queryMode != EventModel::SyncQuery) {
+    if (resolveContacts == EventModel::ResolveImmediately && queryMode != EventModel::SyncQuery
+        && !events.isEmpty()) {
         if (!receiveResolver) {
             receiveResolver = new ContactResolver(this);
             connect(receiveResolver, SIGNAL(finished()), SLOT(receiveResolverFinished()));
@@ -499,6 +947,13 @@ void EventModelPrivate::eventDeletedSlot(int id)
     deleteFromModel(id);
 }
 
+void EventModelPrivate::eventsDeletedSlot(const QList<int> &ids)
+{
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << ":" << ids.size() << "events";
+
+    deleteFromModel(ids);
+}
+
 void EventModelPrivate::canFetchMoreChangedSlot(bool canFetch)
 {
     threadCanFetchMore = canFetch;
@@ -584,12 +1039,31 @@ void EventModelPrivate::setResolveContacts(EventModel::ContactResolveType type)
         delete onDemandResolver;
         onDemandResolver = 0;
     }
+
+    Q_Q(EventModel);
+    if (resolveContacts == EventModel::ResolveVisible) {
+        // Rows can be added to or moved into the visible range
+        connect(q, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(scheduleViewportResolution()), Qt::UniqueConnection);
+        connect(q, SIGNAL(rowsRemoved(QModelIndex,int,int)), SLOT(scheduleViewportResolution()), Qt::UniqueConnection);
+        connect(q, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), SLOT(scheduleViewportResolution()), Qt::UniqueConnection);
+        connect(q, SIGNAL(layoutChanged()), SLOT(scheduleViewportResolution()), Qt::UniqueConnection);
+        connect(q, SIGNAL(modelReset()), SLOT(scheduleViewportResolution()), Qt::UniqueConnection);
+        scheduleViewportResolution();
+    } else {
+        disconnect(q, 0, this, SLOT(scheduleViewportResolution()));
+
+        delete viewportResolver;
+        viewportResolver = 0;
+        pendingViewport.clear();
+    }
 }
 
 void EventModelPrivate::emitDataChanged(int row, void *data)
 {
     Q_Q(EventModel);
 
+    static_cast<EventTreeItem *>(data)->clearCachedData();
+
     const QModelIndex modelIndex(q->createIndex(row, 0, data));
     emit q->dataChanged(modelIndex, modelIndex);
 }
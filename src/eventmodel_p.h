@@ -25,6 +25,7 @@
 #define COMMHISTORY_EVENTMODEL_P_H
 
 #include <QList>
+#include <QStringList>
 #include <QGenericArgument>
 
 #include "eventmodel.h"
@@ -87,9 +88,10 @@ public:
     /*!
      * Executes a database query. fillModel() is called when new events
      * are received, and modelReady() is emitted when the query is
-     * finished.
+     * finished. With \a archived, the query reads the archive database
+     * and so are the properties and parts of its events.
      */
-    bool executeQuery(QSqlQuery &query);
+    bool executeQuery(QSqlQuery &query, bool archived = false);
 
     /*!
      * Add new events from the query results to the internal event
@@ -111,6 +113,38 @@ public:
      */
     virtual void clearEvents();
 
+    /*!
+     * Applies the database change journal since changeSequence.
+     */
+    virtual bool syncChanges();
+
+    /*!
+     * Repeats the last query from scratch. Used by syncChanges() when the
+     * journal no longer covers changeSequence. Returns false if the model
+     * does not support reloading.
+     */
+    virtual bool reloadEvents();
+
+    /*!
+     * Makes the result of the next query replace the rows with
+     * refreshEvents() instead of being appended to them. Use this instead
+     * of a model reset when the same rows are queried with another filter.
+     */
+    void beginRefresh();
+
+    /*!
+     * Turns the top level rows into \a events using as few row removals,
+     * moves and insertions as possible. Rows are matched by event id and
+     * kept rows get dataChanged() if their contents differ.
+     */
+    void refreshEvents(const QList<Event> &events);
+
+    /*!
+     * Tree version of refreshEvents(), for models that group events under
+     * top level items. Takes ownership of \a items.
+     */
+    void refreshItems(const QList<EventTreeItem *> &items);
+
     void setBufferInsertions(bool buffer);
 
     void addToModel(const Event &event, bool synchronous = false) { addToModel(QList<Event>() << event, synchronous); }
@@ -118,6 +152,7 @@ public:
     virtual void addToModel(const QList<Event> &event, bool synchronous = false);
     virtual void modifyInModel(Event &event);
     virtual void deleteFromModel(int id);
+    virtual void deleteFromModel(const QList<int> &ids);
     virtual void recipientsUpdated(const QSet<Recipient> &recipients, bool resolved = false);
 
     QModelIndex findEventRecursive(int id, EventTreeItem *parent) const;
@@ -131,6 +166,14 @@ public:
 
     DatabaseIO *database();
 
+    /*!
+     * Restricts the eventsAdded/eventsUpdated D-Bus subscription to the
+     * given scoped object paths (see groupUpdatesPath() and
+     * eventTypeUpdatesPath()). An empty list listens to all updates.
+     */
+    void setUpdatesScope(const QStringList &paths);
+    void connectEventUpdates(bool enable);
+
     void recipientsChangedRecursive(const QSet<Recipient> &recipients, EventTreeItem *parent, bool resolved = false);
     void emitDataChanged(int row, void *data);
 
@@ -140,8 +183,14 @@ public:
     // a nonstandard model.
     EventTreeItem *eventRootItem;
 
-    mutable ContactResolver *addResolver, *receiveResolver, *onDemandResolver;
-    mutable QList<Event> pendingAdded, pendingReceived, pendingOnDemand, bufferedInsertions;
+    mutable ContactResolver *addResolver, *receiveResolver, *onDemandResolver, *viewportResolver;
+    mutable QList<Event> pendingAdded, pendingReceived, pendingOnDemand, pendingViewport, bufferedInsertions;
+
+    // Rows reported by EventModel::setVisibleRange(), for ResolveVisible
+    int visibleFirst;
+    int visibleLast;
+    int resolveMargin;
+    bool viewportScheduled;
 
     EventModel::QueryMode queryMode;
     uint chunkSize;
@@ -166,6 +215,14 @@ public:
 
     QSharedPointer<UpdatesEmitter> emitter;
 
+    QStringList updatesScope;
+
+    // Change journal position of the current contents
+    qint64 changeSequence;
+
+    // Next query result replaces the rows, see beginRefresh()
+    bool refreshing;
+
 public Q_SLOTS:
     virtual void prependEvents(QList<Event> events, bool resolved);
     virtual bool fillModel(QList<Event> events, bool resolved);
@@ -173,6 +230,11 @@ public Q_SLOTS:
     virtual void receiveResolverFinished();
     virtual void addResolverFinished();
     virtual void onDemandResolverFinished();
+    void viewportResolverFinished();
+
+    // Resolves the unresolved rows in and around the visible range
+    void resolveViewport();
+    void scheduleViewportResolution();
 
     virtual void eventsReceivedSlot(int start, int end, QList<CommHistory::Event> events);
 
@@ -184,6 +246,8 @@ public Q_SLOTS:
 
     virtual void eventDeletedSlot(int id);
 
+    virtual void eventsDeletedSlot(const QList<int> &ids);
+
     virtual void canFetchMoreChangedSlot(bool canFetch);
 
     virtual void slotContactInfoChanged(const RecipientList &recipients);
@@ -199,6 +263,8 @@ Q_SIGNALS:
 
     void eventDeleted(int id);
 
+    void eventsDeleted(const QList<int> &ids);
+
     void groupsUpdated(const QList<int> &groupIds);
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
 
@@ -96,6 +96,7 @@ void EventTreeItem::setEvent(const Event &event)
 {
     delete eventData;
     eventData = new Event(event);
+    cachedValues.clear();
 }
 
 EventTreeItem *EventTreeItem::parent()
@@ -111,3 +112,19 @@ int EventTreeItem::row() const
 
     return 0;
 }
+
+const QVariant *EventTreeItem::cachedData(int role) const
+{
+    QHash<int, QVariant>::const_iterator it = cachedValues.constFind(role);
+    return it != cachedValues.constEnd() ? &it.value() : 0;
+}
+
+void EventTreeItem::setCachedData(int role, const QVariant &value)
+{
+    cachedValues.insert(role, value);
+}
+
+void EventTreeItem::clearCachedData()
+{
+    cachedValues.clear();
+}
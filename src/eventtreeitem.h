@@ -23,7 +23,9 @@
 #ifndef COMMHISTORY_EVENTTREEITEM_H
 #define COMMHISTORY_EVENTTREEITEM_H
 
+#include <QHash>
 #include <QList>
+#include <QVariant>
 
 namespace CommHistory {
 
@@ -53,9 +55,18 @@ public:
     EventTreeItem *parent();
     int row() const;
 
+    /*!
+     * Role values computed by the model for this event. setEvent() clears
+     * them; callers changing the event in place must call clearCachedData().
+     */
+    const QVariant *cachedData(int role) const;
+    void setCachedData(int role, const QVariant &value);
+    void clearCachedData();
+
 private:
     QList<EventTreeItem *> children;
     Event *eventData;
+    QHash<int, QVariant> cachedValues;
     EventTreeItem *parentItem;
 };
 
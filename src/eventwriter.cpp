@@ -0,0 +1,245 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "eventwriter.h"
+#include "eventwriter_p.h"
+
+#include <QCoreApplication>
+#include <QPointer>
+
+#include "databaseio.h"
+#include "updatesemitter.h"
+#include "debug_p.h"
+
+using namespace CommHistory;
+
+EventWriterPrivate::EventWriterPrivate()
+    : emitter(UpdatesEmitter::instance())
+{
+}
+
+bool EventWriterPrivate::writeAddedEvents(DatabaseIO *database, QList<Event> &events)
+{
+    // Cannot be foreach, because addEvent modifies the events with their new ID
+    for (int i = 0; i < events.size(); i++) {
+        if (!database->addEvent(events[i]))
+            return false;
+    }
+
+    return true;
+}
+
+bool EventWriterPrivate::writeModifiedEvents(DatabaseIO *database, QList<Event> &events,
+                                             QList<int> *updatedGroupIds)
+{
+    for (QList<Event>::Iterator it = events.begin(); it != events.end(); it++) {
+        Event &event = *it;
+        if (event.id() == -1) {
+            qCWarning(lcCommHistory) << Q_FUNC_INFO << "Event id not set";
+            return false;
+        }
+
+        if (event.lastModifiedT() == 0)
+            event.setLastModifiedT(Event::currentTime_t());
+
+        if (!database->modifyEvent(event))
+            return false;
+
+        if (updatedGroupIds
+            && event.isValid()
+            && event.groupId() != -1
+            && !updatedGroupIds->contains(event.groupId())) {
+            updatedGroupIds->append(event.groupId());
+        }
+    }
+
+    return true;
+}
+
+bool EventWriterPrivate::addEvents(DatabaseIO *database, UpdatesEmitter *emitter, QList<Event> &events)
+{
+    if (!database->transaction())
+        return false;
+
+    if (!writeAddedEvents(database, events)) {
+        database->rollback();
+        return false;
+    }
+
+    if (!database->commit())
+        return false;
+
+    emit emitter->eventsAdded(events);
+    return true;
+}
+
+bool EventWriterPrivate::modifyEvents(DatabaseIO *database, UpdatesEmitter *emitter, QList<Event> &events)
+{
+    if (!database->transaction())
+        return false;
+
+    QList<int> modifiedGroups;
+    if (!writeModifiedEvents(database, events, &modifiedGroups)) {
+        database->rollback();
+        return false;
+    }
+
+    if (!database->commit())
+        return false;
+
+    emit emitter->eventsUpdated(events);
+    if (!modifiedGroups.isEmpty())
+        emit emitter->groupsUpdated(modifiedGroups);
+
+    return true;
+}
+
+bool EventWriterPrivate::deleteEvents(DatabaseIO *database, UpdatesEmitter *emitter,
+                                      const QList<int> &eventIds)
+{
+    if (eventIds.isEmpty())
+        return true;
+
+    if (!database->transaction())
+        return false;
+
+    QList<int> updatedGroups, deletedGroups;
+    if (!database->deleteEvents(eventIds, &updatedGroups, &deletedGroups)) {
+        database->rollback();
+        return false;
+    }
+
+    if (!database->commit())
+        return false;
+
+    if (eventIds.size() == 1)
+        emit emitter->eventDeleted(eventIds.first());
+    else
+        emit emitter->eventsDeleted(eventIds);
+    if (!deletedGroups.isEmpty())
+        emit emitter->groupsDeleted(deletedGroups);
+    if (!updatedGroups.isEmpty())
+        emit emitter->groupsUpdated(updatedGroups);
+
+    return true;
+}
+
+EventWriter::EventWriter(QObject *parent)
+    : QObject(parent), d_ptr(new EventWriterPrivate)
+{
+}
+
+EventWriter::~EventWriter()
+{
+    delete d_ptr;
+}
+
+EventWriter *EventWriter::instance()
+{
+    // Owned by the application, so that the emitter stays registered
+    // between writes
+    static QPointer<EventWriter> writer;
+    if (!writer)
+        writer = new EventWriter(QCoreApplication::instance());
+    return writer;
+}
+
+bool EventWriter::addEvent(Event &event)
+{
+    QList<Event> list;
+    list << event;
+    bool ok = addEvents(list);
+    event = list.first();
+    return ok;
+}
+
+bool EventWriter::addEvents(QList<Event> &events)
+{
+    Q_D(EventWriter);
+
+    if (!EventWriterPrivate::addEvents(DatabaseIO::instance(), d->emitter.data(), events))
+        return false;
+
+    emit eventsCommitted(events, true);
+    return true;
+}
+
+bool EventWriter::modifyEvent(Event &event)
+{
+    QList<Event> list;
+    list << event;
+    bool ok = modifyEvents(list);
+    event = list.first();
+    return ok;
+}
+
+bool EventWriter::modifyEvents(QList<Event> &events)
+{
+    Q_D(EventWriter);
+
+    if (!EventWriterPrivate::modifyEvents(DatabaseIO::instance(), d->emitter.data(), events))
+        return false;
+
+    emit eventsCommitted(events, true);
+    return true;
+}
+
+bool EventWriter::deleteEvent(Event &event)
+{
+    Q_D(EventWriter);
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << ":" << event.id();
+
+    if (!event.isValid()) {
+        qCWarning(lcCommHistory) << Q_FUNC_INFO << "Invalid event";
+        return false;
+    }
+
+    if (!EventWriterPrivate::deleteEvents(DatabaseIO::instance(), d->emitter.data(),
+                                          QList<int>() << event.id())) {
+        return false;
+    }
+
+    emit eventsCommitted(QList<Event>() << event, true);
+    return true;
+}
+
+bool EventWriter::deleteEvents(const QList<int> &eventIds)
+{
+    Q_D(EventWriter);
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << ":" << eventIds.size() << "events";
+
+    if (eventIds.isEmpty())
+        return true;
+
+    if (!EventWriterPrivate::deleteEvents(DatabaseIO::instance(), d->emitter.data(), eventIds))
+        return false;
+
+    QList<Event> deletedEvents;
+    foreach (int id, eventIds) {
+        Event event;
+        event.setId(id);
+        deletedEvents << event;
+    }
+
+    emit eventsCommitted(deletedEvents, true);
+    return true;
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_EVENTWRITER_H
+#define COMMHISTORY_EVENTWRITER_H
+
+#include <QObject>
+#include "event.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class EventWriterPrivate;
+
+/*!
+ * \class EventWriter
+ * \brief Adds, modifies and deletes events without a model.
+ *
+ * EventWriter writes like the EventModel functions of the same names and
+ * emits the same change signals to the models in all processes. It holds
+ * no rows and does not resolve contacts or listen for updates. Writes
+ * are synchronous; use WriteQueue to write in the background.
+ *
+ * For occasional writes use the shared instance(), which keeps the
+ * change notifications registered for the lifetime of the application.
+ */
+class LIBCOMMHISTORY_EXPORT EventWriter : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(EventWriter)
+
+public:
+    explicit EventWriter(QObject *parent = 0);
+    ~EventWriter();
+
+    /*!
+     * Shared writer owned by the application. Its eventsCommitted() is
+     * emitted for the writes of every user.
+     */
+    static EventWriter *instance();
+
+    /*!
+     * Add events to the database. The new ids are set on the events.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool addEvent(Event &event);
+    bool addEvents(QList<Event> &events);
+
+    /*!
+     * Modify events in the database. Every event needs a valid id.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool modifyEvent(Event &event);
+    bool modifyEvents(QList<Event> &events);
+
+    /*!
+     * Delete events, and the groups left without events.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool deleteEvent(Event &event);
+    bool deleteEvents(const QList<int> &eventIds);
+
+Q_SIGNALS:
+    /*!
+     * Emitted when a write has been committed.
+     *
+     * \param events committed events; for deletions by id only their ids are set
+     * \param successful true; failed writes are reported by the return value
+     */
+    void eventsCommitted(const QList<CommHistory::Event> &events, bool successful);
+
+private:
+    EventWriterPrivate *d_ptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_EVENTWRITER_P_H
+#define COMMHISTORY_EVENTWRITER_P_H
+
+#include <QSharedPointer>
+
+#include "event.h"
+
+namespace CommHistory {
+
+class DatabaseIO;
+class UpdatesEmitter;
+
+/*
+ * The writes shared by EventWriter, EventModel and WriteQueue.
+ *
+ * writeAddedEvents() and writeModifiedEvents() run inside the caller's
+ * transaction. addEvents(), modifyEvents() and deleteEvents() wrap the
+ * write in a transaction and announce it through the emitter once it has
+ * been committed.
+ */
+class EventWriterPrivate
+{
+public:
+    EventWriterPrivate();
+
+    static bool writeAddedEvents(DatabaseIO *database, QList<Event> &events);
+    static bool writeModifiedEvents(DatabaseIO *database, QList<Event> &events,
+                                    QList<int> *updatedGroupIds);
+
+    static bool addEvents(DatabaseIO *database, UpdatesEmitter *emitter, QList<Event> &events);
+    static bool modifyEvents(DatabaseIO *database, UpdatesEmitter *emitter, QList<Event> &events);
+    // A single id is announced with eventDeleted() for older listeners
+    static bool deleteEvents(DatabaseIO *database, UpdatesEmitter *emitter, const QList<int> &eventIds);
+
+    QSharedPointer<UpdatesEmitter> emitter;
+};
+
+}
+
+#endif
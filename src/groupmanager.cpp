@@ -123,6 +123,8 @@ public:
     QList<Group> pendingResolve;
     QSet<int> pendingIds;
     QList<GroupObject *> pendingObjects;
+
+    qint64 changeSequence;
 };
 
 }
@@ -137,6 +139,7 @@ GroupManagerPrivate::GroupManagerPrivate(GroupManager *manager)
         , queryLimit(0)
         , queryOffset(0)
         , isReady(true)
+        , changeSequence(0)
         , filterLocalUid(QString())
         , filterRemoteUid(QString())
         , bgThread(0)
@@ -555,6 +558,9 @@ bool GroupManager::getGroups(const QString &localUid,
         d->groups.clear();
     }
 
+    if (!d->database()->currentChangeSequence(d->changeSequence))
+        d->changeSequence = 0;
+
     QString queryOrder;
     if (d->queryLimit > 0)
         queryOrder += QString::fromLatin1("LIMIT %1 ").arg(d->queryLimit);
@@ -575,6 +581,48 @@ bool GroupManager::getGroups(const QString &localUid,
     return true;
 }
 
+bool GroupManager::syncChanges()
+{
+    QList<DatabaseIO::Change> changes;
+    bool resetRequired = false;
+    if (!d->database()->getChangesSince(d->changeSequence, changes, resetRequired))
+        return false;
+
+    if (resetRequired)
+        return getGroups(d->filterLocalUid, d->filterRemoteUid);
+
+    // Event changes affect the last event and unread count of their group
+    QList<int> deleted;
+    QSet<int> touched;
+    foreach (const DatabaseIO::Change &change, changes) {
+        d->changeSequence = change.sequence;
+        if (change.itemType == DatabaseIO::GroupChange && change.operation == DatabaseIO::ItemDeleted)
+            deleted.append(change.itemId);
+        else if (change.groupId >= 0)
+            touched.insert(change.groupId);
+    }
+
+    d->groupsDeletedSlot(deleted);
+
+    QList<Group> added;
+    foreach (int groupId, touched) {
+        if (deleted.contains(groupId))
+            continue;
+
+        Group group;
+        if (!d->database()->getGroup(groupId, group))
+            continue;
+
+        if (d->groups.contains(groupId))
+            d->modifyInModel(group, false);
+        else
+            added.append(group);
+    }
+    d->groupsAddedSlot(added);
+
+    return true;
+}
+
 void GroupManagerPrivate::contactResolveFinished()
 {
     Q_Q(GroupManager);
@@ -612,32 +660,51 @@ void GroupManagerPrivate::contactResolveFinished()
 
 bool GroupManager::markAsReadGroup(int id)
 {
-    qCDebug(lcCommHistory) << Q_FUNC_INFO << id;
+    DatabaseIO::ReadFilter filter;
+    filter.groupIds << id;
+    return markAsRead(filter);
+}
+
+bool GroupManager::markAsRead(const DatabaseIO::ReadFilter &filter)
+{
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << filter.groupIds;
+
+    // Without other conditions every listed group ends up read, and is
+    // announced as before even if it had no unread events
+    const bool wholeGroups = !filter.groupIds.isEmpty()
+                             && filter.eventType == Event::UnknownType
+                             && filter.localUid.isEmpty()
+                             && !filter.before.isValid();
 
     if (!d->database()->transaction())
         return false;
 
-    if (!d->database()->markAsReadGroup(id)) {
+    QHash<int, int> unreadDeltas;
+    if (!d->database()->markAsRead(filter, wholeGroups ? 0 : &unreadDeltas)) {
         d->database()->rollback();
         return false;
     }
 
-    if (!d->commitTransaction(QList<int>() << id))
+    const QList<int> groupIds = wholeGroups ? filter.groupIds : unreadDeltas.keys();
+    if (!d->commitTransaction(groupIds))
         return false;
 
-    GroupObject *group = 0;
-    foreach (GroupObject *g, d->groups) {
-        if (g->id() == id) {
-            group = g;
-            group->setUnreadMessages(0);
-            break;
+    QList<Group> updated;
+    QList<int> updatedIds;
+    foreach (int id, groupIds) {
+        GroupObject *group = d->groups.value(id);
+        if (group) {
+            group->setUnreadMessages(wholeGroups ? 0 : qMax(group->unreadMessages() - unreadDeltas.value(id), 0));
+            updated.append(group->toGroup());
+        } else {
+            updatedIds.append(id);
         }
     }
 
-    if (group)
-        emit d->emitter->groupsUpdatedFull(QList<Group>() << group->toGroup());
-    else
-        emit d->emitter->groupsUpdated(QList<int>() << id);
+    if (!updated.isEmpty())
+        emit d->emitter->groupsUpdatedFull(updated);
+    if (!updatedIds.isEmpty())
+        emit d->emitter->groupsUpdated(updatedIds);
 
     return true;
 }
@@ -654,10 +721,22 @@ bool GroupManager::deleteGroups(const QList<int> &groupIds)
 {
     qCDebug(lcCommHistory) << Q_FUNC_INFO << groupIds;
 
+    if (d->bgThread) {
+        // The groups are hidden at once and their events are deleted in
+        // chunks on the background thread
+        const bool success = d->database()->deleteGroups(groupIds, d->bgThread);
+        emit groupsCommitted(groupIds, success);
+        if (!success)
+            return false;
+
+        emit d->emitter->groupsDeleted(groupIds);
+        return true;
+    }
+
     if (!d->database()->transaction())
         return false;
 
-    if (!d->database()->deleteGroups(groupIds, d->bgThread)) {
+    if (!d->database()->deleteGroups(groupIds)) {
         d->database()->rollback();
         return false;
     }
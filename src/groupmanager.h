@@ -27,6 +27,7 @@
 #include "groupobject.h"
 #include "libcommhistoryexport.h"
 #include "eventmodel.h"
+#include "databaseio.h"
 
 namespace CommHistory {
 
@@ -169,6 +170,10 @@ public:
     /*!
      * Delete groups from database.
      *
+     * With a background thread set, the groups are hidden right away and
+     * their events are deleted in chunks on that thread, see
+     * DatabaseIO::deleteGroups().
+     *
      * \param groupIds List of group ids to be deleted.
      * \return true if successful, otherwise false
      */
@@ -191,6 +196,17 @@ public:
      */
     bool markAsReadGroup(int id);
 
+    /*!
+     * Mark the unread events selected by \a filter as read, for example
+     * those of several groups or of one account, with one statement.
+     * A single update is emitted for all affected groups.
+     * NOTE: as with markAsReadGroup(), event models are not updated.
+     *
+     * \param filter events to mark
+     * \return true if successful, otherwise false
+     */
+    bool markAsRead(const DatabaseIO::ReadFilter &filter);
+
     /*!
      * Update groups data
      *
@@ -198,6 +214,17 @@ public:
      */
     void updateGroups(QList<Group> &groups);
 
+    /*!
+     * Applies changes made to the database since getGroups() or the last
+     * call to this method, for example when update signals were missed
+     * while the process was suspended. Only the affected groups are
+     * queried; if the change journal no longer covers the whole period,
+     * the groups are reloaded with getGroups().
+     *
+     * \return true if successful, otherwise false
+     */
+    bool syncChanges();
+
     /*!
      * True when data is loaded from the database
      */
@@ -359,6 +359,12 @@ bool GroupModel::markAsReadGroup(int id)
     return d->manager->markAsReadGroup(id);
 }
 
+bool GroupModel::markAsRead(const DatabaseIO::ReadFilter &filter)
+{
+    d->ensureManager();
+    return d->manager->markAsRead(filter);
+}
+
 void GroupModel::updateGroups(QList<Group> &groups)
 {
     d->ensureManager();
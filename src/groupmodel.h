@@ -218,6 +218,11 @@ public:
      */
     bool markAsReadGroup(int id);
 
+    /*!
+     * \sa GroupManager::markAsRead()
+     */
+    bool markAsRead(const DatabaseIO::ReadFilter &filter);
+
     /*!
      * Update groups data, only model is updated
      *
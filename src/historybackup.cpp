@@ -0,0 +1,495 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "historybackup.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QHash>
+#include <QIODevice>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#include "commhistorydatabase.h"
+#include "databaseio.h"
+#include "databaseio_p.h"
+#include "updatesemitter.h"
+#include "debug_p.h"
+
+using namespace CommHistory;
+
+namespace {
+
+/*
+ * File format, in QDataStream (Qt 4.7) encoding:
+ *
+ *   quint32 magic, quint16 version, quint16 flags
+ *   chunks of: quint8 type, qint32 count, QByteArray items
+ *   an EndChunk
+ *
+ * Items are zlib compressed when flags has CompressedFlag. A GroupChunk
+ * holds id, localUid, remoteUids, chatType, chatName and lastModified of
+ * each group, an EventChunk each Event followed by its extra properties.
+ * Readers skip chunk types they do not know.
+ */
+const quint32 BACKUP_MAGIC = 0x4348424b; // "CHBK"
+const quint16 BACKUP_VERSION = 1;
+const quint16 COMPRESSED_FLAG = 0x1;
+
+enum ChunkType {
+    EndChunk = 0,
+    GroupChunk = 1,
+    EventChunk = 2
+};
+
+}
+
+namespace CommHistory {
+
+class HistoryBackupPrivate
+{
+    Q_DECLARE_PUBLIC(HistoryBackup)
+
+public:
+    HistoryBackup *q_ptr;
+    int chunkSize;
+    bool compressed;
+    int groupCount;
+    int eventCount;
+    QHash<int, int> groupIds;
+
+    explicit HistoryBackupPrivate(HistoryBackup *parent);
+
+    QSqlDatabase &connection();
+
+    bool writeChunk(QDataStream &out, ChunkType type, int count, QBuffer &items);
+    bool exportGroups(QDataStream &out, const QList<Group> &groups);
+    bool exportEvents(QDataStream &out, const QString &condition, bool archive);
+
+    bool importGroups(QDataStream &items, int count, QList<Group> &added);
+    bool importEvents(QDataStream &items, int count, bool &ungrouped);
+};
+
+} // namespace CommHistory
+
+HistoryBackupPrivate::HistoryBackupPrivate(HistoryBackup *parent)
+    : q_ptr(parent),
+      chunkSize(5000),
+      compressed(false),
+      groupCount(0),
+      eventCount(0)
+{
+}
+
+QSqlDatabase &HistoryBackupPrivate::connection()
+{
+    return DatabaseIOPrivate::instance()->connection();
+}
+
+bool HistoryBackupPrivate::writeChunk(QDataStream &out, ChunkType type, int count, QBuffer &items)
+{
+    out << quint8(type) << qint32(count) << (compressed ? qCompress(items.data()) : items.data());
+
+    items.buffer().clear();
+    items.seek(0);
+
+    if (out.status() != QDataStream::Ok) {
+        qCWarning(lcCommHistory) << "Failed to write backup chunk:" << out.device()->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool HistoryBackupPrivate::exportGroups(QDataStream &out, const QList<Group> &groups)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream items(&buffer);
+    items.setVersion(QDataStream::Qt_4_7);
+
+    int count = 0;
+    foreach (const Group &group, groups) {
+        items << group.id() << group.localUid() << group.recipients().remoteUids()
+              << int(group.chatType()) << group.chatName() << group.lastModifiedT();
+        groupCount++;
+
+        if (++count == chunkSize) {
+            if (!writeChunk(out, GroupChunk, count, buffer))
+                return false;
+            count = 0;
+        }
+    }
+
+    return !count || writeChunk(out, GroupChunk, count, buffer);
+}
+
+bool HistoryBackupPrivate::exportEvents(QDataStream &out, const QString &condition, bool archive)
+{
+    Q_Q(HistoryBackup);
+
+    const QString prefix = archive ? QStringLiteral("archive.") : QString();
+    const QString eventIds = QString::fromLatin1("SELECT id FROM %1Events AS Events WHERE %2")
+            .arg(prefix).arg(condition);
+
+    // Properties and parts are read with cursors of their own in event id
+    // order and merged into the events as they are passed
+    QString q = (archive ? DatabaseIOPrivate::archiveEventQueryBase() : DatabaseIOPrivate::eventQueryBase())
+            + QString::fromLatin1("WHERE %1 ORDER BY Events.id").arg(condition);
+    QSqlQuery events = CommHistoryDatabase::prepare(q.toUtf8().constData(), connection());
+
+    q = QString::fromLatin1("SELECT eventId, key, value FROM %1EventProperties WHERE eventId IN (%2) ORDER BY eventId")
+            .arg(prefix).arg(eventIds);
+    QSqlQuery properties = CommHistoryDatabase::prepare(q.toUtf8().constData(), connection());
+
+    q = QString::fromLatin1("SELECT eventId, id, contentId, contentType, path FROM %1MessageParts "
+                            "WHERE eventId IN (%2) ORDER BY eventId, id")
+            .arg(prefix).arg(eventIds);
+    QSqlQuery parts = CommHistoryDatabase::prepare(q.toUtf8().constData(), connection());
+
+    QSqlQuery *queries[] = { &events, &properties, &parts };
+    for (int i = 0; i < 3; i++) {
+        if (!queries[i]->exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << queries[i]->lastError();
+            qCWarning(lcCommHistory) << queries[i]->lastQuery();
+            return false;
+        }
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream items(&buffer);
+    items.setVersion(QDataStream::Qt_4_7);
+
+    bool moreProperties = properties.next();
+    bool moreParts = parts.next();
+    int count = 0;
+
+    while (events.next()) {
+        Event event;
+        bool hasExtraProperties, hasMessageParts;
+        DatabaseIOPrivate::readEventResult(events, event, hasExtraProperties, hasMessageParts);
+
+        QVariantMap extraProperties;
+        while (moreProperties && properties.value(0).toInt() <= event.id()) {
+            if (properties.value(0).toInt() == event.id())
+                extraProperties.insert(properties.value(1).toString(), properties.value(2).toString());
+            moreProperties = properties.next();
+        }
+
+        QList<MessagePart> messageParts;
+        while (moreParts && parts.value(0).toInt() <= event.id()) {
+            if (parts.value(0).toInt() == event.id()) {
+                MessagePart part;
+                part.setId(parts.value(1).toInt());
+                part.setContentId(parts.value(2).toString());
+                part.setContentType(parts.value(3).toString());
+                part.setPath(parts.value(4).toString());
+                messageParts.append(part);
+            }
+            moreParts = parts.next();
+        }
+        event.setMessageParts(messageParts);
+
+        items << event << extraProperties;
+        eventCount++;
+
+        if (++count == chunkSize) {
+            if (!writeChunk(out, EventChunk, count, buffer))
+                return false;
+            count = 0;
+            emit q->progress(eventCount);
+        }
+    }
+
+    if (count) {
+        if (!writeChunk(out, EventChunk, count, buffer))
+            return false;
+        emit q->progress(eventCount);
+    }
+
+    return true;
+}
+
+bool HistoryBackupPrivate::importGroups(QDataStream &items, int count, QList<Group> &added)
+{
+    DatabaseIO *database = DatabaseIO::instance();
+
+    for (int i = 0; i < count; i++) {
+        int id, chatType;
+        QString localUid, chatName;
+        QStringList remoteUids;
+        quint32 lastModified;
+        items >> id >> localUid >> remoteUids >> chatType >> chatName >> lastModified;
+        if (items.status() != QDataStream::Ok) {
+            qCWarning(lcCommHistory) << "Corrupt group chunk in backup";
+            return false;
+        }
+
+        Group group;
+        group.setLocalUid(localUid);
+        group.setRecipients(RecipientList::fromUids(localUid, remoteUids));
+        group.setChatType(static_cast<Group::ChatType>(chatType));
+        group.setChatName(chatName);
+        group.setLastModifiedT(lastModified);
+
+        if (!database->addGroup(group)) {
+            qCWarning(lcCommHistory) << "Error adding group ( local" << localUid
+                                     << ", remote" << group.recipients().debugString() << ")";
+            return false;
+        }
+
+        groupIds.insert(id, group.id());
+        added.append(group);
+        groupCount++;
+    }
+
+    return true;
+}
+
+bool HistoryBackupPrivate::importEvents(QDataStream &items, int count, bool &ungrouped)
+{
+    DatabaseIO *database = DatabaseIO::instance();
+
+    for (int i = 0; i < count; i++) {
+        Event event;
+        QVariantMap extraProperties;
+        items >> event >> extraProperties;
+        if (items.status() != QDataStream::Ok) {
+            qCWarning(lcCommHistory) << "Corrupt event chunk in backup";
+            return false;
+        }
+
+        if (event.groupId() != -1) {
+            QHash<int, int>::const_iterator it = groupIds.constFind(event.groupId());
+            if (it == groupIds.constEnd()) {
+                qCWarning(lcCommHistory) << "Skipping event" << event.id() << "of unknown group" << event.groupId();
+                continue;
+            }
+            event.setGroupId(*it);
+        }
+
+        // New rows for the event and its parts
+        event.setId(-1);
+        QList<MessagePart> parts = event.messageParts();
+        for (int j = 0; j < parts.size(); j++)
+            parts[j].setId(-1);
+        event.setMessageParts(parts);
+        event.setExtraProperties(extraProperties);
+
+        if (!database->addEvent(event))
+            return false;
+        if (event.groupId() == -1)
+            ungrouped = true;
+        eventCount++;
+    }
+
+    return true;
+}
+
+HistoryBackup::HistoryBackup(QObject *parent)
+    : QObject(parent),
+      d_ptr(new HistoryBackupPrivate(this))
+{
+}
+
+HistoryBackup::~HistoryBackup()
+{
+    delete d_ptr;
+}
+
+int HistoryBackup::chunkSize() const
+{
+    Q_D(const HistoryBackup);
+    return d->chunkSize;
+}
+
+void HistoryBackup::setChunkSize(int size)
+{
+    Q_D(HistoryBackup);
+    d->chunkSize = qMax(1, size);
+}
+
+bool HistoryBackup::isCompressed() const
+{
+    Q_D(const HistoryBackup);
+    return d->compressed;
+}
+
+void HistoryBackup::setCompressed(bool compressed)
+{
+    Q_D(HistoryBackup);
+    d->compressed = compressed;
+}
+
+int HistoryBackup::groupCount() const
+{
+    Q_D(const HistoryBackup);
+    return d->groupCount;
+}
+
+int HistoryBackup::eventCount() const
+{
+    Q_D(const HistoryBackup);
+    return d->eventCount;
+}
+
+bool HistoryBackup::exportTo(QIODevice *device, int contents, int groupId)
+{
+    Q_D(HistoryBackup);
+
+    d->groupCount = 0;
+    d->eventCount = 0;
+
+    QList<Group> groups;
+    QStringList conditions;
+    if (contents & Conversations) {
+        if (groupId != -1) {
+            Group group;
+            if (!DatabaseIO::instance()->getGroup(groupId, group)) {
+                qCWarning(lcCommHistory) << "Error reading group" << groupId;
+                return false;
+            }
+            groups.append(group);
+            conditions << QString::fromLatin1("groupId = %1").arg(groupId);
+        } else {
+            if (!DatabaseIO::instance()->getGroups(QString(), QString(), groups))
+                return false;
+            // Groups waiting for background deletion are left out
+            conditions << QString::fromLatin1("groupId IN (SELECT id FROM Groups WHERE isDeleted = 0)");
+        }
+    }
+    if (contents & Calls)
+        conditions << QString::fromLatin1("type = %1").arg(Event::CallEvent);
+
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_4_7);
+    out << BACKUP_MAGIC << BACKUP_VERSION << quint16(d->compressed ? COMPRESSED_FLAG : 0);
+
+    if (!d->exportGroups(out, groups))
+        return false;
+
+    if (!conditions.isEmpty()) {
+        const QString condition = QLatin1Char('(') + conditions.join(QStringLiteral(" OR ")) + QLatin1Char(')');
+        if (!d->exportEvents(out, condition, false))
+            return false;
+        if (CommHistoryDatabase::hasArchive(d->connection()) && !d->exportEvents(out, condition, true))
+            return false;
+    }
+
+    out << quint8(EndChunk) << qint32(0) << QByteArray();
+    return out.status() == QDataStream::Ok;
+}
+
+bool HistoryBackup::importFrom(QIODevice *device)
+{
+    Q_D(HistoryBackup);
+
+    d->groupCount = 0;
+    d->eventCount = 0;
+    d->groupIds.clear();
+
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_4_7);
+
+    quint32 magic;
+    quint16 version, flags;
+    in >> magic >> version >> flags;
+    if (in.status() != QDataStream::Ok || magic != BACKUP_MAGIC) {
+        qCWarning(lcCommHistory) << "Not a history backup";
+        return false;
+    }
+    if (version > BACKUP_VERSION) {
+        qCWarning(lcCommHistory) << "Unsupported backup version" << version;
+        return false;
+    }
+
+    DatabaseIO *database = DatabaseIO::instance();
+    QSharedPointer<UpdatesEmitter> emitter = UpdatesEmitter::instance();
+    QList<Group> addedGroups;
+    bool ungrouped = false;
+    bool ok = true;
+
+    forever {
+        quint8 type;
+        qint32 count;
+        QByteArray data;
+        in >> type >> count >> data;
+        if (in.status() != QDataStream::Ok) {
+            qCWarning(lcCommHistory) << "Backup is truncated";
+            ok = false;
+            break;
+        }
+
+        if (type == EndChunk)
+            break;
+        if (type != GroupChunk && type != EventChunk)
+            continue;
+
+        if (flags & COMPRESSED_FLAG)
+            data = qUncompress(data);
+        QDataStream items(data);
+        items.setVersion(QDataStream::Qt_4_7);
+
+        // One transaction per chunk
+        if (!database->transaction()) {
+            ok = false;
+            break;
+        }
+
+        QList<Group> groups;
+        const bool added = type == GroupChunk
+                ? d->importGroups(items, count, groups)
+                : d->importEvents(items, count, ungrouped);
+        if (!added) {
+            database->rollback();
+            ok = false;
+            break;
+        }
+        if (!database->commit()) {
+            ok = false;
+            break;
+        }
+
+        addedGroups.append(groups);
+        if (type == EventChunk)
+            emit progress(d->eventCount);
+    }
+
+    // Nothing is announced per chunk. Open models reload the calls, and
+    // the conversations are read back for their last event and unread
+    // count.
+    if (ungrouped)
+        emit emitter->eventsImported();
+    if (!addedGroups.isEmpty()) {
+        QList<Group> groups;
+        foreach (const Group &added, addedGroups) {
+            Group group;
+            if (database->getGroup(added.id(), group))
+                groups.append(group);
+        }
+        emit emitter->groupsAdded(groups);
+    }
+
+    return ok;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_HISTORYBACKUP_H
+#define COMMHISTORY_HISTORYBACKUP_H
+
+#include <QObject>
+#include "libcommhistoryexport.h"
+
+class QIODevice;
+
+namespace CommHistory {
+
+class HistoryBackupPrivate;
+
+/*!
+ * \class HistoryBackup
+ * \brief Streams conversations and calls to and from a backup file.
+ *
+ * Export walks the Events table, and the archive if there is one, with a
+ * single cursor and writes chunkSize() events at a time, so memory use
+ * does not grow with the size of the history. The file starts with a
+ * magic number and a format version, followed by chunks of groups and
+ * events that can be compressed with zlib.
+ *
+ * Import adds each chunk in one transaction straight through DatabaseIO.
+ * No change signals are sent while importing. Once the import is
+ * complete, the imported conversations are announced with a single
+ * groupsAdded and imported calls with a single eventsImported, on which
+ * open call models reload.
+ */
+class LIBCOMMHISTORY_EXPORT HistoryBackup : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(HistoryBackup)
+
+public:
+    enum ContentFlag {
+        Conversations = 0x1,
+        Calls = 0x2,
+        AllContent = Conversations | Calls
+    };
+
+    explicit HistoryBackup(QObject *parent = 0);
+    ~HistoryBackup();
+
+    /*!
+     * Number of events per chunk, and per transaction when importing,
+     * 5000 by default.
+     */
+    int chunkSize() const;
+    void setChunkSize(int size);
+
+    /*!
+     * Whether exported chunks are compressed, false by default. Import
+     * reads both.
+     */
+    bool isCompressed() const;
+    void setCompressed(bool compressed);
+
+    /*!
+     * Write the history to \a device.
+     *
+     * \param contents Combination of ContentFlag values
+     * \param groupId Only export this conversation, or all if -1
+     * \return true if successful, otherwise false
+     */
+    bool exportTo(QIODevice *device, int contents = AllContent, int groupId = -1);
+
+    /*!
+     * Add the history read from \a device. Conversations are always added
+     * as new groups.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool importFrom(QIODevice *device);
+
+    /*!
+     * Number of groups and events written or added by the last export or
+     * import.
+     */
+    int groupCount() const;
+    int eventCount() const;
+
+Q_SIGNALS:
+    void progress(int events);
+
+private:
+    HistoryBackupPrivate *d_ptr;
+};
+
+}
+
+#endif
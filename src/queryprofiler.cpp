@@ -0,0 +1,338 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "queryprofiler.h"
+#include "queryprofiler_p.h"
+#include "databaseio_p.h"
+#include "debug_p.h"
+
+#include <QMutex>
+#include <QSqlError>
+#include <QSqlRecord>
+
+using namespace CommHistory;
+
+namespace {
+
+struct ProfilerState
+{
+    ProfilerState()
+        : threshold(100), capacity(50)
+    {
+        bool ok = false;
+        const int msec = qgetenv("COMMHISTORY_SLOW_QUERY_MS").toInt(&ok);
+        if (ok && msec >= 0) {
+            threshold = msec;
+            enabled.storeRelease(1);
+        }
+    }
+
+    QAtomicInt enabled;
+    QMutex lock;
+    int threshold;
+    int capacity;
+    QList<QueryProfiler::SlowQuery> queries;
+};
+
+Q_GLOBAL_STATIC(ProfilerState, profilerState)
+
+QStringList explainQueryPlan(const QString &statement, const QVariantMap &boundValues)
+{
+    QStringList plan;
+
+    QSqlQuery query(DatabaseIOPrivate::instance()->connection());
+    if (!query.prepare(QLatin1String("EXPLAIN QUERY PLAN ") + statement)) {
+        plan << query.lastError().text();
+        return plan;
+    }
+    for (QVariantMap::const_iterator it = boundValues.constBegin(); it != boundValues.constEnd(); ++it)
+        query.bindValue(it.key(), it.value());
+    if (!query.exec()) {
+        plan << query.lastError().text();
+        return plan;
+    }
+
+    // Columns are id, parent, notused and detail
+    while (query.next())
+        plan << QString::fromLatin1("%1 %2 %3").arg(query.value(0).toInt()).arg(query.value(1).toInt())
+                .arg(query.value(3).toString());
+    return plan;
+}
+
+}
+
+bool QueryProfiler::isEnabled()
+{
+    return profilerState()->enabled.loadAcquire();
+}
+
+void QueryProfiler::setEnabled(bool enabled)
+{
+    profilerState()->enabled.storeRelease(enabled ? 1 : 0);
+}
+
+int QueryProfiler::threshold()
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    return state->threshold;
+}
+
+void QueryProfiler::setThreshold(int msec)
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    state->threshold = qMax(0, msec);
+}
+
+int QueryProfiler::capacity()
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    return state->capacity;
+}
+
+void QueryProfiler::setCapacity(int count)
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    state->capacity = qMax(1, count);
+    while (state->queries.size() > state->capacity)
+        state->queries.removeFirst();
+}
+
+QList<QueryProfiler::SlowQuery> QueryProfiler::slowQueries()
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    return state->queries;
+}
+
+void QueryProfiler::clear()
+{
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    state->queries.clear();
+}
+
+QString QueryProfiler::toString(const SlowQuery &query)
+{
+    QString result = QString::fromLatin1("%1: %2 us (prepare %3, exec %4, step %5), %6 rows\n")
+            .arg(query.time.toString(QLatin1String("yyyy-MM-ddThh:mm:ss.zzz")))
+            .arg(query.totalUsecs()).arg(query.prepareUsecs).arg(query.execUsecs).arg(query.stepUsecs)
+            .arg(query.rows);
+    result += query.statement.simplified() + QLatin1Char('\n');
+    for (QVariantMap::const_iterator it = query.boundValues.constBegin(); it != query.boundValues.constEnd(); ++it)
+        result += QString::fromLatin1("  %1 = %2\n").arg(it.key()).arg(it.value().toString());
+    foreach (const QString &line, query.plan)
+        result += QLatin1String("  PLAN ") + line + QLatin1Char('\n');
+    return result;
+}
+
+ProfilingResult::ProfilingResult(const QSqlDatabase &database)
+    : QSqlResult(database.driver()),
+      m_query(database),
+      m_prepareNsecs(0),
+      m_execNsecs(0),
+      m_stepNsecs(0),
+      m_rows(0),
+      m_measuring(false)
+{
+}
+
+ProfilingResult::~ProfilingResult()
+{
+    report();
+}
+
+QVariant ProfilingResult::handle() const
+{
+    return m_query.result() ? m_query.result()->handle() : QVariant();
+}
+
+bool ProfilingResult::prepare(const QString &query)
+{
+    m_timer.start();
+    const bool re = m_query.prepare(query);
+    m_prepareNsecs = m_timer.nsecsElapsed();
+    if (!re)
+        setLastError(m_query.lastError());
+    return re;
+}
+
+bool ProfilingResult::exec()
+{
+    report();
+
+    // Named placeholders are resolved to positions by QSqlResult
+    const QVector<QVariant> &values = boundValues();
+    for (int i = 0; i < values.size(); i++)
+        m_query.bindValue(i, values.at(i), bindValueType(i));
+
+    m_measuring = true;
+    m_timer.start();
+    const bool re = m_query.exec();
+    m_execNsecs = m_timer.nsecsElapsed();
+    return executed(re);
+}
+
+bool ProfilingResult::reset(const QString &query)
+{
+    report();
+
+    m_measuring = true;
+    m_timer.start();
+    const bool re = m_query.exec(query);
+    m_execNsecs = m_timer.nsecsElapsed();
+    return executed(re);
+}
+
+bool ProfilingResult::executed(bool re)
+{
+    setAt(QSql::BeforeFirstRow);
+    setSelect(m_query.isSelect());
+    setActive(m_query.isActive());
+    if (!re)
+        setLastError(m_query.lastError());
+    return re;
+}
+
+bool ProfilingResult::fetch(int i)
+{
+    m_timer.start();
+    const bool re = m_query.seek(i);
+    m_stepNsecs += m_timer.nsecsElapsed();
+    return fetched(re);
+}
+
+bool ProfilingResult::fetchFirst()
+{
+    m_timer.start();
+    const bool re = m_query.first();
+    m_stepNsecs += m_timer.nsecsElapsed();
+    return fetched(re);
+}
+
+bool ProfilingResult::fetchLast()
+{
+    m_timer.start();
+    const bool re = m_query.last();
+    m_stepNsecs += m_timer.nsecsElapsed();
+    return fetched(re);
+}
+
+bool ProfilingResult::fetchNext()
+{
+    m_timer.start();
+    const bool re = m_query.next();
+    m_stepNsecs += m_timer.nsecsElapsed();
+    return fetched(re);
+}
+
+bool ProfilingResult::fetched(bool re)
+{
+    if (re) {
+        setAt(m_query.at());
+        m_rows++;
+    }
+    return re;
+}
+
+QVariant ProfilingResult::data(int i)
+{
+    return m_query.value(i);
+}
+
+bool ProfilingResult::isNull(int i)
+{
+    return m_query.isNull(i);
+}
+
+int ProfilingResult::size()
+{
+    return m_query.size();
+}
+
+int ProfilingResult::numRowsAffected()
+{
+    return m_query.numRowsAffected();
+}
+
+QSqlRecord ProfilingResult::record() const
+{
+    return m_query.record();
+}
+
+QVariant ProfilingResult::lastInsertId() const
+{
+    return m_query.lastInsertId();
+}
+
+void ProfilingResult::setForwardOnly(bool forward)
+{
+    QSqlResult::setForwardOnly(forward);
+    m_query.setForwardOnly(forward);
+}
+
+void ProfilingResult::detachFromResultSet()
+{
+    m_query.finish();
+    report();
+}
+
+void ProfilingResult::report()
+{
+    if (!m_measuring)
+        return;
+    m_measuring = false;
+
+    QueryProfiler::SlowQuery result;
+    result.prepareUsecs = m_prepareNsecs / 1000;
+    result.execUsecs = m_execNsecs / 1000;
+    result.stepUsecs = m_stepNsecs / 1000;
+    result.rows = m_rows;
+
+    // Preparing is only counted for the first execution
+    m_prepareNsecs = m_execNsecs = m_stepNsecs = 0;
+    m_rows = 0;
+
+    qCDebug(lcCommHistorySql) << "Query took" << result.totalUsecs() << "us, prepare" << result.prepareUsecs
+                              << "exec" << result.execUsecs << "step" << result.stepUsecs
+                              << "rows" << result.rows << lastQuery().simplified();
+
+    if (result.totalUsecs() < qint64(QueryProfiler::threshold()) * 1000)
+        return;
+
+    result.time = QDateTime::currentDateTime();
+    result.statement = lastQuery();
+    const QVector<QVariant> &values = boundValues();
+    for (int i = 0; i < values.size(); i++)
+        result.boundValues.insert(boundValueName(i), values.at(i));
+    result.plan = explainQueryPlan(result.statement, result.boundValues);
+    qCInfo(lcCommHistorySql).noquote() << "Slow query" << QueryProfiler::toString(result);
+
+    ProfilerState *state = profilerState();
+    QMutexLocker locker(&state->lock);
+    state->queries.append(result);
+    while (state->queries.size() > state->capacity)
+        state->queries.removeFirst();
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_QUERYPROFILER_H
+#define COMMHISTORY_QUERYPROFILER_H
+
+#include <QDateTime>
+#include <QList>
+#include <QStringList>
+#include <QVariantMap>
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+/*!
+ * \class QueryProfiler
+ * \brief Opt-in timing of the database queries.
+ *
+ * When enabled, preparing, executing and stepping through the results of
+ * every query made with CommHistoryDatabase::prepare() is timed, which
+ * covers the models, DatabaseIO and the background workers. Every measurement
+ * is logged in the debug level of the com.nokia.commhistory.sql category.
+ *
+ * Queries that take at least threshold() milliseconds are logged at the
+ * info level, and the last capacity() of them are kept together with
+ * their bound values and EXPLAIN QUERY PLAN output.
+ *
+ * Profiling is enabled with setEnabled(), or in any process by setting
+ * COMMHISTORY_SLOW_QUERY_MS to the threshold. It costs nothing but a
+ * flag check while disabled.
+ */
+class LIBCOMMHISTORY_EXPORT QueryProfiler
+{
+public:
+    struct SlowQuery {
+        QDateTime time;
+        QString statement;
+        QVariantMap boundValues;
+        QStringList plan;
+        qint64 prepareUsecs;
+        qint64 execUsecs;
+        qint64 stepUsecs;
+        int rows;
+
+        qint64 totalUsecs() const { return prepareUsecs + execUsecs + stepUsecs; }
+    };
+
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    /*!
+     * Duration in milliseconds from which a query is kept, 100 by default.
+     */
+    static int threshold();
+    static void setThreshold(int msec);
+
+    /*!
+     * Number of slow queries kept, 50 by default.
+     */
+    static int capacity();
+    static void setCapacity(int count);
+
+    /*!
+     * Slow queries kept so far, oldest first.
+     */
+    static QList<SlowQuery> slowQueries();
+    static void clear();
+
+    static QString toString(const SlowQuery &query);
+};
+
+}
+
+#endif
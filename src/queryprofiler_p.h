@@ -0,0 +1,80 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_QUERYPROFILER_P_H
+#define COMMHISTORY_QUERYPROFILER_P_H
+
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QSqlResult>
+
+namespace CommHistory {
+
+/*!
+ * Result of the queries that CommHistoryDatabase::prepare() creates while
+ * QueryProfiler is enabled. The statement runs through a query of the
+ * database's own driver, and preparing, executing and reading the rows
+ * is timed. The measurement is reported when the query is finished,
+ * executed again or destroyed.
+ */
+class ProfilingResult : public QSqlResult
+{
+public:
+    explicit ProfilingResult(const QSqlDatabase &database);
+    ~ProfilingResult();
+
+    QVariant handle() const;
+
+protected:
+    bool prepare(const QString &query);
+    bool exec();
+    bool reset(const QString &query);
+    bool fetch(int i);
+    bool fetchFirst();
+    bool fetchLast();
+    bool fetchNext();
+    QVariant data(int i);
+    bool isNull(int i);
+    int size();
+    int numRowsAffected();
+    QSqlRecord record() const;
+    QVariant lastInsertId() const;
+    void setForwardOnly(bool forward);
+    void detachFromResultSet();
+
+private:
+    bool executed(bool re);
+    bool fetched(bool re);
+    void report();
+
+    QSqlQuery m_query;
+    QElapsedTimer m_timer;
+    qint64 m_prepareNsecs;
+    qint64 m_execNsecs;
+    qint64 m_stepNsecs;
+    int m_rows;
+    bool m_measuring;
+};
+
+}
+
+#endif
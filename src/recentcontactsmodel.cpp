@@ -60,7 +60,10 @@ public:
         : EventModelPrivate(model),
           requiredProperty(RecentContactsModel::NoPropertyRequired),
           excludeFavorites(false),
-          addressFlags(0)
+          addressFlags(0),
+          filling(false),
+          fillExhausted(false),
+          fillOffset(0)
     {
         setResolveContacts(EventModel::ResolveOnDemand);
     }
@@ -68,11 +71,14 @@ public:
     virtual bool acceptsEvent(const Event &event) const;
     virtual bool fillModel(int start, int end, QList<Event> events, bool resolved);
     virtual void prependEvents(QList<Event> events, bool resolved);
+    virtual void eventsReceivedSlot(int start, int end, QList<Event> events);
 
     virtual void slotContactInfoChanged(const RecipientList &recipients);
     virtual void slotContactChanged(const RecipientList &recipients);
     virtual void slotContactDetailsChanged(const RecipientList &recipients);
 
+    bool fetchRecent();
+
 private:
     void removeFavorites(const RecipientList &recipients);
 
@@ -82,6 +88,12 @@ private:
     QList<Event> unresolvedEvents;
     QList<Event> resolvedEvents;
     QSet<int> resolvedContactIds;
+
+    // Paged read of RecentRecipients in getEvents()
+    bool filling;
+    bool fillExhausted;
+    int fillOffset;
+    QSet<QString> fillAddresses;
 };
 
 bool RecentContactsModelPrivate::acceptsEvent(const Event &event) const
@@ -96,12 +108,50 @@ bool RecentContactsModelPrivate::fillModel(int start, int end, QList<Event> even
     Q_UNUSED(start);
     Q_UNUSED(end);
 
-    // This model doesn't fetchMore, so fill is only called once. We can use the prepend logic to get
-    // the right contact behaviors.
+    if (filling) {
+        fillExhausted = queryLimit == 0 || events.count() < queryLimit;
+        fillOffset += events.count();
+    }
+
+    // This model doesn't fetchMore, so pages are only read by getEvents(). We can use the prepend
+    // logic to get the right contact behaviors.
     prependEvents(events, resolved);
     return true;
 }
 
+void RecentContactsModelPrivate::eventsReceivedSlot(int start, int end, QList<Event> events)
+{
+    // A later page can be empty, and the contacts found so far still have to be added
+    if (filling && fillOffset > 0 && events.isEmpty()) {
+        fillModel(start, end, events, false);
+        return;
+    }
+
+    EventModelPrivate::eventsReceivedSlot(start, end, events);
+}
+
+bool RecentContactsModelPrivate::fetchRecent()
+{
+    QString categoryClause;
+    if (eventCategoryMask != Event::AnyCategory)
+        categoryClause = QStringLiteral(" WHERE (category & %1) != 0").arg(eventCategoryMask);
+
+    // RecentRecipients holds the latest event of each address and category, so a
+    // page is read from recentrecipients_sorting without touching older events
+    QString q = DatabaseIOPrivate::eventQueryBase() + QString::fromLatin1(
+" JOIN ("
+  " SELECT lastEventId FROM RecentRecipients"
+  "%1"
+  " ORDER BY lastEndTime DESC, lastEventId DESC"
+  "%2"
+" ) AS Recent ON Events.id = Recent.lastEventId"
+" ORDER BY Events.endTime DESC, Events.id DESC")
+        .arg(categoryClause).arg(DatabaseIOPrivate::limitClause(queryLimit, fillOffset));
+
+    QSqlQuery query = prepareQuery(q, 0, 0);
+    return executeQuery(query);
+}
+
 void RecentContactsModelPrivate::slotContactInfoChanged(const RecipientList &recipients)
 {
     if (addressFlags != 0) {
@@ -202,6 +252,15 @@ void RecentContactsModelPrivate::prependEvents(QList<Event> events, bool resolve
         Event &event(*it);
         if (eventCategoryMask == Event::AnyCategory || (event.category() & eventCategoryMask) != 0) {
             if (!resolved) {
+                if (filling) {
+                    // Rows for another category of the same address can't add a contact
+                    const Recipient &recipient = event.recipients().first();
+                    const QString address = recipient.localUid() + QLatin1Char('\n') + recipient.minimizedRemoteUid();
+                    if (fillAddresses.contains(address))
+                        continue;
+                    fillAddresses.insert(address);
+                }
+
                 // Queue these events for resolution if required
                 unresolvedEvents.append(event);
             } else {
@@ -240,7 +299,30 @@ void RecentContactsModelPrivate::prependEvents(QList<Event> events, bool resolve
         unresolvedEvents.clear();
     }
 
-    if (!resolvedEvents.isEmpty()) {
+    bool filled = false;
+    if (filling) {
+        // Keep reading pages until enough distinct contacts have been found
+        if (!fillExhausted && resolvedEvents.count() < queryLimit) {
+            if (!fetchRecent()) {
+                filling = false;
+                fillAddresses.clear();
+            }
+            return;
+        }
+
+        filling = false;
+        fillAddresses.clear();
+        filled = true;
+    }
+
+    bool refreshed = false;
+    if (refreshing) {
+        // The resolved events are the complete new contents
+        refreshEvents(resolvedEvents);
+        resolvedEvents.clear();
+        resolvedContactIds.clear();
+        refreshed = true;
+    } else if (!resolvedEvents.isEmpty()) {
         // Does the new event replace an existing event?
         QSet<int> removeSet;
         const int rowCount = eventRootItem->childCount();
@@ -307,7 +389,7 @@ void RecentContactsModelPrivate::prependEvents(QList<Event> events, bool resolve
         resolvedContactIds.clear();
     }
 
-    if (resolved) {
+    if (resolved || refreshed || filled) {
         modelUpdatedSlot(true);
         emit q->resolvingChanged();
     }
@@ -374,43 +456,28 @@ bool RecentContactsModel::getEvents()
 {
     Q_D(RecentContactsModel);
 
-    beginResetModel();
-    d->clearEvents();
-    endResetModel();
-
-    QString categoryClause, limitClause;
-    if (d->eventCategoryMask != Event::AnyCategory) {
-        categoryClause = QStringLiteral("WHERE ") + DatabaseIOPrivate::categoryClause(d->eventCategoryMask);
-    }
-    if (d->queryLimit) {
-        // Default to 4x the configured limit, because some of the addresses may
-        // resolve to the same final contact, and others will match favorites
-        limitClause = QStringLiteral("LIMIT ") + QString::number(4 * d->queryLimit);
+    if (d->eventRootItem->childCount() > 0) {
+        // Replace the rows in place once the new results are resolved
+        d->beginRefresh();
+    } else {
+        beginResetModel();
+        d->clearEvents();
+        endResetModel();
     }
 
-    QString q = DatabaseIOPrivate::eventQueryBase() + QString::fromLatin1(
-" WHERE Events.id IN ("
-  " SELECT lastId FROM ("
-    " SELECT max(id) AS lastId, max(endTime) FROM Events"
-    " JOIN ("
-      " SELECT remoteUid, localUid, max(endTime) AS lastEventTime FROM Events"
-      " %1"
-      " GROUP BY remoteUid, localUid"
-      " ORDER BY lastEventTime DESC"
-      " %2"
-    " ) AS LastEvent ON Events.endTime = LastEvent.lastEventTime"
-                   " AND Events.remoteUid = LastEvent.remoteUid"
-                   " AND Events.localUid = LastEvent.localUid"
-    " GROUP BY Events.remoteUid, Events.localUid"
-  " )"
-" )"
-" ORDER BY Events.endTime DESC").arg(categoryClause).arg(limitClause);
-
-    QSqlQuery query = d->prepareQuery(q, 0, 0);
-
-    bool re = d->executeQuery(query);
+    // Pages of queryLimit addresses are read until that many distinct contacts
+    // have been resolved, since some addresses resolve to the same contact and
+    // others are favorites or lack the required property
+    d->filling = true;
+    d->fillExhausted = false;
+    d->fillOffset = 0;
+    d->fillAddresses.clear();
+
+    bool re = d->fetchRecent();
     if (re)
         emit resolvingChanged();
+    else
+        d->filling = false;
     return re;
 }
 
@@ -28,6 +28,7 @@
 
 #include <QSet>
 #include <QHash>
+#include <QMutex>
 #include <QDBusArgument>
 #include <QDebug>
 
@@ -80,6 +81,9 @@ typedef QHash<QPair<QString, QString>, WeakRecipient> RecipientUidMap;
 typedef QMultiHash<int, WeakRecipient> RecipientContactMap;
 
 Q_GLOBAL_STATIC(RecipientUidMap, recipientInstances);
+// Recipients are created by worker threads reading events, so the uid map
+// is locked. The contact map is only used on the thread resolving contacts.
+Q_GLOBAL_STATIC(QMutex, recipientInstancesLock);
 Q_GLOBAL_STATIC(RecipientContactMap, recipientContactMap);
 Q_GLOBAL_STATIC_WITH_ARGS(QSharedPointer<RecipientPrivate>, sharedNullRecipient, (new RecipientPrivate(QString(), QString())));
 
@@ -138,7 +142,11 @@ RecipientPrivate::RecipientPrivate(const QString &local, const QString &remote)
 RecipientPrivate::~RecipientPrivate()
 {
     if (!recipientInstances.isDestroyed()) {
-        recipientInstances->remove(makeUidPair(localUid, remoteUid));
+        QMutexLocker locker(recipientInstancesLock());
+        // Another thread may already have replaced this instance
+        RecipientUidMap::iterator it = recipientInstances->find(makeUidPair(localUid, remoteUid));
+        if (it != recipientInstances->end() && it->isNull())
+            recipientInstances->erase(it);
     }
 }
 
@@ -149,6 +157,7 @@ QSharedPointer<RecipientPrivate> RecipientPrivate::get(const QString &localUid,
     }
 
     const QPair<QString, QString> uids = makeUidPair(localUid, remoteUid);
+    QMutexLocker locker(recipientInstancesLock());
     QSharedPointer<RecipientPrivate> instance = recipientInstances->value(uids);
     if (!instance) {
         instance = QSharedPointer<RecipientPrivate>(new RecipientPrivate(localUid, remoteUid));
@@ -0,0 +1,551 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "retentionengine.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QMap>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTimer>
+
+#include "commhistorydatabase.h"
+#include "updatesemitter.h"
+#include "debug_p.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const char *eventColumns =
+    "id, type, startTime, endTime, direction, isDraft, isRead, isMissedCall, isEmergencyCall, "
+    "status, bytesReceived, localUid, remoteUid, parentId, subject, freeText, groupId, "
+    "messageToken, lastModified, vCardFileName, vCardLabel, isDeleted, reportDelivery, "
+    "validityPeriod, contentLocation, messageParts, headers, readStatus, reportRead, "
+    "reportedReadRequested, mmsId, isAction, hasExtraProperties, hasMessageParts";
+
+struct Policy {
+    Policy() : maxAge(0), maxCount(0) {}
+    int maxAge;
+    int maxCount;
+};
+
+struct Task {
+    enum Kind {
+        Age,        // events older than cutoff
+        CountScan,  // find the groups over the count limit
+        Count       // oldest events of one group
+    };
+
+    Kind kind;
+    Event::EventType type;
+    qint64 cutoff;
+    int groupId;    // -1 for events without a group
+    int remaining;
+};
+
+const char *typeNames[] = { "im", "sms", "call", "voicemail", "mms" };
+const Event::EventType typeValues[] = { Event::IMEvent, Event::SMSEvent, Event::CallEvent,
+                                        Event::VoicemailEvent, Event::MMSEvent };
+
+QByteArray joinIds(const QList<int> &ids)
+{
+    QByteArray re;
+    foreach (int id, ids) {
+        if (!re.isEmpty())
+            re += ',';
+        re += QByteArray::number(id);
+    }
+    return re;
+}
+
+}
+
+namespace CommHistory {
+
+class RetentionEnginePrivate : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(RetentionEngine)
+
+public:
+    RetentionEngine *q_ptr;
+    QSqlDatabase db;
+    QSharedPointer<UpdatesEmitter> emitter;
+    QTimer batchTimer;
+    QMap<Event::EventType, Policy> policies;
+    int batchSize;
+    bool running;
+    QList<Task> tasks;
+    int eventsArchived;
+
+    explicit RetentionEnginePrivate(RetentionEngine *parent);
+    ~RetentionEnginePrivate();
+
+    QSqlDatabase &connection();
+
+    void begin();
+    bool step();
+    void finish(bool successful);
+
+    bool selectIds(QSqlQuery &query, QList<int> &ids);
+    bool scanCounts(const Task &task);
+    bool removeStaleCopies();
+    bool moveEvents(const QList<int> &ids);
+    bool execute(const QByteArray &statement);
+    bool executeTransaction(const QByteArray *statements, int count);
+
+public slots:
+    void runBatch();
+};
+
+} // namespace CommHistory
+
+RetentionEnginePrivate::RetentionEnginePrivate(RetentionEngine *parent)
+    : QObject(parent),
+      q_ptr(parent),
+      emitter(UpdatesEmitter::instance()),
+      batchTimer(this),
+      batchSize(200),
+      running(false),
+      eventsArchived(0)
+{
+    batchTimer.setSingleShot(true);
+    batchTimer.setInterval(100);
+    connect(&batchTimer, SIGNAL(timeout()), SLOT(runBatch()));
+}
+
+RetentionEnginePrivate::~RetentionEnginePrivate()
+{
+    if (db.isValid()) {
+        const QString name = db.connectionName();
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+QSqlDatabase &RetentionEnginePrivate::connection()
+{
+    // Opened on first use, in the thread the engine runs in. This is the
+    // only connection that creates the archive.
+    if (!db.isValid()) {
+        db = CommHistoryDatabase::open(QStringLiteral("commhistory-retention-%1")
+                                       .arg(quintptr(this), 0, 16));
+        if (db.isOpen())
+            CommHistoryDatabase::createArchive(db);
+    }
+
+    return db;
+}
+
+void RetentionEnginePrivate::begin()
+{
+    running = true;
+    eventsArchived = 0;
+    tasks.clear();
+
+    if (CommHistoryDatabase::hasArchive(connection()))
+        removeStaleCopies();
+
+    const qint64 now = QDateTime::currentDateTime().toTime_t();
+    for (QMap<Event::EventType, Policy>::const_iterator it = policies.constBegin(); it != policies.constEnd(); ++it) {
+        Task task;
+        task.type = it.key();
+        task.cutoff = now - qint64(it->maxAge) * 24 * 60 * 60;
+        task.groupId = -1;
+        task.remaining = it->maxCount;
+
+        // Age first, so that fewer events are left to count
+        if (it->maxAge > 0) {
+            task.kind = Task::Age;
+            tasks.append(task);
+        }
+        if (it->maxCount > 0) {
+            task.kind = Task::CountScan;
+            tasks.append(task);
+        }
+    }
+}
+
+void RetentionEnginePrivate::finish(bool successful)
+{
+    Q_Q(RetentionEngine);
+
+    running = false;
+    tasks.clear();
+    batchTimer.stop();
+
+    qCDebug(lcCommHistory) << "Retention pass" << (successful ? "finished:" : "failed:")
+                           << eventsArchived << "events archived";
+
+    emit q->finished(successful);
+}
+
+void RetentionEnginePrivate::runBatch()
+{
+    if (!running)
+        return;
+
+    if (!step()) {
+        finish(false);
+        return;
+    }
+
+    if (tasks.isEmpty())
+        finish(true);
+    else
+        batchTimer.start();
+}
+
+bool RetentionEnginePrivate::step()
+{
+    if (tasks.isEmpty())
+        return true;
+
+    if (!CommHistoryDatabase::hasArchive(connection())) {
+        qCWarning(lcCommHistory) << "Archive database is not available";
+        return false;
+    }
+
+    Task &task = tasks.first();
+    QList<int> ids;
+
+    if (task.kind == Task::CountScan) {
+        const Task scan = tasks.takeFirst();
+        return scanCounts(scan);
+    } else if (task.kind == Task::Age) {
+        // The newest event of a conversation stays to represent it
+        QSqlQuery query = CommHistoryDatabase::prepare(
+            "SELECT id FROM Events WHERE type = :type AND isDraft = 0 AND endTime < :cutoff "
+            "AND (groupId IS NULL OR id != (SELECT latest.id FROM Events AS latest "
+            "  WHERE latest.groupId = Events.groupId ORDER BY latest.endTime DESC, latest.id DESC LIMIT 1)) "
+            "LIMIT :limit", connection());
+        query.bindValue(":type", task.type);
+        query.bindValue(":cutoff", task.cutoff);
+        query.bindValue(":limit", batchSize);
+        if (!selectIds(query, ids))
+            return false;
+    } else {
+        QByteArray q = "SELECT id FROM Events WHERE type = :type AND isDraft = 0 AND ";
+        q += task.groupId < 0 ? "groupId IS NULL " : "groupId = :groupId ";
+        q += "ORDER BY endTime ASC, id ASC LIMIT :limit";
+
+        QSqlQuery query = CommHistoryDatabase::prepare(q, connection());
+        query.bindValue(":type", task.type);
+        if (task.groupId >= 0)
+            query.bindValue(":groupId", task.groupId);
+        query.bindValue(":limit", qMin(batchSize, task.remaining));
+        if (!selectIds(query, ids))
+            return false;
+        task.remaining -= ids.size();
+    }
+
+    if (ids.isEmpty() || (task.kind == Task::Count && task.remaining <= 0))
+        tasks.removeFirst();
+
+    return ids.isEmpty() || moveEvents(ids);
+}
+
+bool RetentionEnginePrivate::selectIds(QSqlQuery &query, QList<int> &ids)
+{
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    while (query.next())
+        ids.append(query.value(0).toInt());
+    query.finish();
+    return true;
+}
+
+bool RetentionEnginePrivate::scanCounts(const Task &scan)
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(
+        "SELECT IFNULL(groupId, -1), COUNT(*) FROM Events WHERE type = :type AND isDraft = 0 "
+        "GROUP BY groupId HAVING COUNT(*) > :maxCount", connection());
+    query.bindValue(":type", scan.type);
+    query.bindValue(":maxCount", scan.remaining);
+
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    QList<Task> counts;
+    while (query.next()) {
+        Task task = scan;
+        task.kind = Task::Count;
+        task.groupId = query.value(0).toInt();
+        task.remaining = query.value(1).toInt() - scan.remaining;
+        counts.append(task);
+    }
+
+    tasks = counts + tasks;
+    return true;
+}
+
+bool RetentionEnginePrivate::execute(const QByteArray &statement)
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(statement, connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return true;
+}
+
+bool RetentionEnginePrivate::executeTransaction(const QByteArray *statements, int count)
+{
+    if (!connection().transaction()) {
+        qCWarning(lcCommHistory) << "Failed to begin transaction" << connection().lastError();
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!execute(statements[i])) {
+            connection().rollback();
+            return false;
+        }
+    }
+
+    if (!connection().commit()) {
+        qCWarning(lcCommHistory) << "Failed to commit transaction" << connection().lastError();
+        connection().rollback();
+        return false;
+    }
+
+    return true;
+}
+
+bool RetentionEnginePrivate::removeStaleCopies()
+{
+    // Left by a batch that was interrupted after the copy was committed.
+    // Properties and parts go with their events.
+    const QByteArray statement("DELETE FROM archive.Events WHERE EXISTS "
+                               "(SELECT 1 FROM main.Events WHERE main.Events.id = archive.Events.id)");
+    return executeTransaction(&statement, 1);
+}
+
+bool RetentionEnginePrivate::moveEvents(const QList<int> &ids)
+{
+    const QByteArray idList = joinIds(ids);
+    const QByteArray columns(eventColumns);
+
+    QList<int> groupIds;
+    QSqlQuery query = CommHistoryDatabase::prepare("SELECT DISTINCT groupId FROM main.Events "
+                                                   "WHERE id IN (" + idList + ") AND groupId IS NOT NULL",
+                                                   connection());
+    if (!selectIds(query, groupIds))
+        return false;
+
+    // SQLite commits a WAL main database and an attached one separately,
+    // main first, so a single transaction could lose the events between
+    // the two commits. The copies are committed first instead; an
+    // interruption before the live rows are removed leaves copies of live
+    // events, which the next pass removes. Removing the live parts first
+    // keeps their files from being collected as detached.
+    const QByteArray copy[] = {
+        "INSERT OR REPLACE INTO archive.Events (" + columns + ") "
+        "SELECT " + columns + " FROM main.Events WHERE id IN (" + idList + ")",
+        "INSERT OR REPLACE INTO archive.EventProperties (eventId, key, value) "
+        "SELECT eventId, key, value FROM main.EventProperties WHERE eventId IN (" + idList + ")",
+        "INSERT OR REPLACE INTO archive.MessageParts (id, eventId, contentId, contentType, path) "
+        "SELECT id, eventId, contentId, contentType, path FROM main.MessageParts "
+        "WHERE eventId IN (" + idList + ")"
+    };
+    const QByteArray remove[] = {
+        "INSERT OR REPLACE INTO ArchivedGroups (groupId, archivedEvents) "
+        "SELECT groupId, COUNT(*) + IFNULL((SELECT archivedEvents FROM ArchivedGroups "
+        "  WHERE ArchivedGroups.groupId = Events.groupId), 0) "
+        "FROM main.Events WHERE id IN (" + idList + ") AND groupId IS NOT NULL GROUP BY groupId",
+        "DELETE FROM main.MessageParts WHERE eventId IN (" + idList + ")",
+        "DELETE FROM main.Events WHERE id IN (" + idList + ")"
+    };
+
+    if (!executeTransaction(copy, sizeof(copy) / sizeof(*copy))
+            || !executeTransaction(remove, sizeof(remove) / sizeof(*remove)))
+        return false;
+
+    eventsArchived += ids.size();
+
+    // Models drop the archived events and reload the group counts
+    emit emitter->eventsDeleted(ids);
+    if (!groupIds.isEmpty())
+        emit emitter->groupsUpdated(groupIds);
+    return true;
+}
+
+RetentionEngine::RetentionEngine(QObject *parent)
+    : QObject(parent), d_ptr(new RetentionEnginePrivate(this))
+{
+}
+
+RetentionEngine::~RetentionEngine()
+{
+}
+
+void RetentionEngine::setPolicy(Event::EventType type, int maxAgeDays, int maxCount)
+{
+    Q_D(RetentionEngine);
+
+    if (maxAgeDays <= 0 && maxCount <= 0) {
+        d->policies.remove(type);
+        return;
+    }
+
+    Policy policy;
+    policy.maxAge = qMax(0, maxAgeDays);
+    policy.maxCount = qMax(0, maxCount);
+    d->policies.insert(type, policy);
+}
+
+void RetentionEngine::clearPolicy(Event::EventType type)
+{
+    Q_D(RetentionEngine);
+    d->policies.remove(type);
+}
+
+int RetentionEngine::maxAge(Event::EventType type) const
+{
+    Q_D(const RetentionEngine);
+    return d->policies.value(type).maxAge;
+}
+
+int RetentionEngine::maxCount(Event::EventType type) const
+{
+    Q_D(const RetentionEngine);
+    return d->policies.value(type).maxCount;
+}
+
+bool RetentionEngine::loadPolicies(const QString &fileName)
+{
+    if (!QFile::exists(fileName))
+        return false;
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        qCWarning(lcCommHistory) << "Failed to read retention policies from" << fileName;
+        return false;
+    }
+
+    const QStringList groups = settings.childGroups();
+    for (unsigned i = 0; i < sizeof(typeNames) / sizeof(*typeNames); i++) {
+        const QString name = QLatin1String(typeNames[i]);
+        if (!groups.contains(name))
+            continue;
+
+        settings.beginGroup(name);
+        setPolicy(typeValues[i], settings.value(QStringLiteral("maxAge")).toInt(),
+                  settings.value(QStringLiteral("maxCount")).toInt());
+        settings.endGroup();
+    }
+
+    return true;
+}
+
+int RetentionEngine::batchSize() const
+{
+    Q_D(const RetentionEngine);
+    return d->batchSize;
+}
+
+void RetentionEngine::setBatchSize(int size)
+{
+    Q_D(RetentionEngine);
+    d->batchSize = qMax(1, size);
+}
+
+int RetentionEngine::batchInterval() const
+{
+    Q_D(const RetentionEngine);
+    return d->batchTimer.interval();
+}
+
+void RetentionEngine::setBatchInterval(int msec)
+{
+    Q_D(RetentionEngine);
+    d->batchTimer.setInterval(msec);
+}
+
+bool RetentionEngine::isRunning() const
+{
+    Q_D(const RetentionEngine);
+    return d->running;
+}
+
+int RetentionEngine::eventsArchived() const
+{
+    Q_D(const RetentionEngine);
+    return d->eventsArchived;
+}
+
+void RetentionEngine::start()
+{
+    Q_D(RetentionEngine);
+
+    if (d->running)
+        return;
+
+    d->begin();
+    d->batchTimer.start();
+}
+
+void RetentionEngine::stop()
+{
+    Q_D(RetentionEngine);
+
+    if (d->running)
+        d->finish(false);
+}
+
+bool RetentionEngine::run()
+{
+    Q_D(RetentionEngine);
+
+    // A pass already running incrementally is completed here
+    if (!d->running)
+        d->begin();
+    d->batchTimer.stop();
+
+    while (!d->tasks.isEmpty()) {
+        if (!d->step()) {
+            d->finish(false);
+            return false;
+        }
+    }
+
+    d->finish(true);
+    return true;
+}
+
+#include "retentionengine.moc"
@@ -0,0 +1,130 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_RETENTIONENGINE_H
+#define COMMHISTORY_RETENTIONENGINE_H
+
+#include <QObject>
+#include "event.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class RetentionEnginePrivate;
+
+/*!
+ * \class RetentionEngine
+ * \brief Moves old events into the archive database.
+ *
+ * The archive database lives next to the main database and has the same
+ * Events, EventProperties and MessageParts tables. It is created by the
+ * first pass. Archived events keep their ids and attachments; they no
+ * longer appear in group counts or searches, and ConversationModel pages
+ * them in after the live events. Moved events are announced as deleted,
+ * and their groups as updated. Deleting a group or an event deletes its
+ * archived events as well.
+ *
+ * A policy limits events of one type by age, by count, or both. The
+ * count applies per conversation, or to all events without a group such
+ * as calls. Drafts and the newest event of each conversation are never
+ * archived.
+ *
+ * Events are moved in batches of batchSize() with batchInterval()
+ * milliseconds between them. The engine opens its own database connection
+ * and can be moved to another thread before it is started.
+ */
+class LIBCOMMHISTORY_EXPORT RetentionEngine : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(RetentionEngine)
+
+public:
+    explicit RetentionEngine(QObject *parent = 0);
+    ~RetentionEngine();
+
+    /*!
+     * Archive events of \a type older than \a maxAgeDays days, and all but
+     * the newest \a maxCount events. A limit of 0 is not applied.
+     */
+    void setPolicy(Event::EventType type, int maxAgeDays, int maxCount);
+    void clearPolicy(Event::EventType type);
+
+    int maxAge(Event::EventType type) const;
+    int maxCount(Event::EventType type) const;
+
+    /*!
+     * Read policies from an ini file. Each group is named after an event
+     * type (im, sms, mms, call, voicemail) and has maxAge (in days) and
+     * maxCount keys. Policies of types not in the file are kept.
+     *
+     * \return true if the file could be read, otherwise false
+     */
+    bool loadPolicies(const QString &fileName);
+
+    /*!
+     * Number of events moved per transaction, 200 by default.
+     */
+    int batchSize() const;
+    void setBatchSize(int size);
+
+    /*!
+     * Pause between batches in milliseconds, 100 by default.
+     */
+    int batchInterval() const;
+    void setBatchInterval(int msec);
+
+    bool isRunning() const;
+
+    /*!
+     * Number of events archived by the current or last pass.
+     */
+    int eventsArchived() const;
+
+public Q_SLOTS:
+    /*!
+     * Start an incremental pass unless one is running. finished() is
+     * emitted when it is done.
+     */
+    void start();
+
+    /*!
+     * Stop the running pass after the current batch. Events moved so far
+     * stay archived.
+     */
+    void stop();
+
+    /*!
+     * Run a complete pass without returning to the event loop.
+     *
+     * \return true if successful, otherwise false
+     */
+    bool run();
+
+Q_SIGNALS:
+    void finished(bool successful);
+
+private:
+    RetentionEnginePrivate *d_ptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,486 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "searchmodel.h"
+
+#include "eventmodel_p.h"
+#include "eventtreeitem.h"
+#include "databaseio_p.h"
+#include "commhistorydatabase.h"
+#include "dbus_p.h"
+#include "debug_p.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+
+namespace CommHistory {
+
+using namespace CommHistory;
+
+// Placed around matches by snippet() and replaced by the markers after
+// the text is escaped, from the Unicode private use area
+static const QChar snippetOpenSentinel(0xE000);
+static const QChar snippetCloseSentinel(0xE001);
+
+class SearchModelPrivate : public EventModelPrivate
+{
+public:
+    Q_DECLARE_PUBLIC(SearchModel)
+
+    SearchModelPrivate(EventModel *model)
+        : EventModelPrivate(model),
+          filterType(Event::UnknownType),
+          snippetOpen(QStringLiteral("<b>")),
+          snippetClose(QStringLiteral("</b>")),
+          nextMatch(0),
+          indexed(false),
+          hasMore(false)
+    {
+        queryMode = EventModel::StreamedAsyncQuery;
+        updateScope();
+    }
+
+    virtual bool acceptsEvent(const Event &event) const;
+    virtual void modifyInModel(Event &event);
+    virtual void clearEvents();
+
+    bool findMatches();
+    bool fetchChunk();
+    void updateScope();
+
+    static QString matchExpression(const QString &text);
+    QString markSnippet(const QString &snippet) const;
+
+    QString searchText;
+    QSet<int> filterGroups;
+    Event::EventType filterType;
+    QString filterAccount;
+    QString snippetOpen;
+    QString snippetClose;
+    QHash<int, QString> snippets;
+    // Ids of all results in order, read by findMatches()
+    QList<int> matchIds;
+    int nextMatch;
+    bool indexed;
+    bool hasMore;
+};
+
+bool SearchModelPrivate::acceptsEvent(const Event &event) const
+{
+    // Only the indexed query knows what matches; keep the rows we have
+    // as long as they pass the filters
+    if (!findEvent(event.id()).isValid())
+        return false;
+
+    if (event.isDraft())
+        return false;
+    if (filterType != Event::UnknownType && event.type() != filterType)
+        return false;
+    if (!filterAccount.isEmpty() && event.localUid() != filterAccount)
+        return false;
+    if (!filterGroups.isEmpty() && !filterGroups.contains(event.groupId()))
+        return false;
+
+    return true;
+}
+
+void SearchModelPrivate::modifyInModel(Event &event)
+{
+    // Rows are ordered by relevance, so unlike the base class a newer
+    // endTime does not move the row to the top
+    QModelIndex index = findEvent(event.id());
+    if (!index.isValid())
+        return;
+
+    if (!acceptsEvent(event)) {
+        deleteFromModel(event.id());
+        return;
+    }
+
+    EventTreeItem *item = static_cast<EventTreeItem *>(index.internalPointer());
+    Event oldEvent = item->event();
+    oldEvent.copyValidProperties(event);
+    item->setEvent(oldEvent);
+
+    // The snippet no longer reflects edited text
+    if (event.validProperties().contains(Event::FreeText) || event.validProperties().contains(Event::Subject))
+        snippets.remove(event.id());
+
+    emitDataChanged(index.row(), index.internalPointer());
+}
+
+void SearchModelPrivate::clearEvents()
+{
+    snippets.clear();
+    matchIds.clear();
+    nextMatch = 0;
+    hasMore = false;
+    EventModelPrivate::clearEvents();
+}
+
+QString SearchModelPrivate::matchExpression(const QString &text)
+{
+    // Each word is quoted and matched as a prefix, so that user input is
+    // never taken as FTS5 query syntax
+    QStringList terms;
+    foreach (QString word, text.split(QRegExp(QStringLiteral("\\s+")), QString::SkipEmptyParts)) {
+        word.replace(QLatin1Char('"'), QLatin1String("\"\""));
+        terms.append(QLatin1Char('"') + word + QLatin1String("\"*"));
+    }
+    return terms.join(QLatin1Char(' '));
+}
+
+QString SearchModelPrivate::markSnippet(const QString &snippet) const
+{
+    QString marked = snippet.toHtmlEscaped();
+    marked.replace(snippetOpenSentinel, snippetOpen);
+    marked.replace(snippetCloseSentinel, snippetClose);
+    return marked;
+}
+
+void SearchModelPrivate::updateScope()
+{
+    if (filterType != Event::UnknownType) {
+        setUpdatesScope(QStringList() << eventTypeUpdatesPath(filterType));
+    } else {
+        setUpdatesScope(QStringList() << eventTypeUpdatesPath(Event::IMEvent)
+                                      << eventTypeUpdatesPath(Event::SMSEvent)
+                                      << eventTypeUpdatesPath(Event::MMSEvent));
+    }
+}
+
+bool SearchModelPrivate::findMatches()
+{
+    matchIds.clear();
+    nextMatch = 0;
+
+    const QStringList words = searchText.split(QRegExp(QStringLiteral("\\s+")), QString::SkipEmptyParts);
+    if (words.isEmpty())
+        return true;
+
+    // Without FTS5 every word is matched anywhere in the text, newest first
+    indexed = CommHistoryDatabase::hasFullTextSearch(DatabaseIOPrivate::instance()->connection());
+
+    QString q;
+    if (indexed) {
+        q = "SELECT Events.id FROM Events JOIN EventsSearch ON EventsSearch.rowid = Events.id "
+            "WHERE EventsSearch MATCH :match ";
+    } else {
+        q = "SELECT Events.id FROM Events WHERE 1 ";
+        for (int i = 0; i < words.size(); i++) {
+            q += QString::fromLatin1("AND (Events.freeText LIKE :word%1 ESCAPE '\\' "
+                                     "OR Events.subject LIKE :word%1 ESCAPE '\\') ").arg(i);
+        }
+    }
+
+    q += "AND Events.isDraft = 0 AND IFNULL(Events.groupId, 0) NOT IN (SELECT id FROM Groups WHERE isDeleted = 1) ";
+    if (!filterGroups.isEmpty()) {
+        QStringList groups;
+        foreach (int groupId, filterGroups)
+            groups.append(QString::number(groupId));
+        q += "AND Events.groupId IN (" + groups.join(QLatin1Char(',')) + ") ";
+    }
+    if (filterType != Event::UnknownType)
+        q += "AND Events.type = :filterType ";
+    if (!filterAccount.isEmpty())
+        q += "AND Events.localUid = :filterAccount ";
+    q += indexed ? "ORDER BY EventsSearch.rank, Events.endTime DESC, Events.id DESC"
+                 : "ORDER BY Events.endTime DESC, Events.id DESC";
+
+    QSqlQuery query = prepareQuery(q, queryLimit, 0);
+    if (indexed) {
+        query.bindValue(":match", matchExpression(searchText));
+    } else {
+        for (int i = 0; i < words.size(); i++) {
+            QString word = words[i];
+            word.replace(QLatin1Char('\\'), QLatin1String("\\\\"));
+            word.replace(QLatin1Char('%'), QLatin1String("\\%"));
+            word.replace(QLatin1Char('_'), QLatin1String("\\_"));
+            query.bindValue(QString::fromLatin1(":word%1").arg(i), QLatin1Char('%') + word + QLatin1Char('%'));
+        }
+    }
+    if (filterType != Event::UnknownType)
+        query.bindValue(":filterType", filterType);
+    if (!filterAccount.isEmpty())
+        query.bindValue(":filterAccount", filterAccount);
+
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    while (query.next())
+        matchIds.append(query.value(0).toInt());
+    query.finish();
+    return true;
+}
+
+bool SearchModelPrivate::fetchChunk()
+{
+    // The search runs once, chunks only read the events of the next ids
+    const int limit = (nextMatch == 0 && firstChunkSize > 0) ? firstChunkSize : chunkSize;
+    const QList<int> chunkIds = matchIds.mid(nextMatch, limit > 0 ? limit : -1);
+    nextMatch += chunkIds.size();
+    hasMore = nextMatch < matchIds.size();
+
+    isReady = false;
+
+    QList<Event> events;
+    QStringList ids;
+    foreach (int id, chunkIds)
+        ids.append(QString::number(id));
+
+    if (!ids.isEmpty()) {
+        QSqlQuery query = prepareQuery(DatabaseIOPrivate::eventQueryBase()
+                                       + "WHERE Events.id IN (" + ids.join(QLatin1Char(',')) + ")", 0, 0);
+
+        if (!query.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << query.lastError();
+            qCWarning(lcCommHistory) << query.lastQuery();
+            refreshing = false;
+            return false;
+        }
+
+        QHash<int, Event> found;
+        QList<int> extraPropertyIds;
+        QList<int> hasPartsIds;
+        while (query.next()) {
+            Event e;
+            bool extra = false, parts = false;
+            DatabaseIOPrivate::readEventResult(query, e, extra, parts);
+            if (extra)
+                extraPropertyIds.append(e.id());
+            if (parts)
+                hasPartsIds.append(e.id());
+            found.insert(e.id(), e);
+        }
+        query.finish();
+
+        foreach (int id, extraPropertyIds)
+            database()->getEventExtraProperties(found[id]);
+        foreach (int id, hasPartsIds)
+            database()->getMessageParts(found[id]);
+
+        // Events deleted since the search are skipped
+        foreach (int id, chunkIds) {
+            QHash<int, Event>::const_iterator it = found.constFind(id);
+            if (it != found.constEnd())
+                events.append(*it);
+        }
+    }
+
+    if (indexed && !ids.isEmpty()) {
+        // snippet() needs the full text query, so it is only evaluated for
+        // the rows of this chunk
+        // The text is escaped before the markers go in, so snippet() marks
+        // the matches with characters that cannot be markup
+        QSqlQuery snippetQuery = prepareQuery(QStringLiteral(
+            "SELECT rowid, snippet(EventsSearch, -1, :open, :close, :ellipsis, 12) FROM EventsSearch "
+            "WHERE EventsSearch MATCH :match AND rowid IN (%1)").arg(ids.join(QLatin1Char(','))), 0, 0);
+        snippetQuery.bindValue(":open", QString(snippetOpenSentinel));
+        snippetQuery.bindValue(":close", QString(snippetCloseSentinel));
+        snippetQuery.bindValue(":ellipsis", QString(QChar(0x2026)));
+        snippetQuery.bindValue(":match", matchExpression(searchText));
+
+        if (!snippetQuery.exec()) {
+            qCWarning(lcCommHistory) << "Failed to execute query";
+            qCWarning(lcCommHistory) << snippetQuery.lastError();
+            qCWarning(lcCommHistory) << snippetQuery.lastQuery();
+        } else {
+            QHash<int, QString> chunkSnippets;
+            while (snippetQuery.next())
+                chunkSnippets.insert(snippetQuery.value(0).toInt(), markSnippet(snippetQuery.value(1).toString()));
+            snippetQuery.finish();
+
+            if (refreshing) {
+                // Kept rows highlight the new words
+                QHash<int, QString> previous = snippets;
+                snippets = chunkSnippets;
+                for (QHash<int, QString>::const_iterator it = chunkSnippets.constBegin(); it != chunkSnippets.constEnd(); ++it) {
+                    QModelIndex index = findEvent(it.key());
+                    if (index.isValid() && previous.value(it.key()) != it.value())
+                        emitDataChanged(index.row(), index.internalPointer());
+                }
+            } else {
+                snippets.unite(chunkSnippets);
+            }
+        }
+    } else if (refreshing) {
+        snippets.clear();
+    }
+
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << "read" << events.size() << "of" << matchIds.size() << "results";
+
+    eventsReceivedSlot(0, events.size(), events);
+    return true;
+}
+
+SearchModel::SearchModel(QObject *parent)
+    : EventModel(*new SearchModelPrivate(this), parent)
+{
+}
+
+SearchModel::~SearchModel()
+{
+}
+
+QString SearchModel::searchText() const
+{
+    Q_D(const SearchModel);
+    return d->searchText;
+}
+
+void SearchModel::setSearchText(const QString &text)
+{
+    Q_D(SearchModel);
+    if (d->searchText != text) {
+        d->searchText = text;
+        emit searchTextChanged();
+    }
+}
+
+QList<int> SearchModel::filterGroups() const
+{
+    Q_D(const SearchModel);
+    return d->filterGroups.values();
+}
+
+void SearchModel::setFilterGroups(const QList<int> &groupIds)
+{
+    Q_D(SearchModel);
+    QSet<int> groups = groupIds.toSet();
+    if (groups != d->filterGroups) {
+        d->filterGroups = groups;
+        emit filterGroupsChanged();
+    }
+}
+
+int SearchModel::filterType() const
+{
+    Q_D(const SearchModel);
+    return d->filterType;
+}
+
+void SearchModel::setFilterType(int type)
+{
+    Q_D(SearchModel);
+    if (d->filterType != type) {
+        d->filterType = static_cast<Event::EventType>(type);
+        d->updateScope();
+        emit filterTypeChanged();
+    }
+}
+
+QString SearchModel::filterAccount() const
+{
+    Q_D(const SearchModel);
+    return d->filterAccount;
+}
+
+void SearchModel::setFilterAccount(const QString &localUid)
+{
+    Q_D(SearchModel);
+    if (d->filterAccount != localUid) {
+        d->filterAccount = localUid;
+        emit filterAccountChanged();
+    }
+}
+
+void SearchModel::setSnippetMarkers(const QString &open, const QString &close)
+{
+    Q_D(SearchModel);
+    d->snippetOpen = open;
+    d->snippetClose = close;
+}
+
+QString SearchModel::snippet(const QModelIndex &index) const
+{
+    Q_D(const SearchModel);
+
+    if (!index.isValid())
+        return QString();
+
+    Event &event = static_cast<EventTreeItem *>(index.internalPointer())->event();
+    QHash<int, QString>::const_iterator it = d->snippets.constFind(event.id());
+    if (it != d->snippets.constEnd())
+        return *it;
+    return (event.freeText().isEmpty() ? event.subject() : event.freeText()).toHtmlEscaped();
+}
+
+bool SearchModel::getEvents()
+{
+    Q_D(SearchModel);
+
+    if (d->eventRootItem->childCount() > 0) {
+        // Typing usually narrows the results, keep the rows that still match
+        d->beginRefresh();
+    } else {
+        beginResetModel();
+        d->clearEvents();
+        endResetModel();
+    }
+
+    if (!d->findMatches()) {
+        d->refreshing = false;
+        return false;
+    }
+
+    return d->fetchChunk();
+}
+
+QVariant SearchModel::data(const QModelIndex &index, int role) const
+{
+    if (role == SnippetRole)
+        return snippet(index);
+
+    return EventModel::data(index, role);
+}
+
+QHash<int, QByteArray> SearchModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = EventModel::roleNames();
+    roles[SnippetRole] = "snippet";
+    return roles;
+}
+
+bool SearchModel::canFetchMore(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    Q_D(const SearchModel);
+
+    return d->hasMore && d->isReady;
+}
+
+void SearchModel::fetchMore(const QModelIndex &parent)
+{
+    Q_UNUSED(parent);
+    Q_D(SearchModel);
+
+    if (!canFetchMore(parent))
+        return;
+
+    d->fetchChunk();
+}
+
+} // namespace CommHistory
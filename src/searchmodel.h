@@ -0,0 +1,136 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#ifndef COMMHISTORY_SEARCHMODEL_H
+#define COMMHISTORY_SEARCHMODEL_H
+
+#include "eventmodel.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class SearchModelPrivate;
+
+/*!
+ * \class SearchModel
+ * \brief Model of the messages matching a full text search.
+ *
+ * Every word of searchText() is matched as a word prefix against the
+ * message text and subject. Results are ordered by relevance and fetched
+ * in chunks of chunkSize() through fetchMore(). Initialize with
+ * getEvents(), which runs the search once; each chunk then only reads
+ * the events of the next results.
+ *
+ * If SQLite has no FTS5, words are matched anywhere in the text, results
+ * are ordered by time and snippet() returns the whole text, escaped.
+ *
+ * Rows of the current results are updated and removed as the events
+ * change, but new events are not added until getEvents() is called again.
+ */
+class LIBCOMMHISTORY_EXPORT SearchModel : public EventModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString searchText READ searchText WRITE setSearchText NOTIFY searchTextChanged)
+    Q_PROPERTY(QList<int> filterGroups READ filterGroups WRITE setFilterGroups NOTIFY filterGroupsChanged)
+    Q_PROPERTY(int filterType READ filterType WRITE setFilterType NOTIFY filterTypeChanged)
+    Q_PROPERTY(QString filterAccount READ filterAccount WRITE setFilterAccount NOTIFY filterAccountChanged)
+
+public:
+    enum {
+        SnippetRole = EventModel::IncomingStatusRole + 1
+    };
+
+    /*!
+     * Model constructor.
+     *
+     * \param parent Parent object.
+     */
+    explicit SearchModel(QObject *parent = 0);
+
+    /*!
+     * Destructor.
+     */
+    ~SearchModel();
+
+    QString searchText() const;
+    void setSearchText(const QString &text);
+
+    /*!
+     * Limits the results to the given groups. An empty list searches
+     * all groups.
+     */
+    QList<int> filterGroups() const;
+    void setFilterGroups(const QList<int> &groupIds);
+
+    /*!
+     * Limits the results to one Event::EventType. Event::UnknownType
+     * searches all message types.
+     */
+    int filterType() const;
+    void setFilterType(int type);
+
+    /*!
+     * Limits the results to one local account.
+     */
+    QString filterAccount() const;
+    void setFilterAccount(const QString &localUid);
+
+    /*!
+     * Set the markup placed around matched words in snippets, by default
+     * "<b>" and "</b>".
+     */
+    void setSnippetMarkers(const QString &open, const QString &close);
+
+    /*!
+     * Excerpt of the matching text with the matched words marked, also
+     * available as SnippetRole. The text is HTML escaped, only the
+     * markers are inserted as they are.
+     */
+    QString snippet(const QModelIndex &index) const;
+
+    /*!
+     * Run the search with the current text and filters. Rows kept from
+     * the previous results are updated in place.
+     *
+     * \return true if successful, otherwise false
+     */
+    Q_INVOKABLE bool getEvents();
+
+    // reimp
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QHash<int, QByteArray> roleNames() const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
+Q_SIGNALS:
+    void searchTextChanged();
+    void filterGroupsChanged();
+    void filterTypeChanged();
+    void filterAccountChanged();
+
+private:
+    Q_DECLARE_PRIVATE(SearchModel)
+};
+
+} // namespace CommHistory
+
+#endif
@@ -69,6 +69,14 @@ QT_LIKE_HEADERS += \
                    headers/GroupModel \
                    headers/SingleEventModel \
                    headers/RecentContactsModel \
+                   headers/SearchModel \
+                   headers/AttachmentCollector \
+                   headers/RetentionEngine \
+                   headers/DatabaseMigrator \
+                   headers/QueryProfiler \
+                   headers/HistoryBackup \
+                   headers/WriteQueue \
+                   headers/EventWriter \
                    headers/Recipient \
                    headers/Events \
                    headers/Models \
@@ -93,6 +101,14 @@ PUBLIC_HEADERS += \
            singleeventmodel.h \
            recipienteventmodel.h \
            recentcontactsmodel.h \
+           searchmodel.h \
+           attachmentcollector.h \
+           retentionengine.h \
+           databasemigrator.h \
+           queryprofiler.h \
+           historybackup.h \
+           writequeue.h \
+           eventwriter.h \
            mmsconstants.h \
            mmsreadreportmodel.h \
            groupobject.h \
@@ -125,6 +141,9 @@ HEADERS += \
            updatesemitter.h \
            databaseio_p.h \
            draftsmodel_p.h \
+           queryprofiler_p.h \
+           eventwriter_p.h \
+           databasemigrator_p.h \
 
 SOURCES += commonutils.cpp \
            eventmodel.cpp \
@@ -146,6 +165,14 @@ SOURCES += commonutils.cpp \
            singleeventmodel.cpp \
            recipienteventmodel.cpp \
            recentcontactsmodel.cpp \
+           searchmodel.cpp \
+           attachmentcollector.cpp \
+           retentionengine.cpp \
+           databasemigrator.cpp \
+           queryprofiler.cpp \
+           historybackup.cpp \
+           writequeue.cpp \
+           eventwriter.cpp \
            updatesemitter.cpp \
            updateslistener.cpp \
            groupmanager.cpp \
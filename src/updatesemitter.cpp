@@ -49,6 +49,11 @@ UpdatesEmitter::UpdatesEmitter()
         qCWarning(lcCommHistory) << Q_FUNC_INFO << ": error registering service"
                                  << QDBusConnection::sessionBus().lastError();
     }
+
+    connect(this, &UpdatesEmitter::eventsAdded,
+            this, &UpdatesEmitter::relayScopedEventsAdded);
+    connect(this, &UpdatesEmitter::eventsUpdated,
+            this, &UpdatesEmitter::relayScopedEventsUpdated);
 }
 
 UpdatesEmitter::~UpdatesEmitter()
@@ -70,4 +75,38 @@ QSharedPointer<UpdatesEmitter> UpdatesEmitter::instance()
     return result;
 }
 
+void UpdatesEmitter::relayScopedEventsAdded(const QList<Event> &events)
+{
+    sendScoped(EVENTS_ADDED_SIGNAL, events);
+}
+
+void UpdatesEmitter::relayScopedEventsUpdated(const QList<Event> &events)
+{
+    sendScoped(EVENTS_UPDATED_SIGNAL, events);
+}
+
+void UpdatesEmitter::sendScoped(const QString &signal, const QList<Event> &events)
+{
+    // Split the events per group and per type; each subset goes out on its
+    // own object path so that only the interested listeners unmarshal it.
+    // The unscoped signals are still sent on /CommHistoryModel by the Adaptor.
+    QMap<QString, QList<Event> > scoped;
+    foreach (const Event &event, events) {
+        if (event.groupId() >= 0)
+            scoped[groupUpdatesPath(event.groupId())].append(event);
+        scoped[eventTypeUpdatesPath(event.type())].append(event);
+        if (signal == EVENTS_UPDATED_SIGNAL && event.modifiedProperties().contains(Event::GroupId))
+            scoped[COMM_HISTORY_MOVED_PATH].append(event);
+    }
+
+    QMap<QString, QList<Event> >::const_iterator it = scoped.constBegin();
+    for ( ; it != scoped.constEnd(); ++it) {
+        QDBusMessage message = QDBusMessage::createSignal(it.key(), COMM_HISTORY_SCOPED_INTERFACE,
+                                                          signal);
+        message << QVariant::fromValue(it.value());
+        if (!QDBusConnection::sessionBus().send(message))
+            qCWarning(lcCommHistory) << Q_FUNC_INFO << ": error sending" << signal << "to" << it.key();
+    }
+}
+
 }
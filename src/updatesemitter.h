@@ -46,14 +46,22 @@ public:
     void eventsAdded(const QList<CommHistory::Event> &events);
     void eventsUpdated(const QList<CommHistory::Event> &events);
     void eventDeleted(int id);
+    void eventsDeleted(const QList<int> &ids);
+    void eventsImported();
     void groupsAdded(const QList<CommHistory::Group> &groups);
     void groupsUpdated(const QList<int> &groupIds);
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
     void groupsDeleted(const QList<int> &groupIds);
 
+private Q_SLOTS:
+    void relayScopedEventsAdded(const QList<CommHistory::Event> &events);
+    void relayScopedEventsUpdated(const QList<CommHistory::Event> &events);
+
 private:
     UpdatesEmitter();
 
+    void sendScoped(const QString &signal, const QList<CommHistory::Event> &events);
+
     static QWeakPointer<UpdatesEmitter> m_Instance;
 };
 
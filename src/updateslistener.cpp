@@ -34,6 +34,7 @@ UpdatesListener::UpdatesListener(QObject *parent)
 
 UpdatesListener::UpdatesListener(const QString &objectPath, QObject *parent)
     : QObject(parent)
+    , m_objectPath(objectPath)
 {
     qDBusRegisterMetaType<CommHistory::Recipient>();
     qDBusRegisterMetaType<CommHistory::Event>();
@@ -44,15 +45,16 @@ UpdatesListener::UpdatesListener(const QString &objectPath, QObject *parent)
     qDBusRegisterMetaType<QList<CommHistory::Event> >();
     qDBusRegisterMetaType<QList<CommHistory::Group> >();
 
-    QDBusConnection::sessionBus().connect(
-        QString(), objectPath, COMM_HISTORY_INTERFACE, EVENTS_ADDED_SIGNAL,
-        this, SIGNAL(eventsAdded(const QList<CommHistory::Event> &)));
-    QDBusConnection::sessionBus().connect(
-        QString(), objectPath, COMM_HISTORY_INTERFACE, EVENTS_UPDATED_SIGNAL,
-        this, SIGNAL(eventsUpdated(const QList<CommHistory::Event> &)));
+    connectEventUpdates(true);
     QDBusConnection::sessionBus().connect(
         QString(), objectPath, COMM_HISTORY_INTERFACE, EVENT_DELETED_SIGNAL,
         this, SIGNAL(eventDeleted(int)));
+    QDBusConnection::sessionBus().connect(
+        QString(), objectPath, COMM_HISTORY_INTERFACE, EVENTS_DELETED_SIGNAL,
+        this, SIGNAL(eventsDeleted(const QList<int> &)));
+    QDBusConnection::sessionBus().connect(
+        QString(), objectPath, COMM_HISTORY_INTERFACE, EVENTS_IMPORTED_SIGNAL,
+        this, SIGNAL(eventsImported()));
 
     QDBusConnection::sessionBus().connect(
         QString(), objectPath, COMM_HISTORY_INTERFACE, GROUPS_ADDED_SIGNAL,
@@ -68,4 +70,56 @@ UpdatesListener::UpdatesListener(const QString &objectPath, QObject *parent)
         this, SIGNAL(groupsDeleted(const QList<int> &)));
 }
 
+void UpdatesListener::setGroupScope(const QList<int> &groupIds)
+{
+    QStringList paths;
+    foreach (int groupId, groupIds)
+        paths << groupUpdatesPath(groupId);
+    if (!paths.isEmpty())
+        paths << COMM_HISTORY_MOVED_PATH;
+    setScopePaths(paths);
+}
+
+void UpdatesListener::setEventTypeScope(const QList<Event::EventType> &eventTypes)
+{
+    QStringList paths;
+    foreach (Event::EventType type, eventTypes)
+        paths << eventTypeUpdatesPath(type);
+    setScopePaths(paths);
+}
+
+void UpdatesListener::setScopePaths(const QStringList &paths)
+{
+    if (paths == m_scopePaths)
+        return;
+
+    connectEventUpdates(false);
+    m_scopePaths = paths;
+    connectEventUpdates(true);
+}
+
+void UpdatesListener::connectEventUpdates(bool enable)
+{
+    QDBusConnection bus(QDBusConnection::sessionBus());
+    typedef bool (QDBusConnection::*ConnectFunction)(const QString &, const QString &,
+                                                     const QString &, const QString &,
+                                                     QObject *, const char *);
+    ConnectFunction method = enable ? &QDBusConnection::connect : &QDBusConnection::disconnect;
+
+    if (m_scopePaths.isEmpty()) {
+        (bus.*method)(QString(), m_objectPath, COMM_HISTORY_INTERFACE, EVENTS_ADDED_SIGNAL,
+                      this, SIGNAL(eventsAdded(const QList<CommHistory::Event> &)));
+        (bus.*method)(QString(), m_objectPath, COMM_HISTORY_INTERFACE, EVENTS_UPDATED_SIGNAL,
+                      this, SIGNAL(eventsUpdated(const QList<CommHistory::Event> &)));
+        return;
+    }
+
+    foreach (const QString &path, m_scopePaths) {
+        (bus.*method)(QString(), path, COMM_HISTORY_SCOPED_INTERFACE, EVENTS_ADDED_SIGNAL,
+                      this, SIGNAL(eventsAdded(const QList<CommHistory::Event> &)));
+        (bus.*method)(QString(), path, COMM_HISTORY_SCOPED_INTERFACE, EVENTS_UPDATED_SIGNAL,
+                      this, SIGNAL(eventsUpdated(const QList<CommHistory::Event> &)));
+    }
+}
+
 }
@@ -23,6 +23,7 @@
 #define UPDATESLISTENER_H
 
 #include <QObject>
+#include <QStringList>
 
 #include "event.h"
 #include "group.h"
@@ -38,14 +39,37 @@ public:
     UpdatesListener(QObject *parent = nullptr);
     UpdatesListener(const QString &objectPath, QObject *parent = nullptr);
 
+    /*!
+     * Only receive eventsAdded() and eventsUpdated() for events belonging
+     * to one of \a groupIds, and eventsUpdated() for events moved to another
+     * group. An empty list removes the restriction.
+     */
+    void setGroupScope(const QList<int> &groupIds);
+
+    /*!
+     * Only receive eventsAdded() and eventsUpdated() for events of one of
+     * \a eventTypes. An empty list removes the restriction.
+     */
+    void setEventTypeScope(const QList<CommHistory::Event::EventType> &eventTypes);
+
 Q_SIGNALS:
     void eventsAdded(const QList<CommHistory::Event> &events);
     void eventsUpdated(const QList<CommHistory::Event> &events);
     void eventDeleted(int id);
+    void eventsDeleted(const QList<int> &ids);
+    // Events without a group were added in bulk, such as imported calls
+    void eventsImported();
     void groupsAdded(const QList<CommHistory::Group> &groups);
     void groupsUpdated(const QList<int> &groupIds);
     void groupsUpdatedFull(const QList<CommHistory::Group> &groups);
     void groupsDeleted(const QList<int> &groupIds);
+
+private:
+    void setScopePaths(const QStringList &paths);
+    void connectEventUpdates(bool enable);
+
+    QString m_objectPath;
+    QStringList m_scopePaths;
 };
 
 }
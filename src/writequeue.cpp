@@ -0,0 +1,481 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "writequeue.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QTimer>
+
+#include "databaseio.h"
+#include "databaseio_p.h"
+#include "commhistorydatabase.h"
+#include "eventwriter_p.h"
+#include "updatesemitter.h"
+#include "debug_p.h"
+
+namespace CommHistory {
+
+struct WriteRequest
+{
+    enum Operation {
+        AddEvents,
+        ModifyEvents,
+        DeleteEvents,
+        MarkGroupsRead
+    };
+
+    int id;
+    Operation operation;
+    QList<Event> events;
+    QList<int> ids;
+    // Set by the writing thread
+    QList<int> updatedGroupIds;
+    QList<int> deletedGroupIds;
+    bool successful;
+};
+
+}
+
+Q_DECLARE_METATYPE(QList<CommHistory::WriteRequest>)
+
+namespace CommHistory {
+
+/* Writes the requests of every WriteQueue in the process on its own
+ * thread and connection. Requests are collected for the commit window
+ * and written in one transaction, each inside a savepoint so that a
+ * failing request is rolled back alone. */
+class WriteWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QSharedPointer<WriteWorker> instance();
+    ~WriteWorker();
+
+public slots:
+    void enqueue(const QList<CommHistory::WriteRequest> &requests);
+    void flush();
+
+signals:
+    void written(const QList<CommHistory::WriteRequest> &requests);
+
+private:
+    WriteWorker();
+
+    static void destroy(WriteWorker *worker);
+
+    bool execute(const char *statement);
+    bool write(WriteRequest &request);
+    void fail(WriteRequest &request);
+
+    QTimer m_timer;
+    QList<WriteRequest> m_pending;
+    int m_pendingEvents;
+};
+
+class WriteQueuePrivate : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(WriteQueue)
+
+public:
+    WriteQueue *q_ptr;
+    QSharedPointer<WriteWorker> worker;
+    QSharedPointer<UpdatesEmitter> emitter;
+    QSet<int> pending;
+    int failures;
+
+    explicit WriteQueuePrivate(WriteQueue *parent);
+
+    int submit(WriteRequest::Operation operation, const QList<Event> &events,
+               const QList<int> &ids = QList<int>());
+    void announce(WriteRequest::Operation operation, const QList<Event> &events, const QList<int> &ids,
+                  const QList<int> &updatedGroupIds, const QList<int> &deletedGroupIds);
+
+public slots:
+    void requestsWritten(const QList<CommHistory::WriteRequest> &requests);
+};
+
+} // namespace CommHistory
+
+using namespace CommHistory;
+
+// Events written per transaction at most; a larger backlog is committed
+// without waiting for the window to close
+static const int maxBatchEvents = 1000;
+
+static QAtomicInt commitWindowMsec(5);
+static QAtomicInt nextRequestId(1);
+
+Q_GLOBAL_STATIC(QMutex, writeWorkerMutex);
+Q_GLOBAL_STATIC(QWeakPointer<WriteWorker>, writeWorkerInstance);
+
+WriteWorker::WriteWorker()
+    : m_timer(this), m_pendingEvents(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(flush()));
+}
+
+WriteWorker::~WriteWorker()
+{
+}
+
+QSharedPointer<WriteWorker> WriteWorker::instance()
+{
+    QMutexLocker locker(writeWorkerMutex());
+
+    QSharedPointer<WriteWorker> result = writeWorkerInstance->toStrongRef();
+    if (!result) {
+        qRegisterMetaType<QList<CommHistory::WriteRequest> >();
+
+        QThread *thread = new QThread;
+        WriteWorker *worker = new WriteWorker;
+        worker->moveToThread(thread);
+        thread->start();
+
+        result = QSharedPointer<WriteWorker>(worker, &WriteWorker::destroy);
+        *writeWorkerInstance = result.toWeakRef();
+    }
+
+    return result;
+}
+
+void WriteWorker::destroy(WriteWorker *worker)
+{
+    // The queues have waited for their requests; the thread's connection
+    // is closed when it exits
+    QThread *thread = worker->thread();
+    thread->quit();
+    thread->wait();
+    delete worker;
+    delete thread;
+}
+
+void WriteWorker::enqueue(const QList<WriteRequest> &requests)
+{
+    foreach (const WriteRequest &request, requests) {
+        m_pending.append(request);
+        m_pendingEvents += qMax(request.events.size(), request.ids.size());
+    }
+
+    if (m_pendingEvents >= maxBatchEvents)
+        flush();
+    else if (!m_timer.isActive())
+        m_timer.start(commitWindowMsec.load());
+}
+
+void WriteWorker::flush()
+{
+    m_timer.stop();
+    if (m_pending.isEmpty())
+        return;
+
+    QList<WriteRequest> requests;
+    requests.swap(m_pending);
+    m_pendingEvents = 0;
+
+    DatabaseIO *database = DatabaseIO::instance();
+    bool committed = database->transaction();
+    if (committed) {
+        for (QList<WriteRequest>::iterator it = requests.begin(); it != requests.end(); ++it) {
+            if (!execute("SAVEPOINT request")) {
+                fail(*it);
+                continue;
+            }
+
+            it->successful = write(*it);
+            if (!it->successful) {
+                fail(*it);
+                execute("ROLLBACK TO request");
+            }
+            execute("RELEASE request");
+        }
+
+        // commit() rolls back if it fails
+        committed = database->commit();
+    }
+
+    if (!committed) {
+        for (QList<WriteRequest>::iterator it = requests.begin(); it != requests.end(); ++it)
+            fail(*it);
+    }
+
+    qCDebug(lcCommHistory) << Q_FUNC_INFO << "Wrote" << requests.size() << "requests in one transaction";
+    emit written(requests);
+}
+
+bool WriteWorker::execute(const char *statement)
+{
+    QSqlQuery query = CommHistoryDatabase::prepare(statement, DatabaseIOPrivate::instance()->connection());
+    if (!query.exec()) {
+        qCWarning(lcCommHistory) << "Failed to execute query";
+        qCWarning(lcCommHistory) << query.lastError();
+        qCWarning(lcCommHistory) << query.lastQuery();
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteWorker::write(WriteRequest &request)
+{
+    DatabaseIO *database = DatabaseIO::instance();
+
+    switch (request.operation) {
+    case WriteRequest::AddEvents:
+        return EventWriterPrivate::writeAddedEvents(database, request.events);
+
+    case WriteRequest::ModifyEvents:
+        return EventWriterPrivate::writeModifiedEvents(database, request.events, &request.updatedGroupIds);
+
+    case WriteRequest::DeleteEvents:
+        return database->deleteEvents(request.ids, &request.updatedGroupIds, &request.deletedGroupIds);
+
+    case WriteRequest::MarkGroupsRead: {
+        if (request.ids.isEmpty())
+            return true;
+
+        DatabaseIO::ReadFilter filter;
+        filter.groupIds = request.ids;
+        if (!database->markAsRead(filter))
+            return false;
+        request.updatedGroupIds = request.ids;
+        return true;
+    }
+    }
+
+    return false;
+}
+
+void WriteWorker::fail(WriteRequest &request)
+{
+    request.successful = false;
+    request.updatedGroupIds.clear();
+    request.deletedGroupIds.clear();
+
+    // Ids of added events were rolled back with them
+    if (request.operation == WriteRequest::AddEvents) {
+        for (int i = 0; i < request.events.size(); i++)
+            request.events[i].setId(-1);
+    }
+}
+
+WriteQueuePrivate::WriteQueuePrivate(WriteQueue *parent)
+    : q_ptr(parent), failures(0)
+{
+    // DatabaseIO belongs to the thread that uses it first, which must not
+    // be the writing thread
+    DatabaseIO::instance();
+
+    worker = WriteWorker::instance();
+    emitter = UpdatesEmitter::instance();
+
+    connect(worker.data(), SIGNAL(written(QList<CommHistory::WriteRequest>)),
+            SLOT(requestsWritten(QList<CommHistory::WriteRequest>)), Qt::QueuedConnection);
+}
+
+int WriteQueuePrivate::submit(WriteRequest::Operation operation, const QList<Event> &events,
+                              const QList<int> &ids)
+{
+    WriteRequest request;
+    request.id = nextRequestId.fetchAndAddRelaxed(1);
+    request.operation = operation;
+    request.events = events;
+    request.ids = ids;
+    request.successful = false;
+
+    pending.insert(request.id);
+    QMetaObject::invokeMethod(worker.data(), "enqueue", Qt::QueuedConnection,
+                              Q_ARG(QList<CommHistory::WriteRequest>, QList<WriteRequest>() << request));
+
+    return request.id;
+}
+
+void WriteQueuePrivate::announce(WriteRequest::Operation operation, const QList<Event> &events,
+                                 const QList<int> &ids, const QList<int> &updatedGroupIds,
+                                 const QList<int> &deletedGroupIds)
+{
+    switch (operation) {
+    case WriteRequest::AddEvents:
+        if (!events.isEmpty())
+            emit emitter->eventsAdded(events);
+        break;
+    case WriteRequest::ModifyEvents:
+        if (!events.isEmpty())
+            emit emitter->eventsUpdated(events);
+        break;
+    case WriteRequest::DeleteEvents:
+        if (!ids.isEmpty())
+            emit emitter->eventsDeleted(ids);
+        if (!deletedGroupIds.isEmpty())
+            emit emitter->groupsDeleted(deletedGroupIds);
+        break;
+    case WriteRequest::MarkGroupsRead:
+        break;
+    }
+
+    if (!updatedGroupIds.isEmpty())
+        emit emitter->groupsUpdated(updatedGroupIds);
+}
+
+void WriteQueuePrivate::requestsWritten(const QList<WriteRequest> &requests)
+{
+    Q_Q(WriteQueue);
+
+    // Every queue sees the whole batch
+    QList<WriteRequest> finished;
+    foreach (const WriteRequest &request, requests) {
+        if (pending.remove(request.id))
+            finished.append(request);
+    }
+
+    // Consecutive requests of the same kind are announced together
+    QList<Event> events;
+    QList<int> ids, updatedGroupIds, deletedGroupIds;
+    for (int i = 0; i < finished.size(); i++) {
+        const WriteRequest &request = finished.at(i);
+        if (request.successful) {
+            events.append(request.events);
+            ids.append(request.ids);
+            foreach (int groupId, request.updatedGroupIds) {
+                if (!updatedGroupIds.contains(groupId))
+                    updatedGroupIds.append(groupId);
+            }
+            deletedGroupIds.append(request.deletedGroupIds);
+        }
+
+        if (i + 1 == finished.size() || finished.at(i + 1).operation != request.operation) {
+            announce(request.operation, events, ids, updatedGroupIds, deletedGroupIds);
+            events.clear();
+            ids.clear();
+            updatedGroupIds.clear();
+            deletedGroupIds.clear();
+        }
+    }
+
+    foreach (const WriteRequest &request, finished) {
+        if (!request.successful)
+            failures++;
+        emit q->finished(request.id, request.events, request.successful);
+    }
+}
+
+WriteQueue::WriteQueue(QObject *parent)
+    : QObject(parent), d_ptr(new WriteQueuePrivate(this))
+{
+}
+
+WriteQueue::~WriteQueue()
+{
+    waitForFinished();
+    delete d_ptr;
+}
+
+int WriteQueue::commitWindow()
+{
+    return commitWindowMsec.load();
+}
+
+void WriteQueue::setCommitWindow(int msec)
+{
+    commitWindowMsec.store(qMax(msec, 0));
+}
+
+int WriteQueue::addEvent(const Event &event)
+{
+    return addEvents(QList<Event>() << event);
+}
+
+int WriteQueue::addEvents(const QList<Event> &events)
+{
+    Q_D(WriteQueue);
+    return d->submit(WriteRequest::AddEvents, events);
+}
+
+int WriteQueue::modifyEvent(const Event &event)
+{
+    return modifyEvents(QList<Event>() << event);
+}
+
+int WriteQueue::modifyEvents(const QList<Event> &events)
+{
+    Q_D(WriteQueue);
+    return d->submit(WriteRequest::ModifyEvents, events);
+}
+
+int WriteQueue::deleteEvents(const QList<int> &eventIds)
+{
+    Q_D(WriteQueue);
+
+    QList<Event> events;
+    foreach (int id, eventIds) {
+        Event event;
+        event.setId(id);
+        events << event;
+    }
+
+    return d->submit(WriteRequest::DeleteEvents, events, eventIds);
+}
+
+int WriteQueue::markAsReadGroups(const QList<int> &groupIds)
+{
+    Q_D(WriteQueue);
+    return d->submit(WriteRequest::MarkGroupsRead, QList<Event>(), groupIds);
+}
+
+bool WriteQueue::isFinished(int request) const
+{
+    Q_D(const WriteQueue);
+    return !d->pending.contains(request);
+}
+
+int WriteQueue::pendingRequests() const
+{
+    Q_D(const WriteQueue);
+    return d->pending.size();
+}
+
+bool WriteQueue::waitForFinished()
+{
+    Q_D(WriteQueue);
+
+    if (d->pending.isEmpty())
+        return true;
+
+    // The flush is queued behind this queue's requests, and the results
+    // are queued to d before it returns
+    d->failures = 0;
+    QMetaObject::invokeMethod(d->worker.data(), "flush", Qt::BlockingQueuedConnection);
+    QCoreApplication::sendPostedEvents(d, QEvent::MetaCall);
+
+    return d->pending.isEmpty() && !d->failures;
+}
+
+#include "writequeue.moc"
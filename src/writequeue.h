@@ -0,0 +1,137 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef COMMHISTORY_WRITEQUEUE_H
+#define COMMHISTORY_WRITEQUEUE_H
+
+#include <QObject>
+#include "event.h"
+#include "libcommhistoryexport.h"
+
+namespace CommHistory {
+
+class WriteQueuePrivate;
+
+/*!
+ * \class WriteQueue
+ * \brief Writes events to the database on a background thread.
+ *
+ * Each call queues a request and returns its number right away, so the
+ * calling thread never waits for the disk. Requests from all queues in a
+ * process are written by one thread. Those arriving within commitWindow()
+ * milliseconds of each other share one transaction, but a request that
+ * fails is rolled back without affecting the others. Requests are written
+ * in the order they were made.
+ *
+ * When a request has been committed, the queue announces the change to
+ * the models in all processes like EventModel and GroupManager do, and
+ * emits finished() with the events as written, so added events carry
+ * their new ids.
+ */
+class LIBCOMMHISTORY_EXPORT WriteQueue : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(WriteQueue)
+
+public:
+    explicit WriteQueue(QObject *parent = 0);
+
+    /*!
+     * Waits for the requests of this queue, see waitForFinished().
+     */
+    ~WriteQueue();
+
+    /*!
+     * Milliseconds for which the writing thread collects requests into a
+     * transaction, 5 by default. The setting applies to all queues in the
+     * process.
+     */
+    static int commitWindow();
+    static void setCommitWindow(int msec);
+
+    /*!
+     * Add events to the database. The events need a valid group unless
+     * they are calls.
+     *
+     * \return request number passed to finished()
+     */
+    int addEvent(const Event &event);
+    int addEvents(const QList<Event> &events);
+
+    /*!
+     * Modify events in the database. Every event needs a valid id.
+     *
+     * \return request number passed to finished()
+     */
+    int modifyEvent(const Event &event);
+    int modifyEvents(const QList<Event> &events);
+
+    /*!
+     * Delete events, and the groups left without events.
+     *
+     * \return request number passed to finished()
+     */
+    int deleteEvents(const QList<int> &eventIds);
+
+    /*!
+     * Mark all events in the groups as read.
+     *
+     * \return request number passed to finished()
+     */
+    int markAsReadGroups(const QList<int> &groupIds);
+
+    /*!
+     * True if the request has been written, or failed.
+     */
+    bool isFinished(int request) const;
+
+    /*!
+     * Number of requests of this queue that have not finished.
+     */
+    int pendingRequests() const;
+
+    /*!
+     * Write the pending requests of this queue now and emit their
+     * finished() signals before returning. This blocks the calling thread
+     * like the synchronous model functions do.
+     *
+     * \return true if all requests were written successfully
+     */
+    bool waitForFinished();
+
+Q_SIGNALS:
+    /*!
+     * Emitted once a request has been committed, or has failed.
+     *
+     * \param request number returned when the request was made
+     * \param events events as written; for deletions only their ids are set
+     * \param successful false if nothing of the request was written
+     */
+    void finished(int request, const QList<CommHistory::Event> &events, bool successful);
+
+private:
+    WriteQueuePrivate *d_ptr;
+};
+
+}
+
+#endif
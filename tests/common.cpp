@@ -207,25 +207,36 @@ quint64 idleTicks = 0;
 QSet<QContactId> addedContactIds;
 QSet<int> addedEventIds;
 
+static void removeTestDatabases()
+{
+    if (!QDir(TEST_DATABASE_DIR).removeRecursively()) {
+        qWarning() << "Unable to remove test database directory:" << TEST_DATABASE_DIR;
+    }
+
+    if (!qgetenv("LIBCONTACTS_TEST_MODE").isEmpty()) {
+        QString contactsDbDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
+                + QStringLiteral("/system/privileged/Contacts/qtcontacts-sqlite-test");
+        if (!QDir(contactsDbDir).removeRecursively()) {
+            qWarning() << "Unable to remove test contacts database directory:" << contactsDbDir;
+        }
+    }
+}
+
 void initTestDatabase()
 {
     CommHistoryDatabasePath::setRootDir(TEST_DATABASE_DIR);
-    deleteAll();
+    // Before any connection is open, so that connections opened later by
+    // the code under test see the same files
+    removeTestDatabases();
 }
 
-int addTestEvent(EventModel &model,
-                 Event::EventType type,
-                 Event::EventDirection direction,
-                 const QString &account,
-                 int groupId,
-                 const QString &text,
-                 bool isDraft,
-                 bool isMissedCall,
-                 const QDateTime &when,
-                 const QString &remoteUid,
-                 bool toModelOnly,
-                 const QString &messageToken,
-                 const QString &subscriberIdentity)
+Event createTestEvent(Event::EventType type,
+                      Event::EventDirection direction,
+                      const QString &account,
+                      int groupId,
+                      const QString &text,
+                      const QDateTime &when,
+                      const QString &remoteUid)
 {
     Event event;
     event.setType(type);
@@ -243,6 +254,24 @@ int addTestEvent(EventModel &model,
         event.setRecipients(Recipient(account, remoteUid));
     }
     event.setFreeText(text);
+    return event;
+}
+
+int addTestEvent(EventModel &model,
+                 Event::EventType type,
+                 Event::EventDirection direction,
+                 const QString &account,
+                 int groupId,
+                 const QString &text,
+                 bool isDraft,
+                 bool isMissedCall,
+                 const QDateTime &when,
+                 const QString &remoteUid,
+                 bool toModelOnly,
+                 const QString &messageToken,
+                 const QString &subscriberIdentity)
+{
+    Event event = createTestEvent(type, direction, account, groupId, text, when, remoteUid);
     event.setIsDraft(isDraft);
     event.setIsMissedCall(isMissedCall);
     event.setMessageToken(messageToken);
@@ -573,17 +602,7 @@ void deleteAll(bool deleteDb)
         return;
     }
 
-    if (!QDir(TEST_DATABASE_DIR).removeRecursively()) {
-        qWarning() << "Unable to remove test database directory:" << TEST_DATABASE_DIR;
-    }
-
-    if (!qgetenv("LIBCONTACTS_TEST_MODE").isEmpty()) {
-        QString contactsDbDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation)
-                + QStringLiteral("/system/privileged/Contacts/qtcontacts-sqlite-test");
-        if (!QDir(contactsDbDir).removeRecursively()) {
-            qWarning() << "Unable to remove test contacts database directory:" << contactsDbDir;
-        }
-    }
+    removeTestDatabases();
 }
 
 QString randomMessage(int words)
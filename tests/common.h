@@ -91,6 +91,15 @@ const int TESTCALL_SECS = 100;
 
 void initTestDatabase();
 
+/* The event added by addTestEvent, without writing it */
+Event createTestEvent(Event::EventType type,
+                      Event::EventDirection direction,
+                      const QString &account,
+                      int groupId,
+                      const QString &text = QString("test event"),
+                      const QDateTime &when = QDateTime::currentDateTime(),
+                      const QString &remoteUid = QString());
+
 int addTestEvent(EventModel &model,
                  Event::EventType type,
                  Event::EventDirection direction,
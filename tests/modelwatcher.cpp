@@ -43,6 +43,8 @@ ModelWatcher::ModelWatcher(QObject *parent)
             this, &ModelWatcher::eventsUpdatedSlot);
     connect(this, &UpdatesListener::eventDeleted,
             this, &ModelWatcher::eventDeletedSlot);
+    connect(this, &UpdatesListener::eventsDeleted,
+            this, &ModelWatcher::eventsDeletedSlot);
 }
 
 ModelWatcher::~ModelWatcher()
@@ -175,3 +177,11 @@ void ModelWatcher::eventDeletedSlot(int id)
     m_deletedCount++;
     m_lastDeleted = id;
 }
+
+void ModelWatcher::eventsDeletedSlot(const QList<int> &ids)
+{
+    // qDebug() << "deleted" << ids.count() << "events";
+    m_deletedCount += ids.count();
+    if (!ids.isEmpty())
+        m_lastDeleted = ids.last();
+}
@@ -52,6 +52,7 @@ public Q_SLOTS:
     void eventsAddedSlot(const QList<CommHistory::Event> &events);
     void eventsUpdatedSlot(const QList<CommHistory::Event> &events);
     void eventDeletedSlot(int eventId);
+    void eventsDeletedSlot(const QList<int> &eventIds);
     void eventsCommittedSlot(const QList<CommHistory::Event> &events, bool successful);
 
 public:
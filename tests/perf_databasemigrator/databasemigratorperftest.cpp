@@ -0,0 +1,239 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include <QtTest/QtTest>
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <algorithm>
+#include <cstdlib>
+#include "databasemigratorperftest.h"
+#include "databasemigrator.h"
+#include "commhistorydatabasepath.h"
+#include "eventmodel.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const char *connectionName = "perf_databasemigrator";
+
+QString databasePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::databaseFile());
+}
+
+QString migratedPath()
+{
+    return databasePath() + QLatin1String(".utf8");
+}
+
+QString migratedArchivePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::archiveFile())
+            + QLatin1String(".utf8");
+}
+
+qint64 databaseSize(const QString &path)
+{
+    qint64 size = -1;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(path);
+        if (db.open()) {
+            QSqlQuery query(db);
+            if (query.exec("SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()")
+                    && query.next())
+                size = query.value(0).toLongLong();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    return size;
+}
+
+// Median time in microseconds of running \a statement \a iterations times
+qint64 queryTime(const QString &path, const QString &statement, int iterations)
+{
+    QList<qint64> times;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(path);
+        if (db.open()) {
+            QSqlQuery query(db);
+            for (int i = 0; i < iterations; i++) {
+                QElapsedTimer time;
+                time.start();
+                if (!query.exec(statement))
+                    break;
+                while (query.next())
+                    ;
+                times << time.nsecsElapsed() / 1000;
+            }
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (times.isEmpty())
+        return -1;
+    std::sort(times.begin(), times.end());
+    return times.at(times.size() / 2);
+}
+
+}
+
+void DatabaseMigratorPerfTest::initTestCase()
+{
+    // Create the database the way older versions did
+    qputenv("COMMHISTORY_DB_ENCODING", "UTF-16");
+    initTestDatabase();
+
+    logFile = new QFile("libcommhistory-performance-test.log");
+    if(!logFile->open(QIODevice::Append)) {
+        qDebug() << "!!!! Failed to open log file !!!!";
+        logFile = 0;
+    }
+
+    qsrand( QDateTime::currentDateTime().toTime_t() );
+}
+
+void DatabaseMigratorPerfTest::migrate_data()
+{
+    QTest::addColumn<int>("groups");
+    QTest::addColumn<int>("messages");
+
+    QTest::newRow("10 groups of 100 messages") << 10 << 100;
+    QTest::newRow("100 groups of 100 messages") << 100 << 100;
+}
+
+void DatabaseMigratorPerfTest::migrate()
+{
+    QFETCH(int, groups);
+    QFETCH(int, messages);
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    cleanupTestGroups();
+    cleanupTestEvents();
+
+    qDebug() << Q_FUNC_INFO << "- Creating" << groups << "groups of" << messages << "messages";
+
+    EventModel eventModel;
+    QDateTime when = QDateTime::currentDateTime();
+    for (int gi = 0; gi < groups; gi++) {
+        Group group;
+        addTestGroup(group, RING_ACCOUNT, QString("+3580%1").arg(gi + 100000));
+
+        QList<Event> eventList;
+        for (int i = 0; i < messages; i++) {
+            Event e;
+            e.setType(Event::SMSEvent);
+            e.setDirection(qrand() % 2 ? Event::Inbound : Event::Outbound);
+            e.setGroupId(group.id());
+            e.setStartTime(when.addSecs(i));
+            e.setEndTime(when.addSecs(i));
+            e.setLocalUid(RING_ACCOUNT);
+            e.setRecipients(group.recipients());
+            e.setFreeText(randomMessage(qrand() % 49 + 1));  // Max 50 words / message
+            eventList << e;
+        }
+        QVERIFY(eventModel.addEvents(eventList, false));
+    }
+
+    QVERIFY(DatabaseMigrator::isRequired());
+
+    QList<int> times;
+
+    int iterations = 5;
+    #ifdef PERF_ITERATIONS
+    iterations = PERF_ITERATIONS;
+    #endif
+
+    char *iterVar = getenv("PERF_ITERATIONS");
+    if (iterVar) {
+        int iters = QString::fromLatin1(iterVar).toInt();
+        if (iters > 0) {
+            iterations = iters;
+        }
+    }
+
+    qDebug() << Q_FUNC_INFO << "- Migrating." << iterations << "iterations";
+    for (int i = 0; i < iterations; i++) {
+        DatabaseMigrator migrator;
+
+        QElapsedTimer time;
+        time.start();
+        QVERIFY(migrator.run());
+
+        int elapsed = time.elapsed();
+        times << elapsed;
+        qDebug("Time elapsed: %d ms", elapsed);
+
+        QCOMPARE(migrator.copiedRows(), migrator.totalRows());
+        QVERIFY(DatabaseMigrator::isPending());
+    }
+
+    summarizeResults(metaObject()->className(), times, logFile, startTime.secsTo(QDateTime::currentDateTime()));
+
+    // Compare the size and raw query times of the UTF-16 database and its copy
+    const qint64 originalSize = databaseSize(databasePath());
+    const qint64 migratedSize = databaseSize(migratedPath());
+
+    QStringList statements;
+    statements << QString("SELECT id, freeText FROM Events WHERE groupId = %1 "
+                          "ORDER BY endTime DESC, id DESC LIMIT 50").arg(groups / 2 + 1)
+               << QString("SELECT id FROM Events WHERE freeText LIKE '%hendrerit%'")
+               << QString("SELECT id FROM Events WHERE remoteUid = '+3580%1'").arg(100000 + groups / 2);
+
+    QString report = QString("%1 - %2 groups of %3 messages: %4 bytes in UTF-16, %5 bytes in UTF-8\n")
+            .arg(metaObject()->className()).arg(groups).arg(messages)
+            .arg(originalSize).arg(migratedSize);
+    foreach (const QString &statement, statements) {
+        const qint64 before = queryTime(databasePath(), statement, 20);
+        const qint64 after = queryTime(migratedPath(), statement, 20);
+        QVERIFY(before >= 0);
+        QVERIFY(after >= 0);
+        report += QString("    %1 us / %2 us: %3\n").arg(before).arg(after).arg(statement);
+    }
+    qDebug() << qPrintable(report);
+
+    if (logFile) {
+        logFile->write(report.toUtf8());
+        logFile->flush();
+    }
+
+    QFile::remove(migratedPath());
+    QFile::remove(migratedArchivePath());
+}
+
+void DatabaseMigratorPerfTest::cleanupTestCase()
+{
+    if(logFile) {
+        logFile->close();
+        delete logFile;
+        logFile = 0;
+    }
+
+    deleteAll();
+}
+
+QTEST_MAIN(DatabaseMigratorPerfTest)
@@ -0,0 +1,97 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "benchmarkreport.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+#include <algorithm>
+
+namespace {
+
+double toMsecs(qint64 nsecs)
+{
+    return nsecs / 1000000.0;
+}
+
+// Nearest-rank percentile of sorted samples
+qint64 percentile(const QList<qint64> &sorted, int p)
+{
+    const int rank = qMax(1, (p * sorted.size() + 99) / 100);
+    return sorted.at(qMin(rank, sorted.size()) - 1);
+}
+
+}
+
+BenchmarkReport::BenchmarkReport(const QString &suite)
+    : m_suite(suite),
+      m_build(QString::fromLocal8Bit(qgetenv("PERF_BUILD_ID")))
+{
+}
+
+QString BenchmarkReport::resultsFile()
+{
+    const QByteArray file = qgetenv("PERF_RESULTS");
+    return file.isEmpty() ? QStringLiteral("libcommhistory-benchmarks.jsonl") : QString::fromLocal8Bit(file);
+}
+
+void BenchmarkReport::add(const QString &scenario, int datasetEvents, QList<qint64> nsecs, qint64 rows)
+{
+    if (nsecs.isEmpty())
+        return;
+
+    std::sort(nsecs.begin(), nsecs.end());
+    qint64 total = 0;
+    foreach (qint64 sample, nsecs)
+        total += sample;
+
+    QJsonObject result;
+    result.insert("suite", m_suite);
+    result.insert("scenario", scenario);
+    result.insert("build", m_build);
+    result.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    result.insert("events", datasetEvents);
+    result.insert("samples", nsecs.size());
+    result.insert("rows", double(rows));
+    result.insert("min_ms", toMsecs(nsecs.first()));
+    result.insert("p50_ms", toMsecs(percentile(nsecs, 50)));
+    result.insert("p90_ms", toMsecs(percentile(nsecs, 90)));
+    result.insert("p95_ms", toMsecs(percentile(nsecs, 95)));
+    result.insert("p99_ms", toMsecs(percentile(nsecs, 99)));
+    result.insert("max_ms", toMsecs(nsecs.last()));
+    result.insert("mean_ms", toMsecs(total / nsecs.size()));
+    result.insert("rows_per_sec", total > 0 ? rows * nsecs.size() * 1000000000.0 / total : 0.0);
+
+    const QByteArray line = QJsonDocument(result).toJson(QJsonDocument::Compact);
+    qDebug() << line.constData();
+
+    QFile file(resultsFile());
+    if (!file.open(QIODevice::Append)) {
+        qWarning() << "Failed to open benchmark results" << file.fileName();
+        return;
+    }
+    file.write(line + '\n');
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef BENCHMARKREPORT_H
+#define BENCHMARKREPORT_H
+
+#include <QList>
+#include <QString>
+
+/*!
+ * Collects benchmark samples and writes one JSON object per scenario to
+ * the file named by PERF_RESULTS, libcommhistory-benchmarks.jsonl in the
+ * current directory by default. Each object holds the suite, scenario,
+ * dataset size, build id from PERF_BUILD_ID, sample count, percentiles in
+ * milliseconds and rows per second, so runs of different builds can be
+ * compared line by line.
+ */
+class BenchmarkReport
+{
+public:
+    BenchmarkReport(const QString &suite);
+
+    /*!
+     * Record a scenario. \a nsecs holds the duration of each sample and
+     * \a rows the number of rows handled by one sample.
+     */
+    void add(const QString &scenario, int datasetEvents, QList<qint64> nsecs, qint64 rows);
+
+    static QString resultsFile();
+
+private:
+    QString m_suite;
+    QString m_build;
+};
+
+#endif
@@ -0,0 +1,227 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "datasetgenerator.h"
+
+#include "databaseio.h"
+#include "commonutils.h"
+#include "messagepart.h"
+#include "common.h"
+
+#include <QDebug>
+
+using namespace CommHistory;
+
+namespace {
+
+const int transactionSize = 1000;
+const int sampleInterval = 1000;
+const int contactBatchSize = 25;
+
+const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+    "adipiscing", "elit", "in", "imperdiet", "cursus", "lacus", "vitae", "suscipit",
+    "maecenas", "bibendum", "rutrum", "at", "hendrerit", "ok", "thanks", ":)", "see",
+    "you", "tomorrow", "where", "are", "kiitos", "moi" };
+const int wordCount = sizeof(words) / sizeof(*words);
+
+}
+
+DatasetGenerator::DatasetGenerator(quint32 seed)
+    : m_state(seed ? seed : 1),
+      m_eventCount(0),
+      m_contactCount(0),
+      m_maxContacts(1000),
+      m_time(QDate(2025, 1, 1), QTime(0, 0), Qt::UTC),
+      m_callNumbers(0)
+{
+}
+
+quint32 DatasetGenerator::next()
+{
+    // xorshift32, so that runs do not depend on the C library
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+}
+
+int DatasetGenerator::bounded(int limit)
+{
+    return limit > 0 ? int(next() % quint32(limit)) : 0;
+}
+
+QString DatasetGenerator::messageText()
+{
+    // Skewed towards short messages
+    const int count = 1 + bounded(50) * bounded(50) / 50;
+    QStringList text;
+    for (int i = 0; i < count; i++)
+        text << QLatin1String(words[bounded(wordCount)]);
+    return text.join(QLatin1Char(' '));
+}
+
+int DatasetGenerator::largestGroup() const
+{
+    int largest = -1;
+    for (int i = 0; i < m_groupSizes.size(); i++) {
+        if (largest < 0 || m_groupSizes.at(i) > m_groupSizes.at(largest))
+            largest = i;
+    }
+    return largest;
+}
+
+bool DatasetGenerator::addGroup(Group &group, QStringList &contactNumbers)
+{
+    const int index = m_groups.size();
+    if (bounded(100) < 85) {
+        const QString number = QString("+3584%1").arg(1000000 + index);
+        group.setLocalUid(RING_ACCOUNT);
+        group.setRecipients(RecipientList::fromPhoneNumbers(QStringList() << number));
+        if (m_contactCount + contactNumbers.size() < m_maxContacts && bounded(100) < 60)
+            contactNumbers << number;
+    } else {
+        group.setLocalUid(ACCOUNT1);
+        group.setRecipients(Recipient(ACCOUNT1, QString("user%1@example.org").arg(index)));
+    }
+
+    if (!DatabaseIO::instance()->addGroup(group))
+        return false;
+
+    m_groups.append(group);
+    m_groupSizes.append(0);
+    return true;
+}
+
+void DatasetGenerator::fillMessage(Event &event, const Group &group)
+{
+    event.setGroupId(group.id());
+    event.setLocalUid(group.localUid());
+    event.setRecipients(group.recipients());
+    event.setDirection(bounded(100) < 55 ? Event::Inbound : Event::Outbound);
+    event.setIsRead(event.direction() == Event::Outbound || bounded(100) >= 2);
+    event.setFreeText(messageText());
+
+    if (group.localUid() != RING_ACCOUNT) {
+        event.setType(Event::IMEvent);
+    } else if (bounded(100) < 10) {
+        event.setType(Event::MMSEvent);
+
+        QList<MessagePart> parts;
+        const int partCount = 2 + bounded(2);
+        for (int i = 0; i < partCount; i++) {
+            MessagePart part;
+            part.setContentId(QString("part%1").arg(i));
+            part.setContentType(i == 0 ? QLatin1String("application/smil") : QLatin1String("image/jpeg"));
+            part.setPath(QString("/tmp/perf_scaled/%1/part%2").arg(m_eventCount).arg(i));
+            parts << part;
+        }
+        event.setMessageParts(parts);
+    } else {
+        event.setType(Event::SMSEvent);
+    }
+}
+
+void DatasetGenerator::fillCall(Event &event)
+{
+    event.setType(Event::CallEvent);
+    event.setLocalUid(RING_ACCOUNT);
+    event.setDirection(bounded(100) < 55 ? Event::Inbound : Event::Outbound);
+
+    // Mostly people there are conversations with
+    QString number;
+    if (!m_messageGroups.isEmpty() && bounded(100) < 70) {
+        const Group &group = m_groups.at(m_messageGroups.at(bounded(m_messageGroups.size())));
+        if (group.localUid() == RING_ACCOUNT)
+            number = group.recipients().value(0).remoteUid();
+    }
+    if (number.isEmpty())
+        number = QString("+3585%1").arg(1000000 + m_callNumbers++);
+    event.setRecipients(Recipient::fromPhoneNumber(number));
+
+    const bool missed = event.direction() == Event::Inbound && bounded(100) < 30;
+    event.setIsMissedCall(missed);
+    event.setIsRead(!missed || bounded(100) >= 10);
+    if (!missed)
+        event.setEndTime(event.startTime().addSecs(bounded(600)));
+}
+
+bool DatasetGenerator::extendTo(int events)
+{
+    DatabaseIO *io = DatabaseIO::instance();
+    QStringList contactNumbers;
+
+    while (m_eventCount < events) {
+        if (!io->transaction())
+            return false;
+
+        const int batchEnd = qMin(events, m_eventCount + transactionSize);
+        for (; m_eventCount < batchEnd; m_eventCount++) {
+            Event event;
+            m_time = m_time.addSecs(bounded(120) + 1);
+            event.setStartTime(m_time);
+            event.setEndTime(m_time);
+
+            if (bounded(4) == 0) {
+                fillCall(event);
+            } else {
+                int groupIndex;
+                if (m_groups.isEmpty() || bounded(100) == 0) {
+                    Group group;
+                    if (!addGroup(group, contactNumbers)) {
+                        io->rollback();
+                        return false;
+                    }
+                    groupIndex = m_groups.size() - 1;
+                } else {
+                    groupIndex = m_messageGroups.at(bounded(m_messageGroups.size()));
+                }
+
+                m_messageGroups.append(groupIndex);
+                m_groupSizes[groupIndex]++;
+                fillMessage(event, m_groups.at(groupIndex));
+            }
+
+            if (!io->addEvent(event)) {
+                io->rollback();
+                return false;
+            }
+            if (m_eventCount % sampleInterval == 0)
+                m_sampleEventIds.append(event.id());
+        }
+
+        if (!io->commit())
+            return false;
+    }
+
+    QList<QPair<QString, QPair<QString, QString> > > details;
+    foreach (const QString &number, contactNumbers) {
+        details.append(qMakePair(QString("Perf Contact %1").arg(++m_contactCount), qMakePair(number, QString())));
+        if (details.size() == contactBatchSize) {
+            addTestContacts(details);
+            details.clear();
+        }
+    }
+    if (!details.isEmpty())
+        addTestContacts(details);
+
+    return true;
+}
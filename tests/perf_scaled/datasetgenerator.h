@@ -0,0 +1,101 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef DATASETGENERATOR_H
+#define DATASETGENERATOR_H
+
+#include <QList>
+#include <QStringList>
+#include <QDateTime>
+
+#include "group.h"
+#include "event.h"
+
+/*!
+ * Deterministic generator of a realistic history.
+ *
+ * The same seed always produces the same events in the same order, and a
+ * larger dataset starts with the events of a smaller one, so extendTo()
+ * can grow the database from one size to the next.
+ *
+ * Distributions:
+ * - a quarter of the events are calls, 30% of incoming calls are missed
+ * - a new conversation starts for 1% of the messages; otherwise the
+ *   message goes to a conversation chosen in proportion to its size, which
+ *   gives a few long conversations and a long tail of short ones
+ * - 85% of conversations are phone numbers, the rest instant messaging
+ * - 10% of phone messages are MMS with two or three parts
+ * - 55% of events are incoming, 2% of incoming messages are unread
+ * - messages have 1-50 words, mostly short
+ * - 60% of phone numbers belong to a contact, up to maxContacts()
+ */
+class DatasetGenerator
+{
+public:
+    DatasetGenerator(quint32 seed = 1);
+
+    /*!
+     * Add events to the database until it holds \a events generated
+     * events. Contacts are added for the new phone numbers.
+     */
+    bool extendTo(int events);
+
+    int eventCount() const { return m_eventCount; }
+    int contactCount() const { return m_contactCount; }
+
+    int maxContacts() const { return m_maxContacts; }
+    void setMaxContacts(int count) { m_maxContacts = count; }
+
+    const QList<CommHistory::Group> &groups() const { return m_groups; }
+
+    // Index into groups() of the conversation with the most messages
+    int largestGroup() const;
+
+    // Message counts of each conversation
+    const QList<int> &groupSizes() const { return m_groupSizes; }
+
+    // Ids of a few generated events spread over the whole dataset
+    const QList<int> &sampleEventIds() const { return m_sampleEventIds; }
+
+    QString messageText();
+    quint32 next();
+    int bounded(int limit);
+
+private:
+    bool addGroup(CommHistory::Group &group, QStringList &contactNumbers);
+    void fillMessage(CommHistory::Event &event, const CommHistory::Group &group);
+    void fillCall(CommHistory::Event &event);
+
+    quint32 m_state;
+    int m_eventCount;
+    int m_contactCount;
+    int m_maxContacts;
+    QDateTime m_time;
+    QList<CommHistory::Group> m_groups;
+    QList<int> m_groupSizes;
+    // Group index of each message, to pick groups in proportion to size
+    QList<int> m_messageGroups;
+    QList<int> m_sampleEventIds;
+    int m_callNumbers;
+};
+
+#endif
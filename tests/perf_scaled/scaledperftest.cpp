@@ -0,0 +1,632 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <cstdlib>
+
+#include "scaledperftest.h"
+#include "databaseio.h"
+#include "eventmodel.h"
+#include "groupmodel.h"
+#include "groupmanager.h"
+#include "contactgroupmodel.h"
+#include "conversationmodel.h"
+#include "callmodel.h"
+#include "recentcontactsmodel.h"
+#include "searchmodel.h"
+#include "recipienteventmodel.h"
+#include "draftsmodel.h"
+#include "singleeventmodel.h"
+#include "contactresolver.h"
+#include "common.h"
+
+using namespace CommHistory;
+
+namespace {
+
+const int firstPageSize = 25;
+const int databaseOperationCount = 100;
+const int batchSize = 100;
+const int fanOutModels = 4;
+const int scrollWindow = 12;
+const int scrollRows = 2000;
+
+const char *modelNames[] = { "groupmodel", "contactgroupmodel", "conversationmodel", "callmodel",
+                             "recentcontactsmodel", "searchmodel", "recipienteventmodel",
+                             "draftsmodel", "singleeventmodel" };
+
+int envValue(const char *name, int defaultValue)
+{
+    const int value = QString::fromLatin1(qgetenv(name)).toInt();
+    return value > 0 ? value : defaultValue;
+}
+
+Event outgoingMessage(const Group &group, const QString &text)
+{
+    Event event;
+    event.setType(group.localUid() == RING_ACCOUNT ? Event::SMSEvent : Event::IMEvent);
+    event.setDirection(Event::Outbound);
+    event.setGroupId(group.id());
+    event.setLocalUid(group.localUid());
+    event.setRecipients(group.recipients());
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(event.startTime());
+    event.setIsRead(true);
+    event.setFreeText(text);
+    return event;
+}
+
+Event mmsMessage(const Group &group, const QString &text, int index)
+{
+    Event event = outgoingMessage(group, text);
+    event.setType(Event::MMSEvent);
+    event.setSubject(text.left(20));
+    event.setExtraProperty("mms-message-id", QString("perf-%1").arg(index));
+    event.setExtraProperty("mms-read-report", true);
+
+    QList<MessagePart> parts;
+    MessagePart smil;
+    smil.setContentId("smil");
+    smil.setContentType("application/smil");
+    smil.setPath("/home/user/.mms/perf/smil.xml");
+    MessagePart textPart;
+    textPart.setContentId("text_0001.txt");
+    textPart.setContentType("text/plain;charset=utf-8");
+    textPart.setPath("/home/user/.mms/perf/text_0001.txt");
+    MessagePart image;
+    image.setContentId("image_0001.jpg");
+    image.setContentType("image/jpeg");
+    image.setPath("/home/user/.mms/perf/image_0001.jpg");
+    parts << smil << textPart << image;
+    event.setMessageParts(parts);
+    return event;
+}
+
+Event callEvent(const QString &number)
+{
+    Event event;
+    event.setType(Event::CallEvent);
+    event.setDirection(Event::Inbound);
+    event.setLocalUid(RING_ACCOUNT);
+    event.setRecipients(Recipient(RING_ACCOUNT, number));
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(event.startTime());
+    event.setIsMissedCall(true);
+    event.setExtraProperty("callSubscriberId", "perf");
+    return event;
+}
+
+}
+
+ModelWaiter::ModelWaiter()
+    : m_done(false)
+{
+    m_timeout.setSingleShot(true);
+    connect(&m_timeout, SIGNAL(timeout()), &m_loop, SLOT(quit()));
+}
+
+void ModelWaiter::watchLoad(QAbstractItemModel *model, bool firstRows)
+{
+    connect(model, SIGNAL(modelReady(bool)), SLOT(loaded()));
+    if (firstRows)
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(loaded()));
+}
+
+void ModelWaiter::watchChanges(QAbstractItemModel *model)
+{
+    m_watched.insert(model);
+    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(changed()));
+    connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), SLOT(changed()));
+    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(changed()));
+    connect(model, SIGNAL(layoutChanged()), SLOT(changed()));
+}
+
+void ModelWaiter::reset()
+{
+    m_done = false;
+    m_changed.clear();
+}
+
+bool ModelWaiter::wait(int msecs)
+{
+    if (!m_done) {
+        m_timeout.start(msecs);
+        m_loop.exec();
+        m_timeout.stop();
+    }
+    return m_done;
+}
+
+void ModelWaiter::loaded()
+{
+    m_done = true;
+    m_loop.quit();
+}
+
+void ModelWaiter::changed()
+{
+    m_changed.insert(sender());
+    if (m_changed.size() == m_watched.size())
+        loaded();
+}
+
+ScaledPerfTest::ScaledPerfTest()
+    : report(QStringLiteral("perf_scaled")),
+      iterations(10)
+{
+    #ifdef PERF_ITERATIONS
+    iterations = PERF_ITERATIONS;
+    #endif
+    iterations = envValue("PERF_ITERATIONS", iterations);
+}
+
+void ScaledPerfTest::initTestCase()
+{
+    initTestDatabase();
+
+    generator.setMaxContacts(envValue("PERF_MAX_CONTACTS", generator.maxContacts()));
+}
+
+void ScaledPerfTest::benchmark_data()
+{
+    QTest::addColumn<int>("events");
+
+    // Sizes grow, so each row extends the dataset of the previous one
+    const int maxEvents = envValue("PERF_MAX_EVENTS", 100000);
+    const int sizes[] = { 10000, 100000, 500000 };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        if (sizes[i] <= maxEvents)
+            QTest::newRow(qPrintable(QString("%1 events").arg(sizes[i]))) << sizes[i];
+    }
+}
+
+void ScaledPerfTest::benchmark()
+{
+    QFETCH(int, events);
+
+    QElapsedTimer generation;
+    generation.start();
+    QVERIFY(generator.extendTo(events));
+    qDebug() << Q_FUNC_INFO << "- Dataset of" << events << "events," << generator.groups().size()
+             << "conversations and" << generator.contactCount() << "contacts generated in"
+             << generation.elapsed() << "ms";
+
+    databaseOperations();
+    if (QTest::currentTestFailed())
+        return;
+    modifyThroughput();
+    if (QTest::currentTestFailed())
+        return;
+    modelLoads();
+    if (QTest::currentTestFailed())
+        return;
+    contactResolution();
+    if (QTest::currentTestFailed())
+        return;
+    scrollData();
+    if (QTest::currentTestFailed())
+        return;
+    updateFanOut();
+}
+
+void ScaledPerfTest::databaseOperations()
+{
+    DatabaseIO *io = DatabaseIO::instance();
+    const Group &group = generator.groups().at(generator.largestGroup());
+    const int events = generator.eventCount();
+
+    QList<qint64> addTimes, getTimes, modifyTimes, deleteTimes;
+    QList<Event> added;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < databaseOperationCount; i++) {
+        Event event = outgoingMessage(group, generator.messageText());
+        timer.start();
+        QVERIFY(io->addEvent(event));
+        addTimes << timer.nsecsElapsed();
+        added << event;
+    }
+
+    const QList<int> &sampleIds = generator.sampleEventIds();
+    QVERIFY(!sampleIds.isEmpty());
+    for (int i = 0; i < databaseOperationCount; i++) {
+        Event event;
+        timer.start();
+        QVERIFY(io->getEvent(sampleIds.at(i % sampleIds.size()), event));
+        getTimes << timer.nsecsElapsed();
+    }
+
+    for (int i = 0; i < added.size(); i++) {
+        added[i].setFreeText(generator.messageText());
+        added[i].setStatus(Event::DeliveredStatus);
+        timer.start();
+        QVERIFY(io->modifyEvent(added[i]));
+        modifyTimes << timer.nsecsElapsed();
+    }
+
+    for (int i = 0; i < added.size(); i++) {
+        timer.start();
+        QVERIFY(io->deleteEvent(added[i]));
+        deleteTimes << timer.nsecsElapsed();
+    }
+
+    report.add("databaseio.addEvent", events, addTimes, 1);
+    report.add("databaseio.getEvent", events, getTimes, 1);
+    report.add("databaseio.modifyEvent", events, modifyTimes, 1);
+    report.add("databaseio.deleteEvent", events, deleteTimes, 1);
+
+    // Batches inside one transaction, as EventModel::addEvents() does
+    QList<qint64> batchAddTimes, batchDeleteTimes;
+    for (int i = 0; i < iterations; i++) {
+        QList<int> ids;
+        timer.start();
+        QVERIFY(io->transaction());
+        for (int j = 0; j < batchSize; j++) {
+            Event event = outgoingMessage(group, generator.messageText());
+            QVERIFY(io->addEvent(event));
+            ids << event.id();
+        }
+        QVERIFY(io->commit());
+        batchAddTimes << timer.nsecsElapsed();
+
+        timer.start();
+        QVERIFY(io->deleteEvents(ids));
+        batchDeleteTimes << timer.nsecsElapsed();
+    }
+
+    report.add(QString("databaseio.addEvents.batch%1").arg(batchSize), events, batchAddTimes, batchSize);
+    report.add(QString("databaseio.deleteEvents.batch%1").arg(batchSize), events, batchDeleteTimes, batchSize);
+}
+
+void ScaledPerfTest::modifyThroughput()
+{
+    DatabaseIO *io = DatabaseIO::instance();
+    const Group &group = generator.groups().at(generator.largestGroup());
+    const int events = generator.eventCount();
+
+    QList<Event> mms, calls;
+    for (int i = 0; i < databaseOperationCount; i++) {
+        Event event = mmsMessage(group, generator.messageText(), i);
+        QVERIFY(io->addEvent(event));
+        mms << event;
+
+        event = callEvent(QString("+3584%1").arg(1000000 + i));
+        QVERIFY(io->addEvent(event));
+        calls << event;
+    }
+
+    // Delivery reports and read receipts: the status and one property
+    // change while the parts are saved again as they were
+    QList<qint64> mmsTimes;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; i++) {
+        timer.start();
+        for (int j = 0; j < mms.size(); j++) {
+            Event &event = mms[j];
+            event.setStatus(i % 2 ? Event::DeliveredStatus : Event::SentStatus);
+            event.setExtraProperty("mms-delivery-time", QDateTime::currentDateTime().toString(Qt::ISODate));
+            event.setMessageParts(event.messageParts());
+            QVERIFY(io->modifyEvent(event));
+        }
+        mmsTimes << timer.nsecsElapsed();
+    }
+
+    // Missed calls being seen, with a property added and removed
+    QList<qint64> callTimes;
+    for (int i = 0; i < iterations; i++) {
+        timer.start();
+        for (int j = 0; j < calls.size(); j++) {
+            Event &event = calls[j];
+            event.setIsRead(!(i % 2));
+            event.setExtraProperty("callSeen", i % 2 ? QVariant() : QVariant(true));
+            QVERIFY(io->modifyEvent(event));
+        }
+        callTimes << timer.nsecsElapsed();
+    }
+
+    QList<int> ids;
+    foreach (const Event &event, mms + calls)
+        ids << event.id();
+    QVERIFY(io->deleteEvents(ids));
+
+    report.add("databaseio.modifyEvent.mms", events, mmsTimes, mms.size());
+    report.add("databaseio.modifyEvent.call", events, callTimes, calls.size());
+}
+
+void ScaledPerfTest::loadModel(ModelKind kind, bool firstPage, bool resolve, qint64 &nsecs, int &rows)
+{
+    const Group &group = generator.groups().at(generator.largestGroup());
+    const EventModel::QueryMode mode = firstPage ? EventModel::StreamedAsyncQuery : EventModel::AsyncQuery;
+    const EventModel::ContactResolveType eventResolve = resolve ? EventModel::ResolveImmediately
+                                                                : EventModel::DoNotResolve;
+
+    QScopedPointer<QAbstractItemModel> model;
+    GroupManager *manager = 0;
+    EventModel *eventModel = 0;
+
+    switch (kind) {
+    case Groups: {
+        GroupModel *groupModel = new GroupModel;
+        groupModel->setQueryMode(mode);
+        groupModel->setFirstChunkSize(firstPageSize);
+        groupModel->setChunkSize(firstPageSize);
+        groupModel->setResolveContacts(resolve ? GroupManager::ResolveImmediately : GroupManager::DoNotResolve);
+        model.reset(groupModel);
+        break;
+    }
+    case ContactGroups: {
+        ContactGroupModel *contactGroupModel = new ContactGroupModel;
+        manager = new GroupManager(contactGroupModel);
+        manager->setQueryMode(mode);
+        manager->setFirstChunkSize(firstPageSize);
+        manager->setChunkSize(firstPageSize);
+        manager->setResolveContacts(resolve ? GroupManager::ResolveImmediately : GroupManager::DoNotResolve);
+        contactGroupModel->setManager(manager);
+        model.reset(contactGroupModel);
+        break;
+    }
+    case Conversation:
+        eventModel = new ConversationModel;
+        break;
+    case Calls:
+        eventModel = new CallModel;
+        break;
+    case RecentContacts:
+        eventModel = new RecentContactsModel;
+        break;
+    case Search:
+        eventModel = new SearchModel;
+        static_cast<SearchModel *>(eventModel)->setSearchText(QStringLiteral("hendrerit"));
+        break;
+    case RecipientEvents:
+        eventModel = new RecipientEventModel;
+        static_cast<RecipientEventModel *>(eventModel)->setRecipients(group.recipients());
+        break;
+    case Drafts:
+        eventModel = new DraftsModel;
+        break;
+    case SingleEvent:
+        eventModel = new SingleEventModel;
+        break;
+    }
+
+    if (eventModel) {
+        eventModel->setQueryMode(mode);
+        eventModel->setFirstChunkSize(firstPageSize);
+        eventModel->setChunkSize(firstPageSize);
+        eventModel->setResolveContacts(eventResolve);
+        model.reset(eventModel);
+    }
+
+    ModelWaiter waiter;
+    waiter.watchLoad(model.data(), firstPage);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool started = false;
+    switch (kind) {
+    case Groups:
+        started = static_cast<GroupModel *>(model.data())->getGroups();
+        break;
+    case ContactGroups:
+        started = manager->getGroups();
+        break;
+    case Conversation:
+        started = static_cast<ConversationModel *>(eventModel)->getEvents(group.id());
+        break;
+    case Calls:
+        started = static_cast<CallModel *>(eventModel)->getEvents();
+        break;
+    case RecentContacts:
+        started = static_cast<RecentContactsModel *>(eventModel)->getEvents();
+        break;
+    case Search:
+        started = static_cast<SearchModel *>(eventModel)->getEvents();
+        break;
+    case RecipientEvents:
+        started = static_cast<RecipientEventModel *>(eventModel)->getEvents();
+        break;
+    case Drafts:
+        started = static_cast<DraftsModel *>(eventModel)->getEvents();
+        break;
+    case SingleEvent:
+        started = static_cast<SingleEventModel *>(eventModel)->getEventById(generator.sampleEventIds().last());
+        break;
+    }
+    QVERIFY(started);
+    QVERIFY(waiter.wait());
+
+    nsecs = timer.nsecsElapsed();
+    rows = model->rowCount();
+}
+
+void ScaledPerfTest::modelLoads()
+{
+    const int events = generator.eventCount();
+
+    for (int kind = Groups; kind <= SingleEvent; kind++) {
+        // Models that only ever hold a few rows have no first page
+        const bool paged = kind != RecentContacts && kind != Drafts && kind != SingleEvent;
+
+        for (int firstPage = paged ? 1 : 0; firstPage >= 0; firstPage--) {
+            QList<qint64> times;
+            int rows = 0;
+            for (int i = 0; i < iterations; i++) {
+                qint64 nsecs = 0;
+                loadModel(static_cast<ModelKind>(kind), firstPage, false, nsecs, rows);
+                if (QTest::currentTestFailed())
+                    return;
+                times << nsecs;
+            }
+            report.add(QString("%1.%2").arg(modelNames[kind]).arg(firstPage ? "firstPage" : "fullLoad"),
+                       events, times, rows);
+        }
+    }
+}
+
+void ScaledPerfTest::contactResolution()
+{
+    const int events = generator.eventCount();
+
+    // Loading with contacts resolved before the model is ready
+    const ModelKind kinds[] = { Groups, Conversation, Calls };
+    for (unsigned k = 0; k < sizeof(kinds) / sizeof(*kinds); k++) {
+        QList<qint64> times;
+        int rows = 0;
+        for (int i = 0; i < iterations; i++) {
+            qint64 nsecs = 0;
+            loadModel(kinds[k], false, true, nsecs, rows);
+            if (QTest::currentTestFailed())
+                return;
+            times << nsecs;
+        }
+        report.add(QString("%1.fullLoad.resolved").arg(modelNames[kinds[k]]), events, times, rows);
+    }
+
+    // Resolving the recipients of every conversation again
+    RecipientList recipients;
+    foreach (const Group &group, generator.groups()) {
+        foreach (const Recipient &recipient, group.recipients())
+            recipients << recipient;
+    }
+
+    QList<qint64> times;
+    for (int i = 0; i < iterations; i++) {
+        ContactResolver resolver(this);
+        resolver.setForceResolving(true);
+        QSignalSpy finished(&resolver, SIGNAL(finished()));
+
+        QElapsedTimer timer;
+        timer.start();
+        resolver.add(recipients);
+        QVERIFY(finished.count() || finished.wait(60000));
+        times << timer.nsecsElapsed();
+    }
+    report.add("contactresolver.allConversations", events, times, recipients.size());
+}
+
+void ScaledPerfTest::scrollData()
+{
+    const int events = generator.eventCount();
+    const Group &group = generator.groups().at(generator.largestGroup());
+
+    ConversationModel model;
+    model.setQueryMode(EventModel::AsyncQuery);
+    model.setResolveContacts(EventModel::ResolveImmediately);
+    ModelWaiter waiter;
+    waiter.watchLoad(&model, false);
+    QVERIFY(model.getEvents(group.id()));
+    QVERIFY(waiter.wait());
+
+    // The roles a conversation delegate binds to, and the section property
+    const int roles[] = { EventModel::EventIdRole, EventModel::DirectionRole, EventModel::StatusRole,
+                          EventModel::FreeTextRole, EventModel::SubjectRole, EventModel::MessagePartsRole,
+                          EventModel::StartTimeRole, EventModel::EndTimeRole, EventModel::IsReadRole,
+                          EventModel::ContactNamesRole, EventModel::DateAndAccountGroupingRole };
+    const int roleCount = sizeof(roles) / sizeof(*roles);
+    const int rows = qMin(model.rowCount(), scrollRows);
+    const int last = qMax(rows - scrollWindow, 0);
+
+    // A list view scrolled down and back up one row per frame, reading
+    // every role of each visible row in each frame
+    QList<qint64> times;
+    qint64 calls = 0;
+    for (int i = 0; i < iterations; i++) {
+        calls = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int frame = 0; frame <= 2 * last; frame++) {
+            const int first = frame <= last ? frame : 2 * last - frame;
+            for (int row = first; row < first + scrollWindow && row < rows; row++) {
+                const QModelIndex index(model.index(row, 0));
+                for (int r = 0; r < roleCount; r++) {
+                    model.data(index, roles[r]);
+                    calls++;
+                }
+            }
+        }
+        times << timer.nsecsElapsed();
+    }
+    QVERIFY(calls > 0);
+    report.add("conversationmodel.scrollData", events, times, calls);
+}
+
+void ScaledPerfTest::updateFanOut()
+{
+    const int events = generator.eventCount();
+    const Group &group = generator.groups().at(generator.largestGroup());
+
+    // Listeners as in a running UI: conversation lists and open conversations
+    QList<QAbstractItemModel *> models;
+    ModelWaiter waiter;
+    for (int i = 0; i < fanOutModels; i++) {
+        GroupModel *groupModel = new GroupModel;
+        groupModel->setResolveContacts(GroupManager::DoNotResolve);
+        ModelWaiter loadWaiter;
+        loadWaiter.watchLoad(groupModel, false);
+        QVERIFY(groupModel->getGroups());
+        QVERIFY(loadWaiter.wait());
+        models << groupModel;
+        waiter.watchChanges(groupModel);
+
+        ConversationModel *conversation = new ConversationModel;
+        conversation->setQueryMode(EventModel::StreamedAsyncQuery);
+        conversation->setFirstChunkSize(firstPageSize);
+        conversation->setChunkSize(firstPageSize);
+        conversation->setResolveContacts(EventModel::DoNotResolve);
+        loadWaiter.reset();
+        loadWaiter.watchLoad(conversation, false);
+        QVERIFY(conversation->getEvents(group.id()));
+        QVERIFY(loadWaiter.wait());
+        models << conversation;
+        waiter.watchChanges(conversation);
+    }
+
+    EventModel writer;
+    QList<int> ids;
+    QList<qint64> times;
+    for (int i = 0; i < iterations; i++) {
+        Event event = outgoingMessage(group, generator.messageText());
+        waiter.reset();
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(writer.addEvent(event));
+        QVERIFY(waiter.wait());
+        times << timer.nsecsElapsed();
+        ids << event.id();
+    }
+    report.add(QString("updates.fanOut%1Models").arg(models.size()), events, times, models.size());
+
+    qDeleteAll(models);
+    QVERIFY(DatabaseIO::instance()->deleteEvents(ids));
+}
+
+void ScaledPerfTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+QTEST_MAIN(ScaledPerfTest)
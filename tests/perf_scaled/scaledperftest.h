@@ -0,0 +1,106 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef SCALEDPERFTEST_H
+#define SCALEDPERFTEST_H
+
+#include <QObject>
+#include <QEventLoop>
+#include <QTimer>
+#include <QSet>
+
+#include "datasetgenerator.h"
+#include "benchmarkreport.h"
+
+class QAbstractItemModel;
+
+/*!
+ * Runs the event loop until a model has loaded, or until a number of
+ * models have reported a change.
+ */
+class ModelWaiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    ModelWaiter();
+
+    // Done when \a model is ready, or when it has its first rows
+    void watchLoad(QAbstractItemModel *model, bool firstRows);
+    // Done when every watched model has changed since reset()
+    void watchChanges(QAbstractItemModel *model);
+
+    void reset();
+    bool wait(int msecs = 60000);
+
+private Q_SLOTS:
+    void loaded();
+    void changed();
+
+private:
+    QEventLoop m_loop;
+    QTimer m_timeout;
+    QSet<QObject *> m_watched;
+    QSet<QObject *> m_changed;
+    bool m_done;
+};
+
+class ScaledPerfTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    ScaledPerfTest();
+
+private slots:
+    void initTestCase();
+    void benchmark_data();
+    void benchmark();
+    void cleanupTestCase();
+
+private:
+    enum ModelKind {
+        Groups,
+        ContactGroups,
+        Conversation,
+        Calls,
+        RecentContacts,
+        Search,
+        RecipientEvents,
+        Drafts,
+        SingleEvent
+    };
+
+    void databaseOperations();
+    void modifyThroughput();
+    void modelLoads();
+    void loadModel(ModelKind kind, bool firstPage, bool resolve, qint64 &nsecs, int &rows);
+    void contactResolution();
+    void scrollData();
+    void updateFanOut();
+
+    DatasetGenerator generator;
+    BenchmarkReport report;
+    int iterations;
+};
+
+#endif
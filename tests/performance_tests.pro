@@ -27,8 +27,10 @@ TEMPLATE = subdirs
 SUBDIRS = \
     perf_callmodel \
     perf_conversationmodel \
+    perf_databasemigrator \
     perf_groupmodel \
     perf_recentcontactsmodel \
+    perf_scaled \
     profile_callmodel \
     profile_conversationmodel \
     profile_groupmodel \
@@ -31,5 +31,16 @@ SUBDIRS = \
     ut_groupmodel \
     ut_recentcontactsmodel \
     ut_singleeventmodel \
-    ut_recipienteventmodel
+    ut_recipienteventmodel \
+    ut_searchmodel \
+    ut_attachmentcollector \
+    ut_retentionengine \
+    ut_databasemigrator \
+    ut_queryprofiler \
+    ut_queryplans \
+    ut_historybackup \
+    ut_jsonimport \
+    ut_contactresolver \
+    ut_writequeue \
+    ut_eventwriter
 
@@ -0,0 +1,246 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "attachmentcollectortest.h"
+
+#include "attachmentcollector.h"
+#include "commhistorydatabasepath.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+
+Group group1, group2;
+
+namespace {
+
+QString writeFile(const QString &path, int size)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return QString();
+    file.write(QByteArray(size, 'x'));
+    return path;
+}
+
+MessagePart testPart(const QString &path)
+{
+    MessagePart part;
+    part.setContentType("text/plain");
+    part.setContentId(QFileInfo(path).fileName());
+    part.setPath(path);
+    return part;
+}
+
+// Event with one part per size, stored under its data directory
+Event addEventWithParts(EventModel &model, const QList<int> &sizes)
+{
+    Event event;
+    event.setType(Event::MMSEvent);
+    event.setDirection(Event::Inbound);
+    event.setGroupId(group1.id());
+    event.setStartTime(QDateTime::currentDateTime());
+    event.setEndTime(QDateTime::currentDateTime());
+    event.setLocalUid(ACCOUNT1);
+    event.setRecipients(Recipient(ACCOUNT1, "attachments"));
+    event.setFreeText("attachments");
+    if (!model.addEvent(event))
+        return Event();
+
+    QList<MessagePart> parts;
+    for (int i = 0; i < sizes.size(); i++) {
+        const QString path = CommHistoryDatabasePath::dataDir(event.id()) + QString("part%1.txt").arg(i);
+        parts.append(testPart(writeFile(path, sizes[i])));
+    }
+    event.setMessageParts(parts);
+    if (!model.modifyEvent(event))
+        return Event();
+
+    return event;
+}
+
+}
+
+void AttachmentCollectorTest::initTestCase()
+{
+    initTestDatabase();
+    addTestGroups(group1, group2);
+}
+
+void AttachmentCollectorTest::cleanupTestCase()
+{
+    deleteAll();
+    QDir(CommHistoryDatabasePath::dataDir()).removeRecursively();
+}
+
+void AttachmentCollectorTest::detachedParts()
+{
+    EventModel model;
+    Event event = addEventWithParts(model, QList<int>() << 100 << 250);
+    QVERIFY(event.isValid());
+
+    const QString kept = event.messageParts().at(0).path();
+    const QString detached = event.messageParts().at(1).path();
+
+    // Dropping a part from the event only detaches its row
+    event.setMessageParts(QList<MessagePart>() << event.messageParts().at(0));
+    QVERIFY(model.modifyEvent(event));
+    QVERIFY(QFile::exists(detached));
+
+    AttachmentCollector collector;
+    QVERIFY(collector.collect());
+    QVERIFY(!collector.isRunning());
+    QCOMPARE(collector.partsRemoved(), 1);
+    QCOMPARE(collector.filesRemoved(), 1);
+    QCOMPARE(collector.bytesReclaimed(), qint64(250));
+    QCOMPARE(collector.directoriesRemoved(), 0);
+
+    QVERIFY(!QFile::exists(detached));
+    QVERIFY(QFile::exists(kept));
+
+    Event stored;
+    QVERIFY(model.databaseIO().getEvent(event.id(), stored));
+    QCOMPARE(stored.messageParts().size(), 1);
+
+    // Nothing left to do
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.partsRemoved(), 0);
+    QCOMPARE(collector.bytesReclaimed(), qint64(0));
+}
+
+void AttachmentCollectorTest::deletedEvents()
+{
+    EventModel model;
+    Event event = addEventWithParts(model, QList<int>() << 10 << 20);
+    QVERIFY(event.isValid());
+
+    // A part of another event sharing a file keeps that file
+    Event other = addEventWithParts(model, QList<int>());
+    QVERIFY(other.isValid());
+    other.setMessageParts(QList<MessagePart>() << testPart(event.messageParts().at(0).path()));
+    QVERIFY(model.modifyEvent(other));
+
+    const QString directory = CommHistoryDatabasePath::dataDir(event.id());
+    QVERIFY(model.deleteEvent(event.id()));
+    QVERIFY(QFile::exists(directory));
+
+    AttachmentCollector collector;
+    collector.setMinimumAge(0);
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.partsRemoved(), 2);
+    QCOMPARE(collector.filesRemoved(), 1);
+    QCOMPARE(collector.bytesReclaimed(), qint64(20));
+    QVERIFY(QFile::exists(event.messageParts().at(0).path()));
+    QVERIFY(!QFile::exists(event.messageParts().at(1).path()));
+
+    // Once the last reference is gone, so is the directory
+    QVERIFY(model.deleteEvent(other.id()));
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.partsRemoved(), 1);
+    QCOMPARE(collector.bytesReclaimed(), qint64(10));
+    QVERIFY(!QFile::exists(directory));
+}
+
+void AttachmentCollectorTest::orphanedDirectories()
+{
+    const QString orphan = CommHistoryDatabasePath::dataDir(999999);
+    writeFile(orphan + "a/b.bin", 64);
+    writeFile(orphan + "c.bin", 36);
+
+    // Not named after an event
+    const QString foreign = CommHistoryDatabasePath::dataDir() + "cache/";
+    writeFile(foreign + "d.bin", 10);
+
+    AttachmentCollector collector;
+
+    // Too recent, the event may still be on its way
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.directoriesRemoved(), 0);
+    QVERIFY(QFile::exists(orphan));
+
+    collector.setMinimumAge(0);
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.directoriesRemoved(), 1);
+    QCOMPARE(collector.filesRemoved(), 2);
+    QCOMPARE(collector.bytesReclaimed(), qint64(100));
+    QVERIFY(!QFile::exists(orphan));
+    QVERIFY(QFile::exists(foreign + "d.bin"));
+}
+
+void AttachmentCollectorTest::unattachedArchive()
+{
+    const QString orphan = CommHistoryDatabasePath::dataDir(999998);
+    writeFile(orphan + "e.bin", 16);
+
+    // An archive that cannot be attached may still refer to the directory
+    const QString archive = QDir(CommHistoryDatabasePath::databaseDir())
+            .absoluteFilePath(CommHistoryDatabasePath::archiveFile());
+    QVERIFY(!QFile::exists(archive));
+    QFile file(archive);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(QByteArray("not a database\n").repeated(64));
+    file.close();
+
+    AttachmentCollector collector;
+    collector.setMinimumAge(0);
+    QVERIFY(!collector.collect());
+    QCOMPARE(collector.directoriesRemoved(), 0);
+    QVERIFY(QFile::exists(orphan + "e.bin"));
+
+    QVERIFY(QFile::remove(archive));
+    QVERIFY(collector.collect());
+    QCOMPARE(collector.directoriesRemoved(), 1);
+    QVERIFY(!QFile::exists(orphan));
+}
+
+void AttachmentCollectorTest::incremental()
+{
+    EventModel model;
+    QList<int> ids;
+    for (int i = 0; i < 5; i++) {
+        Event event = addEventWithParts(model, QList<int>() << 1 << 2 << 3);
+        QVERIFY(event.isValid());
+        ids.append(event.id());
+    }
+    QVERIFY(model.deleteEvents(ids));
+
+    AttachmentCollector collector;
+    collector.setMinimumAge(0);
+    collector.setBatchSize(2);
+    collector.setBatchInterval(10);
+    QSignalSpy finished(&collector, SIGNAL(finished(bool)));
+
+    collector.start();
+    QVERIFY(collector.isRunning());
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(finished.first().at(0).toBool());
+    QVERIFY(!collector.isRunning());
+
+    QCOMPARE(collector.partsRemoved(), 15);
+    QCOMPARE(collector.bytesReclaimed(), qint64(30));
+    QCOMPARE(collector.directoriesRemoved(), 5);
+    foreach (int id, ids)
+        QVERIFY(!QFile::exists(CommHistoryDatabasePath::dataDir(id)));
+}
+
+QTEST_MAIN(AttachmentCollectorTest)
@@ -881,6 +881,59 @@ void CallModelTest::deleteAllCalls()
     QCOMPARE(model.rowCount(), 0);
 }
 
+void CallModelTest::deleteAllCallsInBackground()
+{
+    CallModel model;
+    watcher.setModel(&model);
+    model.setQueryMode(EventModel::SyncQuery);
+    QDateTime when = QDateTime::currentDateTime();
+    int first = addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, -1, "", false, false, when, REMOTEUID1);
+    QVERIFY(watcher.waitForAdded());
+    int second = addTestEvent(model, Event::CallEvent, Event::Outbound, ACCOUNT1, -1, "", false, false, when.addSecs(1), REMOTEUID2);
+    QVERIFY(watcher.waitForAdded());
+
+    // The thread is started only after the refetch, so that the deletion
+    // is still pending then
+    QThread deletionThread;
+    model.setBackgroundThread(&deletionThread);
+
+    QVERIFY(model.getEvents());
+    QVERIFY(model.rowCount() > 0);
+
+    QSignalSpy deletionFinished(&model.databaseIO(), SIGNAL(deletionFinished(QList<int>,bool)));
+    QVERIFY(model.deleteAll());
+    QCOMPARE(model.rowCount(), 0);
+
+    // Refetching before the deletion finished does not show the calls again
+    Event event;
+    QVERIFY(model.databaseIO().getEvent(first, event));
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 0);
+
+    // A call added in the meantime is shown and kept
+    int third = addTestEvent(model, Event::CallEvent, Event::Inbound, ACCOUNT1, -1, "", false, false, when.addSecs(2), REMOTEUID1);
+    QVERIFY(watcher.waitForAdded());
+    QTRY_COMPARE(model.rowCount(), 1);
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.event(model.index(0, 0)).id(), third);
+
+    deletionThread.start();
+    QTRY_COMPARE(deletionFinished.count(), 1);
+    QVERIFY(deletionFinished.first().at(1).toBool());
+
+    QVERIFY(!model.databaseIO().getEvent(first, event));
+    QVERIFY(!model.databaseIO().getEvent(second, event));
+    QVERIFY(model.databaseIO().getEvent(third, event));
+
+    model.setBackgroundThread(0);
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 1);
+
+    deletionThread.quit();
+    deletionThread.wait();
+}
+
 void CallModelTest::testMarkAllRead()
 {
     CallModel callModel;
@@ -1189,6 +1242,43 @@ void CallModelTest::testContactGrouping()
     QCOMPARE(postModel.rowCount(), 3);
 }
 
+void CallModelTest::testVisibleRangeResolution()
+{
+    deleteAll(false);
+
+    CallModel model;
+    model.setFilter(CallModel::SortByTime);
+    model.setResolveContacts(EventModel::ResolveVisible);
+    model.setResolveMargin(1);
+
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 0);
+
+    // Addresses that have not been resolved by earlier tests
+    QDateTime when = QDateTime::currentDateTime();
+    for (int i = 0; i < 6; i++) {
+        addTestEvent(model, Event::CallEvent, Event::Inbound, RING_ACCOUNT, -1, "", false, false,
+                     when.addSecs(i), QString::fromLatin1("+35840777000%1").arg(i));
+    }
+    QTRY_COMPARE(model.rowCount(), 6);
+
+    // Reading a row outside the range doesn't resolve it
+    model.setVisibleRange(0, 1);
+    (void)model.data(model.index(5, 0), CallModel::ContactIdsRole);
+
+    // The visible rows and one more are resolved
+    QTRY_VERIFY(model.event(model.index(2, 0)).recipients().allContactsResolved());
+    QVERIFY(model.event(model.index(0, 0)).recipients().allContactsResolved());
+    QVERIFY(model.event(model.index(1, 0)).recipients().allContactsResolved());
+    for (int row = 3; row < 6; row++)
+        QVERIFY(!model.event(model.index(row, 0)).recipients().allContactsResolved());
+
+    model.setVisibleRange(4, 5);
+    QTRY_VERIFY(model.event(model.index(3, 0)).recipients().allContactsResolved());
+    QTRY_VERIFY(model.event(model.index(4, 0)).recipients().allContactsResolved());
+    QTRY_VERIFY(model.event(model.index(5, 0)).recipients().allContactsResolved());
+}
+
 void CallModelTest::cleanupTestCase()
 {
     deleteAll();
@@ -47,11 +47,13 @@ private slots:
     void testSIPAddress();
     void testLimit();
     void deleteAllCalls();
+    void deleteAllCallsInBackground();
     void testMarkAllRead();
     void testModifyEvent();
     void testMinimizedPhone();
     void testMinimizedEmpty();
     void testContactGrouping();
+    void testVisibleRangeResolution();
     void cleanupTestCase();
 
 private:
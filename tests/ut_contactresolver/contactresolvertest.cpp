@@ -0,0 +1,148 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#include "contactresolvertest.h"
+
+#include "contactresolver.h"
+#include "recipient.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+
+namespace {
+
+const QString aliceName("Alice");
+const QString alicePhone("+358401111111");
+int aliceId = 0;
+
+// Recipients share their resolved state within the process, so each test
+// uses addresses that have not been resolved before
+Recipient unknownRecipient(int index)
+{
+    return Recipient(RING_ACCOUNT, QString::fromLatin1("+35850%1").arg(9000000 + index));
+}
+
+}
+
+void ContactResolverTest::initTestCase()
+{
+    initTestDatabase();
+
+    ContactChangeListener listener;
+    aliceId = addTestContact(aliceName, alicePhone, RING_ACCOUNT, &listener);
+    QVERIFY(aliceId > 0);
+}
+
+void ContactResolverTest::cleanupTestCase()
+{
+    deleteTestContact(aliceId);
+}
+
+void ContactResolverTest::sharedLookup()
+{
+    ContactResolver::resetStatistics();
+
+    const Recipient recipient(unknownRecipient(0));
+    ContactResolver first(this), second(this);
+    QSignalSpy firstFinished(&first, SIGNAL(finished()));
+    QSignalSpy secondFinished(&second, SIGNAL(finished()));
+
+    first.add(recipient);
+    second.add(recipient);
+    QVERIFY(first.isResolving());
+    QVERIFY(second.isResolving());
+
+    QTRY_COMPARE(firstFinished.count(), 1);
+    QTRY_COMPARE(secondFinished.count(), 1);
+    QVERIFY(recipient.isContactResolved());
+    QCOMPARE(recipient.contactId(), 0);
+
+    // The address was looked up once for both resolvers
+    const ContactResolver::Statistics stats = ContactResolver::statistics();
+    QCOMPARE(stats.requests, 2);
+    QCOMPARE(stats.sharedLookups, 1);
+    QCOMPARE(stats.lookups, 1);
+    QCOMPARE(stats.completed, 1);
+    QCOMPARE(stats.pending, 0);
+    QCOMPARE(stats.peakPending, 1);
+    QVERIFY(stats.maxLatency >= stats.averageLatency());
+}
+
+void ContactResolverTest::knownContact()
+{
+    const Recipient recipient(RING_ACCOUNT, alicePhone);
+    ContactResolver first(this), second(this);
+    QSignalSpy firstFinished(&first, SIGNAL(finished()));
+    QSignalSpy secondFinished(&second, SIGNAL(finished()));
+
+    first.add(recipient);
+    second.add(recipient);
+
+    QTRY_COMPARE(firstFinished.count(), 1);
+    QTRY_COMPARE(secondFinished.count(), 1);
+    QCOMPARE(recipient.contactId(), aliceId);
+}
+
+void ContactResolverTest::batchedLookups()
+{
+    ContactResolver::resetStatistics();
+
+    QList<Recipient> recipients;
+    for (int i = 1; i <= 3; i++)
+        recipients << unknownRecipient(i);
+
+    ContactResolver resolver(this);
+    QSignalSpy finished(&resolver, SIGNAL(finished()));
+    resolver.add(recipients);
+
+    // Queued until control returns to the event loop
+    QCOMPARE(ContactResolver::statistics().pending, 3);
+    QCOMPARE(ContactResolver::statistics().lookups, 0);
+
+    QTRY_COMPARE(finished.count(), 1);
+
+    const ContactResolver::Statistics stats = ContactResolver::statistics();
+    QCOMPARE(stats.batches, 1);
+    QCOMPARE(stats.lookups, 3);
+    QCOMPARE(stats.completed, 3);
+    QCOMPARE(stats.peakPending, 3);
+    QCOMPARE(stats.pending, 0);
+}
+
+void ContactResolverTest::deletedResolver()
+{
+    const Recipient recipient(unknownRecipient(4));
+    ContactResolver *first = new ContactResolver(this);
+    ContactResolver second(this);
+    QSignalSpy secondFinished(&second, SIGNAL(finished()));
+
+    first->add(recipient);
+    second.add(recipient);
+    delete first;
+
+    // The lookup goes on for the remaining resolver
+    QTRY_COMPARE(secondFinished.count(), 1);
+    QVERIFY(recipient.isContactResolved());
+}
+
+QTEST_MAIN(ContactResolverTest)
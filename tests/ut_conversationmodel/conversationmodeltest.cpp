@@ -22,6 +22,7 @@
 
 #include <QtTest/QtTest>
 #include <QDBusConnection>
+#include <QBuffer>
 #include "conversationmodeltest.h"
 #include "groupmodel.h"
 #include "conversationmodel.h"
@@ -30,6 +31,8 @@
 #include "common.h"
 #include "databaseio.h"
 #include "modelwatcher.h"
+#include "updateslistener.h"
+#include "historybackup.h"
 
 using namespace CommHistory;
 
@@ -340,6 +343,245 @@ void ConversationModelTest::deleteEvent()
     QVERIFY(model.rowCount() == rows - 1);
 }
 
+void ConversationModelTest::scopedUpdates()
+{
+    UpdatesListener groupListener;
+    groupListener.setGroupScope(QList<int>() << group2.id());
+    QSignalSpy groupAdded(&groupListener, &UpdatesListener::eventsAdded);
+
+    UpdatesListener typeListener;
+    typeListener.setEventTypeScope(QList<Event::EventType>() << Event::CallEvent);
+    QSignalSpy typeAdded(&typeListener, &UpdatesListener::eventsAdded);
+
+    UpdatesListener smsListener;
+    smsListener.setEventTypeScope(QList<Event::EventType>() << Event::SMSEvent);
+    QSignalSpy smsAdded(&smsListener, &UpdatesListener::eventsAdded);
+
+    UpdatesListener allListener;
+    QSignalSpy allAdded(&allListener, &UpdatesListener::eventsAdded);
+
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group2.id()));
+    int rows = model.rowCount();
+
+    EventModel eventModel;
+    watcher.setModel(&eventModel);
+    addTestEvent(eventModel, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "scoped group1");
+    addTestEvent(eventModel, Event::SMSEvent, Event::Inbound, ACCOUNT1, group2.id(), "scoped group2");
+    addTestEvent(eventModel, Event::CallEvent, Event::Inbound, ACCOUNT1, -1);
+    QVERIFY(watcher.waitForAdded(3));
+
+    // Only the event in group2 reaches the group scoped listener and model
+    QTRY_COMPARE(groupAdded.count(), 1);
+    QList<Event> events = groupAdded.first().first().value<QList<Event> >();
+    QCOMPARE(events.size(), 1);
+    QCOMPARE(events.first().groupId(), group2.id());
+    QTRY_COMPARE(model.rowCount(), rows + 1);
+
+    QTRY_COMPARE(typeAdded.count(), 1);
+    events = typeAdded.first().first().value<QList<Event> >();
+    QCOMPARE(events.size(), 1);
+    QCOMPARE(events.first().type(), Event::CallEvent);
+
+    // Type scopes also cover events that belong to a group
+    QTRY_COMPARE(smsAdded.count(), 1);
+    QCOMPARE(smsAdded.first().first().value<QList<Event> >().size(), 2);
+
+    QTest::qWait(100);
+    QCOMPARE(groupAdded.count(), 1);
+    QCOMPARE(typeAdded.count(), 1);
+
+    // Without a scope each event arrives exactly once
+    QList<int> ids;
+    for (int i = 0; i < allAdded.count(); i++) {
+        foreach (const Event &event, allAdded.at(i).first().value<QList<Event> >())
+            ids << event.id();
+    }
+    QCOMPARE(ids.size(), 3);
+    QCOMPARE(ids.toSet().size(), 3);
+
+    // An event moved out of group2 leaves the group scoped model
+    Event moved = model.event(model.index(0, 0));
+    QCOMPARE(moved.groupId(), group2.id());
+    moved.setGroupId(group1.id());
+    watcher.reset();
+    QVERIFY(eventModel.modifyEvent(moved));
+    QVERIFY(watcher.waitForUpdated());
+    QTRY_COMPARE(model.rowCount(), rows);
+    QVERIFY(!model.findEvent(moved.id()).isValid());
+}
+
+void ConversationModelTest::syncChanges()
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group1.id()));
+    int rows = model.rowCount();
+    QVERIFY(rows > 2);
+
+    // Nothing changed yet
+    QVERIFY(model.syncChanges());
+    QCOMPARE(model.rowCount(), rows);
+
+    // Changes through DatabaseIO bypass the D-Bus updates entirely
+    Event added = model.event(model.index(0, 0));
+    added.setId(-1);
+    added.setFreeText("missed update");
+    added.setEndTime(added.endTime().addSecs(60));
+    QVERIFY(model.databaseIO().addEvent(added));
+
+    Event modified = model.event(model.index(1, 0));
+    modified.setFreeText("modified while away");
+    QVERIFY(model.databaseIO().modifyEvent(modified));
+
+    Event deleted = model.event(model.index(rows - 1, 0));
+    QVERIFY(model.databaseIO().deleteEvent(deleted));
+
+    QTest::qWait(100);
+    QCOMPARE(model.rowCount(), rows);
+
+    QVERIFY(model.syncChanges());
+    QCOMPARE(model.rowCount(), rows);
+    QCOMPARE(model.event(model.index(0, 0)).id(), added.id());
+    QVERIFY(!model.findEvent(deleted.id()).isValid());
+    QModelIndex index = model.findEvent(modified.id());
+    QVERIFY(index.isValid());
+    QCOMPARE(model.event(index).freeText(), QString("modified while away"));
+
+    // Applied changes are not replayed
+    QVERIFY(model.syncChanges());
+    QCOMPARE(model.rowCount(), rows);
+}
+
+void ConversationModelTest::incrementalGroups()
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents());
+    int rows = model.rowCount();
+    QVERIFY(rows > 2);
+
+    QSignalSpy reset(&model, &ConversationModel::modelReset);
+    QSignalSpy inserted(&model, &ConversationModel::rowsInserted);
+
+    // A loaded model without any rows takes the new group as well
+    const QString account = QLatin1String("/org/freedesktop/Telepathy/Account/incremental");
+    ConversationModel empty;
+    empty.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(empty.setFilter(Event::UnknownType, account));
+    QVERIFY(empty.getEvents());
+    QCOMPARE(empty.rowCount(), 0);
+
+    // Import a conversation, which signals only the group once it is
+    // complete. Its events come from a group that is exported and then
+    // dropped without signals.
+    Group group;
+    group.setLocalUid(account);
+    group.setRecipients(RecipientList::fromUids(account, QStringList() << "incremental@localhost"));
+    QVERIFY(model.databaseIO().addGroup(group));
+
+    Event newest = model.event(model.index(0, 0));
+    Event oldest = model.event(model.index(rows - 1, 0));
+    Event middle = model.event(model.index(rows / 2, 0));
+    foreach (Event event, QList<Event>() << newest << middle << oldest) {
+        event.setId(-1);
+        event.setGroupId(group.id());
+        event.setLocalUid(account);
+        event.setRecipients(group.recipients());
+        event.setType(Event::IMEvent);
+        event.setFreeText("incremental");
+        QVERIFY(model.databaseIO().addEvent(event));
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::ReadWrite);
+    HistoryBackup backup;
+    QVERIFY(backup.exportTo(&buffer, HistoryBackup::Conversations, group.id()));
+    QVERIFY(model.databaseIO().deleteGroup(group.id()));
+    buffer.seek(0);
+    QVERIFY(backup.importFrom(&buffer));
+    QCOMPARE(backup.eventCount(), 3);
+
+    QTRY_COMPARE(model.rowCount(), rows + 3);
+    QTRY_COMPARE(empty.rowCount(), 3);
+    QCOMPARE(reset.count(), 0);
+    QVERIFY(inserted.count() > 0);
+
+    // Rows stay sorted by endTime and id, newest first
+    QSet<int> importedGroups;
+    for (int row = 0; row < model.rowCount(); row++) {
+        Event b = model.event(model.index(row, 0));
+        if (b.freeText() == "incremental")
+            importedGroups.insert(b.groupId());
+        if (row == 0)
+            continue;
+        Event a = model.event(model.index(row - 1, 0));
+        QVERIFY(a.endTimeT() > b.endTimeT() || (a.endTimeT() == b.endTimeT() && a.id() > b.id()));
+    }
+    QCOMPARE(importedGroups.size(), 1);
+    const int importedGroupId = *importedGroups.constBegin();
+    QVERIFY(importedGroupId != group.id());
+
+    // Deleting the group removes just its rows
+    QSignalSpy removed(&model, &ConversationModel::rowsRemoved);
+    GroupModel groups;
+    QVERIFY(groups.deleteGroups(QList<int>() << importedGroupId));
+
+    QTRY_COMPARE(model.rowCount(), rows);
+    QCOMPARE(reset.count(), 0);
+    QVERIFY(removed.count() > 0);
+    for (int row = 0; row < model.rowCount(); row++)
+        QVERIFY(model.event(model.index(row, 0)).groupId() != importedGroupId);
+}
+
+void ConversationModelTest::refreshFilter()
+{
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents());
+    const int rows = model.rowCount();
+
+    QList<int> smsIds;
+    for (int row = 0; row < rows; row++) {
+        Event event = model.event(model.index(row, 0));
+        if (event.type() == Event::SMSEvent)
+            smsIds << event.id();
+    }
+    QVERIFY(!smsIds.isEmpty());
+    QVERIFY(smsIds.size() < rows);
+
+    QPersistentModelIndex kept(model.findEvent(smsIds.first()));
+    QSignalSpy reset(&model, &ConversationModel::modelReset);
+    QSignalSpy inserted(&model, &ConversationModel::rowsInserted);
+    QSignalSpy removed(&model, &ConversationModel::rowsRemoved);
+
+    QVERIFY(model.setFilter(Event::SMSEvent));
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(inserted.count(), 0);
+    QVERIFY(removed.count() > 0);
+    QCOMPARE(model.rowCount(), smsIds.size());
+    for (int row = 0; row < model.rowCount(); row++)
+        QCOMPARE(model.event(model.index(row, 0)).id(), smsIds.at(row));
+    QVERIFY(kept.isValid());
+    QCOMPARE(model.event(kept).id(), smsIds.first());
+
+    // Clearing the filter brings the other rows back in their places
+    removed.clear();
+    QVERIFY(model.setFilter(Event::UnknownType));
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(removed.count(), 0);
+    QVERIFY(inserted.count() > 0);
+    QCOMPARE(model.rowCount(), rows);
+    for (int row = 1; row < model.rowCount(); row++) {
+        Event a = model.event(model.index(row - 1, 0));
+        Event b = model.event(model.index(row, 0));
+        QVERIFY(a.endTimeT() > b.endTimeT() || (a.endTimeT() == b.endTimeT() && a.id() > b.id()));
+    }
+    QVERIFY(kept.isValid());
+    QCOMPARE(model.event(kept).id(), smsIds.first());
+}
+
 void ConversationModelTest::asyncMode()
 {
     ConversationModel model;
@@ -41,6 +41,10 @@ private slots:
     void addEvent();
     void modifyEvent();
     void deleteEvent();
+    void scopedUpdates();
+    void syncChanges();
+    void incrementalGroups();
+    void refreshFilter();
     void asyncMode();
     void sorting();
     void contacts_data();
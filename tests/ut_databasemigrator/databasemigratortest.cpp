@@ -0,0 +1,296 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "databasemigratortest.h"
+
+#include "databasemigrator.h"
+#include "databasemigrator_p.h"
+#include "retentionengine.h"
+#include "commhistorydatabasepath.h"
+#include "databaseio.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+namespace {
+
+Group group;
+QList<int> eventIds;
+QList<int> archivedIds;
+
+QString databasePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::databaseFile());
+}
+
+QString archivePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::archiveFile());
+}
+
+QString migratedPath(const QString &path)
+{
+    return path + QLatin1String(".utf8");
+}
+
+QSqlDatabase openDatabase(const QString &name, const QString &path)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "ut_databasemigrator-" + name);
+    db.setDatabaseName(path);
+    db.open();
+    return db;
+}
+
+void closeDatabase(QSqlDatabase &db)
+{
+    const QString name = db.connectionName();
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
+}
+
+QVariant queryValue(QSqlDatabase &db, const QString &statement)
+{
+    QSqlQuery query(db);
+    if (!query.exec(statement) || !query.next())
+        return QVariant();
+    return query.value(0);
+}
+
+QSet<int> storedIds(QSqlDatabase &db)
+{
+    QSet<int> ids;
+    QSqlQuery query(db);
+    query.exec("SELECT id FROM Events");
+    while (query.next())
+        ids.insert(query.value(0).toInt());
+    return ids;
+}
+
+// Copies a database file that this process has open, with its WAL
+// checkpointed into it
+bool copyDatabase(const QString &from, const QString &to)
+{
+    QSqlDatabase db = openDatabase("checkpoint", from);
+    queryValue(db, "PRAGMA wal_checkpoint(TRUNCATE)");
+    closeDatabase(db);
+    return QFile::copy(from, to);
+}
+
+int addOldEvent(EventModel &model, int days, const QString &text)
+{
+    return addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group.id(), text,
+                        false, false, QDateTime::currentDateTime().addDays(-days));
+}
+
+}
+
+void DatabaseMigratorTest::initTestCase()
+{
+    // Create the database the way older versions did
+    qputenv("COMMHISTORY_DB_ENCODING", "UTF-16");
+    initTestDatabase();
+
+    addTestGroup(group, ACCOUNT1, "migration@localhost");
+    EventModel model;
+    archivedIds << addOldEvent(model, 40, "archived 1") << addOldEvent(model, 35, "archived 2");
+    for (int i = 0; i < 5; i++)
+        eventIds << addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group.id(), QString("message %1").arg(i));
+
+    // The archive is migrated along with the database
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 30, 0);
+    QVERIFY(engine.run());
+    QCOMPARE(engine.eventsArchived(), archivedIds.size());
+
+    QVERIFY(DatabaseMigrator::isRequired());
+    QVERIFY(!DatabaseMigrator::isPending());
+}
+
+void DatabaseMigratorTest::cleanupTestCase()
+{
+    QFile::remove(migratedPath(databasePath()));
+    QFile::remove(migratedPath(archivePath()));
+    deleteAll();
+    QFile::remove(archivePath());
+}
+
+void DatabaseMigratorTest::copyInBackground()
+{
+    DatabaseMigrator migrator;
+    migrator.setBatchSize(2);
+    migrator.setBatchInterval(20);
+    QSignalSpy progress(&migrator, SIGNAL(progress(int,int)));
+    QSignalSpy finished(&migrator, SIGNAL(finished(bool)));
+
+    migrator.start();
+    QVERIFY(migrator.isRunning());
+
+    // The copy holds no transaction between batches, so writes go on
+    EventModel model;
+    eventIds << addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group.id(), "during the copy");
+
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(finished.first().at(0).toBool());
+    QVERIFY(!migrator.isRunning());
+    QVERIFY(progress.count() > 0);
+    QVERIFY(migrator.copiedRows() > 0);
+
+    QVERIFY(DatabaseMigrator::isPending());
+    QVERIFY(QFile::exists(migratedPath(archivePath())));
+}
+
+void DatabaseMigratorTest::swapInUse()
+{
+    // This process has the database open, so the files stay in place
+    QVERIFY(!DatabaseMigrator::completeMigration());
+    QVERIFY(DatabaseMigrator::isPending());
+
+    QSqlDatabase live = openDatabase("live", databasePath());
+    QVERIFY(queryValue(live, "PRAGMA encoding").toString().startsWith("UTF-16"));
+    closeDatabase(live);
+}
+
+void DatabaseMigratorTest::catchUpDatabase()
+{
+    QSqlDatabase copy = openDatabase("copy", migratedPath(databasePath()));
+    const qint64 sequence = queryValue(copy, "SELECT sourceSequence FROM MigrationState").toLongLong();
+    QVERIFY(sequence > 0);
+
+    EventModel model;
+    const int added = addTestEvent(model, Event::SMSEvent, Event::Outbound, ACCOUNT1, group.id(), "after the copy");
+    Event modified;
+    QVERIFY(DatabaseIO::instance()->getEvent(eventIds.at(0), modified));
+    modified.setFreeText("modified after the copy");
+    QVERIFY(model.modifyEvent(modified));
+    const int deleted = eventIds.takeAt(1);
+    QVERIFY(model.deleteEvent(deleted));
+    eventIds << added;
+
+    QSqlDatabase live = openDatabase("live", databasePath());
+    QVERIFY(copy.transaction());
+    QVERIFY(DatabaseMigratorPrivate::catchUpDatabase(live, copy, sequence));
+    QVERIFY(copy.commit());
+
+    const QSet<int> ids = storedIds(copy);
+    QCOMPARE(ids, storedIds(live));
+    QVERIFY(ids.contains(added));
+    QVERIFY(!ids.contains(deleted));
+    QCOMPARE(queryValue(copy, QString("SELECT freeText FROM Events WHERE id = %1").arg(modified.id())).toString(),
+             QString("modified after the copy"));
+    // The copy continues the change log of the live database
+    QCOMPARE(queryValue(copy, "SELECT MAX(seq) FROM ChangeLog").toLongLong(),
+             queryValue(live, "SELECT MAX(seq) FROM ChangeLog").toLongLong());
+
+    closeDatabase(live);
+    closeDatabase(copy);
+}
+
+void DatabaseMigratorTest::catchUpArchive()
+{
+    // One more event is archived and an archived one deleted after the copy
+    EventModel model;
+    const int archived = addOldEvent(model, 50, "archived after the copy");
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 30, 0);
+    QVERIFY(engine.run());
+    QCOMPARE(engine.eventsArchived(), 1);
+
+    Event event;
+    event.setId(archivedIds.takeFirst());
+    QVERIFY(DatabaseIO::instance()->deleteEvent(event));
+    archivedIds << archived;
+
+    QSqlDatabase live = openDatabase("live", archivePath());
+    QSqlDatabase copy = openDatabase("copy", migratedPath(archivePath()));
+    QVERIFY(storedIds(copy) != storedIds(live));
+
+    QVERIFY(copy.transaction());
+    QVERIFY(DatabaseMigratorPrivate::catchUpArchive(live, copy));
+    QVERIFY(copy.commit());
+
+    QCOMPARE(storedIds(copy), storedIds(live));
+    QCOMPARE(storedIds(copy), archivedIds.toSet());
+
+    closeDatabase(live);
+    closeDatabase(copy);
+}
+
+void DatabaseMigratorTest::swapDatabase()
+{
+    // The swap replaces files nothing else has open, so it runs on copies
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString mainFile = dir.path() + "/commhistory.db";
+    const QString archiveFile = dir.path() + "/commhistory-archive.db";
+    QVERIFY(copyDatabase(databasePath(), mainFile));
+    QVERIFY(copyDatabase(archivePath(), archiveFile));
+    QVERIFY(QFile::copy(migratedPath(databasePath()), migratedPath(mainFile)));
+    QVERIFY(QFile::copy(migratedPath(archivePath()), migratedPath(archiveFile)));
+
+    QVERIFY(DatabaseMigratorPrivate::replaceDatabase(mainFile, archiveFile));
+    QVERIFY(!QFile::exists(migratedPath(mainFile)));
+    QVERIFY(!QFile::exists(migratedPath(archiveFile)));
+
+    QSqlDatabase live = openDatabase("live", databasePath());
+    QSqlDatabase swapped = openDatabase("swapped", mainFile);
+    QCOMPARE(queryValue(swapped, "PRAGMA encoding").toString(), QString("UTF-8"));
+    QCOMPARE(queryValue(swapped, "PRAGMA user_version").toInt(), queryValue(live, "PRAGMA user_version").toInt());
+    QCOMPARE(queryValue(swapped, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'MigrationState'").toInt(), 0);
+    QCOMPARE(storedIds(swapped), storedIds(live));
+    QCOMPARE(storedIds(swapped), eventIds.toSet());
+    closeDatabase(swapped);
+    closeDatabase(live);
+
+    swapped = openDatabase("swapped", archiveFile);
+    QCOMPARE(queryValue(swapped, "PRAGMA encoding").toString(), QString("UTF-8"));
+    QCOMPARE(storedIds(swapped), archivedIds.toSet());
+    closeDatabase(swapped);
+
+    // Nothing is left to swap in
+    QVERIFY(!DatabaseMigratorPrivate::replaceDatabase(mainFile, archiveFile));
+    QVERIFY(!QFile::exists(migratedPath(mainFile)));
+}
+
+void DatabaseMigratorTest::prunedChangeLog()
+{
+    QSqlDatabase copy = openDatabase("copy", migratedPath(databasePath()));
+    const qint64 sequence = queryValue(copy, "SELECT sourceSequence FROM MigrationState").toLongLong();
+    QSqlDatabase live = openDatabase("live", databasePath());
+    const qint64 latest = queryValue(live, "SELECT MAX(seq) FROM ChangeLog").toLongLong();
+    QVERIFY(latest > sequence + 1);
+
+    // The changes since the copy was taken can no longer be applied
+    QVERIFY(DatabaseIO::instance()->pruneChanges(latest));
+    QVERIFY(copy.transaction());
+    QVERIFY(!DatabaseMigratorPrivate::catchUpDatabase(live, copy, sequence));
+    QVERIFY(copy.rollback());
+
+    closeDatabase(live);
+    closeDatabase(copy);
+}
+
+QTEST_MAIN(DatabaseMigratorTest)
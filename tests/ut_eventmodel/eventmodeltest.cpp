@@ -43,6 +43,30 @@ int groupDeleted = 0;
 
 ModelWatcher watcher;
 
+// Reads events through DatabaseIO on its own thread
+class EventReader : public QThread
+{
+public:
+    EventReader(const QList<int> &ids) : ids(ids), failures(0) {}
+
+    void run()
+    {
+        for (int round = 0; round < 20; round++) {
+            events.clear();
+            foreach (int id, ids) {
+                Event event;
+                if (!DatabaseIO::instance()->getEvent(id, event) || event.id() != id)
+                    failures++;
+                events.append(event);
+            }
+        }
+    }
+
+    QList<int> ids;
+    QList<Event> events;
+    int failures;
+};
+
 void EventModelTest::groupsUpdatedSlot(const QList<int> &groupIds)
 {
     if (!groupIds.isEmpty())
@@ -732,6 +756,56 @@ void EventModelTest::testDeleteEventGroupUpdated()
     QVERIFY(!groupModel.databaseIO().getGroup(group.id(), group));
 }
 
+void EventModelTest::testDeleteEvents()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    Group groupA, groupB;
+    const QString LOCAL_ID("/org/freedesktop/Telepathy/Account/ring/tel/ring");
+    addTestGroup(groupA, LOCAL_ID, "5550001");
+    addTestGroup(groupB, LOCAL_ID, "5550002");
+
+    QList<int> idsA, idsB;
+    for (int i = 0; i < 3; i++) {
+        idsA << addTestEvent(model, Event::SMSEvent, Event::Inbound, LOCAL_ID, groupA.id(),
+                             QString("bulk delete A%1").arg(i));
+        QVERIFY(watcher.waitForAdded());
+        idsB << addTestEvent(model, Event::SMSEvent, Event::Inbound, LOCAL_ID, groupB.id(),
+                             QString("bulk delete B%1").arg(i));
+        QVERIFY(watcher.waitForAdded());
+    }
+
+    groupUpdated = -1;
+    groupDeleted = -1;
+
+    // All of group A and part of group B in one call
+    QList<int> ids = idsA;
+    ids << idsB.first();
+    QSignalSpy committed(&model, SIGNAL(eventsCommitted(QList<CommHistory::Event>,bool)));
+    QVERIFY(model.deleteEvents(ids));
+    QVERIFY(watcher.waitForDeleted(ids.size()));
+
+    // None of them were loaded, they are read from the database
+    QCOMPARE(committed.count(), 1);
+    QList<Event> committedEvents = committed.first().at(0).value<QList<Event> >();
+    QCOMPARE(committedEvents.size(), ids.size());
+    foreach (const Event &e, committedEvents) {
+        QVERIFY(ids.contains(e.id()));
+        QVERIFY(e.groupId() == groupA.id() || e.groupId() == groupB.id());
+        QVERIFY(e.freeText().startsWith("bulk delete"));
+    }
+    QTRY_COMPARE(groupDeleted, groupA.id());
+    QTRY_COMPARE(groupUpdated, groupB.id());
+
+    Event event;
+    foreach (int id, ids)
+        QVERIFY(!model.databaseIO().getEvent(id, event));
+    QVERIFY(model.databaseIO().getEvent(idsB.last(), event));
+    QVERIFY(!model.databaseIO().getGroup(groupA.id(), groupA));
+    QVERIFY(model.databaseIO().getGroup(groupB.id(), groupB));
+}
+
 void EventModelTest::testVCard()
 {
     QString vcardFilename1( "filename.vcd" );
@@ -942,6 +1016,29 @@ void EventModelTest::testMessageParts()
     foreach (MessagePart part, e.messageParts())
         QVERIFY(parts.indexOf(part) >= 0);
 
+    // changed and unchanged parts keep their rows, new parts get one
+    parts[1].setPath("/home/user/.mms/msgid001/dogphoto2.jpg");
+    MessagePart part3;
+    part3.setContentId("birdphoto");
+    part3.setContentType("image/jpeg");
+    part3.setPath("/home/user/.mms/msgid001/birdphoto.jpg");
+    parts << part3;
+    event.setMessageParts(parts);
+    QVERIFY(model.modifyEvent(event));
+    QVERIFY(watcher.waitForUpdated());
+
+    QCOMPARE(event.messageParts().size(), 3);
+    QCOMPARE(event.messageParts().at(0).id(), parts.at(0).id());
+    QCOMPARE(event.messageParts().at(1).id(), parts.at(1).id());
+    QCOMPARE(event.messageParts().at(1).path(), QString("/home/user/.mms/msgid001/dogphoto2.jpg"));
+    QVERIFY(event.messageParts().at(2).id() >= 0);
+    parts = event.messageParts();
+
+    QVERIFY(model.databaseIO().getEvent(event.id(), e));
+    QCOMPARE(e.messageParts().size(), parts.size());
+    foreach (MessagePart part, e.messageParts())
+        QVERIFY(parts.indexOf(part) >= 0);
+
     // remove message part
     parts.takeFirst();
     event.setMessageParts(parts);
@@ -1387,6 +1484,27 @@ void EventModelTest::testExtraProperties()
     returnedEvent = model2.event();
     QVERIFY(returnedEvent.isValid());
     QVERIFY(returnedEvent.extraProperties().isEmpty());
+
+    // Change, keep, add and remove properties in one modify
+    newEvent.setExtraProperty("kept", "same");
+    newEvent.setExtraProperty("changed", 1);
+    newEvent.setExtraProperty("removed", true);
+    QVERIFY(model.modifyEvent(newEvent));
+    QVERIFY(watcher.waitForUpdated());
+
+    newEvent.setExtraProperty("changed", 2);
+    newEvent.setExtraProperty("removed", QVariant());
+    newEvent.setExtraProperty("added", "new");
+    QVERIFY(model.modifyEvent(newEvent));
+    QVERIFY(watcher.waitForUpdated());
+
+    QVERIFY(model2.getEventById(newEvent.id()));
+    returnedEvent = model2.event();
+    QCOMPARE(returnedEvent.extraProperties().size(), 3);
+    QCOMPARE(returnedEvent.extraProperty("kept").toString(), QString("same"));
+    QCOMPARE(returnedEvent.extraProperty("changed").toInt(), 2);
+    QCOMPARE(returnedEvent.extraProperty("added").toString(), QString("new"));
+    QVERIFY(!returnedEvent.extraProperties().contains("removed"));
 }
 
 void EventModelTest::testContactMatching_data()
@@ -1560,6 +1678,84 @@ void EventModelTest::testBufferInsertions()
     rowsInserted.clear();
 }
 
+void EventModelTest::testThreadedReads()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    QList<int> ids;
+    for (int i = 0; i < 10; i++) {
+        ids.append(addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                                QString("threaded %1").arg(i), false, false,
+                                QDateTime::currentDateTime(), QString("thread%1@localhost").arg(i % 3)));
+        QVERIFY(watcher.waitForAdded());
+    }
+
+    QList<EventReader *> readers;
+    for (int i = 0; i < 4; i++)
+        readers.append(new EventReader(ids));
+    foreach (EventReader *reader, readers)
+        reader->start();
+
+    // The main thread keeps its own connection meanwhile
+    for (int round = 0; round < 20; round++) {
+        Event event;
+        QVERIFY(model.databaseIO().getEvent(ids.first(), event));
+    }
+
+    foreach (EventReader *reader, readers) {
+        QVERIFY(reader->wait(30000));
+        QCOMPARE(reader->failures, 0);
+        QCOMPARE(reader->events.size(), ids.size());
+
+        for (int i = 0; i < ids.size(); i++) {
+            Event event;
+            QVERIFY(model.databaseIO().getEvent(ids[i], event));
+            QCOMPARE(reader->events[i].freeText(), event.freeText());
+            // Recipients read on other threads share the interned instance
+            QVERIFY(reader->events[i].recipients().value(0) == event.recipients().value(0));
+        }
+    }
+    qDeleteAll(readers);
+}
+
+void EventModelTest::testCachedRoles()
+{
+    EventModel model;
+    watcher.setModel(&model);
+
+    Event event;
+    event.setType(Event::IMEvent);
+    event.setDirection(Event::Inbound);
+    event.setGroupId(group1.id());
+    event.setStartTime(QDateTime::fromString("2011-03-10T10:00:00Z", Qt::ISODate));
+    event.setEndTime(QDateTime::fromString("2011-03-10T10:00:00Z", Qt::ISODate));
+    event.setLocalUid(ACCOUNT1);
+    event.setRecipients(Recipient(ACCOUNT1, "cached@localhost"));
+    event.setFreeText("cached roles");
+    QVERIFY(model.addEvent(event));
+    QVERIFY(watcher.waitForAdded());
+
+    QModelIndex index = model.findEvent(event.id());
+    QVERIFY(index.isValid());
+    QCOMPARE(index.data(EventModel::EndTimeRole).toDateTime(), event.endTime());
+    QCOMPARE(index.data(EventModel::EndTimeRole).toDateTime(), event.endTime());
+    QCOMPARE(index.data(EventModel::DateAndAccountGroupingRole).toString(), event.dateAndAccountGrouping());
+
+    // The cached values are replaced when the event changes
+    event.resetModifiedProperties();
+    event.setStartTime(QDateTime::fromString("2011-03-12T10:00:00Z", Qt::ISODate));
+    event.setEndTime(QDateTime::fromString("2011-03-12T10:00:00Z", Qt::ISODate));
+    QVERIFY(model.modifyEvent(event));
+    QVERIFY(watcher.waitForUpdated());
+
+    index = model.findEvent(event.id());
+    QVERIFY(index.isValid());
+    QCOMPARE(index.data(EventModel::EndTimeRole).toDateTime(), event.endTime());
+    QCOMPARE(index.data(EventModel::StartTimeRole).toDateTime(), event.startTime());
+    QCOMPARE(index.data(EventModel::DateAndAccountGroupingRole).toString(), event.dateAndAccountGrouping());
+}
+
 void EventModelTest::cleanupTestCase()
 {
     deleteAll();
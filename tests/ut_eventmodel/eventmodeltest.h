@@ -41,6 +41,7 @@ private slots:
     void testDeleteEventMmsParts_data();
     void testDeleteEventMmsParts();
     void testDeleteEventGroupUpdated();
+    void testDeleteEvents();
     void testMessageToken();
     void testVCard();
     void testDeliveryStatus();
@@ -58,6 +59,8 @@ private slots:
     void testAddNonDigitRemoteId_data();
     void testAddNonDigitRemoteId();
     void testBufferInsertions();
+    void testThreadedReads();
+    void testCachedRoles();
     void cleanupTestCase();
 
     void groupsUpdatedSlot(const QList<int> &groupIds);
@@ -0,0 +1,188 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "eventwritertest.h"
+
+#include "eventwriter.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "event.h"
+#include "group.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+
+namespace {
+
+Group group;
+
+Event messageEvent(const QString &text)
+{
+    return createTestEvent(Event::IMEvent, Event::Outbound, ACCOUNT1, group.id(), text,
+                           QDateTime::currentDateTime(), "eventwriter@localhost");
+}
+
+}
+
+void EventWriterTest::initTestCase()
+{
+    initTestDatabase();
+    qRegisterMetaType<QList<CommHistory::Event> >();
+
+    addTestGroup(group, ACCOUNT1, "eventwriter@localhost");
+
+    // Keeps the group from being deleted with the test events
+    EventWriter writer;
+    Event event = messageEvent("kept");
+    QVERIFY(writer.addEvent(event));
+}
+
+void EventWriterTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+void EventWriterTest::addModifyDelete()
+{
+    ConversationModel model;
+    QSignalSpy ready(&model, SIGNAL(modelReady(bool)));
+    QVERIFY(model.getEvents(group.id()));
+    QVERIFY(ready.count() || ready.wait());
+    const int rows = model.rowCount();
+
+    EventWriter writer;
+    QSignalSpy committed(&writer, SIGNAL(eventsCommitted(QList<CommHistory::Event>,bool)));
+
+    Event event = messageEvent("written");
+    QVERIFY(writer.addEvent(event));
+    QVERIFY(event.id() != -1);
+    QCOMPARE(committed.count(), 1);
+    QCOMPARE(committed.at(0).at(0).value<QList<Event> >().first().id(), event.id());
+
+    // Models hear about the event like after EventModel::addEvent()
+    QTRY_COMPARE(model.rowCount(), rows + 1);
+
+    Event stored;
+    QVERIFY(DatabaseIO::instance()->getEvent(event.id(), stored));
+    QCOMPARE(stored.freeText(), QString("written"));
+
+    event.resetModifiedProperties();
+    event.setFreeText("written again");
+    QVERIFY(writer.modifyEvent(event));
+    QCOMPARE(committed.count(), 2);
+    QVERIFY(DatabaseIO::instance()->getEvent(event.id(), stored));
+    QCOMPARE(stored.freeText(), QString("written again"));
+    QTRY_COMPARE(model.event(model.findEvent(event.id())).freeText(), QString("written again"));
+
+    QVERIFY(writer.deleteEvent(event));
+    QCOMPARE(committed.count(), 3);
+    QVERIFY(!DatabaseIO::instance()->getEvent(event.id(), stored));
+    QTRY_COMPARE(model.rowCount(), rows);
+}
+
+void EventWriterTest::deleteEvents()
+{
+    EventWriter writer;
+
+    QList<Event> events;
+    events << messageEvent("bulk 1") << messageEvent("bulk 2") << messageEvent("bulk 3");
+    QVERIFY(writer.addEvents(events));
+
+    QList<int> ids;
+    foreach (const Event &event, events) {
+        QVERIFY(event.id() != -1);
+        ids << event.id();
+    }
+
+    QSignalSpy committed(&writer, SIGNAL(eventsCommitted(QList<CommHistory::Event>,bool)));
+    QVERIFY(writer.deleteEvents(ids));
+    QCOMPARE(committed.count(), 1);
+    QCOMPARE(committed.at(0).at(0).value<QList<Event> >().size(), ids.size());
+
+    Event stored;
+    foreach (int id, ids)
+        QVERIFY(!DatabaseIO::instance()->getEvent(id, stored));
+}
+
+void EventWriterTest::invalidEvents()
+{
+    EventWriter writer;
+    QSignalSpy committed(&writer, SIGNAL(eventsCommitted(QList<CommHistory::Event>,bool)));
+
+    Event event = messageEvent("never written");
+    QVERIFY(!writer.modifyEvent(event));
+    QVERIFY(!writer.deleteEvent(event));
+    QCOMPARE(committed.count(), 0);
+}
+
+void EventWriterTest::sharedInstance()
+{
+    EventWriter *writer = EventWriter::instance();
+    QVERIFY(writer);
+    QCOMPARE(EventWriter::instance(), writer);
+    QCOMPARE(writer->parent(), QCoreApplication::instance());
+
+    Event event = messageEvent("shared");
+    QVERIFY(writer->addEvent(event));
+    QVERIFY(writer->deleteEvent(event));
+}
+
+void EventWriterTest::changeLog()
+{
+    DatabaseIO *database = DatabaseIO::instance();
+    qint64 sequence = 0;
+    QVERIFY(database->currentChangeSequence(sequence));
+
+    // Setting the flag columns does not journal the event again
+    EventWriter writer;
+    Event event = messageEvent("journaled");
+    event.setExtraProperty("key", "value");
+    QVERIFY(writer.addEvent(event));
+
+    QList<DatabaseIO::Change> changes;
+    bool resetRequired = true;
+    QVERIFY(database->getChangesSince(sequence, changes, resetRequired));
+    QVERIFY(!resetRequired);
+
+    int found = 0;
+    foreach (const DatabaseIO::Change &change, changes) {
+        if (change.itemType == DatabaseIO::EventChange && change.itemId == event.id()) {
+            QCOMPARE(change.operation, DatabaseIO::ItemAdded);
+            found++;
+        }
+    }
+    QCOMPARE(found, 1);
+
+    // A reader behind the pruned sequence has to reload
+    qint64 latest = 0;
+    QVERIFY(database->currentChangeSequence(latest));
+    QVERIFY(database->pruneChanges(latest + 1));
+    changes.clear();
+    QVERIFY(database->getChangesSince(sequence, changes, resetRequired));
+    QVERIFY(resetRequired);
+    QVERIFY(database->getChangesSince(latest, changes, resetRequired));
+    QVERIFY(!resetRequired);
+
+    QVERIFY(writer.deleteEvent(event));
+}
+
+QTEST_MAIN(EventWriterTest)
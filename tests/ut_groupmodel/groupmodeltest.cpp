@@ -28,6 +28,7 @@
 #include "event.h"
 #include "common.h"
 #include "databaseio.h"
+#include "updateslistener.h"
 
 using namespace CommHistory;
 
@@ -602,6 +603,66 @@ void GroupModelTest::deleteGroups()
     QVERIFY(!model.databaseIO().getEvent(mms.id(), event));
 }
 
+void GroupModelTest::deleteGroupsInBackground()
+{
+    EventModel model;
+    Group group;
+    addTestGroup(group, ACCOUNT1, "bgdelete");
+
+    // Enough events for several chunks
+    QList<Event> events;
+    for (int i = 0; i < 1200; i++) {
+        Event e;
+        e.setType(Event::SMSEvent);
+        e.setDirection(Event::Inbound);
+        e.setGroupId(group.id());
+        e.setStartTime(QDateTime::currentDateTime());
+        e.setEndTime(QDateTime::currentDateTime());
+        e.setLocalUid(ACCOUNT1);
+        e.setRecipients(Recipient(ACCOUNT1, "bgdelete"));
+        e.setFreeText(QString("bgdelete %1").arg(i));
+        events.append(e);
+    }
+    QVERIFY(model.addEvents(events));
+    int lastEventId = events.last().id();
+
+    QThread deletionThread;
+    deletionThread.start();
+
+    GroupModel groupModel;
+    groupModel.setResolveContacts(GroupManager::DoNotResolve);
+    groupModel.setQueryMode(EventModel::SyncQuery);
+    groupModel.setBackgroundThread(&deletionThread);
+    QVERIFY(groupModel.getGroups());
+    int numGroups = groupModel.rowCount();
+
+    QSignalSpy deletionProgress(&model.databaseIO(), SIGNAL(deletionProgress(QList<int>,int,int)));
+    QSignalSpy deletionFinished(&model.databaseIO(), SIGNAL(deletionFinished(QList<int>,bool)));
+
+    QVERIFY(groupModel.deleteGroups(QList<int>() << group.id()));
+
+    // Hidden from queries before the events are gone
+    Group g;
+    QVERIFY(!model.databaseIO().getGroup(group.id(), g));
+    QTRY_COMPARE(groupModel.rowCount(), numGroups - 1);
+
+    QTRY_COMPARE(deletionFinished.count(), 1);
+    QCOMPARE(deletionFinished.first().at(0).value<QList<int> >(), QList<int>() << group.id());
+    QVERIFY(deletionFinished.first().at(1).toBool());
+    QVERIFY(deletionProgress.count() >= 3);
+    QCOMPARE(deletionProgress.last().at(1).toInt(), events.size());
+    QCOMPARE(deletionProgress.last().at(2).toInt(), events.size());
+
+    Event event;
+    QVERIFY(!model.databaseIO().getEvent(lastEventId, event));
+    int total = -1;
+    QVERIFY(model.databaseIO().totalEventsInGroup(group.id(), total));
+    QCOMPARE(total, 0);
+
+    deletionThread.quit();
+    deletionThread.wait();
+}
+
 void GroupModelTest::streamingQuery_data()
 {
     QTest::addColumn<bool>("useThread");
@@ -958,6 +1019,96 @@ void GroupModelTest::markGroupAsRead()
     QCOMPARE(testGroup.unreadMessages(),0);
 }
 
+void GroupModelTest::markAsReadFilter()
+{
+    EventModel eventModel;
+    GroupModel groupModel;
+    groupModel.setResolveContacts(GroupManager::DoNotResolve);
+    groupModel.setQueryMode(EventModel::SyncQuery);
+    QSignalSpy groupsCommitted(&groupModel, SIGNAL(groupsCommitted(QList<int>,bool)));
+
+    Group group1, group2;
+    addTestGroup(group1, ACCOUNT1, QString("filter1@localhost"));
+    addTestGroup(group2, ACCOUNT2, QString("filter2@localhost"));
+
+    const QDateTime old = QDateTime::currentDateTime().addDays(-2);
+    const int oldId = addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                                   "Old unread", false, false, old);
+    const int newId = addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT1, group1.id(),
+                                   "New unread");
+    const int otherId = addTestEvent(eventModel, Event::IMEvent, Event::Inbound, ACCOUNT2, group2.id(),
+                                     "Other account");
+
+    // Loaded groups are updated from the deltas, without another query
+    QVERIFY(groupModel.getGroups());
+    QModelIndex index1 = groupModel.findGroup(group1.id());
+    QModelIndex index2 = groupModel.findGroup(group2.id());
+    QVERIFY(index1.isValid());
+    QVERIFY(index2.isValid());
+    QCOMPARE(groupModel.group(index1).unreadMessages(), 2);
+    QCOMPARE(groupModel.group(index2).unreadMessages(), 1);
+
+    UpdatesListener listener;
+    QSignalSpy groupsUpdatedFull(&listener, SIGNAL(groupsUpdatedFull(QList<CommHistory::Group>)));
+    QSignalSpy groupsUpdated(&listener, SIGNAL(groupsUpdated(QList<int>)));
+
+    // Only the old event of the first account
+    DatabaseIO::ReadFilter filter;
+    filter.groupIds << group1.id() << group2.id();
+    filter.localUid = ACCOUNT1;
+    filter.before = QDateTime::currentDateTime().addDays(-1);
+    QVERIFY(groupModel.markAsRead(filter));
+
+    QCOMPARE(groupsCommitted.count(), 1);
+    QCOMPARE(groupsCommitted.first().at(0).value<QList<int> >(), QList<int>() << group1.id());
+    QVERIFY(groupsCommitted.first().at(1).toBool());
+    groupsCommitted.clear();
+
+    QTRY_COMPARE(groupsUpdatedFull.count(), 1);
+    QList<Group> updated = groupsUpdatedFull.first().at(0).value<QList<Group> >();
+    QCOMPARE(updated.size(), 1);
+    QCOMPARE(updated.first().id(), group1.id());
+    QCOMPARE(updated.first().unreadMessages(), 1);
+    QCOMPARE(groupsUpdated.count(), 0);
+    groupsUpdatedFull.clear();
+
+    QCOMPARE(groupModel.group(groupModel.findGroup(group1.id())).unreadMessages(), 1);
+    QCOMPARE(groupModel.group(groupModel.findGroup(group2.id())).unreadMessages(), 1);
+
+    Event e;
+    QVERIFY(groupModel.databaseIO().getEvent(oldId, e));
+    QVERIFY(e.isRead());
+    QVERIFY(groupModel.databaseIO().getEvent(newId, e));
+    QVERIFY(!e.isRead());
+    QVERIFY(groupModel.databaseIO().getEvent(otherId, e));
+    QVERIFY(!e.isRead());
+
+    Group testGroup;
+    QVERIFY(groupModel.databaseIO().getGroup(group1.id(), testGroup));
+    QCOMPARE(testGroup.unreadMessages(), 1);
+
+    // The rest of both groups with one statement
+    DatabaseIO::ReadFilter groups;
+    groups.groupIds << group1.id() << group2.id();
+    groups.eventType = Event::IMEvent;
+    QVERIFY(groupModel.markAsRead(groups));
+    QCOMPARE(groupsCommitted.count(), 1);
+    QCOMPARE(groupsCommitted.first().at(0).value<QList<int> >().size(), 2);
+
+    QCOMPARE(groupsUpdatedFull.count(), 1);
+    QCOMPARE(groupsUpdatedFull.first().at(0).value<QList<Group> >().size(), 2);
+    QCOMPARE(groupsUpdated.count(), 0);
+    QCOMPARE(groupModel.group(groupModel.findGroup(group1.id())).unreadMessages(), 0);
+    QCOMPARE(groupModel.group(groupModel.findGroup(group2.id())).unreadMessages(), 0);
+
+    QVERIFY(groupModel.databaseIO().getEvent(newId, e));
+    QVERIFY(e.isRead());
+    QVERIFY(groupModel.databaseIO().getEvent(otherId, e));
+    QVERIFY(e.isRead());
+    QVERIFY(groupModel.databaseIO().getGroup(group2.id(), testGroup));
+    QCOMPARE(testGroup.unreadMessages(), 0);
+}
+
 void GroupModelTest::resolveContact()
 {
     ContactChangeListener contactChangeListener;
@@ -52,10 +52,12 @@ private slots:
     void getGroups();
     void updateGroups();
     void deleteGroups();
+    void deleteGroupsInBackground();
     void streamingQuery_data();
     void streamingQuery();
     void deleteMmsContent();
     void markGroupAsRead();
+    void markAsReadFilter();
     void resolveContact();
     void queryContacts();
     void changeRemoteUid();
@@ -0,0 +1,227 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#include "historybackuptest.h"
+
+#include "historybackup.h"
+#include "callmodel.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "messagepart.h"
+#include "updateslistener.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+#include <QBuffer>
+
+namespace {
+
+const int MESSAGES = 7;
+const int CALLS = 3;
+
+Group group;
+int mmsEventId = -1;
+
+QByteArray exportHistory(HistoryBackup &backup, int contents = HistoryBackup::AllContent, int groupId = -1)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    if (!backup.exportTo(&buffer, contents, groupId))
+        return QByteArray();
+    return buffer.data();
+}
+
+bool importHistory(HistoryBackup &backup, const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    return backup.importFrom(&buffer);
+}
+
+// The group added last, which is the imported copy
+Group latestGroup()
+{
+    QList<Group> groups;
+    DatabaseIO::instance()->getGroups(QString(), QString(), groups);
+    Group latest;
+    foreach (const Group &g, groups) {
+        if (g.id() > latest.id())
+            latest = g;
+    }
+    return latest;
+}
+
+}
+
+void HistoryBackupTest::initTestCase()
+{
+    initTestDatabase();
+
+    addTestGroup(group, ACCOUNT1, "backup@localhost");
+
+    EventModel model;
+    for (int i = 0; i < MESSAGES - 1; i++) {
+        QVERIFY(addTestEvent(model, Event::IMEvent, i % 2 ? Event::Inbound : Event::Outbound,
+                             ACCOUNT1, group.id(), QString("backup %1").arg(i)) != -1);
+    }
+
+    Event mms;
+    mms.setType(Event::MMSEvent);
+    mms.setDirection(Event::Inbound);
+    mms.setGroupId(group.id());
+    mms.setStartTime(QDateTime::currentDateTime());
+    mms.setEndTime(mms.startTime());
+    mms.setLocalUid(ACCOUNT1);
+    mms.setRecipients(Recipient(ACCOUNT1, "backup@localhost"));
+    mms.setFreeText("backup mms");
+    mms.setExtraProperty("backup-key", "backup-value");
+    MessagePart part;
+    part.setContentId("<part1>");
+    part.setContentType("image/jpeg");
+    part.setPath("/tmp/backup-part1.jpg");
+    mms.addMessagePart(part);
+    QVERIFY(model.addEvent(mms));
+    mmsEventId = mms.id();
+
+    for (int i = 0; i < CALLS; i++)
+        QVERIFY(addTestEvent(model, Event::CallEvent, Event::Inbound, RING_ACCOUNT, -1) != -1);
+}
+
+void HistoryBackupTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+void HistoryBackupTest::roundTrip_data()
+{
+    QTest::addColumn<bool>("compressed");
+
+    QTest::newRow("plain") << false;
+    QTest::newRow("compressed") << true;
+}
+
+void HistoryBackupTest::roundTrip()
+{
+    QFETCH(bool, compressed);
+
+    HistoryBackup backup;
+    backup.setCompressed(compressed);
+    // Several chunks of each kind
+    backup.setChunkSize(2);
+
+    QSignalSpy progress(&backup, SIGNAL(progress(int)));
+    const QByteArray data = exportHistory(backup, HistoryBackup::Conversations, group.id());
+    QVERIFY(!data.isEmpty());
+    QCOMPARE(backup.groupCount(), 1);
+    QCOMPARE(backup.eventCount(), MESSAGES);
+    QVERIFY(progress.count() > 1);
+    QCOMPARE(progress.last().at(0).toInt(), MESSAGES);
+
+    QVERIFY(importHistory(backup, data));
+    QCOMPARE(backup.groupCount(), 1);
+    QCOMPARE(backup.eventCount(), MESSAGES);
+
+    const Group imported = latestGroup();
+    QVERIFY(imported.id() != group.id());
+    QCOMPARE(imported.localUid(), group.localUid());
+    QCOMPARE(imported.recipients().remoteUids(), group.recipients().remoteUids());
+
+    ConversationModel original, copy;
+    original.setQueryMode(EventModel::SyncQuery);
+    original.setResolveContacts(EventModel::DoNotResolve);
+    copy.setQueryMode(EventModel::SyncQuery);
+    copy.setResolveContacts(EventModel::DoNotResolve);
+    QVERIFY(original.getEvents(group.id()));
+    QVERIFY(copy.getEvents(imported.id()));
+    QCOMPARE(copy.rowCount(), original.rowCount());
+
+    for (int i = 0; i < original.rowCount(); i++) {
+        Event a = original.event(original.index(i, 0));
+        Event b = copy.event(copy.index(i, 0));
+        QVERIFY(b.id() != a.id());
+        QCOMPARE(b.groupId(), imported.id());
+        QCOMPARE(b.type(), a.type());
+        QCOMPARE(b.direction(), a.direction());
+        QCOMPARE(b.freeText(), a.freeText());
+        QCOMPARE(b.endTime(), a.endTime());
+
+        if (a.id() == mmsEventId) {
+            Event full;
+            QVERIFY(DatabaseIO::instance()->getEvent(b.id(), full));
+            QCOMPARE(full.extraProperty("backup-key").toString(), QString("backup-value"));
+            QCOMPARE(full.messageParts().size(), 1);
+            QCOMPARE(full.messageParts().first().contentId(), QString("<part1>"));
+            QCOMPARE(full.messageParts().first().path(), QString("/tmp/backup-part1.jpg"));
+        }
+    }
+}
+
+void HistoryBackupTest::calls()
+{
+    HistoryBackup backup;
+    backup.setChunkSize(1);
+    const QByteArray data = exportHistory(backup, HistoryBackup::Calls);
+    QVERIFY(!data.isEmpty());
+    QCOMPARE(backup.groupCount(), 0);
+    QCOMPARE(backup.eventCount(), CALLS);
+
+    CallModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(CallModel::SortByTime));
+    const int rows = model.rowCount();
+
+    // The calls are announced once at the end, not per chunk
+    UpdatesListener listener;
+    QSignalSpy eventsAdded(&listener, SIGNAL(eventsAdded(QList<CommHistory::Event>)));
+    QSignalSpy eventsImported(&listener, SIGNAL(eventsImported()));
+    QVERIFY(importHistory(backup, data));
+    QCOMPARE(backup.eventCount(), CALLS);
+    QTRY_COMPARE(eventsImported.count(), 1);
+
+    // An open call model reloads
+    QTRY_COMPARE(model.rowCount(), rows + CALLS);
+    QTest::qWait(100);
+    QCOMPARE(eventsImported.count(), 1);
+    QCOMPARE(eventsAdded.count(), 0);
+
+    exportHistory(backup, HistoryBackup::Calls);
+    QCOMPARE(backup.eventCount(), 2 * CALLS);
+}
+
+void HistoryBackupTest::invalidData()
+{
+    HistoryBackup backup;
+    QVERIFY(!importHistory(backup, QByteArray("not a backup")));
+    QCOMPARE(backup.eventCount(), 0);
+
+    const QByteArray data = exportHistory(backup, HistoryBackup::Conversations, group.id());
+    const int latestId = latestGroup().id();
+    QVERIFY(!importHistory(backup, data.left(data.size() - 8)));
+    // Complete chunks before the damage are kept
+    QVERIFY(latestGroup().id() > latestId);
+}
+
+QTEST_MAIN(HistoryBackupTest)
@@ -0,0 +1,211 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "jsonimporttest.h"
+
+#include "jsonimporter.h"
+#include "jsonstreamreader.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+#include <QBuffer>
+
+namespace {
+
+// JsonStreamReader reads the device in pieces of this size
+const int READ_SIZE = 64 * 1024;
+
+const int CONVERSATION_EVENTS = 5;
+
+QByteArray conversation(const QString &to, const QString &prefix)
+{
+    QByteArray data = "{\"type\": \"sms\", \"to\": \"" + to.toUtf8() + "\", \"events\": [";
+    for (int i = 0; i < CONVERSATION_EVENTS; i++) {
+        if (i)
+            data += ", ";
+        data += "{\"direction\": \"in\", \"date\": \"2026-01-01T10:0" + QByteArray::number(i)
+                + ":00\", \"text\": \"" + prefix.toUtf8() + QByteArray::number(i) + "\"}";
+    }
+    return data + "]}";
+}
+
+bool import(JsonImporter &importer, const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    return importer.run(&buffer);
+}
+
+QStringList conversationTexts(const QString &remoteUid)
+{
+    QList<Group> groups;
+    if (!DatabaseIO::instance()->getGroups(RING_ACCOUNT, remoteUid, groups) || groups.size() != 1)
+        return QStringList();
+
+    ConversationModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    if (!model.getEvents(groups.first().id()))
+        return QStringList();
+
+    QStringList texts;
+    for (int i = 0; i < model.rowCount(); i++)
+        texts << model.event(model.index(i, 0)).freeText();
+    texts.sort();
+    return texts;
+}
+
+}
+
+void JsonImportTest::initTestCase()
+{
+    initTestDatabase();
+}
+
+void JsonImportTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+void JsonImportTest::escapesAcrossBuffers_data()
+{
+    QTest::addColumn<int>("escapeOffset");
+
+    // Every byte of the escapes lands on the end of the first buffer once
+    for (int i = READ_SIZE - 12; i <= READ_SIZE; i++)
+        QTest::newRow(qPrintable(QString::number(i))) << i;
+}
+
+void JsonImportTest::escapesAcrossBuffers()
+{
+    QFETCH(int, escapeOffset);
+
+    const QByteArray filler(escapeOffset - 2, 'a');
+    QBuffer buffer;
+    buffer.setData("[\"" + filler + "\\\"\\\\\\u00e9\\\"\", 1]");
+    buffer.open(QIODevice::ReadOnly);
+
+    JsonStreamReader reader(&buffer);
+    QVERIFY(reader.beginArray());
+    QVERIFY(reader.nextElement());
+    QCOMPARE(reader.readValue().toString(),
+             QString::fromLatin1(filler) + QString::fromUtf8("\"\\\xc3\xa9\""));
+    QVERIFY(reader.nextElement());
+    QCOMPARE(reader.readValue().toInt(), 1);
+    QVERIFY(!reader.nextElement());
+    QVERIFY2(!reader.hasError(), qPrintable(reader.errorString()));
+    QCOMPARE(reader.offset(), buffer.size());
+}
+
+void JsonImportTest::byteOrderMark()
+{
+    QBuffer buffer;
+    buffer.setData("\xef\xbb\xbf[\"a\"]");
+    buffer.open(QIODevice::ReadOnly);
+
+    JsonStreamReader reader(&buffer);
+    QVERIFY(reader.beginArray());
+    QVERIFY(reader.nextElement());
+    QCOMPARE(reader.readValue().toString(), QString("a"));
+    QVERIFY(!reader.nextElement());
+    QVERIFY(!reader.hasError());
+
+    // Only at the start of the data
+    QBuffer inside;
+    inside.setData("[\xef\xbb\xbf\"a\"]");
+    inside.open(QIODevice::ReadOnly);
+
+    JsonStreamReader insideReader(&inside);
+    QVERIFY(insideReader.beginArray());
+    QVERIFY(insideReader.nextElement());
+    insideReader.readValue();
+    QVERIFY(insideReader.hasError());
+}
+
+void JsonImportTest::errorOffsets_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QString>("error");
+
+    QTest::newRow("missing comma") << QByteArray("[1, 2 x]")
+        << "Expected ',' or ']' at offset 6";
+    QTest::newRow("missing value") << QByteArray("[1,]")
+        << "Expected a value at offset 3";
+    QTest::newRow("unterminated string") << QByteArray("[\"abc")
+        << "Unterminated string at offset 5";
+    QTest::newRow("after a buffer") << "[" + QByteArray(READ_SIZE + 10, ' ') + "1 x]"
+        << QString("Expected ',' or ']' at offset %1").arg(READ_SIZE + 13);
+}
+
+void JsonImportTest::errorOffsets()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(QString, error);
+
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    JsonStreamReader reader(&buffer);
+    QVERIFY(reader.beginArray());
+    while (reader.nextElement()) {
+        if (!reader.skipValue())
+            break;
+    }
+    QCOMPARE(reader.errorString(), error);
+}
+
+void JsonImportTest::resume()
+{
+    const QByteArray data = "[" + conversation("+358501", "first")
+                            + ", " + conversation("+358502", "second") + "]";
+
+    // Interrupted inside the fourth event of the second conversation
+    const int cut = data.indexOf("second3");
+    QVERIFY(cut > 0);
+
+    JsonImporter interrupted(0, 2, 0);
+    QVERIFY(!import(interrupted, data.left(cut)));
+    QVERIFY(!interrupted.error.isEmpty());
+    QCOMPARE(interrupted.events, CONVERSATION_EVENTS + 2);
+    QVERIFY(interrupted.offset > data.indexOf("second1"));
+    QVERIFY(interrupted.offset < data.indexOf("second2"));
+    QCOMPARE(conversationTexts("+358502").size(), 2);
+
+    JsonImporter resumed(0, 2, interrupted.offset);
+    QVERIFY2(import(resumed, data), qPrintable(resumed.error));
+    QVERIFY(resumed.ok);
+    QCOMPARE(resumed.events, CONVERSATION_EVENTS - 2);
+
+    QStringList first;
+    QStringList second;
+    for (int i = 0; i < CONVERSATION_EVENTS; i++) {
+        first << QString("first%1").arg(i);
+        second << QString("second%1").arg(i);
+    }
+    QCOMPARE(conversationTexts("+358501"), first);
+    QCOMPARE(conversationTexts("+358502"), second);
+}
+
+QTEST_MAIN(JsonImportTest)
@@ -0,0 +1,350 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+
+#include "queryplanstest.h"
+
+#include "queryprofiler.h"
+#include "callmodel.h"
+#include "conversationmodel.h"
+#include "draftsmodel.h"
+#include "mmsconstants.h"
+#include "mmsreadreportmodel.h"
+#include "recentcontactsmodel.h"
+#include "recipienteventmodel.h"
+#include "singleeventmodel.h"
+#include "databaseio.h"
+#include "commonutils.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+#include <QRegularExpression>
+
+/*
+ * Loads each model against a populated database with the query profiler
+ * capturing every query, and checks the EXPLAIN QUERY PLAN output for
+ * full table scans and temporary sorts where an index should be used.
+ *
+ * Known exceptions, which are not checked:
+ * - ConversationModel::getEvents() without groups sorts all events
+ * - CallModel finds calls through events_type and sorts them by time in a
+ *   temporary B-tree, so only the Events scan is checked
+ * - DraftsModel without filter groups scans Events, isDraft is not indexed
+ * - RecipientEventModel matches phone numbers with LIKE '%number%'
+ */
+
+namespace {
+
+enum PlanCheck {
+    NoEventsScan = 0x1,
+    NoGroupsScan = 0x2,
+    NoTempSort = 0x4,
+    IndexedAndSorted = NoEventsScan | NoTempSort
+};
+
+const QString PHONE_ACCOUNT = RING_ACCOUNT + QLatin1String("/account0");
+const int GROUP_EVENTS = 50;
+const int CALL_EVENTS = 200;
+
+QList<Group> groups;
+int mmsGroupId = -1;
+QString messageToken;
+QString mmsId;
+
+// A walk through the table itself, rather than a search or an index walk.
+// Older SQLite versions print "SCAN TABLE Events AS alias".
+bool scansTable(const QString &detail, const QString &table)
+{
+    QRegularExpression re(QString::fromLatin1("^SCAN (TABLE )?%1( AS \\w+)?$").arg(table));
+    return re.match(detail).hasMatch();
+}
+
+// Returns false, after printing the offending query, if a plan breaks a check
+bool verifyPlans(int checks)
+{
+    const QList<QueryProfiler::SlowQuery> queries = QueryProfiler::slowQueries();
+    QueryProfiler::clear();
+
+    if (queries.isEmpty()) {
+        qWarning() << "No queries were captured";
+        return false;
+    }
+
+    foreach (const QueryProfiler::SlowQuery &query, queries) {
+        if (query.plan.isEmpty()) {
+            qWarning() << "No plan for" << query.statement;
+            return false;
+        }
+
+        foreach (const QString &line, query.plan) {
+            // Lines are "id parent detail"
+            const QString detail = line.section(' ', 2);
+            if (((checks & NoEventsScan) && scansTable(detail, "Events"))
+                || ((checks & NoGroupsScan) && scansTable(detail, "Groups"))
+                || ((checks & NoTempSort) && detail.contains("TEMP B-TREE") && detail.contains("ORDER BY"))) {
+                qWarning() << "Unexpected plan:" << qPrintable(QueryProfiler::toString(query));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void setupModel(EventModel &model)
+{
+    model.setResolveContacts(EventModel::DoNotResolve);
+    model.setQueryMode(EventModel::SyncQuery);
+}
+
+Event testEvent(Event::EventType type, Event::EventDirection direction,
+                const Group &group, const QDateTime &when)
+{
+    Event event;
+    event.setType(type);
+    event.setDirection(direction);
+    event.setGroupId(group.id());
+    event.setStartTime(when);
+    event.setEndTime(when);
+    event.setLocalUid(group.localUid());
+    event.setRecipients(group.recipients());
+    event.setFreeText(randomMessage(5));
+    event.setIsRead(true);
+    return event;
+}
+
+}
+
+void QueryPlansTest::initTestCase()
+{
+    initTestDatabase();
+
+    for (int i = 0; i < 6; i++) {
+        Group group;
+        if (i < 4)
+            addTestGroup(group, ACCOUNT1, QString::fromLatin1("plans%1@localhost").arg(i));
+        else
+            addTestGroup(group, PHONE_ACCOUNT, QString::fromLatin1("+3584000%1").arg(i));
+        QVERIFY(group.id() != -1);
+        groups.append(group);
+    }
+    mmsGroupId = groups.last().id();
+
+    EventModel model;
+    QDateTime when = QDateTime::currentDateTime().addDays(-30);
+    QList<Event> events;
+
+    foreach (const Group &group, groups) {
+        const Event::EventType type = group.localUid() == ACCOUNT1 ? Event::IMEvent : Event::SMSEvent;
+        for (int i = 0; i < GROUP_EVENTS; i++) {
+            when = when.addSecs(60);
+            Event event = testEvent(type, i % 2 ? Event::Inbound : Event::Outbound, group, when);
+            event.setIsRead(i < GROUP_EVENTS - 5);
+            event.setMessageToken(QString::fromLatin1("plans-token-%1-%2").arg(group.id()).arg(i));
+            events.append(event);
+        }
+
+        Event draft = testEvent(type, Event::Outbound, group, when);
+        draft.setIsDraft(true);
+        events.append(draft);
+    }
+    messageToken = events.first().messageToken();
+
+    // Read inbound MMS whose read report has not been sent
+    for (int i = 0; i < 5; i++) {
+        when = when.addSecs(60);
+        Event event = testEvent(Event::MMSEvent, Event::Inbound, groups.last(), when);
+        event.setMmsId(QString::fromLatin1("plans-mms-%1").arg(i));
+        event.setReportRead(true);
+        event.setExtraProperty(MMS_PROPERTY_UNREAD, QString::fromLatin1("plans-unread-%1").arg(i));
+        events.append(event);
+    }
+    mmsId = events.last().mmsId();
+
+    for (int i = 0; i < CALL_EVENTS; i++) {
+        when = when.addSecs(600);
+        Event event;
+        event.setType(Event::CallEvent);
+        event.setDirection(i % 3 ? Event::Inbound : Event::Outbound);
+        event.setIsMissedCall(i % 3 == 1);
+        event.setStartTime(when);
+        event.setEndTime(when.addSecs(30));
+        event.setLocalUid(PHONE_ACCOUNT);
+        event.setRecipients(Recipient(PHONE_ACCOUNT, QString::fromLatin1("+35841000%1").arg(i % 20)));
+        event.setIsRead(true);
+        events.append(event);
+    }
+
+    QVERIFY(model.addEvents(events));
+
+    QueryProfiler::setEnabled(true);
+    QueryProfiler::setThreshold(0);
+    QueryProfiler::setCapacity(100);
+}
+
+void QueryPlansTest::cleanupTestCase()
+{
+    QueryProfiler::setEnabled(false);
+    QueryProfiler::setCapacity(50);
+    deleteAll();
+}
+
+void QueryPlansTest::init()
+{
+    QueryProfiler::clear();
+}
+
+void QueryPlansTest::conversationModel()
+{
+    ConversationModel model;
+    setupModel(model);
+
+    QVERIFY(model.getEvents(groups.first().id()));
+    QCOMPARE(model.rowCount(), GROUP_EVENTS);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+
+    // First page only
+    model.setLimit(20);
+    QVERIFY(model.getEvents(groups.first().id()));
+    QVERIFY(verifyPlans(IndexedAndSorted));
+
+    // A merged conversation is a UNION ALL of one indexed query per group
+    model.setLimit(0);
+    QVERIFY(model.getEvents(QList<int>() << groups.at(0).id() << groups.at(1).id()));
+    QCOMPARE(model.rowCount(), 2 * GROUP_EVENTS);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+
+    QVERIFY(model.setFilter(Event::IMEvent, ACCOUNT1, Event::Inbound));
+    QVERIFY(model.getEvents(groups.first().id()));
+    QVERIFY(verifyPlans(IndexedAndSorted));
+}
+
+void QueryPlansTest::callModel()
+{
+    // Calls are found through events_type and sorted by time afterwards
+    CallModel model;
+    setupModel(model);
+
+    model.setSorting(CallModel::SortByTime);
+    QVERIFY(model.getEvents());
+    QVERIFY(model.rowCount() > 0);
+    QVERIFY(verifyPlans(NoEventsScan));
+
+    model.setSorting(CallModel::SortByContact);
+    QVERIFY(model.getEvents());
+    QVERIFY(verifyPlans(NoEventsScan));
+
+    model.setSorting(CallModel::SortByTime);
+    model.setFilterType(CallEvent::MissedCallType);
+    QVERIFY(model.getEvents());
+    QVERIFY(verifyPlans(NoEventsScan));
+
+    model.setFilterAccount(PHONE_ACCOUNT);
+    QVERIFY(model.getEvents());
+    QVERIFY(verifyPlans(NoEventsScan));
+}
+
+void QueryPlansTest::draftsModel()
+{
+    DraftsModel model;
+    setupModel(model);
+
+    model.setFilterGroup(groups.first().id());
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 1);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+
+    model.setFilterGroups(QList<int>() << groups.at(0).id() << groups.at(1).id());
+    QVERIFY(model.getEvents());
+    QCOMPARE(model.rowCount(), 2);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+}
+
+void QueryPlansTest::recentContactsModel()
+{
+    // A page of RecentRecipients is read from its sorting index and joined
+    // to Events by id, and the handful of results is sorted afterwards
+    RecentContactsModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    model.setLimit(10);
+
+    QVERIFY(model.getEvents());
+    QVERIFY(verifyPlans(NoEventsScan));
+}
+
+void QueryPlansTest::recipientEventModel()
+{
+    // Addresses that are not phone numbers are looked up in events_remoteUid
+    RecipientEventModel model;
+    model.setQueryMode(EventModel::SyncQuery);
+    model.setRecipients(groups.first().recipients());
+
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QVERIFY(model.rowCount() >= GROUP_EVENTS);
+    QVERIFY(verifyPlans(NoEventsScan));
+}
+
+void QueryPlansTest::mmsReadReportModel()
+{
+    MmsReadReportModel model;
+    setupModel(model);
+
+    QVERIFY(model.getEvents(mmsGroupId));
+    QCOMPARE(model.rowCount(), 5);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+}
+
+void QueryPlansTest::singleEventModel()
+{
+    SingleEventModel model;
+    setupModel(model);
+
+    QVERIFY(model.getEventByTokens(messageToken, QString(), -1));
+    QCOMPARE(model.rowCount(), 1);
+    QVERIFY(verifyPlans(NoEventsScan));
+    const int eventId = model.event(0).id();
+
+    QVERIFY(model.getEventByTokens(messageToken, mmsId, mmsGroupId));
+    QCOMPARE(model.rowCount(), 1);
+    QVERIFY(verifyPlans(NoEventsScan));
+
+    QVERIFY(model.getEventById(eventId));
+    QCOMPARE(model.rowCount(), 1);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+}
+
+void QueryPlansTest::groupQuery()
+{
+    // Every group is listed, but the unread counts and the last event of
+    // each group come from the Events indexes
+    QList<Group> result;
+    QVERIFY(DatabaseIO::instance()->getGroups(QString(), QString(), result));
+    QCOMPARE(result.size(), groups.size());
+    QVERIFY(verifyPlans(IndexedAndSorted));
+
+    QVERIFY(DatabaseIO::instance()->getGroups(ACCOUNT1, QString(), result, "LIMIT 2"));
+    QCOMPARE(result.size(), 2);
+    QVERIFY(verifyPlans(IndexedAndSorted));
+}
+
+QTEST_MAIN(QueryPlansTest)
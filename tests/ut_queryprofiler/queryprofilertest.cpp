@@ -0,0 +1,162 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "queryprofilertest.h"
+
+#include "queryprofiler.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+
+namespace {
+
+Group group;
+QList<int> eventIds;
+
+void loadConversation()
+{
+    ConversationModel model;
+    model.setResolveContacts(EventModel::DoNotResolve);
+    model.setQueryMode(EventModel::SyncQuery);
+    QVERIFY(model.getEvents(group.id()));
+    QCOMPARE(model.rowCount(), eventIds.size());
+}
+
+}
+
+void QueryProfilerTest::initTestCase()
+{
+    initTestDatabase();
+
+    addTestGroup(group, ACCOUNT1, "profiler@localhost");
+    EventModel model;
+    for (int i = 0; i < 3; i++)
+        eventIds.append(addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT1, group.id()));
+}
+
+void QueryProfilerTest::cleanupTestCase()
+{
+    QueryProfiler::setEnabled(false);
+    deleteAll();
+}
+
+void QueryProfilerTest::disabled()
+{
+    QueryProfiler::setEnabled(false);
+    QueryProfiler::setThreshold(0);
+    QueryProfiler::clear();
+
+    loadConversation();
+    QVERIFY(QueryProfiler::slowQueries().isEmpty());
+}
+
+void QueryProfilerTest::capture()
+{
+    QueryProfiler::setEnabled(true);
+    QueryProfiler::setThreshold(0);
+    QueryProfiler::clear();
+
+    loadConversation();
+
+    // The conversation query returns the events of the group
+    QueryProfiler::SlowQuery conversation;
+    conversation.rows = -1;
+    foreach (const QueryProfiler::SlowQuery &query, QueryProfiler::slowQueries()) {
+        if (query.rows == eventIds.size())
+            conversation = query;
+    }
+    QCOMPARE(conversation.rows, eventIds.size());
+    QVERIFY(conversation.time.isValid());
+    QVERIFY(conversation.statement.contains("FROM Events"));
+    QVERIFY(conversation.totalUsecs() >= conversation.execUsecs);
+    QVERIFY(!conversation.plan.isEmpty());
+    QVERIFY(!QueryProfiler::toString(conversation).isEmpty());
+
+    QueryProfiler::clear();
+    Event event;
+    QVERIFY(DatabaseIO::instance()->getEvent(eventIds.first(), event));
+    QCOMPARE(QueryProfiler::slowQueries().size(), 1);
+    const QueryProfiler::SlowQuery query = QueryProfiler::slowQueries().first();
+    QCOMPARE(query.rows, 1);
+    QCOMPARE(query.boundValues.value(":eventId").toInt(), eventIds.first());
+    QVERIFY(!query.plan.isEmpty());
+    // Looked up by the primary key
+    QVERIFY(query.plan.join(' ').contains("Events"));
+}
+
+void QueryProfilerTest::allQueries()
+{
+    QueryProfiler::setEnabled(true);
+    QueryProfiler::setThreshold(0);
+    QueryProfiler::clear();
+
+    // Every query prepared by the library is covered, not only the model ones
+    Event event;
+    QVERIFY(DatabaseIO::instance()->getEvent(eventIds.first(), event));
+    QVERIFY(DatabaseIO::instance()->getMessageParts(event));
+    QVERIFY(DatabaseIO::instance()->getEventExtraProperties(event));
+    QVERIFY(DatabaseIO::instance()->markAsRead(eventIds));
+
+    QStringList statements;
+    foreach (const QueryProfiler::SlowQuery &query, QueryProfiler::slowQueries())
+        statements.append(query.statement);
+    const QString all = statements.join('\n');
+    QVERIFY(all.contains("FROM MessageParts"));
+    QVERIFY(all.contains("UPDATE Events SET isRead=1"));
+    QVERIFY(statements.size() >= 4);
+}
+
+void QueryProfilerTest::threshold()
+{
+    QueryProfiler::setEnabled(true);
+    QueryProfiler::setThreshold(60000);
+    QueryProfiler::clear();
+
+    loadConversation();
+    QVERIFY(QueryProfiler::slowQueries().isEmpty());
+}
+
+void QueryProfilerTest::capacity()
+{
+    QueryProfiler::setEnabled(true);
+    QueryProfiler::setThreshold(0);
+    QueryProfiler::setCapacity(2);
+    QueryProfiler::clear();
+
+    for (int i = 0; i < eventIds.size(); i++) {
+        Event event;
+        QVERIFY(DatabaseIO::instance()->getEvent(eventIds.at(i), event));
+    }
+
+    // Only the latest ones are kept
+    const QList<QueryProfiler::SlowQuery> queries = QueryProfiler::slowQueries();
+    QCOMPARE(queries.size(), 2);
+    QCOMPARE(queries.last().boundValues.value(":eventId").toInt(), eventIds.last());
+
+    QueryProfiler::setCapacity(50);
+}
+
+QTEST_MAIN(QueryProfilerTest)
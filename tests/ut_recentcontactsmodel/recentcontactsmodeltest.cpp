@@ -207,6 +207,34 @@ void RecentContactsModelTest::limitedFill()
     QCOMPARE(e.contacts(), QList<ContactDetails>() << qMakePair(bobId, bobName));
 }
 
+void RecentContactsModelTest::pagedFill()
+{
+    addEvents(7);
+
+    RecentContactsModel model;
+    model.setLimit(3);
+
+    InsertionSpy insert(model);
+
+    // The first page of three addresses holds only Bob and Charlie, so
+    // Alice has to come from the next one
+    QVERIFY(model.getEvents());
+    QTRY_COMPARE(model.resolving(), false);
+    QCOMPARE(insert.count(), 3);
+    QCOMPARE(model.rowCount(), 3);
+
+    Event e;
+
+    e = model.event(model.index(0, 0));
+    QCOMPARE(e.contacts(), QList<ContactDetails>() << qMakePair(bobId, bobName));
+    QCOMPARE(e.type(), Event::IMEvent);
+    e = model.event(model.index(1, 0));
+    QCOMPARE(e.contacts(), QList<ContactDetails>() << qMakePair(charlieId, charlieName));
+    e = model.event(model.index(2, 0));
+    QCOMPARE(e.contacts(), QList<ContactDetails>() << qMakePair(aliceId, aliceName));
+    QCOMPARE(e.type(), Event::SMSEvent);
+}
+
 void RecentContactsModelTest::repeated()
 {
     addEvents(5);
@@ -13,6 +13,7 @@ private slots:
 
     void simple();
     void limitedFill();
+    void pagedFill();
     void repeated();
     void limitedDynamic();
     void differentTypes();
@@ -0,0 +1,255 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "retentionenginetest.h"
+
+#include "retentionengine.h"
+#include "commhistorydatabasepath.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "updateslistener.h"
+#include "eventmodel.h"
+#include "event.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+namespace {
+
+QString archivePath()
+{
+    return QDir(CommHistoryDatabasePath::databaseDir()).absoluteFilePath(CommHistoryDatabasePath::archiveFile());
+}
+
+int groupCounter = 0;
+
+Group addRetentionGroup()
+{
+    Group group;
+    addTestGroup(group, ACCOUNT1, QString("retention%1@localhost").arg(++groupCounter));
+    return group;
+}
+
+// Adds an SMS event \a days days old
+int addOldEvent(EventModel &model, const Group &group, int days, const QString &text = QString("old"))
+{
+    return addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group.id(), text,
+                        false, false, QDateTime::currentDateTime().addDays(-days));
+}
+
+int archivedEvents(int groupId)
+{
+    QSqlDatabase db = QSqlDatabase::database("ut_retentionengine");
+    if (!db.isValid()) {
+        db = QSqlDatabase::addDatabase("QSQLITE", "ut_retentionengine");
+        db.setDatabaseName(archivePath());
+    }
+    if (!db.isOpen() && !db.open())
+        return -1;
+
+    QSqlQuery query(db);
+    query.prepare("SELECT COUNT(*) FROM Events WHERE groupId = :groupId");
+    query.bindValue(":groupId", groupId);
+    if (!query.exec() || !query.next())
+        return -1;
+    return query.value(0).toInt();
+}
+
+// Ids from all emissions of a signal with a QList<int> argument
+QSet<int> spiedIds(const QSignalSpy &spy)
+{
+    QSet<int> ids;
+    for (int i = 0; i < spy.count(); i++)
+        ids += spy.at(i).at(0).value<QList<int> >().toSet();
+    return ids;
+}
+
+// Pages through the whole conversation, two events at a time
+void loadConversation(ConversationModel &model, int groupId, QList<int> &ids)
+{
+    model.setQueryMode(EventModel::StreamedAsyncQuery);
+    model.setFirstChunkSize(2);
+    model.setChunkSize(2);
+    QVERIFY(model.getEvents(groupId));
+
+    QTRY_VERIFY(model.rowCount() > 0 || model.isReady());
+    for (int i = 0; i < 10 && model.canFetchMore(QModelIndex()); i++) {
+        const int rows = model.rowCount();
+        model.fetchMore(QModelIndex());
+        QTRY_VERIFY(model.rowCount() > rows || !model.canFetchMore(QModelIndex()));
+    }
+
+    for (int i = 0; i < model.rowCount(); i++)
+        ids.append(model.event(model.index(i, 0)).id());
+}
+
+}
+
+void RetentionEngineTest::initTestCase()
+{
+    QFile::remove(archivePath());
+    initTestDatabase();
+    qRegisterMetaType<QList<int> >();
+
+    // The connection is opened before the archive exists, so the tests
+    // below go through attaching it on demand
+    DatabaseIO::instance()->eventExists(0);
+    // Only the engine creates the archive
+    QVERIFY(!QFile::exists(archivePath()));
+}
+
+void RetentionEngineTest::cleanupTestCase()
+{
+    QSqlDatabase::removeDatabase("ut_retentionengine");
+    deleteAll();
+    QFile::remove(archivePath());
+}
+
+void RetentionEngineTest::agePolicy()
+{
+    EventModel model;
+    Group group = addRetentionGroup();
+    Group stale = addRetentionGroup();
+
+    const int oldest = addOldEvent(model, group, 40);
+    const int old = addOldEvent(model, group, 35);
+    const int recent = addOldEvent(model, group, 1);
+    const int staleOld = addOldEvent(model, stale, 50);
+    const int staleNewest = addOldEvent(model, stale, 45);
+
+    UpdatesListener listener;
+    QSignalSpy deleted(&listener, SIGNAL(eventsDeleted(QList<int>)));
+    QSignalSpy groupsUpdated(&listener, SIGNAL(groupsUpdated(QList<int>)));
+
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 30, 0);
+    QCOMPARE(engine.maxAge(Event::SMSEvent), 30);
+    QCOMPARE(engine.maxCount(Event::SMSEvent), 0);
+
+    QVERIFY(engine.run());
+    QVERIFY(!engine.isRunning());
+    QCOMPARE(engine.eventsArchived(), 3);
+
+    // Moved events are announced as deleted from the live database
+    QTRY_COMPARE(spiedIds(deleted), QSet<int>() << oldest << old << staleOld);
+    QTRY_COMPARE(spiedIds(groupsUpdated), QSet<int>() << group.id() << stale.id());
+
+    QVERIFY(QFile::exists(archivePath()));
+
+    DatabaseIO *io = DatabaseIO::instance();
+    QVERIFY(!io->eventExists(oldest));
+    QVERIFY(!io->eventExists(old));
+    QVERIFY(io->eventExists(recent));
+    QVERIFY(!io->eventExists(staleOld));
+    // The newest event of a conversation always stays
+    QVERIFY(io->eventExists(staleNewest));
+
+    QCOMPARE(archivedEvents(group.id()), 2);
+    QCOMPARE(archivedEvents(stale.id()), 1);
+
+    // Nothing left to do
+    QVERIFY(engine.run());
+    QCOMPARE(engine.eventsArchived(), 0);
+}
+
+void RetentionEngineTest::countPolicy()
+{
+    EventModel model;
+    Group group = addRetentionGroup();
+
+    QList<int> ids;
+    for (int i = 5; i > 0; i--)
+        ids.append(addOldEvent(model, group, i));
+
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 0, 2);
+    engine.setBatchSize(1);
+    engine.setBatchInterval(10);
+    QSignalSpy finished(&engine, SIGNAL(finished(bool)));
+
+    engine.start();
+    QVERIFY(engine.isRunning());
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(finished.first().at(0).toBool());
+    QCOMPARE(engine.eventsArchived(), 3);
+
+    DatabaseIO *io = DatabaseIO::instance();
+    for (int i = 0; i < ids.size(); i++)
+        QCOMPARE(io->eventExists(ids[i]), i >= 3);
+    QCOMPARE(archivedEvents(group.id()), 3);
+}
+
+void RetentionEngineTest::conversationPaging()
+{
+    EventModel model;
+    Group group = addRetentionGroup();
+
+    QList<int> ids;
+    for (int i = 5; i > 0; i--)
+        ids.prepend(addOldEvent(model, group, i * 10, QString("event %1").arg(i)));
+
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 25, 0);
+    QVERIFY(engine.run());
+    QCOMPARE(engine.eventsArchived(), 3);
+
+    // Live events come first, then the archived ones in the same order
+    ConversationModel conversation;
+    QList<int> loaded;
+    loadConversation(conversation, group.id(), loaded);
+    QCOMPARE(loaded, ids);
+    QCOMPARE(conversation.event(conversation.index(4, 0)).freeText(), QString("event 5"));
+
+    ConversationModel liveOnly;
+    liveOnly.setIncludeArchive(false);
+    loaded.clear();
+    loadConversation(liveOnly, group.id(), loaded);
+    QCOMPARE(loaded, ids.mid(0, 2));
+}
+
+void RetentionEngineTest::deleteArchived()
+{
+    EventModel model;
+    Group group = addRetentionGroup();
+
+    const int first = addOldEvent(model, group, 30);
+    addOldEvent(model, group, 20);
+    addOldEvent(model, group, 1);
+
+    RetentionEngine engine;
+    engine.setPolicy(Event::SMSEvent, 10, 0);
+    QVERIFY(engine.run());
+    QCOMPARE(archivedEvents(group.id()), 2);
+
+    // Single archived events can be deleted
+    Event event;
+    event.setId(first);
+    QVERIFY(DatabaseIO::instance()->deleteEvent(event));
+    QCOMPARE(archivedEvents(group.id()), 1);
+
+    // Deleting the group takes its archived events along
+    QVERIFY(DatabaseIO::instance()->deleteGroup(group.id()));
+    QCOMPARE(archivedEvents(group.id()), 0);
+}
+
+QTEST_MAIN(RetentionEngineTest)
@@ -0,0 +1,188 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+
+#include "searchmodeltest.h"
+
+#include "searchmodel.h"
+#include "event.h"
+#include "common.h"
+#include "databaseio.h"
+
+#include <QtTest/QtTest>
+
+Group group1, group2;
+
+void SearchModelTest::initTestCase()
+{
+    initTestDatabase();
+
+    addTestGroups(group1, group2);
+
+    EventModel model;
+    QDateTime when = QDateTime::currentDateTime();
+    addTestEvent(model, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "see you at the harbour", false, false, when);
+    addTestEvent(model, Event::SMSEvent, Event::Outbound, ACCOUNT1, group1.id(), "harbour harbour harbour", false, false, when.addSecs(1));
+    addTestEvent(model, Event::IMEvent, Event::Inbound, ACCOUNT2, group2.id(), "meet at the harbourside cafe", false, false, when.addSecs(2));
+    addTestEvent(model, Event::IMEvent, Event::Outbound, ACCOUNT2, group2.id(), "nothing to see here", false, false, when.addSecs(3));
+    addTestEvent(model, Event::SMSEvent, Event::Outbound, ACCOUNT1, group1.id(), "draft about the harbour", true, false, when.addSecs(4));
+}
+
+void SearchModelTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+void SearchModelTest::search()
+{
+    SearchModel model;
+    model.setSearchText("harbour");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+
+    // Prefix matching includes "harbourside", drafts are excluded
+    QCOMPARE(model.rowCount(), 3);
+
+    // The message repeating the word ranks first
+    QCOMPARE(model.event(model.index(0, 0)).freeText(), QString("harbour harbour harbour"));
+
+    for (int row = 0; row < model.rowCount(); row++) {
+        QString snippet = model.data(model.index(row, 0), SearchModel::SnippetRole).toString();
+        QVERIFY(snippet.contains("<b>harbour"));
+    }
+
+    // Every word must match
+    model.setSearchText("harbour cafe");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.event(model.index(0, 0)).freeText(), QString("meet at the harbourside cafe"));
+
+    // Query syntax is not interpreted
+    model.setSearchText("\"harbour OR nothing\" -");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 0);
+
+    model.setSearchText(QString());
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 0);
+}
+
+void SearchModelTest::filters()
+{
+    SearchModel model;
+    model.setSearchText("harbour");
+
+    model.setFilterType(Event::IMEvent);
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+
+    model.setFilterType(Event::UnknownType);
+    model.setFilterAccount(ACCOUNT1);
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 2);
+
+    model.setFilterAccount(QString());
+    model.setFilterGroups(QList<int>() << group2.id());
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.event(model.index(0, 0)).groupId(), group2.id());
+}
+
+void SearchModelTest::chunks()
+{
+    SearchModel model;
+    model.setChunkSize(2);
+    model.setSearchText("harbour");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 2);
+    QVERIFY(model.canFetchMore(QModelIndex()));
+
+    model.fetchMore(QModelIndex());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 3);
+    QVERIFY(!model.canFetchMore(QModelIndex()));
+
+    // Narrowing the search keeps the remaining row
+    QPersistentModelIndex kept = model.index(0, 0);
+    QSignalSpy reset(&model, &SearchModel::modelReset);
+    model.setSearchText("harbour harbour");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(reset.count(), 0);
+    QVERIFY(kept.isValid());
+}
+
+void SearchModelTest::updates()
+{
+    SearchModel model;
+    model.setSearchText("nothing");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+
+    // Edited text is reindexed by the database triggers
+    Event event = model.event(model.index(0, 0));
+    event.setFreeText("something else entirely");
+    QVERIFY(model.modifyEvent(event));
+    QTRY_COMPARE(model.event(model.index(0, 0)).freeText(), QString("something else entirely"));
+
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 0);
+
+    model.setSearchText("entirely");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+
+    // Deleted events leave the results
+    QVERIFY(model.deleteEvent(event.id()));
+    QTRY_COMPARE(model.rowCount(), 0);
+}
+
+void SearchModelTest::escapedSnippets()
+{
+    EventModel eventModel;
+    addTestEvent(eventModel, Event::SMSEvent, Event::Inbound, ACCOUNT1, group1.id(), "fish & chips <b>tonight</b>");
+
+    SearchModel model;
+    model.setSearchText("chips");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    QCOMPARE(model.rowCount(), 1);
+
+    // Only the markers are markup
+    QString snippet = model.data(model.index(0, 0), SearchModel::SnippetRole).toString();
+    QCOMPARE(snippet, QString("fish &amp; <b>chips</b> &lt;b&gt;tonight&lt;/b&gt;"));
+
+    model.setSnippetMarkers("[", "]");
+    QVERIFY(model.getEvents());
+    QTRY_VERIFY(model.isReady());
+    snippet = model.data(model.index(0, 0), SearchModel::SnippetRole).toString();
+    QCOMPARE(snippet, QString("fish &amp; [chips] &lt;b&gt;tonight&lt;/b&gt;"));
+}
+
+QTEST_MAIN(SearchModelTest)
@@ -0,0 +1,225 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "writequeuetest.h"
+
+#include "writequeue.h"
+#include "conversationmodel.h"
+#include "databaseio.h"
+#include "event.h"
+#include "group.h"
+#include "common.h"
+
+#include <QtTest/QtTest>
+
+namespace {
+
+Group group;
+
+Event messageEvent(const QString &text)
+{
+    return createTestEvent(Event::IMEvent, Event::Inbound, ACCOUNT1, group.id(), text,
+                           QDateTime::currentDateTime(), "writequeue@localhost");
+}
+
+}
+
+void WriteQueueTest::initTestCase()
+{
+    initTestDatabase();
+    qRegisterMetaType<QList<CommHistory::Event> >();
+
+    addTestGroup(group, ACCOUNT1, "writequeue@localhost");
+}
+
+void WriteQueueTest::cleanupTestCase()
+{
+    deleteAll();
+}
+
+void WriteQueueTest::addAndModify()
+{
+    ConversationModel model;
+    QSignalSpy ready(&model, SIGNAL(modelReady(bool)));
+    QVERIFY(model.getEvents(group.id()));
+    QVERIFY(ready.count() || ready.wait());
+    const int rows = model.rowCount();
+
+    WriteQueue queue;
+    QSignalSpy finished(&queue, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+
+    QList<Event> events;
+    events << messageEvent("queued 1") << messageEvent("queued 2");
+    const int request = queue.addEvents(events);
+    QVERIFY(request > 0);
+    QVERIFY(!queue.isFinished(request));
+    QCOMPARE(queue.pendingRequests(), 1);
+
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(0).toInt(), request);
+    QVERIFY(finished.at(0).at(2).toBool());
+    QVERIFY(queue.isFinished(request));
+    QCOMPARE(queue.pendingRequests(), 0);
+
+    events = finished.at(0).at(1).value<QList<Event> >();
+    QCOMPARE(events.size(), 2);
+    Event stored;
+    foreach (const Event &event, events) {
+        QVERIFY(event.id() != -1);
+        QVERIFY(DatabaseIO::instance()->getEvent(event.id(), stored));
+        QCOMPARE(stored.freeText(), event.freeText());
+    }
+
+    // Models of the group hear about the new events
+    QTRY_COMPARE(model.rowCount(), rows + 2);
+
+    Event modified = events.first();
+    modified.resetModifiedProperties();
+    modified.setFreeText("queued 1 modified");
+    finished.clear();
+    const int modifyRequest = queue.modifyEvent(modified);
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.at(0).at(0).toInt(), modifyRequest);
+    QVERIFY(finished.at(0).at(2).toBool());
+
+    QVERIFY(DatabaseIO::instance()->getEvent(modified.id(), stored));
+    QCOMPARE(stored.freeText(), QString("queued 1 modified"));
+    QTRY_COMPARE(model.event(model.findEvent(modified.id())).freeText(), QString("queued 1 modified"));
+}
+
+void WriteQueueTest::groupCommit()
+{
+    const int window = WriteQueue::commitWindow();
+    WriteQueue::setCommitWindow(200);
+
+    // Requests of two queues in the same window, finished in order
+    WriteQueue first, second;
+    QSignalSpy firstFinished(&first, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+    QSignalSpy secondFinished(&second, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+
+    QList<int> requests;
+    requests << first.addEvent(messageEvent("window 1"));
+    requests << second.addEvent(messageEvent("window 2"));
+    requests << first.addEvent(messageEvent("window 3"));
+
+    QVERIFY(secondFinished.wait());
+    QTRY_COMPARE(firstFinished.count(), 2);
+    QCOMPARE(secondFinished.count(), 1);
+    QCOMPARE(firstFinished.at(0).at(0).toInt(), requests.at(0));
+    QCOMPARE(firstFinished.at(1).at(0).toInt(), requests.at(2));
+    QCOMPARE(secondFinished.at(0).at(0).toInt(), requests.at(1));
+
+    // Ids are assigned in the order of the requests
+    const int id1 = firstFinished.at(0).at(1).value<QList<Event> >().first().id();
+    const int id2 = secondFinished.at(0).at(1).value<QList<Event> >().first().id();
+    const int id3 = firstFinished.at(1).at(1).value<QList<Event> >().first().id();
+    QVERIFY(id1 < id2);
+    QVERIFY(id2 < id3);
+
+    WriteQueue::setCommitWindow(window);
+}
+
+void WriteQueueTest::failedRequest()
+{
+    const int window = WriteQueue::commitWindow();
+    WriteQueue::setCommitWindow(200);
+
+    WriteQueue queue;
+    QSignalSpy finished(&queue, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+
+    // The invalid request in the middle is rolled back alone
+    queue.addEvent(messageEvent("before failure"));
+    Event invalid = messageEvent("no id");
+    queue.modifyEvent(invalid);
+    queue.addEvent(messageEvent("after failure"));
+
+    QTRY_COMPARE(finished.count(), 3);
+    QVERIFY(finished.at(0).at(2).toBool());
+    QVERIFY(!finished.at(1).at(2).toBool());
+    QVERIFY(finished.at(2).at(2).toBool());
+
+    Event stored;
+    const Event after = finished.at(2).at(1).value<QList<Event> >().first();
+    QVERIFY(DatabaseIO::instance()->getEvent(after.id(), stored));
+    QCOMPARE(stored.freeText(), QString("after failure"));
+
+    WriteQueue::setCommitWindow(window);
+}
+
+void WriteQueueTest::deleteAndMarkRead()
+{
+    WriteQueue queue;
+    QSignalSpy finished(&queue, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+
+    queue.addEvents(QList<Event>() << messageEvent("unread 1") << messageEvent("unread 2"));
+    QVERIFY(finished.wait());
+    const QList<Event> added = finished.at(0).at(1).value<QList<Event> >();
+
+    Group stored;
+    QVERIFY(DatabaseIO::instance()->getGroup(group.id(), stored));
+    QVERIFY(stored.unreadMessages() >= 2);
+
+    finished.clear();
+    queue.markAsReadGroups(QList<int>() << group.id());
+    QVERIFY(finished.wait());
+    QVERIFY(finished.at(0).at(2).toBool());
+    QVERIFY(DatabaseIO::instance()->getGroup(group.id(), stored));
+    QCOMPARE(stored.unreadMessages(), 0);
+
+    finished.clear();
+    QList<int> ids;
+    foreach (const Event &event, added)
+        ids << event.id();
+    queue.deleteEvents(ids);
+    QVERIFY(finished.wait());
+    QVERIFY(finished.at(0).at(2).toBool());
+    const QList<Event> deleted = finished.at(0).at(1).value<QList<Event> >();
+    QCOMPARE(deleted.size(), 2);
+    QCOMPARE(deleted.first().id(), ids.first());
+
+    Event event;
+    foreach (int id, ids)
+        QVERIFY(!DatabaseIO::instance()->getEvent(id, event));
+}
+
+void WriteQueueTest::waitForFinished()
+{
+    const int window = WriteQueue::commitWindow();
+    WriteQueue::setCommitWindow(10000);
+
+    WriteQueue queue;
+    QSignalSpy finished(&queue, SIGNAL(finished(int,QList<CommHistory::Event>,bool)));
+
+    const int request = queue.addEvent(messageEvent("waited for"));
+    QVERIFY(queue.waitForFinished());
+    QCOMPARE(finished.count(), 1);
+    QVERIFY(queue.isFinished(request));
+
+    const Event event = finished.at(0).at(1).value<QList<Event> >().first();
+    Event stored;
+    QVERIFY(DatabaseIO::instance()->getEvent(event.id(), stored));
+
+    WriteQueue::setCommitWindow(window);
+}
+
+QTEST_MAIN(WriteQueueTest)
@@ -34,8 +34,14 @@
 #include "../src/callevent.h"
 #include "../src/group.h"
 #include "../src/databaseio.h"
+#include "../src/attachmentcollector.h"
+#include "../src/retentionengine.h"
+#include "../src/databasemigrator.h"
+#include "../src/queryprofiler.h"
+#include "../src/historybackup.h"
 
 #include "catcher.h"
+#include "jsonimporter.h"
 
 #include <QJsonDocument>
 
@@ -85,13 +91,6 @@ const char *mmsSubject[] = {
 
 const int numMmsSubjects = 10;
 
-#define TELEPATHY_ACCOUNT_PREFIX       QLatin1String("/org/freedesktop/Telepathy/Account/")
-#define TELEPATHY_MMS_ACCOUNT_POSTFIX  QLatin1String("mmscm/mms/mms0")
-#define TELEPATHY_RING_ACCOUNT_POSTFIX QLatin1String("ring/tel/account0")
-
-#define MMS_ACCOUNT  TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_MMS_ACCOUNT_POSTFIX
-#define RING_ACCOUNT TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_RING_ACCOUNT_POSTFIX
-
 QStringList optionsWithArguments;
 
 QVariantMap parseOptions(QStringList &arguments)
@@ -143,11 +142,19 @@ void printUsage()
     std::cout << "                 deletegroup group-id"                                                                                                   << std::endl;
     std::cout << "                 deleteall [-groups] [-calls] [-reset]"                                                                                  << std::endl;
     std::cout << "                 markallcallsread"                                                                                                       << std::endl;
+    std::cout << "                 collect-attachments"                                                                                                    << std::endl;
+    std::cout << "                 archive policy-file"                                                                                                    << std::endl;
+    std::cout << "                 migrate-utf8"                                                                                                           << std::endl;
+    std::cout << "                 slowqueries [-threshold msec] [-group group-id]"                                                                        << std::endl;
     std::cout << "                 export [-group group-id] [-calls] [-groups] filename"
                         << std::endl;
     std::cout << "                 import filename"
                         << std::endl;
-    std::cout << "                 import-json [-relativeDate yyMMdd] filename"
+    std::cout << "                 import-json [-relativeDate yyMMdd] [-batch events] [-resume offset] filename"
+                        << std::endl;
+    std::cout << "                 export-stream [-group group-id] [-calls] [-groups] [-compress] filename"
+                        << std::endl;
+    std::cout << "                 import-stream filename"
                         << std::endl;
     std::cout << "When adding new events, the default count is 1."                                                                                         << std::endl;
     std::cout << "When adding new events, the given local-ui is ignored, if -sms or -mms specified."                                                       << std::endl;
@@ -979,6 +986,123 @@ int doMarkAllCallsRead(const QStringList &arguments, const QVariantMap &options)
     return 0;
 }
 
+int doCollectAttachments(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+    Q_UNUSED(options);
+
+    AttachmentCollector collector;
+    if (!collector.collect()) {
+        qCritical() << "Error collecting attachments.";
+        return -1;
+    }
+
+    std::cout << "Removed " << collector.partsRemoved() << " message parts, "
+              << collector.filesRemoved() << " files and "
+              << collector.directoriesRemoved() << " directories, "
+              << collector.bytesReclaimed() << " bytes reclaimed" << std::endl;
+
+    return 0;
+}
+
+int doArchive(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(options);
+
+    RetentionEngine engine;
+    if (!engine.loadPolicies(arguments.at(2))) {
+        qCritical() << "Unable to read retention policies from" << arguments.at(2);
+        return -1;
+    }
+
+    if (!engine.run()) {
+        qCritical() << "Error archiving events.";
+        return -1;
+    }
+
+    std::cout << "Archived " << engine.eventsArchived() << " events" << std::endl;
+
+    return 0;
+}
+
+int doMigrateUtf8(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+    Q_UNUSED(options);
+
+    if (!DatabaseMigrator::isRequired()) {
+        std::cout << "Database is already stored in UTF-8" << std::endl;
+        return 0;
+    }
+
+    if (!DatabaseMigrator::isPending()) {
+        DatabaseMigrator migrator;
+        if (!migrator.run()) {
+            qCritical() << "Error copying the database.";
+            return -1;
+        }
+
+        std::cout << "Copied " << migrator.copiedRows() << " rows: " << migrator.originalSize()
+                  << " bytes before, " << migrator.migratedSize() << " bytes after" << std::endl;
+    }
+
+    if (!DatabaseMigrator::completeMigration()) {
+        std::cout << "The database is in use; it is replaced when it is next opened by the first client"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
+int doSlowQueries(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(arguments);
+
+    // Profiles the queries of the main views in this process
+    const int threshold = options.value("-threshold", 0).toInt();
+    QueryProfiler::setThreshold(threshold);
+    QueryProfiler::setCapacity(1000);
+    QueryProfiler::setEnabled(true);
+
+    GroupModel groupModel;
+    groupModel.setResolveContacts(GroupManager::DoNotResolve);
+    groupModel.setQueryMode(EventModel::SyncQuery);
+    if (!groupModel.getGroups()) {
+        qCritical() << "Error fetching groups";
+        return -1;
+    }
+
+    int groupId = options.value("-group", -1).toInt();
+    if (groupId < 0 && groupModel.rowCount() > 0)
+        groupId = groupModel.group(groupModel.index(0, 0)).id();
+
+    if (groupId >= 0) {
+        ConversationModel conversationModel;
+        conversationModel.setResolveContacts(EventModel::DoNotResolve);
+        conversationModel.setQueryMode(EventModel::SyncQuery);
+        if (!conversationModel.getEvents(groupId)) {
+            qCritical() << "Error fetching events of group" << groupId;
+            return -1;
+        }
+    }
+
+    CallModel callModel;
+    callModel.setResolveContacts(EventModel::DoNotResolve);
+    callModel.setQueryMode(EventModel::SyncQuery);
+    if (!callModel.getEvents()) {
+        qCritical() << "Error fetching calls";
+        return -1;
+    }
+
+    const QList<QueryProfiler::SlowQuery> queries = QueryProfiler::slowQueries();
+    foreach (const QueryProfiler::SlowQuery &query, queries)
+        std::cout << qPrintable(QueryProfiler::toString(query)) << std::endl;
+
+    std::cout << queries.size() << " queries took " << threshold << " ms or more" << std::endl;
+
+    return 0;
+}
+
 bool exportGroup(QDataStream &out, const Group &group)
 {
     ConversationModel model;
@@ -1158,168 +1282,123 @@ int doImport(const QStringList &arguments, const QVariantMap &options)
     return 0;
 }
 
-int doJsonImport(const QStringList &arguments, const QVariantMap &options)
+int doExportStream(const QStringList &arguments, const QVariantMap &options)
 {
-    Q_UNUSED(options);
-
     QString fileName = arguments.at(2);
     QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qCritical() << "Unable to open file" << fileName << " for reading:" << file.errorString();
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Unable to open file" << fileName << " for writing:" << file.errorString();
         return -1;
     }
 
-    int dateOffset = 0;
-    if (options.contains("-relativeDate")) {
-        QDateTime endTime = QDateTime::fromString(options.value("-relativeDate").toString(), "yyyyMMdd");
-        if (!endTime.isValid()) {
-            qCritical() << "Invalid end time";
+    int groupId = -1;
+    if (options.contains("-group")) {
+        bool ok = false;
+        groupId = options.value("-group").toInt(&ok);
+        if (!ok) {
+            qCritical() << "Invalid group id";
             return -1;
         }
-
-        dateOffset = endTime.secsTo(QDateTime(QDate::currentDate()));
     }
 
-    bool ok = true;
+    // Everything unless a part is asked for
+    int contents = 0;
+    if (options.contains("-group") || options.contains("-groups"))
+        contents |= HistoryBackup::Conversations;
+    if (options.contains("-calls"))
+        contents |= HistoryBackup::Calls;
+    if (!contents)
+        contents = HistoryBackup::AllContent;
 
-    QByteArray data = file.readAll();
-    QJsonParseError error;
-    QJsonDocument json = QJsonDocument::fromJson(data, &error);
-    if (json.isNull()) {
-        qCritical() << "Unable to import file" << fileName << ":" << error.errorString() << "at" << error.offset;
+    HistoryBackup backup;
+    backup.setCompressed(options.contains("-compress"));
+    if (!backup.exportTo(&file, contents, groupId)) {
+        qCritical() << "Error exporting to" << fileName;
         return -1;
     }
-    QVariantList result = json.array().toVariantList();
-
-    GroupModel groupModel;
-    groupModel.setResolveContacts(GroupManager::DoNotResolve);
-    groupModel.setQueryMode(EventModel::SyncQuery);
-    Catcher groupCatcher(&groupModel);
-    EventModel model;
-    Catcher eventCatcher(&model);
-    int groupCount = 0;
-
-    foreach (const QVariant &c, result) {
-        QVariantMap conversation = c.toMap();
-        Group group;
-        Event::EventType type;
-
-        groupCount++;
-
-        if (conversation["type"] == QLatin1String("sms")) {
-            type = Event::SMSEvent;
-            group.setLocalUid(RING_ACCOUNT);
-        } else if (conversation["type"] == QLatin1String("im")) {
-            type = Event::IMEvent;
-            QString from = conversation["from"].toString();
-            if (from.isEmpty()) {
-                qWarning() << "No 'from' field in IM conversation" << groupCount;
-                ok = false;
-                continue;
-            }
-
-            group.setLocalUid(TELEPATHY_ACCOUNT_PREFIX + from);
-        } else if (conversation["type"] == QLatin1String("call")) {
-            type = Event::CallEvent;
-            group.setLocalUid(RING_ACCOUNT);
-        } else {
-            qWarning() << "No valid type for conversation" << groupCount;
-            ok = false;
-            continue;
-        }
-
-        QString to = conversation.value("to").toString();
-        if (to.isEmpty()) {
-            qWarning() << "No 'to' field in conversation" << groupCount;
-            ok = false;
-            continue;
-        }
 
-        group.setRecipients(RecipientList::fromUids(group.localUid(), QStringList() << to));
-        group.setChatType(Group::ChatTypeP2P);
+    std::cout << "Exported " << backup.groupCount() << " conversations, "
+              << backup.eventCount() << " events" << std::endl;
 
-        // Calls don't actually belong to groups
-        if (type != Event::CallEvent) {
-            groupCatcher.reset();
-            if (!groupModel.addGroup(group)) {
-                qWarning() << "Error adding conversation" << groupCount << "( local" << group.localUid() << ", remote" << group.recipients().debugString() << ")";
-                ok = false;
-                continue;
-            }
-            groupCatcher.waitCommit(0);
-        }
+    return 0;
+}
 
-        // events (and "messages" for compatibility)
-        QVariantList eventData;
-        eventData << conversation.value("events").toList() << conversation.value("messages").toList();
-        QList<Event> events;
-        events.reserve(eventData.size());
+int doImportStream(const QStringList &arguments, const QVariantMap &options)
+{
+    Q_UNUSED(options);
 
-        int eventCount = 0;
-        foreach (const QVariant &e, eventData) {
-            QVariantMap data = e.toMap();
-            Event event;
-            event.setType(type);
-            if (group.id() >= 0)
-                event.setGroupId(group.id());
-            event.setLocalUid(group.localUid());
-            event.setRecipients(group.recipients());
+    QString fileName = arguments.at(2);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "Unable to open file" << fileName << " for reading:" << file.errorString();
+        return -1;
+    }
 
-            eventCount++;
+    HistoryBackup backup;
+    bool ok = backup.importFrom(&file);
 
-            if (data["direction"] == "in") {
-                event.setDirection(Event::Inbound);
-            } else if (data["direction"] == "out") {
-                event.setDirection(Event::Outbound);
-                event.setStatus(Event::DeliveredStatus);
-            } else {
-                qWarning() << "No valid direction for event" << eventCount << "in conversation" << groupCount;
-                ok = false;
-                continue;
-            }
+    std::cout << "Imported " << backup.groupCount() << " conversations, "
+              << backup.eventCount() << " events" << std::endl;
 
-            QDateTime date = QDateTime::fromString(data.value("date").toString(), Qt::ISODate);
-            if (!date.isValid()) {
-                qWarning() << "No valid date for event" << eventCount << "in conversation" << groupCount;
-                ok = false;
-                continue;
-            }
+    if (!ok) {
+        qCritical() << "Error importing" << fileName << ". Data may be incomplete.";
+        return -1;
+    }
 
-            QDateTime endDate = QDateTime::fromString(data.value("endDate").toString(), Qt::ISODate);
-            if (!endDate.isValid())
-                endDate = date;
+    return 0;
+}
 
-            date = date.addSecs(dateOffset);
-            endDate = endDate.addSecs(dateOffset);
-            event.setStartTime(date);
-            event.setEndTime(endDate);
+int doJsonImport(const QStringList &arguments, const QVariantMap &options)
+{
+    QString fileName = arguments.at(2);
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "Unable to open file" << fileName << " for reading:" << file.errorString();
+        return -1;
+    }
 
-            if (type == Event::CallEvent) {
-                if (data.value("missed").toBool())
-                    event.setIsMissedCall(true);
-            } else {
-                if (!data.value("unread").toBool())
-                    event.setIsRead(true);
+    int dateOffset = 0;
+    if (options.contains("-relativeDate")) {
+        QDateTime endTime = QDateTime::fromString(options.value("-relativeDate").toString(), "yyyyMMdd");
+        if (!endTime.isValid()) {
+            qCritical() << "Invalid end time";
+            return -1;
+        }
 
-                event.setFreeText(data.value("text").toString());
-            }
+        dateOffset = endTime.secsTo(QDateTime(QDate::currentDate()));
+    }
 
-            events.append(event);
+    int batchSize = 1000;
+    if (options.contains("-batch")) {
+        bool ok = false;
+        batchSize = options.value("-batch").toInt(&ok);
+        if (!ok || batchSize < 1) {
+            qCritical() << "Invalid batch size";
+            return -1;
         }
+    }
 
-        eventCatcher.reset();
-        if (!events.isEmpty() && !model.addEvents(events)) {
-            qWarning() << "Error adding messages for conversation" << groupCount;
-            ok = false;
-            continue;
+    qint64 resumeOffset = 0;
+    if (options.contains("-resume")) {
+        bool ok = false;
+        resumeOffset = options.value("-resume").toLongLong(&ok);
+        if (!ok || resumeOffset < 0) {
+            qCritical() << "Invalid resume offset";
+            return -1;
         }
-        eventCatcher.waitCommit(events.size());
+    }
+
+    JsonImporter importer(dateOffset, batchSize, resumeOffset);
+    bool finished = importer.run(&file);
+    importer.reportProgress(true);
 
-        qDebug() << "CONVERSATION " << group.id() << ":" << group.localUid() << group.recipients().debugString() << "-"
-                 << events.size() << "messages";
+    if (!finished) {
+        qCritical() << "Unable to import file" << fileName << ":" << importer.error;
+        std::cout << "Resume with -resume " << importer.offset << std::endl;
+        return -1;
     }
 
-    if (!ok) {
+    if (!importer.ok) {
         qWarning() << "Errors occurred while importing JSON file. Data may be incomplete.";
         return 1;
     }
@@ -1336,7 +1415,8 @@ int main(int argc, char **argv)
 #endif
         QCoreApplication app(argc, argv);
 
-        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text" << "-relativeDate";
+        optionsWithArguments << "-group" << "-startTime" << "-endTime" << "-n" << "-text" << "-relativeDate" << "-threshold"
+                            << "-batch" << "-resume";
 
         QStringList args = app.arguments();
         QVariantMap options = parseOptions(args);
@@ -1387,12 +1467,24 @@ int main(int argc, char **argv)
             return doDeleteAll(args, options);
         } else if (args.at(1) == "markallcallsread") {
             return doMarkAllCallsRead(args, options);
+        } else if (args.at(1) == "collect-attachments") {
+            return doCollectAttachments(args, options);
+        } else if (args.at(1) == "archive" && args.count() > 2) {
+            return doArchive(args, options);
+        } else if (args.at(1) == "migrate-utf8") {
+            return doMigrateUtf8(args, options);
+        } else if (args.at(1) == "slowqueries") {
+            return doSlowQueries(args, options);
         } else if (args.at(1) == "export" && args.count() > 2) {
             return doExport(args, options);
         } else if (args.at(1) == "import") {
             return doImport(args, options);
         } else if (args.at(1) == "import-json" && args.count() >= 3) {
             return doJsonImport(args, options);
+        } else if (args.at(1) == "export-stream" && args.count() > 2) {
+            return doExportStream(args, options);
+        } else if (args.at(1) == "import-stream" && args.count() > 2) {
+            return doImportStream(args, options);
         } else {
             printUsage();
         }
@@ -0,0 +1,285 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+#include "jsonimporter.h"
+
+#include <iostream>
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonObject>
+#include <QJsonValue>
+
+#include "../src/databaseio.h"
+#include "jsonstreamreader.h"
+
+using namespace CommHistory;
+
+JsonImporter::JsonImporter(int dateOffset, int batchSize, qint64 resumeOffset)
+    : ok(true), conversations(0), events(0), offset(resumeOffset),
+      m_dateOffset(dateOffset), m_batchSize(batchSize), m_resumeOffset(resumeOffset),
+      m_groupCatcher(&m_groupModel)
+{
+    m_groupModel.setResolveContacts(GroupManager::DoNotResolve);
+    m_groupModel.setQueryMode(EventModel::SyncQuery);
+}
+
+bool JsonImporter::run(QIODevice *device)
+{
+    m_timer.start();
+    m_reportTimer.start();
+
+    JsonStreamReader reader(device);
+    if (reader.beginArray()) {
+        while (reader.nextElement()) {
+            conversations++;
+            if (!readConversation(reader))
+                break;
+        }
+    }
+
+    if (reader.hasError())
+        error = reader.errorString();
+    return error.isEmpty();
+}
+
+void JsonImporter::reportProgress(bool force)
+{
+    if (!force && m_reportTimer.elapsed() < 1000)
+        return;
+    m_reportTimer.restart();
+
+    const qint64 msecs = qMax<qint64>(1, m_timer.elapsed());
+    std::cout << conversations << " conversations, " << events << " events in "
+              << msecs / 1000.0 << " s (" << qRound64(events * 1000.0 / msecs)
+              << " events/s), imported up to offset " << offset << std::endl;
+}
+
+bool JsonImporter::readConversation(JsonStreamReader &reader)
+{
+    m_resuming = reader.offset() < m_resumeOffset;
+    m_group = Group();
+    m_ready = false;
+    m_valid = false;
+
+    QVariantMap header;
+    QList<QJsonValue> pending;
+
+    if (!reader.beginObject())
+        return false;
+
+    QString name;
+    while (reader.nextMember(&name)) {
+        if (name == QLatin1String("events") || name == QLatin1String("messages")) {
+            if (!reader.beginArray())
+                return false;
+
+            while (reader.nextElement()) {
+                if (reader.offset() < m_resumeOffset) {
+                    if (!reader.skipValue())
+                        return false;
+                    continue;
+                }
+
+                QJsonValue value = reader.readValue();
+                if (reader.hasError())
+                    return false;
+
+                if (!m_ready) {
+                    pending.append(value);
+                } else if (!addEvent(value.toObject().toVariantMap(), reader.offset())) {
+                    return false;
+                }
+            }
+        } else {
+            QJsonValue value = reader.readValue();
+            if (reader.hasError())
+                return false;
+
+            header.insert(name, value.toVariant());
+            if (!m_ready && header.contains("type") && header.contains("to")
+                    && (header.value("type") != QLatin1String("im") || header.contains("from"))) {
+                m_ready = true;
+                m_valid = setupConversation(header);
+            }
+        }
+    }
+    if (reader.hasError())
+        return false;
+
+    if (!m_ready) {
+        m_ready = true;
+        m_valid = setupConversation(header);
+    }
+
+    // Added together, the offset is only reached at the end
+    foreach (const QJsonValue &value, pending)
+        addEvent(value.toObject().toVariantMap(), -1);
+
+    if (m_valid && !m_resuming && !ensureGroup())
+        m_valid = false;
+
+    if (!flush(reader.offset()))
+        return false;
+
+    if (m_valid && !m_resuming) {
+        qDebug() << "CONVERSATION " << m_group.id() << ":" << m_group.localUid()
+                 << m_group.recipients().debugString();
+    }
+
+    return true;
+}
+
+bool JsonImporter::setupConversation(const QVariantMap &conversation)
+{
+    if (conversation["type"] == QLatin1String("sms")) {
+        m_type = Event::SMSEvent;
+        m_group.setLocalUid(RING_ACCOUNT);
+    } else if (conversation["type"] == QLatin1String("im")) {
+        m_type = Event::IMEvent;
+        QString from = conversation["from"].toString();
+        if (from.isEmpty()) {
+            qWarning() << "No 'from' field in IM conversation" << conversations;
+            ok = false;
+            return false;
+        }
+
+        m_group.setLocalUid(TELEPATHY_ACCOUNT_PREFIX + from);
+    } else if (conversation["type"] == QLatin1String("call")) {
+        m_type = Event::CallEvent;
+        m_group.setLocalUid(RING_ACCOUNT);
+    } else {
+        qWarning() << "No valid type for conversation" << conversations;
+        ok = false;
+        return false;
+    }
+
+    QString to = conversation.value("to").toString();
+    if (to.isEmpty()) {
+        qWarning() << "No 'to' field in conversation" << conversations;
+        ok = false;
+        return false;
+    }
+
+    m_group.setRecipients(RecipientList::fromUids(m_group.localUid(), QStringList() << to));
+    m_group.setChatType(Group::ChatTypeP2P);
+    return true;
+}
+
+bool JsonImporter::ensureGroup()
+{
+    if (m_type == Event::CallEvent || m_group.id() != -1)
+        return true;
+
+    if (m_resuming) {
+        QList<Group> groups;
+        if (DatabaseIO::instance()->getGroups(m_group.localUid(), m_group.recipients().value(0).remoteUid(), groups)
+                && !groups.isEmpty()) {
+            m_group = groups.last();
+            return true;
+        }
+    }
+
+    m_groupCatcher.reset();
+    if (!m_groupModel.addGroup(m_group)) {
+        qWarning() << "Error adding conversation" << conversations << "( local" << m_group.localUid()
+                   << ", remote" << m_group.recipients().debugString() << ")";
+        ok = false;
+        return false;
+    }
+    m_groupCatcher.waitCommit(0);
+    return true;
+}
+
+bool JsonImporter::addEvent(const QVariantMap &data, qint64 eventOffset)
+{
+    if (!m_valid)
+        return true;
+
+    Event event;
+    event.setType(m_type);
+    event.setLocalUid(m_group.localUid());
+    event.setRecipients(m_group.recipients());
+
+    if (data["direction"] == "in") {
+        event.setDirection(Event::Inbound);
+    } else if (data["direction"] == "out") {
+        event.setDirection(Event::Outbound);
+        event.setStatus(Event::DeliveredStatus);
+    } else {
+        qWarning() << "No valid direction for an event in conversation" << conversations;
+        ok = false;
+        return true;
+    }
+
+    QDateTime date = QDateTime::fromString(data.value("date").toString(), Qt::ISODate);
+    if (!date.isValid()) {
+        qWarning() << "No valid date for an event in conversation" << conversations;
+        ok = false;
+        return true;
+    }
+
+    QDateTime endDate = QDateTime::fromString(data.value("endDate").toString(), Qt::ISODate);
+    if (!endDate.isValid())
+        endDate = date;
+
+    date = date.addSecs(m_dateOffset);
+    endDate = endDate.addSecs(m_dateOffset);
+    event.setStartTime(date);
+    event.setEndTime(endDate);
+
+    if (m_type == Event::CallEvent) {
+        if (data.value("missed").toBool())
+            event.setIsMissedCall(true);
+    } else {
+        if (!data.value("unread").toBool())
+            event.setIsRead(true);
+
+        event.setFreeText(data.value("text").toString());
+    }
+
+    m_batch.append(event);
+    if (eventOffset >= 0 && m_batch.size() >= m_batchSize)
+        return flush(eventOffset);
+    return true;
+}
+
+bool JsonImporter::flush(qint64 importedOffset)
+{
+    if (!m_batch.isEmpty() && m_valid) {
+        if (!ensureGroup()) {
+            m_valid = false;
+        } else {
+            for (int i = 0; i < m_batch.size(); i++)
+                m_batch[i].setGroupId(m_group.id());
+
+            if (!m_model.addEvents(m_batch)) {
+                error = QString::fromLatin1("Error adding events for conversation %1").arg(conversations);
+                return false;
+            }
+            events += m_batch.size();
+        }
+    }
+    m_batch.clear();
+
+    offset = importedOffset;
+    reportProgress(false);
+    return true;
+}
@@ -0,0 +1,103 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef JSONIMPORTER_H
+#define JSONIMPORTER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+
+#include "../src/event.h"
+#include "../src/eventmodel.h"
+#include "../src/group.h"
+#include "../src/groupmodel.h"
+
+#include "catcher.h"
+
+class QIODevice;
+class JsonStreamReader;
+
+#define TELEPATHY_ACCOUNT_PREFIX       QLatin1String("/org/freedesktop/Telepathy/Account/")
+#define TELEPATHY_MMS_ACCOUNT_POSTFIX  QLatin1String("mmscm/mms/mms0")
+#define TELEPATHY_RING_ACCOUNT_POSTFIX QLatin1String("ring/tel/account0")
+
+#define MMS_ACCOUNT  TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_MMS_ACCOUNT_POSTFIX
+#define RING_ACCOUNT TELEPATHY_ACCOUNT_PREFIX + TELEPATHY_RING_ACCOUNT_POSTFIX
+
+/*
+ * Imports an import-json file while reading it. Events are added in
+ * batches of batchSize, so only one batch and one event are held in
+ * memory. After each batch the file has been imported up to offset(),
+ * and a failed import can be resumed from there: the part before it is
+ * read without being added, and the conversation it falls in is found
+ * by its addresses instead of being added again.
+ *
+ * Events are only streamed once the type and the addresses of their
+ * conversation are known. Events that come before those in a
+ * conversation are kept until its end.
+ */
+class JsonImporter
+{
+public:
+    JsonImporter(int dateOffset, int batchSize, qint64 resumeOffset);
+
+    // Returns false if the import stopped before the end of the file
+    bool run(QIODevice *device);
+    void reportProgress(bool force);
+
+    bool ok;            // false if a conversation or an event was skipped
+    int conversations;
+    int events;
+    qint64 offset;
+    QString error;
+
+private:
+    bool readConversation(JsonStreamReader &reader);
+    bool setupConversation(const QVariantMap &conversation);
+    // Calls don't actually belong to groups
+    bool ensureGroup();
+    // A negative offset does not flush and keeps the import offset
+    bool addEvent(const QVariantMap &data, qint64 eventOffset);
+    // Adds the batch in one transaction. Returns false if that failed.
+    bool flush(qint64 importedOffset);
+
+    int m_dateOffset;
+    int m_batchSize;
+    qint64 m_resumeOffset;
+    CommHistory::GroupModel m_groupModel;
+    Catcher m_groupCatcher;
+    CommHistory::EventModel m_model;
+    QElapsedTimer m_timer;
+    QElapsedTimer m_reportTimer;
+
+    // Conversation being read
+    CommHistory::Event::EventType m_type;
+    CommHistory::Group m_group;
+    bool m_resuming;
+    bool m_ready;
+    bool m_valid;
+    QList<CommHistory::Event> m_batch;
+};
+
+#endif
@@ -0,0 +1,294 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#include "jsonstreamreader.h"
+
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+namespace {
+
+const int READ_SIZE = 64 * 1024;
+
+QJsonValue parseValue(const QByteArray &raw, QJsonParseError *error)
+{
+    // QJsonDocument only takes arrays and objects
+    QJsonDocument document = QJsonDocument::fromJson('[' + raw + ']', error);
+    if (document.isNull())
+        return QJsonValue(QJsonValue::Undefined);
+    return document.array().at(0);
+}
+
+}
+
+JsonStreamReader::JsonStreamReader(QIODevice *device)
+    : m_device(device),
+      m_pos(0),
+      m_bufferOffset(device->pos())
+{
+}
+
+qint64 JsonStreamReader::offset() const
+{
+    return m_bufferOffset + m_pos;
+}
+
+bool JsonStreamReader::hasError() const
+{
+    return !m_error.isEmpty();
+}
+
+QString JsonStreamReader::errorString() const
+{
+    return m_error;
+}
+
+bool JsonStreamReader::beginArray()
+{
+    if (!expect('['))
+        return false;
+    m_first.append(true);
+    return true;
+}
+
+bool JsonStreamReader::beginObject()
+{
+    if (!expect('{'))
+        return false;
+    m_first.append(true);
+    return true;
+}
+
+bool JsonStreamReader::nextElement()
+{
+    return nextInContainer(']');
+}
+
+bool JsonStreamReader::nextMember(QString *name)
+{
+    if (!nextInContainer('}'))
+        return false;
+
+    QByteArray raw;
+    if (peek() != '"' || !scanString(&raw)) {
+        setError(QStringLiteral("Expected a member name"));
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonValue value = parseValue(raw, &error);
+    if (value.isUndefined()) {
+        setError(error.errorString());
+        return false;
+    }
+    *name = value.toString();
+
+    return expect(':');
+}
+
+QJsonValue JsonStreamReader::readValue()
+{
+    QByteArray raw;
+    if (!scanValue(&raw))
+        return QJsonValue(QJsonValue::Undefined);
+
+    QJsonParseError error;
+    QJsonValue value = parseValue(raw, &error);
+    if (value.isUndefined())
+        setError(error.errorString());
+    return value;
+}
+
+bool JsonStreamReader::skipValue()
+{
+    return scanValue(0);
+}
+
+int JsonStreamReader::peek()
+{
+    if (m_pos >= m_buffer.size()) {
+        m_bufferOffset += m_buffer.size();
+        m_buffer = m_device->read(READ_SIZE);
+        m_pos = 0;
+        if (m_buffer.isEmpty())
+            return -1;
+    }
+    return static_cast<unsigned char>(m_buffer.at(m_pos));
+}
+
+int JsonStreamReader::get()
+{
+    int c = peek();
+    if (c != -1)
+        m_pos++;
+    return c;
+}
+
+void JsonStreamReader::skipWhitespace()
+{
+    // Byte order mark
+    if (offset() == 0 && peek() == 0xef) {
+        for (int i = 0; i < 3; i++)
+            get();
+    }
+
+    forever {
+        int c = peek();
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+        m_pos++;
+    }
+}
+
+bool JsonStreamReader::scanString(QByteArray *raw)
+{
+    // Opening quote
+    int c = get();
+    if (raw)
+        raw->append(char(c));
+
+    forever {
+        c = get();
+        if (c == -1) {
+            setError(QStringLiteral("Unterminated string"));
+            return false;
+        }
+        if (raw)
+            raw->append(char(c));
+
+        if (c == '\\') {
+            c = get();
+            if (c == -1) {
+                setError(QStringLiteral("Unterminated string"));
+                return false;
+            }
+            if (raw)
+                raw->append(char(c));
+        } else if (c == '"') {
+            return true;
+        }
+    }
+}
+
+bool JsonStreamReader::scanValue(QByteArray *raw)
+{
+    if (hasError())
+        return false;
+
+    skipWhitespace();
+    int c = peek();
+    if (c == -1) {
+        setError(QStringLiteral("Unexpected end of data"));
+        return false;
+    }
+
+    if (c == '"')
+        return scanString(raw);
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        do {
+            c = peek();
+            if (c == -1) {
+                setError(QStringLiteral("Unexpected end of data"));
+                return false;
+            }
+            if (c == '"') {
+                if (!scanString(raw))
+                    return false;
+                continue;
+            }
+
+            m_pos++;
+            if (raw)
+                raw->append(char(c));
+            if (c == '{' || c == '[')
+                depth++;
+            else if (c == '}' || c == ']')
+                depth--;
+        } while (depth > 0);
+        return true;
+    }
+
+    // Number, true, false or null
+    int length = 0;
+    while ((c = peek()) != -1 && c != ',' && c != ']' && c != '}'
+           && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        m_pos++;
+        if (raw)
+            raw->append(char(c));
+        length++;
+    }
+    if (!length) {
+        setError(QStringLiteral("Expected a value"));
+        return false;
+    }
+    return true;
+}
+
+bool JsonStreamReader::expect(char c)
+{
+    if (hasError())
+        return false;
+
+    // Errors point at the unexpected character
+    skipWhitespace();
+    if (peek() != c) {
+        setError(QStringLiteral("Expected '%1'").arg(QLatin1Char(c)));
+        return false;
+    }
+    m_pos++;
+    return true;
+}
+
+bool JsonStreamReader::nextInContainer(char close)
+{
+    if (hasError() || m_first.isEmpty())
+        return false;
+
+    skipWhitespace();
+    if (peek() == close) {
+        m_pos++;
+        m_first.removeLast();
+        return false;
+    }
+
+    if (m_first.last()) {
+        m_first.last() = false;
+        return true;
+    }
+
+    if (peek() != ',') {
+        setError(QStringLiteral("Expected ',' or '%1'").arg(QLatin1Char(close)));
+        return false;
+    }
+    m_pos++;
+    skipWhitespace();
+    return true;
+}
+
+void JsonStreamReader::setError(const QString &message)
+{
+    if (m_error.isEmpty())
+        m_error = QStringLiteral("%1 at offset %2").arg(message).arg(offset());
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+**
+** This file is part of libcommhistory.
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the GNU Lesser General Public License version 2.1 as
+** published by the Free Software Foundation.
+**
+** This library is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+** License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public License
+** along with this library; if not, write to the Free Software Foundation, Inc.,
+** 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+**
+******************************************************************************/
+
+
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QJsonValue>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+/*
+ * Reads a JSON document from a device a piece at a time. Containers are
+ * walked with beginArray()/nextElement() and beginObject()/nextMember(),
+ * and only the values asked for with readValue() are parsed in full, so
+ * memory use depends on the largest such value rather than on the file.
+ *
+ * offset() is the position in the device of the next unread byte, which
+ * can be used to tell where an element starts or ends.
+ */
+class JsonStreamReader
+{
+public:
+    explicit JsonStreamReader(QIODevice *device);
+
+    qint64 offset() const;
+
+    bool hasError() const;
+    QString errorString() const;
+
+    // Enter the array or object that is the next value
+    bool beginArray();
+    bool beginObject();
+
+    // Move to the next element of the innermost array. Returns false
+    // after its closing bracket, or on an error.
+    bool nextElement();
+
+    // Move to the next member of the innermost object and read its name.
+    // Returns false after its closing brace, or on an error.
+    bool nextMember(QString *name);
+
+    // Read or skip the next value, including any nested containers
+    QJsonValue readValue();
+    bool skipValue();
+
+private:
+    int peek();
+    int get();
+    void skipWhitespace();
+    bool scanValue(QByteArray *raw);
+    bool scanString(QByteArray *raw);
+    bool expect(char c);
+    bool nextInContainer(char close);
+    void setError(const QString &message);
+
+    QIODevice *m_device;
+    QByteArray m_buffer;
+    int m_pos;
+    qint64 m_bufferOffset;
+    // For each open container, whether no element has been read yet
+    QVector<bool> m_first;
+    QString m_error;
+};
+
+#endif
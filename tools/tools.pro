@@ -35,8 +35,12 @@ PKGCONFIG += qtcontacts-sqlite-qt5-extensions contactcache-qt5
 LIBS += -L../src ../src/libcommhistory-qt5.so
 
 INCLUDEPATH += ../src 
-HEADERS += catcher.h
-SOURCES += commhistory-tool.cpp
+HEADERS += catcher.h \
+    jsonimporter.h \
+    jsonstreamreader.h
+SOURCES += commhistory-tool.cpp \
+    jsonimporter.cpp \
+    jsonstreamreader.cpp
 
 include( ../common-installs-config.pri )
 